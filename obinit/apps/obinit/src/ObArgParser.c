@@ -15,6 +15,7 @@
 #define APP_NAME "obinit"
 #define OB_DEFAULT_ROOT_PREFIX ""
 #define OB_DEFAULT_CONFIG_FILE "/root/etc/overboot.yaml"
+#define OB_DEFAULT_PREFETCH_TIME 60
 
 static void printVersion()
 {
@@ -25,6 +26,10 @@ static void printVersion()
 static void printUsage()
 {
   printf("Usage: %s [-h][-v][-r root_path][-c config_file]\n", APP_NAME);
+  printf("       %s -s source_dir -d destination_dir [-H][-x keep|delete|whiteout]\n", APP_NAME);
+  printf("       %s -m layer_dir\n", APP_NAME);
+  printf("       %s -p layer_dir [-f erofs|squashfs]\n", APP_NAME);
+  printf("       %s -R prefetch_list [-t seconds]\n", APP_NAME);
 }
 
 ObCliOptions obParseArgs(int argc, char* argv[])
@@ -33,11 +38,20 @@ ObCliOptions obParseArgs(int argc, char* argv[])
   options.exitProgram = false;
   options.exitStatus = EXIT_SUCCESS;
   strcpy(options.rootPrefix, OB_DEFAULT_ROOT_PREFIX);
+  strcpy(options.syncSource, "");
+  strcpy(options.syncDestination, "");
+  strcpy(options.syncExtraMode, "keep");
+  options.syncCompareHash = false;
+  strcpy(options.manifestLayer, "");
+  strcpy(options.packLayer, "");
+  strcpy(options.packFormat, "erofs");
+  strcpy(options.prefetchList, "");
+  options.prefetchTime = OB_DEFAULT_PREFETCH_TIME;
 
   char c = -1;
   bool isConfigSet = false;
   while (optind < argc) {
-    if ((c = getopt(argc, argv, "vhr:c:")) != -1) {
+    if ((c = getopt(argc, argv, "vhr:c:s:d:x:Hm:p:f:R:t:")) != -1) {
       switch (c) {
       case 'v': {
         printVersion();
@@ -58,6 +72,33 @@ ObCliOptions obParseArgs(int argc, char* argv[])
       case 'r':
         strncpy(options.rootPrefix, optarg, OB_CLI_PATH_MAX);
         break;
+      case 's':
+        strncpy(options.syncSource, optarg, OB_CLI_PATH_MAX - 1);
+        break;
+      case 'd':
+        strncpy(options.syncDestination, optarg, OB_CLI_PATH_MAX - 1);
+        break;
+      case 'x':
+        strncpy(options.syncExtraMode, optarg, OB_CLI_PATH_MAX - 1);
+        break;
+      case 'H':
+        options.syncCompareHash = true;
+        break;
+      case 'm':
+        strncpy(options.manifestLayer, optarg, OB_CLI_PATH_MAX - 1);
+        break;
+      case 'p':
+        strncpy(options.packLayer, optarg, OB_CLI_PATH_MAX - 1);
+        break;
+      case 'f':
+        strncpy(options.packFormat, optarg, OB_CLI_PATH_MAX - 1);
+        break;
+      case 'R':
+        strncpy(options.prefetchList, optarg, OB_CLI_PATH_MAX - 1);
+        break;
+      case 't':
+        options.prefetchTime = atoi(optarg);
+        break;
       default:
         break;
       }
@@ -70,6 +111,13 @@ ObCliOptions obParseArgs(int argc, char* argv[])
     }
   }
 
+  if ((strlen(options.syncSource) == 0) != (strlen(options.syncDestination) == 0)) {
+    obLogE("Both source (-s) and destination (-d) directories are required");
+    printUsage();
+    options.exitStatus = EXIT_FAILURE;
+    options.exitProgram = true;
+  }
+
   if (!isConfigSet) {
     strcpy(options.configFile, options.rootPrefix);
     strcat(options.configFile, OB_DEFAULT_CONFIG_FILE);
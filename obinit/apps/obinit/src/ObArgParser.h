@@ -13,6 +13,15 @@ typedef struct ObCliOptions
 {
   char rootPrefix[OB_CLI_PATH_MAX];
   char configFile[OB_CLI_PATH_MAX];
+  char syncSource[OB_CLI_PATH_MAX];
+  char syncDestination[OB_CLI_PATH_MAX];
+  char syncExtraMode[OB_CLI_PATH_MAX];
+  bool syncCompareHash;
+  char manifestLayer[OB_CLI_PATH_MAX];
+  char packLayer[OB_CLI_PATH_MAX];
+  char packFormat[OB_CLI_PATH_MAX];
+  char prefetchList[OB_CLI_PATH_MAX];
+  int prefetchTime;
   int exitStatus;
   bool exitProgram;
 } ObCliOptions;
@@ -6,8 +6,16 @@
 #include "ob/ObInitTasks.h"
 #include "ob/ObLogging.h"
 #include "ob/ObYamlConfigReader.h"
+#include "ob/ObSync.h"
+#include "ob/ObLayerManifest.h"
+#include "ob/ObLayerImage.h"
+#include "ob/ObPrefetch.h"
+#include "ob/ObTrace.h"
+#include "ob/ObDefs.h"
 
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #ifdef OB_LOG_STDOUT
 # define OB_LOG_USE_STD true
@@ -30,12 +38,81 @@ static void loadContext(ObContext** context, const ObCliOptions* options)
     obFreeObContext(context);
   }
   *context = obCreateObContext(options->rootPrefix);
-  obLoadYamlConfig(&(*context)->config, options->configFile);
+
+  char cachePath[OB_CPATH_MAX];
+  snprintf(cachePath, OB_CPATH_MAX, "%s%s", options->configFile, OB_CONFIG_CACHE_EXT);
+  obLoadCachedYamlConfig(&(*context)->config, options->configFile, cachePath);
+  obSetLogLevel((*context)->config.logLevel);
   obLogObContext(*context);
 }
 
+/**
+ * The overlay dir is bound to /overboot in the new root
+ */
+static void writeBootTrace(const ObContext* context, uint64_t traceStart)
+{
+  obTraceSpan("obinit", NULL, traceStart);
+
+  char tracePath[OB_CPATH_MAX];
+  snprintf(tracePath, OB_CPATH_MAX, "%s/%s", context->overbootDir, OB_BOOT_TRACE_NAME);
+  obWriteTrace(tracePath);
+}
+
+static int runSync(const ObCliOptions* options)
+{
+  ObSyncOptions syncOptions;
+  obInitSyncOptions(&syncOptions);
+  syncOptions.incremental = true;
+  syncOptions.compareHash = options->syncCompareHash;
+
+  if (strcmp(options->syncExtraMode, "delete") == 0) {
+    syncOptions.extraMode = OB_SYNC_DELETE_EXTRA;
+  }
+  else if (strcmp(options->syncExtraMode, "whiteout") == 0) {
+    syncOptions.extraMode = OB_SYNC_WHITEOUT_EXTRA;
+  }
+  else if (strcmp(options->syncExtraMode, "keep") != 0) {
+    obLogE("Unknown extra entries mode: %s", options->syncExtraMode);
+    return EXIT_FAILURE;
+  }
+
+  return obSyncTree(options->syncSource, options->syncDestination, &syncOptions)
+      ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int runWriteManifest(const ObCliOptions* options)
+{
+  char rootPath[OB_PATH_MAX];
+  char manifestPath[OB_PATH_MAX];
+  snprintf(rootPath, OB_PATH_MAX, "%s%s", options->manifestLayer, OB_LAYER_ROOT_DIR);
+  snprintf(manifestPath, OB_PATH_MAX, "%s%s", options->manifestLayer, OB_LAYER_MANIFEST_PATH);
+
+  return obWriteLayerManifest(rootPath, manifestPath) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int runPackLayer(const ObCliOptions* options)
+{
+  ObLayerFormat format = obParseLayerFormat(options->packFormat);
+  if (format == OB_LAYER_FORMAT_DIR) {
+    obLogE("Unsupported image format: %s", options->packFormat);
+    return EXIT_FAILURE;
+  }
+
+  return obPackLayerImage(options->packLayer, format) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+static int runRecordPrefetch(const ObCliOptions* options)
+{
+  char rootPath[OB_PATH_MAX];
+  snprintf(rootPath, OB_PATH_MAX, "%s/", options->rootPrefix);
+
+  return obRecordPrefetchList(rootPath, options->prefetchList, options->prefetchTime)
+      ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 int main(int argc, char* argv[])
 {
+  uint64_t traceStart = obGetMonotonicNs();
   obInitLogger(OB_LOG_USE_STD, OB_LOG_USE_KMSG);
 
   ObCliOptions options = obParseArgs(argc, argv);
@@ -43,6 +120,22 @@ int main(int argc, char* argv[])
     exit(options.exitStatus);
   }
 
+  if (strlen(options.syncSource) > 0) {
+    exit(runSync(&options));
+  }
+
+  if (strlen(options.manifestLayer) > 0) {
+    exit(runWriteManifest(&options));
+  }
+
+  if (strlen(options.packLayer) > 0) {
+    exit(runPackLayer(&options));
+  }
+
+  if (strlen(options.prefetchList) > 0) {
+    exit(runRecordPrefetch(&options));
+  }
+
   ObContext* context = NULL;
   int exitCode = EXIT_SUCCESS;
   size_t maxReloads = OB_MAX_CONFIG_RELOADS;
@@ -66,6 +159,10 @@ int main(int argc, char* argv[])
     exitCode = EXIT_SUCCESS;
   }
 
+  if (exitCode == EXIT_SUCCESS && context->config.enabled) {
+    writeBootTrace(context, traceStart);
+  }
+
   obFreeObContext(&context);
 
   obLogI("Overboot initialization sequence finished with exit code %i", exitCode);
@@ -6,12 +6,23 @@
 #define OBCONFIG_H
 
 #include "ob/ObDefs.h"
+#include "ob/ObLogging.h"
 
 #include <stdbool.h>
 
+typedef enum ObLayerVerifyLevel
+{
+  OB_LAYER_VERIFY_NONE = 0,
+  OB_LAYER_VERIFY_METADATA, // type, mode, owner, size and mtime
+  OB_LAYER_VERIFY_SAMPLED,  // metadata and content of some of the files
+  OB_LAYER_VERIFY_FULL      // metadata and content of all files
+} ObLayerVerifyLevel;
+
+struct ObArena;
+
 typedef struct ObDurable
 {
-  char path[OB_PATH_MAX];
+  const char* path;
   bool copyOrigin;
   bool forceFileType;
   struct ObDurable* next;
@@ -19,32 +30,49 @@ typedef struct ObDurable
 
 typedef struct ObConfig
 {
-  char prefix[OB_PREFIX_MAX];
-  char devicePath[OB_PATH_MAX];
+  // interned in the arena
+  const char* prefix;
+  const char* devicePath;
 
-  char headLayer[OB_NAME_MAX];
-  char repository[OB_PATH_MAX];
-  char configDir[OB_PATH_MAX];
-  char tmpfsSize[16];
+  const char* headLayer;
+  const char* repository;
+  const char* configDir;
+  const char* tmpfsSize;
+  const char* zramCompressor;
   const char* configPath;
 
   bool enabled;
   bool bindLayers;
   bool useTmpfs;
   bool clearUpper;
+  bool writeBack; // (useTmpfs) flush the upper to the persistent one
+  bool useZram; // (useTmpfs) compressed zram disk instead of the tmpfs
   bool rollback;
   bool upperAsLower;
   bool safeMode;
+  bool prefetch; // read ahead the files recorded for the head layer
+  bool flattenLayers; // mount the head chain as a single hardlinked directory
+  ObLogLevel logLevel;
+  ObLayerVerifyLevel verifyLayers;
+  int maxLayerDepth; // squash the bottom layers above it, 0 for no limit
+  int deviceTimeout; // seconds to wait for the device to show up, 0 for no waiting
+  int flushInterval; // (writeBack) seconds between the flushes
+  unsigned long long flushRate; // (writeBack) bytes per second, 0 for no limit
+  int prefetchRecordTime; // (prefetch) seconds of recording after the boot
   ObDurable* durable;
 
+  struct ObArena* arena; // owned by the context, holds the strings and durables
 } ObConfig;
 
 
+/**
+ * @brief Intern str in the config arena
+ */
+const char* obInternConfigString(ObConfig* config, const char* str);
+
 void obAddDurable(ObConfig* config, const char* path);
 
 int obCountDurables(const ObConfig* config);
 
-void obFreeDurable(ObDurable* durable);
-
 
 #endif // OBCONFIG_H
@@ -19,22 +19,54 @@ typedef enum ObDeviceType
   OB_DEV_DIR  // embedded directory
 } ObDeviceType;
 
+/**
+ * Paths derived from the config, see obResolveContextPaths
+ */
+typedef struct ObContextPaths
+{
+  const char* repo;
+  const char* layers;
+  const char* layerIndex;
+  const char* jobs;
+  const char* durables;
+  const char* trash;
+  const char* flushStaging;
+  const char* flushedUpper;
+  const char* prefetch;
+  const char* prefetchList; // of the head layer
+  const char* lock;
+  const char* lowerRoot;
+  const char* persistentUpper;
+  const char* upper;
+  const char* overlayWork;
+  const char* bindedOverlay;
+  const char* bindedUpper;
+} ObContextPaths;
+
 typedef struct ObContext
 {
   struct ObConfig config;
 
-  char* foundDevicePath;
-  char* devMountPoint;
-  char* overbootDir;
-  char* root;
+  const char* foundDevicePath;
+  const char* devMountPoint;
+  const char* overbootDir;
+  const char* zramDevice; // set by obInitOverbootDir for the zram upper
+  const char* root;
   ObDeviceType deviceType;
 
   bool reloadConfig;
+
+  ObContextPaths paths;
+  const char** layers; // bottom first, set by obInitOverlayfs
+  int layerCount;
+  struct ObDurablePlan* durablePlan; // set by obInitDurables
+  struct ObArena* arena; // boot lifetime memory of the context
 } ObContext;
 
 
 /**
- * @brief Create *initialized* OB context
+ * @brief Create *initialized* OB context. The context itself lives
+ * in its arena.
  * @param prefix path to prepend, usually empty
  * @return Initialized OB context
  */
@@ -48,11 +80,17 @@ ObContext* obCreateObContext(const char* prefix);
 void obInitializeObContext(ObContext* context, const char* prefix);
 
 /**
- * @brief Free OB context
+ * @brief Free OB context with all of its arena memory
  * @param context OB context
  */
 void obFreeObContext(ObContext** context);
 
+/**
+ * @brief Compute the paths derived from the loaded config once
+ * (repository, layers, jobs, lock file, overlay directories)
+ */
+void obResolveContextPaths(ObContext* context);
+
 /**
  * @brief Setup context's device path to match existing node
  * @param context OB context
@@ -49,6 +49,55 @@
 #define OB_LAYER_INFO_PATH "/etc/layer.yaml"
 #endif
 
+#ifndef OB_LAYER_MANIFEST_PATH
+#define OB_LAYER_MANIFEST_PATH "/manifest"
+#endif
+
+#ifndef OB_LAYER_FLAT_DIR
+#define OB_LAYER_FLAT_DIR "/flat"
+#endif
+
+#ifndef OB_LAYER_FLAT_INDEX_PATH
+#define OB_LAYER_FLAT_INDEX_PATH "/flat.idx"
+#endif
+
+#ifndef OB_LAYER_VERIFY_SAMPLE_PERCENT
+#define OB_LAYER_VERIFY_SAMPLE_PERCENT 10
+#endif
+
+#ifndef OB_LAYER_EROFS_IMAGE
+#define OB_LAYER_EROFS_IMAGE "/root.erofs"
+#endif
+
+#ifndef OB_LAYER_SQUASHFS_IMAGE
+#define OB_LAYER_SQUASHFS_IMAGE "/root.squashfs"
+#endif
+
+// layer info of an image layer, kept next to the image
+#ifndef OB_LAYER_IMAGE_INFO_PATH
+#define OB_LAYER_IMAGE_INFO_PATH "/layer.yaml"
+#endif
+
+#ifndef OB_MKFS_EROFS_COMMAND
+#define OB_MKFS_EROFS_COMMAND "mkfs.erofs"
+#endif
+
+#ifndef OB_MKFS_EROFS_COMPRESSION
+#define OB_MKFS_EROFS_COMPRESSION "-zlz4hc"
+#endif
+
+#ifndef OB_MKSQUASHFS_COMMAND
+#define OB_MKSQUASHFS_COMMAND "mksquashfs"
+#endif
+
+#ifndef OB_MKSQUASHFS_COMPRESSION
+#define OB_MKSQUASHFS_COMPRESSION "zstd"
+#endif
+
+#ifndef OB_MKFS_EXT4_COMMAND
+#define OB_MKFS_EXT4_COMMAND "mkfs.ext4"
+#endif
+
 #ifndef OB_DEV_MOUNT_POINT
 #define OB_DEV_MOUNT_POINT "/obmnt"
 #endif
@@ -74,6 +123,42 @@
 #define OB_DURABLES_DIR_NAME "durables"
 #endif
 
+#ifndef OB_TRASH_DIR_NAME
+#define OB_TRASH_DIR_NAME "trash"
+#endif
+
+#ifndef OB_FLUSH_DIR_NAME
+#define OB_FLUSH_DIR_NAME "flush"
+#endif
+
+#ifndef OB_FLUSHED_DIR_NAME
+#define OB_FLUSHED_DIR_NAME "flushed"
+#endif
+
+#ifndef OB_FLUSH_PID_PATH
+#define OB_FLUSH_PID_PATH "/run/obinit-flush.pid"
+#endif
+
+#ifndef OB_PREFETCH_DIR_NAME
+#define OB_PREFETCH_DIR_NAME "prefetch"
+#endif
+
+#ifndef OB_PREFETCH_LIST_EXT
+#define OB_PREFETCH_LIST_EXT ".list"
+#endif
+
+#ifndef OB_PREFETCH_MAX_FILES
+#define OB_PREFETCH_MAX_FILES 8192
+#endif
+
+#ifndef OB_PREFETCH_THREADS
+#define OB_PREFETCH_THREADS 4
+#endif
+
+#ifndef OB_LAYER_INDEX_NAME
+#define OB_LAYER_INDEX_NAME "layers.idx"
+#endif
+
 #ifndef OB_LAYER_DIR_EXT
 #define OB_LAYER_DIR_EXT "obld"
 #endif
@@ -110,6 +195,62 @@
 #define OB_DEV_MOUNT_OPTIONS ""
 #endif
 
+#ifndef OB_ARENA_BLOCK_SIZE
+#define OB_ARENA_BLOCK_SIZE (16 * 1024)
+#endif
+
+#ifndef OB_LOG_BUFFER_SIZE
+#define OB_LOG_BUFFER_SIZE (64 * 1024)
+#endif
+
+#ifndef OB_TRACE_MAX_SPANS
+#define OB_TRACE_MAX_SPANS 4096
+#endif
+
+#ifndef OB_BOOT_TRACE_NAME
+#define OB_BOOT_TRACE_NAME "boot-trace.json"
+#endif
+
+#ifndef OB_CONFIG_CACHE_EXT
+#define OB_CONFIG_CACHE_EXT ".cache"
+#endif
+
+#ifndef OB_INIT_TASK_THREADS
+#define OB_INIT_TASK_THREADS 4
+#endif
+
+#ifndef OB_FSTAB_PATH
+#define OB_FSTAB_PATH "/etc/fstab"
+#endif
+
+#ifndef OB_DEVICE_POLL_INTERVAL_MS
+#define OB_DEVICE_POLL_INTERVAL_MS 100
+#endif
+
+#ifndef OB_LOOP_DIRECT_IO
+#define OB_LOOP_DIRECT_IO 1
+#endif
+
+#ifndef OB_LOOP_BUSY_RETRIES
+#define OB_LOOP_BUSY_RETRIES 3
+#endif
+
+#ifndef OB_ZRAM_CONTROL_DIR
+#define OB_ZRAM_CONTROL_DIR "/sys/class/zram-control"
+#endif
+
+#ifndef OB_ZRAM_DEVICE_TIMEOUT_MS
+#define OB_ZRAM_DEVICE_TIMEOUT_MS 2000
+#endif
+
+#ifndef OB_ZRAM_FS
+#define OB_ZRAM_FS "ext4"
+#endif
+
+#ifndef OB_ZRAM_MOUNT_OPTIONS
+#define OB_ZRAM_MOUNT_OPTIONS "discard"
+#endif
+
 #ifndef OB_TMPFS_BLOCK_OPTIONS
 #define OB_TMPFS_BLOCK_OPTIONS "size=256,mode=0600"
 #endif
@@ -7,6 +7,55 @@
 
 #include <inttypes.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#define OB_HASH_STR_MAX 48
+
+typedef enum ObHashType
+{
+  OB_HASH_XXH64 = 0, // legacy, lock files without a prefix
+  OB_HASH_XXH3_64,
+  OB_HASH_XXH3_128
+} ObHashType;
+
+typedef struct ObHash
+{
+  ObHashType type;
+  uint64_t low;  // the whole digest of 64-bit types
+  uint64_t high;
+} ObHash;
+
+/**
+ * @brief Hash the file with the given algorithm. Files on read-only
+ * filesystems are mapped into memory, others are read in large aligned
+ * chunks (or through io_uring when available), so that a file truncated
+ * meanwhile cannot fault.
+ * @return false if the file cannot be read
+ */
+bool obHashFile(const char* path, ObHashType type, ObHash* hash);
+
+bool obHashFd(int fd, ObHashType type, ObHash* hash);
+
+void obHashData(const void* data, size_t size, ObHashType type, ObHash* hash);
+
+bool obHashEqual(const ObHash* first, const ObHash* second);
+
+/**
+ * @brief Format the digest as "<type>:<hex>", e.g. "xxh128:0123...".
+ * XXH64 digests are written as plain hex as they used to be.
+ * @param buffer at least OB_HASH_STR_MAX bytes long
+ */
+const char* obHashToStr(const ObHash* hash, char* buffer);
+
+/**
+ * @brief Parse a string made by obHashToStr. Plain hex without a type
+ * prefix is read as XXH64.
+ */
+bool obHashFromStr(const char* str, ObHash* hash);
+
+bool obWriteHash(const ObHash* hash, const char* outputPath);
+
+bool obReadHash(const char* txtFilePath, ObHash* hash);
 
 uint64_t obCalcualateFileHash(const char* path);
 
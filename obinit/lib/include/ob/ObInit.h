@@ -19,8 +19,16 @@ bool obInitManagementBindings(ObContext* context);
 
 bool obInitFstab(ObContext* context);
 
+/**
+ * @brief Plan and set up all the durables, see obExecDurablePlan
+ */
 bool obInitDurables(ObContext* context);
 
+/**
+ * @brief Read ahead the files recorded for the head layer, see obPrefetchFiles
+ */
+bool obInitPrefetch(ObContext* context);
+
 bool obInitLock(ObContext* context);
 
 bool obUnsetLock(ObContext* context);
@@ -0,0 +1,56 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBLAYERIMAGE_H
+#define OBLAYERIMAGE_H
+
+#include <stdbool.h>
+
+typedef enum ObLayerFormat
+{
+  OB_LAYER_FORMAT_UNSET = -1, // (job files) keep the format of the source layer
+  OB_LAYER_FORMAT_DIR = 0,    // <layer>.obld/root directory
+  OB_LAYER_FORMAT_EROFS,      // <layer>.obld/root.erofs image
+  OB_LAYER_FORMAT_SQUASHFS    // <layer>.obld/root.squashfs image
+} ObLayerFormat;
+
+/**
+ * @brief Parse "dir", "erofs" or "squashfs" (directory if unknown)
+ */
+ObLayerFormat obParseLayerFormat(const char* value);
+
+/**
+ * @brief Detect the format of the layer stored in layerDir (the .obld
+ * directory). An image takes precedence over the root directory, which
+ * is only its mount point then.
+ */
+ObLayerFormat obDetectLayerFormat(const char* layerDir);
+
+/**
+ * @return image file name relative to the layer directory
+ * or an empty string for the directory format
+ */
+const char* obGetLayerImageName(ObLayerFormat format);
+
+/**
+ * @brief Convert a directory layer into a compressed image with mkfs.erofs
+ * or mksquashfs. The layer info is copied next to the image, the manifest
+ * is rewritten from the mounted image and the root directory is removed.
+ */
+bool obPackLayerImage(const char* layerDir, ObLayerFormat format);
+
+/**
+ * @brief Loop-mount the layer image read-only on the layer root directory
+ * (no-op for directory layers)
+ */
+bool obMountLayerImage(const char* layerDir, ObLayerFormat format);
+
+bool obUnmountLayerImage(const char* layerDir);
+
+/**
+ * @brief Unmount the images of all layers found in layersDir
+ */
+void obUnmountLayerImages(const char* layersDir);
+
+#endif // OBLAYERIMAGE_H
@@ -0,0 +1,31 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBLAYERMANIFEST_H
+#define OBLAYERMANIFEST_H
+
+#include "ob/ObConfig.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Write the list of all entries under the layer root with their
+ * metadata and XXH3-128 digests of regular files and symlink targets.
+ * Files are hashed in parallel, the manifest is replaced atomically.
+ */
+bool obWriteLayerManifest(const char* layerRootPath, const char* manifestPath);
+
+/**
+ * @brief Check the layer root against its manifest. The metadata level
+ * compares type, mode, owner, size and mtime of every listed entry, the
+ * sampled level additionally hashes OB_LAYER_VERIFY_SAMPLE_PERCENT of the
+ * files (a different subset on each call) and the full level hashes all
+ * of them.
+ * @return false if any listed entry does not match or the manifest
+ * cannot be read
+ */
+bool obVerifyLayerManifest(const char* layerRootPath, const char* manifestPath,
+                           ObLayerVerifyLevel level);
+
+#endif // OBLAYERMANIFEST_H
@@ -7,12 +7,47 @@
 
 #include <stdbool.h>
 
+typedef enum ObLogLevel
+{
+  OB_LOG_LEVEL_ERROR = 0,
+  OB_LOG_LEVEL_WARNING,
+  OB_LOG_LEVEL_INFO
+} ObLogLevel;
+
+// lower levels are compiled out, e.g. -DOB_LOG_COMPILED_LEVEL=1 for no INFO logs
+#ifndef OB_LOG_COMPILED_LEVEL
+#define OB_LOG_COMPILED_LEVEL OB_LOG_LEVEL_INFO
+#endif
+
 void obInitLogger(bool stdOut, bool kmsgOut);
 
+/**
+ * @brief Skip the messages above the given level at runtime
+ */
+void obSetLogLevel(ObLogLevel level);
+
+/**
+ * @brief Parse "error", "warning" or "info" (info if unknown)
+ */
+ObLogLevel obParseLogLevel(const char* value);
+
+/**
+ * @brief Write the buffered messages out. Called on errors, at exit and
+ * before blocking waits, messages are written in batches otherwise.
+ */
+void obFlushLog();
+
 void obLogI(const char* msg, ...);
 void obLogW(const char* msg, ...);
 void obLogE(const char* msg, ...);
 
+#if OB_LOG_COMPILED_LEVEL < OB_LOG_LEVEL_INFO
+# define obLogI(...) do { if (0) { obLogI(__VA_ARGS__); } } while (0)
+#endif
+#if OB_LOG_COMPILED_LEVEL < OB_LOG_LEVEL_WARNING
+# define obLogW(...) do { if (0) { obLogW(__VA_ARGS__); } } while (0)
+#endif
+
 bool obErrorOccurred();
 void clearErrorOccurrence();
 
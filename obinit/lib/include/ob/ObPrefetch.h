@@ -0,0 +1,40 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBPREFETCH_H
+#define OBPREFETCH_H
+
+#include "ob/ObContext.h"
+#include <stdbool.h>
+
+/**
+ * @brief Record the regular files opened on the mount of mountPath
+ * (fanotify) for the given time and write their paths, relative to the
+ * mount, to listPath in the order of the first open
+ */
+bool obRecordPrefetchList(const char* mountPath, const char* listPath, int seconds);
+
+/**
+ * @brief Resolve every path from the list to the topmost layer that has it
+ * (the way overlayfs does) and read the files ahead in parallel. Missing
+ * and whited-out files and the files under opaque directories of higher
+ * layers are skipped.
+ * @param layers layer roots, top first
+ * @return number of the files read ahead or -1 if the list cannot be read
+ */
+int obPrefetchFiles(const char* listPath, const char* const* layers, int layerCount);
+
+/**
+ * @brief Remove the lists recorded for the other head layers
+ */
+bool obRemoveStalePrefetchLists(const char* prefetchDir, const char* listPath);
+
+/**
+ * @brief Start recording the prefetch list of the head layer in a detached
+ * process that outlives obinit. The mount is watched before returning,
+ * so that the opens after switching the root are recorded.
+ */
+bool obStartPrefetchRecorder(const ObContext* context);
+
+#endif // OBPREFETCH_H
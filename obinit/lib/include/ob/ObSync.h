@@ -0,0 +1,55 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBSYNC_H
+#define OBSYNC_H
+
+#include <stdbool.h>
+
+typedef enum ObSyncExtraMode
+{
+  OB_SYNC_KEEP_EXTRA = 0, // leave entries missing in the source
+  OB_SYNC_DELETE_EXTRA,   // remove them from the destination
+  OB_SYNC_WHITEOUT_EXTRA  // replace them with overlayfs whiteouts
+} ObSyncExtraMode;
+
+typedef struct ObSyncOptions
+{
+  int threads; // copying workers, 0 to copy in the calling thread
+  bool incremental; // skip files with matching type, size and mtime
+  bool compareHash; // (incremental) also compare the content digests
+  ObSyncExtraMode extraMode;
+  bool mergeLayer; // src is an overlayfs layer applied on top of dst
+  bool dropWhiteouts; // (mergeLayer) dst is the bottom of the stack
+  bool linkFiles; // hardlink the regular files to src instead of copying them
+  const char* stagingDir; // copy files there first (on the dst filesystem)
+  unsigned long long rateLimit; // copied bytes per second, 0 for no limit
+} ObSyncOptions;
+
+/**
+ * @brief Set the default sync options (one worker per online CPU)
+ */
+void obInitSyncOptions(ObSyncOptions* options);
+
+/**
+ * @brief Recreate the src tree in dst. The calling thread walks the
+ * directories while the workers copy regular files. Hardlinks are kept,
+ * special files are recreated and extended attributes are copied.
+ * Directory permissions, owners and timestamps are applied after all
+ * files have been copied. In the incremental mode unchanged files are skipped.
+ * Entries missing in src are handled according to extraMode.
+ * When merging a layer, its whiteouts remove the dst entries and its opaque
+ * directories replace the dst directories. The markers are kept for the
+ * layers below dst unless dropWhiteouts is set. An opaque directory merged
+ * onto an opaque one (from an earlier merge) is pruned instead of replaced.
+ * With a staging directory the changed files and the directories replacing
+ * dst entries are built there, flushed with syncfs and moved into place,
+ * nothing is removed from dst before, extra entries included. An interrupted
+ * sync never leaves a partially copied file or a replaced directory
+ * half-filled, nor drops the old name of a moved entry before the new one.
+ * @return false if any entry could not be synced
+ */
+bool obSyncTree(const char* src, const char* dst, const ObSyncOptions* options);
+
+#endif // OBSYNC_H
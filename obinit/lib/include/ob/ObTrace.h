@@ -0,0 +1,45 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBTRACE_H
+#define OBTRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/**
+ * @return CLOCK_MONOTONIC time in nanoseconds (time since boot)
+ */
+uint64_t obGetMonotonicNs();
+
+/**
+ * @return kernel id of the calling thread
+ */
+int obGetThreadId();
+
+/**
+ * @brief Record a span from startNs (see obGetMonotonicNs) until now
+ * on the calling thread
+ * @param detail optional span argument, e.g. a path (may be NULL)
+ */
+void obTraceSpan(const char* name, const char* detail, uint64_t startNs);
+
+/**
+ * @brief Record a span measured elsewhere
+ */
+void obTraceSpanAt(const char* name, const char* detail,
+                   uint64_t startNs, uint64_t endNs, int threadId);
+
+/**
+ * @brief Write all the recorded spans as a Chrome trace-event JSON file
+ * (loadable in chrome://tracing or Perfetto)
+ */
+bool obWriteTrace(const char* path);
+
+/**
+ * @brief Drop all the recorded spans
+ */
+void obClearTrace();
+
+#endif // OBTRACE_H
@@ -11,4 +11,12 @@ typedef struct ObConfig ObConfig;
 
 bool obLoadYamlConfig(ObConfig* config, const char* path);
 
+/**
+ * @brief Load the config from the binary snapshot in cachePath when none
+ * of the config inputs (the file at path and the files of its config_dir)
+ * changed since it was written. Otherwise parse them with obLoadYamlConfig
+ * and try to write a new snapshot (skipped on a read-only filesystem).
+ */
+bool obLoadCachedYamlConfig(ObConfig* config, const char* path, const char* cachePath);
+
 #endif // OBYAMLCONFIGREADER_H
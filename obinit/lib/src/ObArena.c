@@ -0,0 +1,217 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObArena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define ARENA_ALIGN _Alignof(max_align_t)
+#define ARENA_INTERN_INITIAL 64
+
+typedef struct ObArenaBlock
+{
+  struct ObArenaBlock* next;
+  size_t size;
+  size_t used;
+  _Alignas(max_align_t) unsigned char data[];
+} ObArenaBlock;
+
+struct ObArena
+{
+  pthread_mutex_t mutex;
+  size_t blockSize;
+  size_t usage;
+  ObArenaBlock* blocks; // the current block first
+
+  // open addressing table of the interned strings
+  const char** interned;
+  size_t internedCount;
+  size_t internedCapacity;
+};
+
+static size_t obAlignSize(size_t size)
+{
+  return (size + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+static ObArenaBlock* obAddArenaBlock(ObArena* arena, size_t size)
+{
+  ObArenaBlock* block = malloc(sizeof(ObArenaBlock) + size);
+  if (block == NULL) {
+    return NULL;
+  }
+  block->size = size;
+  block->used = 0;
+
+  // a dedicated block goes behind the current one, which still has space
+  if (arena->blocks != NULL && size > arena->blockSize) {
+    block->next = arena->blocks->next;
+    arena->blocks->next = block;
+  }
+  else {
+    block->next = arena->blocks;
+    arena->blocks = block;
+  }
+  return block;
+}
+
+static void* obArenaAllocLocked(ObArena* arena, size_t size)
+{
+  size = obAlignSize(size > 0 ? size : 1);
+  ObArenaBlock* block = arena->blocks;
+  if (block == NULL || block->size - block->used < size) {
+    block = obAddArenaBlock(arena, size > arena->blockSize ? size : arena->blockSize);
+    if (block == NULL) {
+      return NULL;
+    }
+  }
+
+  void* ptr = block->data + block->used;
+  block->used += size;
+  arena->usage += size;
+  memset(ptr, 0, size);
+  return ptr;
+}
+
+static uint64_t obHashString(const char* str)
+{
+  // FNV-1a
+  uint64_t hash = 14695981039346656037ULL;
+  for (const unsigned char* c = (const unsigned char*)str; *c; ++c) {
+    hash ^= *c;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+static const char** obFindInternSlot(const char** table, size_t capacity, const char* str)
+{
+  size_t i = obHashString(str) & (capacity - 1);
+  while (table[i] != NULL && strcmp(table[i], str) != 0) {
+    i = (i + 1) & (capacity - 1);
+  }
+  return &table[i];
+}
+
+static bool obGrowInternTable(ObArena* arena)
+{
+  size_t capacity = arena->internedCapacity ? arena->internedCapacity * 2
+                                            : ARENA_INTERN_INITIAL;
+  const char** table = calloc(capacity, sizeof(const char*));
+  if (table == NULL) {
+    return false;
+  }
+
+  for (size_t i = 0; i < arena->internedCapacity; ++i) {
+    if (arena->interned[i] != NULL) {
+      *obFindInternSlot(table, capacity, arena->interned[i]) = arena->interned[i];
+    }
+  }
+  free(arena->interned);
+  arena->interned = table;
+  arena->internedCapacity = capacity;
+  return true;
+}
+
+// --------- public API ---------- //
+
+ObArena* obCreateArena(size_t blockSize)
+{
+  ObArena* arena = calloc(1, sizeof(ObArena));
+  pthread_mutex_init(&arena->mutex, NULL);
+  arena->blockSize = obAlignSize(blockSize);
+  return arena;
+}
+
+void obFreeArena(ObArena** arena)
+{
+  if (*arena == NULL) {
+    return;
+  }
+
+  ObArenaBlock* block = (*arena)->blocks;
+  while (block != NULL) {
+    ObArenaBlock* next = block->next;
+    free(block);
+    block = next;
+  }
+  free((*arena)->interned);
+  pthread_mutex_destroy(&(*arena)->mutex);
+  free(*arena);
+  *arena = NULL;
+}
+
+void* obArenaAlloc(ObArena* arena, size_t size)
+{
+  pthread_mutex_lock(&arena->mutex);
+  void* ptr = obArenaAllocLocked(arena, size);
+  pthread_mutex_unlock(&arena->mutex);
+  return ptr;
+}
+
+char* obArenaStrdup(ObArena* arena, const char* str)
+{
+  size_t size = strlen(str) + 1;
+  char* copy = obArenaAlloc(arena, size);
+  if (copy != NULL) {
+    memcpy(copy, str, size);
+  }
+  return copy;
+}
+
+char* obArenaPrintf(ObArena* arena, const char* format, ...)
+{
+  va_list args;
+  va_start(args, format);
+  int length = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  if (length < 0) {
+    return NULL;
+  }
+
+  char* str = obArenaAlloc(arena, length + 1);
+  if (str != NULL) {
+    va_start(args, format);
+    vsnprintf(str, length + 1, format, args);
+    va_end(args);
+  }
+  return str;
+}
+
+const char* obArenaIntern(ObArena* arena, const char* str)
+{
+  pthread_mutex_lock(&arena->mutex);
+
+  // keep the table at most half full
+  if ((arena->internedCount + 1) * 2 > arena->internedCapacity
+      && !obGrowInternTable(arena)) {
+    pthread_mutex_unlock(&arena->mutex);
+    return NULL;
+  }
+
+  const char** slot = obFindInternSlot(arena->interned, arena->internedCapacity, str);
+  if (*slot == NULL) {
+    size_t size = strlen(str) + 1;
+    char* copy = obArenaAllocLocked(arena, size);
+    if (copy != NULL) {
+      memcpy(copy, str, size);
+      *slot = copy;
+      arena->internedCount += 1;
+    }
+  }
+
+  const char* result = *slot;
+  pthread_mutex_unlock(&arena->mutex);
+  return result;
+}
+
+size_t obGetArenaUsage(const ObArena* arena)
+{
+  return arena->usage;
+}
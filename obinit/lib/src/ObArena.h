@@ -0,0 +1,45 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBARENA_H
+#define OBARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct ObArena ObArena;
+
+/**
+ * @brief Create a bump allocator releasing all of its memory at once
+ * @param blockSize size of the memory blocks taken from the heap, larger
+ * allocations get a block of their own
+ */
+ObArena* obCreateArena(size_t blockSize);
+
+void obFreeArena(ObArena** arena);
+
+/**
+ * @return zeroed memory aligned for any type, valid until the arena is freed
+ */
+void* obArenaAlloc(ObArena* arena, size_t size);
+
+char* obArenaStrdup(ObArena* arena, const char* str);
+
+/**
+ * @brief Formatted obArenaStrdup
+ */
+char* obArenaPrintf(ObArena* arena, const char* format, ...)
+  __attribute__ ((format (printf, 2, 3)));
+
+/**
+ * @return the arena copy of str, the same pointer for equal strings
+ */
+const char* obArenaIntern(ObArena* arena, const char* str);
+
+/**
+ * @return bytes handed out by the arena (without the block slack)
+ */
+size_t obGetArenaUsage(const ObArena* arena);
+
+#endif // OBARENA_H
@@ -5,11 +5,15 @@
 #include "ObBlkid.h"
 #include "ob/ObDefs.h"
 #include "ob/ObLogging.h"
+#include "ob/ObTrace.h"
+#include "ObThreadPool.h"
 #include <sds.h>
 
 #include <string.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <errno.h>
+#include <stdatomic.h>
 
 #include <dirent.h>
 #include <sys/stat.h>
@@ -20,7 +24,28 @@
 
 #define DEV_PATH "/dev"
 #define DEV_UUID_PREFIX "UUID="
+#define DEV_BY_UUID_PATH "/dev/disk/by-uuid"
+#define UUID_QUEUE_PER_THREAD 4
 
+static bool obCopyDevicePath(const char* path, char* str, size_t size)
+{
+  if (strlen(path) >= size) {
+    obLogE("Device path too long");
+    return false;
+  }
+  strcpy(str, path);
+  return true;
+}
+
+#ifdef OB_USE_BLKID
+
+typedef struct ObProbeWork
+{
+  const char* uuid;
+  const char* devicePath;
+  int index;
+  atomic_int* matchIndex;
+} ObProbeWork;
 
 static int filterNonBlk(const struct dirent* entry)
 {
@@ -45,16 +70,16 @@ static bool matchUuid(const char* uuid, const char* devicePath)
 
   blkid_do_fullprobe(pr);
 
-  const char* usage;
-  const char* devUuid;
-  size_t len;
+  const char* usage = NULL;
+  const char* devUuid = NULL;
+  size_t len = 0;
 
   blkid_probe_lookup_value(pr, "USAGE", &usage, &len);
 
   bool match = false;
-  if (len !=0 && strcmp(usage, "filesystem") == 0) {
-    blkid_probe_lookup_value(pr, "UUID", &devUuid, &len);
-    obLogI("Partition UUID detected, size: %lu, value: %s\n", len, uuid);
+  if (len != 0 && strcmp(usage, "filesystem") == 0
+      && blkid_probe_lookup_value(pr, "UUID", &devUuid, &len) == 0) {
+    obLogI("Partition UUID detected on %s: %s", devicePath, devUuid);
     if (strcmp(uuid, devUuid) == 0) {
       obLogI("UUID %s matched with %s", uuid, devicePath);
       match = true;
@@ -64,25 +89,98 @@ static bool matchUuid(const char* uuid, const char* devicePath)
   return match;
 }
 
-// --------- public API ---------- //
-
-bool obIsUuid(const char* str)
+static bool obFindByBlkidCache(const char* uuid, char* str, size_t size)
 {
-  size_t prefixLen = strlen(DEV_UUID_PREFIX);
-  if (strlen(str) < prefixLen) {
+  char* path = blkid_evaluate_tag("UUID", uuid, NULL);
+  if (path == NULL) {
     return false;
   }
 
-  return strncmp(str, DEV_UUID_PREFIX, prefixLen) == 0;
+  struct stat st;
+  bool result = stat(path, &st) == 0 && S_ISBLK(st.st_mode)
+      && obCopyDevicePath(path, str, size);
+  free(path);
+  return result;
 }
 
-bool obGetPathByUuid(char* str, size_t size)
+static void obProbeWork(void* arg)
+{
+  ObProbeWork* work = arg;
+  // a device earlier in the alphabetical order has already matched
+  if (atomic_load(work->matchIndex) < work->index) {
+    return;
+  }
+
+  if (matchUuid(work->uuid, work->devicePath)) {
+    int current = atomic_load(work->matchIndex);
+    while (work->index < current
+           && !atomic_compare_exchange_weak(work->matchIndex, &current, work->index)) {
+    }
+  }
+}
+
+static int obProbeDevices(const char* uuid, struct dirent** namelist, int32_t n)
+{
+  atomic_int matchIndex = n;
+  if (n == 0) {
+    return n;
+  }
+
+  // the devices are scanned one by one without the workers
+  ObProbeWork* works = calloc(n, sizeof(ObProbeWork));
+  sds* paths = calloc(n, sizeof(sds));
+  int threads = obGetOnlineCpuCount();
+  ObThreadPool* pool = works && paths
+      ? obCreateThreadPool(threads, (threads + 1) * UUID_QUEUE_PER_THREAD)
+      : NULL;
+  if (pool == NULL) {
+    free(paths);
+    free(works);
+    return -1;
+  }
+
+  for (int32_t i = 0; i < n; ++i) {
+    paths[i] = sdscatfmt(sdsempty(), "%s/%s", DEV_PATH, namelist[i]->d_name);
+    works[i].uuid = uuid;
+    works[i].devicePath = paths[i];
+    works[i].index = i;
+    works[i].matchIndex = &matchIndex;
+    if (!obSubmitWork(pool, obProbeWork, &works[i])) {
+      obProbeWork(&works[i]);
+    }
+  }
+
+  obWaitThreadPool(pool);
+  obFreeThreadPool(&pool);
+
+  for (int32_t i = 0; i < n; ++i) {
+    sdsfree(paths[i]);
+  }
+  free(paths);
+  free(works);
+  return atomic_load(&matchIndex);
+}
+
+static int obScanDevices(const char* uuid, struct dirent** namelist, int32_t n)
+{
+  int32_t i = 0;
+  for (; i < n; ++i) {
+    sds path = sdscatfmt(sdsempty(), "%s/%s", DEV_PATH, namelist[i]->d_name);
+    bool match = matchUuid(uuid, path);
+    sdsfree(path);
+    if (match) {
+      break;
+    }
+  }
+  return i;
+}
+
+/**
+ * Probe all block devices in /dev, in parallel if possible. The first
+ * matching device in the alphabetical order is used.
+ */
+static bool obFindByProbing(const char* uuid, char* str, size_t size)
 {
-#ifndef OB_USE_BLKID
-  obLogE("Cannot find device by UUID: this build does not support libblkid");
-  return false;
-#else
-  obLogI("Fetching path from device string %s", str);
   struct dirent** namelist;
   int32_t n = scandir(DEV_PATH, &namelist, filterNonBlk, alphasort);
   if (n == -1) {
@@ -90,34 +188,109 @@ bool obGetPathByUuid(char* str, size_t size)
     return false;
   }
 
-  bool match = false;
-  bool result = false;
-  int32_t i = 0;
-  for (i = 0; i < n && !match; ++i) {
-    sds path = sdsnew(DEV_PATH);
-    path = sdscatfmt(path, "/%s", namelist[i]->d_name);
-
-    if (matchUuid(str + strlen(DEV_UUID_PREFIX), path)) {
-      match = true;
-      if (strlen(path) <= size) {
-        strcpy(str, path);
-        result = true;
-      }
-      else {
-        obLogE("Device path too long");
-      }
-    }
+  const char* tier = "parallel probe";
+  int matchIndex = obProbeDevices(uuid, namelist, n);
+  if (matchIndex < 0) {
+    tier = "device scan";
+    matchIndex = obScanDevices(uuid, namelist, n);
+  }
 
-    free(namelist[i]);
-    namelist[i] = NULL;
+  bool result = false;
+  if (matchIndex < n) {
+    sds path = sdscatfmt(sdsempty(), "%s/%s", DEV_PATH, namelist[matchIndex]->d_name);
+    result = obCopyDevicePath(path, str, size);
     sdsfree(path);
+    if (result) {
+      obLogI("Device found by %s: %s", tier, str);
+    }
   }
 
-  for (i -= 1; i < n; ++i) {
+  for (int32_t i = 0; i < n; ++i) {
     free(namelist[i]);
   }
   free(namelist);
+  return result;
+}
 
+#endif // OB_USE_BLKID
+
+/**
+ * The udev symlinks are only present if udev has already processed the device
+ */
+static bool obFindByUuidLink(const char* uuid, char* str, size_t size)
+{
+  sds linkPath = sdscatfmt(sdsempty(), "%s/%s", DEV_BY_UUID_PATH, uuid);
+  char* path = realpath(linkPath, NULL);
+  sdsfree(linkPath);
+  if (path == NULL) {
+    return false;
+  }
+
+  struct stat st;
+  bool result = stat(path, &st) == 0 && S_ISBLK(st.st_mode)
+      && obCopyDevicePath(path, str, size);
+  free(path);
   return result;
+}
+
+// --------- public API ---------- //
+
+bool obIsUuid(const char* str)
+{
+  size_t prefixLen = strlen(DEV_UUID_PREFIX);
+  if (strlen(str) < prefixLen) {
+    return false;
+  }
+
+  return strncmp(str, DEV_UUID_PREFIX, prefixLen) == 0;
+}
+
+bool obIsUuidLinked(const char* str)
+{
+  char path[OB_DEV_PATH_MAX];
+  return obFindByUuidLink(str + strlen(DEV_UUID_PREFIX), path, OB_DEV_PATH_MAX);
+}
+
+bool obMatchDeviceUuid(const char* str, const char* devicePath)
+{
+#ifdef OB_USE_BLKID
+  return matchUuid(str + strlen(DEV_UUID_PREFIX), devicePath);
+#else
+  (void)str;
+  (void)devicePath;
+  return false;
 #endif
 }
+
+bool obGetPathByUuid(char* str, size_t size)
+{
+  uint64_t traceStart = obGetMonotonicNs();
+  obLogI("Fetching path from device string %s", str);
+  sds uuid = sdsnew(str + strlen(DEV_UUID_PREFIX));
+
+  bool result = false;
+  if (obFindByUuidLink(uuid, str, size)) {
+    obLogI("Device found by %s symlink: %s", DEV_BY_UUID_PATH, str);
+    result = true;
+  }
+#ifdef OB_USE_BLKID
+  else if (obFindByBlkidCache(uuid, str, size)) {
+    obLogI("Device found by libblkid cache: %s", str);
+    result = true;
+  }
+  else {
+    result = obFindByProbing(uuid, str, size);
+  }
+#else
+  else {
+    obLogE("Cannot probe devices by UUID: this build does not support libblkid");
+  }
+#endif
+
+  if (!result) {
+    obLogE("No device found with UUID %s", uuid);
+  }
+  obTraceSpan("obGetPathByUuid", uuid, traceStart);
+  sdsfree(uuid);
+  return result;
+}
@@ -12,4 +12,16 @@ bool obIsUuid(const char* str);
 
 bool obGetPathByUuid(char* str, size_t size);
 
+/**
+ * @brief Check if the /dev/disk/by-uuid symlink for the "UUID=<uuid>"
+ * string points to a block device
+ */
+bool obIsUuidLinked(const char* str);
+
+/**
+ * @brief Probe devicePath for the "UUID=<uuid>" filesystem UUID
+ * (always false in builds without libblkid)
+ */
+bool obMatchDeviceUuid(const char* str, const char* devicePath);
+
 #endif // OBBLKID_H
@@ -3,6 +3,7 @@
 // See accompanying file LICENSE.txt for the full license.
 
 #include "ob/ObConfig.h"
+#include "ObArena.h"
 
 #include <stdlib.h>
 
@@ -18,10 +19,15 @@ static void obCountDurablesRecursive(ObDurable* durable, int* count)
 
 // --------- public API ---------- //
 
+const char* obInternConfigString(ObConfig* config, const char* str)
+{
+  return obArenaIntern(config->arena, str);
+}
+
 void obAddDurable(ObConfig* config, const char* path)
 {
-  ObDurable* durable = malloc(sizeof(ObDurable));
-  strcpy(durable->path, path);
+  ObDurable* durable = obArenaAlloc(config->arena, sizeof(ObDurable));
+  durable->path = obInternConfigString(config, path);
   durable->copyOrigin = false;
   durable->forceFileType = false;
   durable->next = config->durable;
@@ -34,15 +40,3 @@ int obCountDurables(const ObConfig* config)
   obCountDurablesRecursive(config->durable, &count);
   return count;
 }
-
-void obFreeDurable(ObDurable* durable)
-{
-  if (durable == NULL) {
-    return;
-  }
-
-  if (durable->next != NULL) {
-    obFreeDurable(durable->next);
-  }
-  free(durable);
-}
@@ -0,0 +1,229 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObConfigCache.h"
+#include "ob/ObLogging.h"
+#include "ObArena.h"
+#include <sds.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "OBCC"
+
+// bump when the ObConfig layout or the config defaults change
+#define CACHE_VERSION 6
+#define CACHE_STRING_COUNT 6
+
+typedef struct ObConfigCacheHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t configSize;
+  uint32_t durableCount;
+  uint32_t hashType;
+  uint32_t reserved;
+  uint64_t hashLow;
+  uint64_t hashHigh;
+} ObConfigCacheHeader;
+
+// followed by the path without a terminator
+typedef struct ObConfigCacheDurable
+{
+  uint32_t pathLength;
+  uint8_t copyOrigin;
+  uint8_t forceFileType;
+  uint16_t reserved;
+} ObConfigCacheDurable;
+
+// the header is followed by the ObConfig with its pointers cleared,
+// CACHE_STRING_COUNT lengths (uint32_t) with the strings and the durables
+
+static const char** obGetCacheString(ObConfig* config, int i)
+{
+  const char** strings[CACHE_STRING_COUNT] = {
+    &config->devicePath, &config->headLayer, &config->repository,
+    &config->configDir, &config->tmpfsSize, &config->zramCompressor
+  };
+  return strings[i];
+}
+
+static void obClearConfigPointers(ObConfig* config)
+{
+  for (int s = 0; s < CACHE_STRING_COUNT; ++s) {
+    *obGetCacheString(config, s) = NULL;
+  }
+  config->prefix = NULL;
+  config->configPath = NULL;
+  config->durable = NULL;
+  config->arena = NULL;
+}
+
+static const char* obReadCacheString(ObArena* arena, const char* data, size_t size,
+                                     size_t* offset, size_t length)
+{
+  if (size - *offset < length) {
+    return NULL;
+  }
+  char* str = obArenaAlloc(arena, length + 1);
+  memcpy(str, data + *offset, length);
+  str[length] = '\0';
+  *offset += length;
+  return str;
+}
+
+static bool obParseConfigCache(const char* data, size_t size, ObConfig* config,
+                               ObHash* inputHash)
+{
+  ObConfigCacheHeader header;
+  uint32_t lengths[CACHE_STRING_COUNT];
+  if (size < sizeof(header) + sizeof(ObConfig) + sizeof(lengths)) {
+    return false;
+  }
+
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, CACHE_MAGIC, sizeof(header.magic)) != 0
+      || header.version != CACHE_VERSION
+      || header.configSize != sizeof(ObConfig)) {
+    return false;
+  }
+
+  inputHash->type = header.hashType;
+  inputHash->low = header.hashLow;
+  inputHash->high = header.hashHigh;
+
+  ObArena* arena = config->arena;
+  size_t offset = sizeof(header);
+  memcpy(config, data + offset, sizeof(ObConfig));
+  offset += sizeof(ObConfig);
+  obClearConfigPointers(config);
+  config->arena = arena;
+
+  memcpy(lengths, data + offset, sizeof(lengths));
+  offset += sizeof(lengths);
+  for (int s = 0; s < CACHE_STRING_COUNT; ++s) {
+    const char* str = obReadCacheString(arena, data, size, &offset, lengths[s]);
+    if (str == NULL) {
+      return false;
+    }
+    *obGetCacheString(config, s) = str;
+  }
+
+  ObDurable** tail = &config->durable;
+  for (uint32_t i = 0; i < header.durableCount; ++i) {
+    ObConfigCacheDurable record;
+    if (size - offset < sizeof(record)) {
+      return false;
+    }
+    memcpy(&record, data + offset, sizeof(record));
+    offset += sizeof(record);
+
+    ObDurable* durable = obArenaAlloc(arena, sizeof(ObDurable));
+    durable->path = obReadCacheString(arena, data, size, &offset, record.pathLength);
+    if (durable->path == NULL) {
+      return false;
+    }
+    durable->copyOrigin = record.copyOrigin;
+    durable->forceFileType = record.forceFileType;
+    *tail = durable;
+    tail = &durable->next;
+  }
+
+  return offset == size;
+}
+
+// --------- public API ---------- //
+
+bool obReadConfigCache(const char* cachePath, ObConfig* config, ObHash* inputHash)
+{
+  int fd = open(cachePath, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  char* data = NULL;
+  bool result = fstat(fd, &st) == 0 && st.st_size > 0
+      && (data = malloc(st.st_size)) != NULL
+      && read(fd, data, st.st_size) == st.st_size;
+  close(fd);
+
+  result = result && obParseConfigCache(data, st.st_size, config, inputHash);
+  free(data);
+
+  if (!result) {
+    obLogI("Config cache %s cannot be used", cachePath);
+  }
+  return result;
+}
+
+bool obWriteConfigCache(const char* cachePath, const ObConfig* config,
+                        const ObHash* inputHash)
+{
+  ObConfigCacheHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, CACHE_MAGIC, sizeof(header.magic));
+  header.version = CACHE_VERSION;
+  header.configSize = sizeof(ObConfig);
+  header.durableCount = obCountDurables(config);
+  header.hashType = inputHash->type;
+  header.hashLow = inputHash->low;
+  header.hashHigh = inputHash->high;
+
+  ObConfig snapshot = *config;
+  obClearConfigPointers(&snapshot);
+
+  ObConfig strings = *config;
+  uint32_t lengths[CACHE_STRING_COUNT];
+  for (int s = 0; s < CACHE_STRING_COUNT; ++s) {
+    lengths[s] = strlen(*obGetCacheString(&strings, s));
+  }
+
+  sds data = sdsnewlen(&header, sizeof(header));
+  data = sdscatlen(data, &snapshot, sizeof(snapshot));
+  data = sdscatlen(data, lengths, sizeof(lengths));
+  for (int s = 0; s < CACHE_STRING_COUNT; ++s) {
+    data = sdscatlen(data, *obGetCacheString(&strings, s), lengths[s]);
+  }
+
+  for (ObDurable* durable = config->durable; durable != NULL; durable = durable->next) {
+    ObConfigCacheDurable record;
+    memset(&record, 0, sizeof(record));
+    record.pathLength = strlen(durable->path);
+    record.copyOrigin = durable->copyOrigin;
+    record.forceFileType = durable->forceFileType;
+    data = sdscatlen(data, &record, sizeof(record));
+    data = sdscatlen(data, durable->path, record.pathLength);
+  }
+
+  sds tmpPath = sdscat(sdsnew(cachePath), ".tmp");
+  bool result = false;
+  int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd >= 0) {
+    result = write(fd, data, sdslen(data)) == (ssize_t)sdslen(data);
+    result = close(fd) == 0 && result;
+    result = result && rename(tmpPath, cachePath) == 0;
+  }
+
+  if (result) {
+    obLogI("Config cache written to %s", cachePath);
+  }
+  else if (errno == EROFS) {
+    obLogI("Config cache not written, read-only filesystem: %s", cachePath);
+  }
+  else {
+    obLogW("Cannot write config cache: %s (%s)", cachePath, strerror(errno));
+    unlink(tmpPath);
+  }
+
+  sdsfree(tmpPath);
+  sdsfree(data);
+  return result;
+}
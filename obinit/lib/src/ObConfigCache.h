@@ -0,0 +1,30 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBCONFIGCACHE_H
+#define OBCONFIGCACHE_H
+
+#include "ob/ObConfig.h"
+#include "ob/ObHash.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Load the config snapshot written by obWriteConfigCache with
+ * a single read. The strings and durables are allocated in config->arena
+ * (set by the caller), the durables keep their order. The prefix and
+ * configPath are left NULL.
+ * @param inputHash hash of the config inputs the snapshot was made from
+ * @return false if the snapshot is missing, corrupted or made by
+ * an incompatible obinit build
+ */
+bool obReadConfigCache(const char* cachePath, ObConfig* config, ObHash* inputHash);
+
+/**
+ * @brief Write the snapshot of config (with durables) atomically
+ */
+bool obWriteConfigCache(const char* cachePath, const ObConfig* config,
+                        const ObHash* inputHash);
+
+#endif // OBCONFIGCACHE_H
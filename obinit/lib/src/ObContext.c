@@ -6,6 +6,8 @@
 #include "ob/ObLogging.h"
 #include "ObOsUtils.h"
 #include "ObBlkid.h"
+#include "ObUevent.h"
+#include "ObArena.h"
 #include <sds.h>
 
 #include <stdlib.h>
@@ -16,49 +18,61 @@
 static const char* ROOTMNT_ENV_VAR = "rootmnt";
 static const char* DEFAULT_ROOTMNT = "/root";
 static const char* DEFAULT_TMPFS_SIZE = "50%";
+static const char* DEFAULT_ZRAM_COMPRESSOR = "lz4";
 static const char* DEFAULT_DEVICE_PATH = "/var/obdev";
 static const char* DEFAULT_HEAD_LAYER = "root";
 static const char* DEFAULT_REPO_NAME = "overboot";
 static const char* DEFAULT_CONFIG_DIR = "";
+static const int DEFAULT_FLUSH_INTERVAL = 300;
+static const int DEFAULT_PREFETCH_RECORD_TIME = 60;
 
 
-// --------- public API ---------- //
-
-void obInitializeObContext(ObContext* context, const char* prefix)
+static void obInitializeArenaContext(ObContext* context, ObArena* arena, const char* prefix)
 {
+  memset(context, 0, sizeof(ObContext));
+  context->arena = arena;
+
   ObConfig* config = &context->config;
-  strcpy(config->prefix, prefix);
-  strcpy(config->devicePath, DEFAULT_DEVICE_PATH);
-  strcpy(config->headLayer, DEFAULT_HEAD_LAYER);
-  strcpy(config->repository, DEFAULT_REPO_NAME);
-  strcpy(config->configDir, DEFAULT_CONFIG_DIR);
-  strcpy(config->tmpfsSize, DEFAULT_TMPFS_SIZE);
+  config->arena = arena;
+  config->prefix = obInternConfigString(config, prefix);
+  config->devicePath = obInternConfigString(config, DEFAULT_DEVICE_PATH);
+  config->headLayer = obInternConfigString(config, DEFAULT_HEAD_LAYER);
+  config->repository = obInternConfigString(config, DEFAULT_REPO_NAME);
+  config->configDir = obInternConfigString(config, DEFAULT_CONFIG_DIR);
+  config->tmpfsSize = obInternConfigString(config, DEFAULT_TMPFS_SIZE);
+  config->zramCompressor = obInternConfigString(config, DEFAULT_ZRAM_COMPRESSOR);
 
   config->enabled = false;
   config->bindLayers = true;
   config->useTmpfs = true;
   config->clearUpper = false;
+  config->writeBack = false;
+  config->useZram = false;
   config->rollback = false;
   config->upperAsLower = false;
   config->safeMode = false;
+  config->prefetch = false;
+  config->flattenLayers = false;
+  config->logLevel = OB_LOG_LEVEL_INFO;
+  config->verifyLayers = OB_LAYER_VERIFY_NONE;
+  config->maxLayerDepth = 0;
+  config->deviceTimeout = 0;
+  config->flushInterval = DEFAULT_FLUSH_INTERVAL;
+  config->flushRate = 0;
+  config->prefetchRecordTime = DEFAULT_PREFETCH_RECORD_TIME;
 
   config->durable = NULL;
 
-  context->foundDevicePath = sdsempty();
-
-  context->devMountPoint = sdsnew(prefix);
-  context->devMountPoint = sdscat(context->devMountPoint, OB_DEV_MOUNT_POINT);
-
-  context->overbootDir = sdsnew(prefix);
-  context->overbootDir = sdscat(context->overbootDir, OB_OVERLAY_DIR);
+  context->foundDevicePath = "";
+  context->devMountPoint = obArenaPrintf(arena, "%s%s", prefix, OB_DEV_MOUNT_POINT);
+  context->overbootDir = obArenaPrintf(arena, "%s%s", prefix, OB_OVERLAY_DIR);
 
-  context->root = sdsnew(prefix);
   char* rootmnt = getenv(ROOTMNT_ENV_VAR);
   if (rootmnt != NULL) {
-    context->root = sdscat(context->root, rootmnt);
+    context->root = obArenaPrintf(arena, "%s%s", prefix, rootmnt);
   }
   else {
-    context->root = sdscat(context->root, DEFAULT_ROOTMNT);
+    context->root = obArenaPrintf(arena, "%s%s", prefix, DEFAULT_ROOTMNT);
     obLogI("The rootmnt environment variable not set, using %s", context->root);
   }
 
@@ -66,33 +80,76 @@ void obInitializeObContext(ObContext* context, const char* prefix)
   context->reloadConfig = false;
 }
 
+// --------- public API ---------- //
+
+void obInitializeObContext(ObContext* context, const char* prefix)
+{
+  ObArena* arena = obCreateArena(OB_ARENA_BLOCK_SIZE);
+  obInitializeArenaContext(context, arena, prefix);
+}
+
 ObContext* obCreateObContext(const char* prefix)
 {
-  ObContext* context = malloc(sizeof(ObContext));
-  obInitializeObContext(context, prefix);
+  ObArena* arena = obCreateArena(OB_ARENA_BLOCK_SIZE);
+  ObContext* context = obArenaAlloc(arena, sizeof(ObContext));
+  obInitializeArenaContext(context, arena, prefix);
   return context;
 }
 
 void obFreeObContext(ObContext** context)
 {
-  sdsfree((*context)->foundDevicePath);
-  sdsfree((*context)->devMountPoint);
-  sdsfree((*context)->overbootDir);
-  sdsfree((*context)->root);
-  obFreeDurable((*context)->config.durable);
-  free(*context);
+  // the context may live in the arena
+  ObArena* arena = (*context)->arena;
+  obFreeArena(&arena);
   *context = NULL;
 }
 
+void obResolveContextPaths(ObContext* context)
+{
+  ObArena* arena = context->arena;
+  ObContextPaths* paths = &context->paths;
+
+  paths->repo = obArenaPrintf(arena, "%s/%s", context->devMountPoint,
+                              context->config.repository);
+  paths->layers = obArenaPrintf(arena, "%s/%s", paths->repo, OB_LAYERS_DIR_NAME);
+  paths->layerIndex = obArenaPrintf(arena, "%s/%s", paths->repo, OB_LAYER_INDEX_NAME);
+  paths->jobs = obArenaPrintf(arena, "%s/%s", paths->repo, OB_JOBS_DIR_NAME);
+  paths->durables = obArenaPrintf(arena, "%s/%s", paths->repo, OB_DURABLES_DIR_NAME);
+  paths->trash = obArenaPrintf(arena, "%s/%s", paths->repo, OB_TRASH_DIR_NAME);
+  paths->flushStaging = obArenaPrintf(arena, "%s/%s", paths->repo, OB_FLUSH_DIR_NAME);
+  paths->flushedUpper = obArenaPrintf(arena, "%s/%s", paths->repo, OB_FLUSHED_DIR_NAME);
+  paths->prefetch = obArenaPrintf(arena, "%s/%s", paths->repo, OB_PREFETCH_DIR_NAME);
+  paths->prefetchList = obArenaPrintf(arena, "%s/%s%s", paths->prefetch,
+                                      context->config.headLayer, OB_PREFETCH_LIST_EXT);
+  paths->lock = obArenaPrintf(arena, "%s/obinit.lock", paths->repo);
+  paths->lowerRoot = obArenaPrintf(arena, "%s/lower-root", context->overbootDir);
+  paths->persistentUpper = obArenaPrintf(arena, "%s/upper", paths->repo);
+
+  const char* overlayDir = context->config.useTmpfs ? context->overbootDir : paths->repo;
+  paths->upper = obArenaPrintf(arena, "%s/upper", overlayDir);
+  paths->overlayWork = obArenaPrintf(arena, "%s/work", overlayDir);
+
+  paths->bindedOverlay = obArenaPrintf(arena, "%s/%s", context->root, OB_USER_BINDINGS_DIR);
+  paths->bindedUpper = obArenaPrintf(arena, "%s/upper", paths->bindedOverlay);
+}
+
 bool obFindDevice(ObContext* context)
 {
   ObConfig* config = &context->config;
 
+  if (config->deviceTimeout > 0 && obIsHotplugDevice(config->devicePath)) {
+    obWaitForDevice(config->devicePath, config->deviceTimeout * 1000);
+  }
+
   // UUID
-  if (obIsUuid(config->devicePath)
-      && !obGetPathByUuid(config->devicePath, OB_PATH_MAX)) {
-    context->deviceType = OB_DEV_BLK;
-    return false;
+  if (obIsUuid(config->devicePath)) {
+    char uuidDevicePath[OB_PATH_MAX];
+    snprintf(uuidDevicePath, OB_PATH_MAX, "%s", config->devicePath);
+    if (!obGetPathByUuid(uuidDevicePath, OB_PATH_MAX)) {
+      context->deviceType = OB_DEV_BLK;
+      return false;
+    }
+    config->devicePath = obInternConfigString(config, uuidDevicePath);
   }
 
   if (strlen(config->devicePath) && config->devicePath[0] != '/') {
@@ -107,7 +164,7 @@ bool obFindDevice(ObContext* context)
       return false;
     }
     context->deviceType = OB_DEV_BLK;
-    context->foundDevicePath = sdscpy(context->foundDevicePath, config->devicePath);
+    context->foundDevicePath = config->devicePath;
     return true;
   }
 
@@ -123,14 +180,15 @@ bool obFindDevice(ObContext* context)
     }
   }
 
-  sdsfree(context->foundDevicePath);
-  context->foundDevicePath = newPath;
+  context->foundDevicePath = obArenaStrdup(context->arena, newPath);
+  sdsfree(newPath);
 
   if (imgFound) {
     context->deviceType = OB_DEV_IMG;
   }
   else {
-    obLogI("Device not found, using %s as an embedded repository ", newPath);
+    obLogI("Device not found, using %s as an embedded repository ",
+           context->foundDevicePath);
     context->deviceType = OB_DEV_DIR;
   }
 
@@ -142,11 +200,20 @@ void obLogObContext(const ObContext* context)
   const ObConfig* config = &context->config;
   obLogI("enabled: %i", config->enabled);
   obLogI("safe mode: %i", config->safeMode);
+  obLogI("log level: %i", config->logLevel);
   obLogI("use tmpfs: %i", config->useTmpfs);
   obLogI("tmpfs size: %s", config->tmpfsSize);
+  obLogI("use zram: %i (%s)", config->useZram, config->zramCompressor);
+  obLogI("write-back: %i (every %is, %llu B/s)", config->writeBack,
+         config->flushInterval, config->flushRate);
+  obLogI("prefetch: %i (recording for %is)", config->prefetch, config->prefetchRecordTime);
   obLogI("bind layers: %i", config->bindLayers);
   obLogI("Device path: %s", config->devicePath);
+  obLogI("device timeout: %i", config->deviceTimeout);
   obLogI("head layer: %s", config->headLayer);
+  obLogI("verify layers: %i", config->verifyLayers);
+  obLogI("max layer depth: %i", config->maxLayerDepth);
+  obLogI("flatten layers: %i", config->flattenLayers);
   obLogI("repository: %s", config->repository);
   obLogI("include upper: %i", config->upperAsLower);
   obLogI("config dir: %s", config->configDir);
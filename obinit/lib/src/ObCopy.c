@@ -0,0 +1,315 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObCopy.h"
+#include "ObUring.h"
+#include "ob/ObLogging.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <stdatomic.h>
+
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/sendfile.h>
+#include <linux/fs.h>
+
+#define COPY_BUFFER_SIZE (256 * 1024)
+#define COPY_CHUNK_MAX 0x7ffff000
+
+#define COPY_DONE 0
+#define COPY_FALLBACK 1
+#define COPY_ERROR -1
+
+typedef int (*ObCopyFunction)(int srcFd, int dstFd, off_t* offset, off_t size);
+
+static atomic_uint_fast64_t copyFiles[OB_COPY_STRATEGY_COUNT];
+static atomic_uint_fast64_t copyBytes[OB_COPY_STRATEGY_COUNT];
+static atomic_uint_fast64_t copySparseFiles;
+
+// set when the kernel lacks the syscall, other errors depend on the fs pair
+static atomic_bool copyUnsupported[OB_COPY_STRATEGY_COUNT];
+
+static const char* strategyNames[OB_COPY_STRATEGY_COUNT] = {
+  "reflink", "copy_file_range", "io_uring", "sendfile", "buffer"
+};
+
+static bool isFallbackErrno(int error)
+{
+  return error == ENOSYS || error == EXDEV || error == EINVAL
+      || error == EOPNOTSUPP || error == ENOTTY || error == EBADF
+      || error == EPERM || error == ETXTBSY;
+}
+
+static int copyResult(int error, ObCopyStrategy strategy)
+{
+  if (error == ENOSYS) {
+    atomic_store(&copyUnsupported[strategy], true);
+  }
+  return isFallbackErrno(error) ? COPY_FALLBACK : COPY_ERROR;
+}
+
+static int copyReflink(int srcFd, int dstFd, off_t* offset, off_t size)
+{
+  if (*offset != 0) {
+    return COPY_FALLBACK;
+  }
+
+  if (ioctl(dstFd, FICLONE, srcFd) != 0) {
+    return copyResult(errno, OB_COPY_REFLINK);
+  }
+
+  *offset = size;
+  return COPY_DONE;
+}
+
+static int copyRange(int srcFd, int dstFd, off_t* offset, off_t size)
+{
+  loff_t inOffset = *offset;
+  loff_t outOffset = *offset;
+
+  while (inOffset < size) {
+    size_t length = size - inOffset > COPY_CHUNK_MAX ? COPY_CHUNK_MAX : size - inOffset;
+    ssize_t count = copy_file_range(srcFd, &inOffset, dstFd, &outOffset, length, 0);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0) {
+      *offset = inOffset;
+      return copyResult(errno, OB_COPY_RANGE);
+    }
+    if (count == 0) {
+      break;
+    }
+  }
+
+  *offset = inOffset;
+  return COPY_DONE;
+}
+
+static int copyUring(int srcFd, int dstFd, off_t* offset, off_t size)
+{
+  ObUring* ring = obGetThreadUring();
+  if (ring == NULL) {
+    atomic_store(&copyUnsupported[OB_COPY_URING], true);
+    return COPY_FALLBACK;
+  }
+
+  // let the syscall based strategies retry the range after a ring failure
+  return obUringCopyFd(ring, srcFd, dstFd, offset, size) ? COPY_DONE : COPY_FALLBACK;
+}
+
+static int copySendfile(int srcFd, int dstFd, off_t* offset, off_t size)
+{
+  if (lseek(dstFd, *offset, SEEK_SET) < 0) {
+    return COPY_ERROR;
+  }
+
+  while (*offset < size) {
+    size_t length = size - *offset > COPY_CHUNK_MAX ? COPY_CHUNK_MAX : size - *offset;
+    ssize_t count = sendfile(dstFd, srcFd, offset, length);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count < 0) {
+      return copyResult(errno, OB_COPY_SENDFILE);
+    }
+    if (count == 0) {
+      break;
+    }
+  }
+
+  return COPY_DONE;
+}
+
+static int copyBuffer(int srcFd, int dstFd, off_t* offset, off_t size)
+{
+  char* buffer = malloc(COPY_BUFFER_SIZE);
+  if (buffer == NULL) {
+    return COPY_ERROR;
+  }
+
+  int result = COPY_DONE;
+  while (result == COPY_DONE && *offset < size) {
+    size_t length = size - *offset > COPY_BUFFER_SIZE ? COPY_BUFFER_SIZE : size - *offset;
+    ssize_t count = pread(srcFd, buffer, length, *offset);
+    if (count < 0 && errno == EINTR) {
+      continue;
+    }
+    if (count <= 0) {
+      result = count == 0 ? COPY_DONE : COPY_ERROR;
+      break;
+    }
+
+    ssize_t written = 0;
+    while (written < count) {
+      ssize_t n = pwrite(dstFd, buffer + written, count - written, *offset + written);
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n <= 0) {
+        result = COPY_ERROR;
+        break;
+      }
+      written += n;
+    }
+    *offset += written;
+  }
+
+  free(buffer);
+  return result;
+}
+
+static const ObCopyFunction copyFunctions[OB_COPY_STRATEGY_COUNT] = {
+  copyReflink, copyRange, copyUring, copySendfile, copyBuffer
+};
+
+/**
+ * Copy [offset, end) with the first strategy that works,
+ * reflinks are only attempted for whole files.
+ */
+static int copySegment(int srcFd, int dstFd, off_t* offset, off_t end,
+                       ObCopyStrategy first, ObCopyStrategy* used)
+{
+  int result = COPY_FALLBACK;
+  for (ObCopyStrategy current = first; current < OB_COPY_STRATEGY_COUNT; ++current) {
+    if (atomic_load(&copyUnsupported[current])) {
+      continue;
+    }
+    result = copyFunctions[current](srcFd, dstFd, offset, end);
+    if (result != COPY_FALLBACK) {
+      *used = current;
+      break;
+    }
+  }
+  return result;
+}
+
+/**
+ * Copy data segments only, holes are recreated by the final truncate
+ */
+static int copySparse(int srcFd, int dstFd, off_t* offset, off_t size,
+                      ObCopyStrategy* used)
+{
+  off_t data = 0;
+  while (data < size) {
+    data = lseek(srcFd, data, SEEK_DATA);
+    if (data < 0 && errno == ENXIO) {
+      break;
+    }
+    if (data < 0) {
+      return *offset == 0 ? COPY_FALLBACK : COPY_ERROR;
+    }
+
+    off_t hole = lseek(srcFd, data, SEEK_HOLE);
+    if (hole < 0 || hole > size) {
+      hole = size;
+    }
+
+    off_t segmentOffset = data;
+    int result = copySegment(srcFd, dstFd, &segmentOffset, hole, OB_COPY_RANGE, used);
+    if (result != COPY_DONE) {
+      return result;
+    }
+    *offset = segmentOffset;
+    data = hole;
+  }
+
+  *offset = size;
+  return ftruncate(dstFd, size) == 0 ? COPY_DONE : COPY_ERROR;
+}
+
+static bool isSparse(int fd, off_t size)
+{
+  struct stat st;
+  return fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+      && (off_t)st.st_blocks * 512 < size;
+}
+
+// --------- public API ---------- //
+
+bool obCopyFd(int srcFd, int dstFd, off_t size, ObCopyStrategy* strategy)
+{
+  off_t offset = 0;
+  ObCopyStrategy used = OB_COPY_BUFFER;
+  int result = COPY_FALLBACK;
+  bool sparse = false;
+
+  if (!atomic_load(&copyUnsupported[OB_COPY_REFLINK])) {
+    result = copyReflink(srcFd, dstFd, &offset, size);
+    used = OB_COPY_REFLINK;
+  }
+
+  if (result == COPY_FALLBACK && isSparse(srcFd, size)) {
+    result = copySparse(srcFd, dstFd, &offset, size, &used);
+    sparse = result == COPY_DONE;
+  }
+
+  if (result == COPY_FALLBACK) {
+    offset = 0;
+    result = copySegment(srcFd, dstFd, &offset, size, OB_COPY_RANGE, &used);
+  }
+
+  if (result != COPY_DONE) {
+    return false;
+  }
+
+  // the source may have shrunk since it was stat'ed
+  if (offset < size && ftruncate(dstFd, offset) != 0) {
+    return false;
+  }
+
+  atomic_fetch_add(&copyFiles[used], 1);
+  atomic_fetch_add(&copyBytes[used], offset);
+  if (sparse) {
+    atomic_fetch_add(&copySparseFiles, 1);
+  }
+  if (strategy) {
+    *strategy = used;
+  }
+  return true;
+}
+
+const char* obCopyStrategyName(ObCopyStrategy strategy)
+{
+  if (strategy >= OB_COPY_STRATEGY_COUNT) {
+    return "unknown";
+  }
+  return strategyNames[strategy];
+}
+
+void obGetCopyStats(ObCopyStats* stats)
+{
+  for (int i = 0; i < OB_COPY_STRATEGY_COUNT; ++i) {
+    stats->files[i] = atomic_load(&copyFiles[i]);
+    stats->bytes[i] = atomic_load(&copyBytes[i]);
+  }
+  stats->sparseFiles = atomic_load(&copySparseFiles);
+}
+
+void obResetCopyStats()
+{
+  for (int i = 0; i < OB_COPY_STRATEGY_COUNT; ++i) {
+    atomic_store(&copyFiles[i], 0);
+    atomic_store(&copyBytes[i], 0);
+  }
+  atomic_store(&copySparseFiles, 0);
+}
+
+void obLogCopyStats()
+{
+  ObCopyStats stats;
+  obGetCopyStats(&stats);
+  for (int i = 0; i < OB_COPY_STRATEGY_COUNT; ++i) {
+    if (stats.files[i] > 0) {
+      obLogI("Copied %" PRIu64 " file(s), %" PRIu64 " bytes using %s",
+             stats.files[i], stats.bytes[i], obCopyStrategyName(i));
+    }
+  }
+  if (stats.sparseFiles > 0) {
+    obLogI("Copied %" PRIu64 " sparse file(s) hole-aware", stats.sparseFiles);
+  }
+}
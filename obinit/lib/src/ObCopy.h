@@ -0,0 +1,50 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBCOPY_H
+#define OBCOPY_H
+
+#include <stdbool.h>
+#include <inttypes.h>
+#include <sys/types.h>
+
+typedef enum ObCopyStrategy
+{
+  OB_COPY_REFLINK = 0, // FICLONE, shares extents on btrfs/xfs
+  OB_COPY_RANGE,       // copy_file_range(2), in-kernel (server-side on nfs)
+  OB_COPY_URING,       // queued io_uring reads/writes (OB_USE_IO_URING builds)
+  OB_COPY_SENDFILE,    // sendfile(2), in-kernel but page cache bound
+  OB_COPY_BUFFER,      // pread/pwrite userspace loop
+  OB_COPY_STRATEGY_COUNT
+} ObCopyStrategy;
+
+typedef struct ObCopyStats
+{
+  uint64_t files[OB_COPY_STRATEGY_COUNT];
+  uint64_t bytes[OB_COPY_STRATEGY_COUNT];
+  uint64_t sparseFiles; // data segments copied with one of the above
+} ObCopyStats;
+
+/**
+ * @brief Copy size bytes from srcFd to dstFd (both at offset 0) using
+ * the fastest strategy available. Strategies are tried in the enum order
+ * and each one continues where the previous one stopped. Sparse files
+ * that cannot be reflinked are copied segment by segment, keeping holes.
+ * @param strategy if not NULL, set to the strategy that finished the copy
+ * @return true on success
+ */
+bool obCopyFd(int srcFd, int dstFd, off_t size, ObCopyStrategy* strategy);
+
+const char* obCopyStrategyName(ObCopyStrategy strategy);
+
+void obGetCopyStats(ObCopyStats* stats);
+
+void obResetCopyStats();
+
+/**
+ * @brief Log the number of files and bytes copied by each strategy
+ */
+void obLogCopyStats();
+
+#endif // OBCOPY_H
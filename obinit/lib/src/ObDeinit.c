@@ -6,6 +6,9 @@
 #include "ObMount.h"
 #include "ObOsUtils.h"
 #include "ObPaths.h"
+#include "ObDurables.h"
+#include "ObZram.h"
+#include "ob/ObLayerImage.h"
 
 #include <sds.h>
 #include <unistd.h>
@@ -28,32 +31,24 @@ bool obDeinitPersistentDevice(ObContext* context)
 
 bool obDeinitOverbootDir(ObContext* context)
 {
-  sds path = obGetOverlayWorkPath(context);
-  bool result = rmdir(path) == 0;
+  bool result = rmdir(obGetOverlayWorkPath(context)) == 0;
+  result = rmdir(obGetLowerRootPath(context)) == 0 && result;
+  result = rmdir(obGetBindedUpperPath(context)) == 0 && result;
 
-  sdsfree(path);
-  path = obGetLowerRootPath(context);
-  result = rmdir(path) == 0 && result;
-
-  sdsfree(path);
-  path = obGetBindedUpperPath(context);
-  result = rmdir(path) == 0 && result;
-
-  result = obUnmount(context->overbootDir) && result;
+  if (context->zramDevice != NULL) {
+    result = obUnmountZram(context->overbootDir, context->zramDevice) && result;
+  }
+  else {
+    result = obUnmount(context->overbootDir) && result;
+  }
   result = rmdir(context->overbootDir) == 0 && result;
-
-  sdsfree(path);
   return result;
 }
 
 
 bool obDeinitLowerRoot(ObContext* context)
 {
-  sds path = obGetLowerRootPath(context);
-  bool result = obMove(path, context->root);
-  sdsfree(path);
-
-  return result;
+  return obMove(obGetLowerRootPath(context), context->root);
 }
 
 
@@ -62,26 +57,34 @@ bool obDeinitOverlayfs(ObContext* context)
   if (context->deviceType == OB_DEV_DIR) {
     obUnmount(context->foundDevicePath);
   }
-  return obUnmount(context->root);
+  bool result = obUnmount(context->root);
+
+  obUnmountLayerImages(obGetLayersPath(context));
+  return result;
 }
 
 
 bool obDeinitManagementBindings(ObContext* context)
 {
-  sds bindedOverlay = obGetBindedOverlayPath(context);
+  const char* bindedOverlay = obGetBindedOverlayPath(context);
   sds bindedLayersDir = obGetBindedLayersPath(bindedOverlay);
   sds bindedJobsDir = obGetBindedJobsPath(bindedOverlay);
+  sds bindedPrefetchDir = obGetBindedPrefetchPath(bindedOverlay);
 
   bool result = obUnmount(bindedJobsDir);
-  result = rmdir(bindedJobsDir) && result;
+  result = rmdir(bindedJobsDir) == 0 && result;
+  if (obExists(bindedPrefetchDir)) {
+    result = obUnmount(bindedPrefetchDir) && result;
+    result = rmdir(bindedPrefetchDir) == 0 && result;
+  }
   result = obUnmount(bindedLayersDir) && result;
-  result = rmdir(bindedLayersDir) && result;
+  result = rmdir(bindedLayersDir) == 0 && result;
   result = obUnmount(bindedOverlay) && result;
-  result = rmdir(bindedOverlay) && result;
+  result = rmdir(bindedOverlay) == 0 && result;
 
+  sdsfree(bindedPrefetchDir);
   sdsfree(bindedJobsDir);
   sdsfree(bindedLayersDir);
-  sdsfree(bindedOverlay);
   return result;
 }
 
@@ -101,19 +104,9 @@ bool obDeinitFstab(ObContext* context)
 
 bool obDeinitDurables(ObContext* context)
 {
-  bool result = true;
-  ObConfig* config = &context->config;
-  ObDurable* durable = config->durable;
-
-  while (durable != NULL) {
-    sds bindPath = sdsnew(context->root);
-    bindPath = sdscat(bindPath, durable->path);
-    result = obUnmount(bindPath) && result;
-
-    sdsfree(bindPath);
-    durable = durable->next;
+  if (context->durablePlan == NULL) {
+    return true;
   }
-
-  return result;
+  return obUndoDurablePlan(context->durablePlan);
 }
 
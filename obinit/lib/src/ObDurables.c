@@ -0,0 +1,294 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObDurables.h"
+#include "ObOsUtils.h"
+#include "ObMount.h"
+#include "ObThreadPool.h"
+#include "ob/ObSync.h"
+#include "ob/ObLogging.h"
+#include "ob/ObTrace.h"
+#include "ob/ObDefs.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+typedef struct ObDurableCopy
+{
+  const ObDurableEntry* entry;
+  bool isDir;
+  int threads; // tree copying workers
+  bool result;
+} ObDurableCopy;
+
+typedef struct ObDurableLevel
+{
+  const char** dirs;
+  int dirCount;
+  const char** files;
+  int fileCount;
+  ObDurableCopy* copies;
+  int copyCount;
+} ObDurableLevel;
+
+static int obCompareDurableEntries(const void* a, const void* b)
+{
+  return obComparePaths(((const ObDurableEntry*)a)->path,
+                        ((const ObDurableEntry*)b)->path);
+}
+
+static int obCompareDirs(const void* a, const void* b)
+{
+  return obComparePaths(*(const char* const*)a, *(const char* const*)b);
+}
+
+static bool obIsParentPath(const char* parent, const char* path)
+{
+  size_t length = strlen(parent);
+  if (strncmp(parent, path, length) != 0) {
+    return false;
+  }
+  return path[length] == '/' || (length > 0 && parent[length - 1] == '/'
+                                 && path[length] != '\0');
+}
+
+static const char* obArenaDirname(ObArena* arena, const char* path)
+{
+  char* dir = obArenaStrdup(arena, path);
+  char* slash = strrchr(dir, '/');
+  if (slash != NULL && slash != dir) {
+    *slash = '\0';
+  }
+  return dir;
+}
+
+static void obCopyDurableOrigin(ObDurableCopy* copy)
+{
+  uint64_t traceStart = obGetMonotonicNs();
+  const ObDurableEntry* entry = copy->entry;
+
+  if (copy->isDir) {
+    obLogI("Copying origin from %s", entry->bindPath);
+    ObSyncOptions syncOptions;
+    obInitSyncOptions(&syncOptions);
+    syncOptions.threads = copy->threads;
+    copy->result = obSyncTree(entry->bindPath, entry->persistentPath, &syncOptions);
+    if (!copy->result) {
+      obLogE("Copying origin directory failed: %s", entry->bindPath);
+    }
+  }
+  else {
+    obLogI("Copying original file from %s to %s", entry->bindPath, entry->persistentPath);
+    copy->result = obCopyFile(entry->bindPath, entry->persistentPath);
+    if (!copy->result) {
+      obLogE("Copying original file failed: %s", entry->bindPath);
+    }
+  }
+
+  obTraceSpan("obCopyDurableOrigin", entry->path, traceStart);
+}
+
+/**
+ * A single origin gets all the copying workers, many origins are copied
+ * side by side with a worker each
+ */
+static bool obCopyDurableOrigins(ObDurableCopy* copies, int count)
+{
+  if (count == 0) {
+    return true;
+  }
+
+  int cpuCount = obGetOnlineCpuCount();
+  ObThreadPool* pool = NULL;
+  if (count > 1) {
+    pool = obCreateThreadPool(count < cpuCount ? count : cpuCount, count);
+  }
+
+  for (int i = 0; i < count; ++i) {
+    copies[i].threads = pool != NULL ? 0 : cpuCount;
+    if (pool == NULL || !obSubmitWork(pool, (ObWorkFunction)obCopyDurableOrigin, &copies[i])) {
+      obCopyDurableOrigin(&copies[i]);
+    }
+  }
+
+  if (pool != NULL) {
+    obWaitThreadPool(pool);
+    obFreeThreadPool(&pool);
+  }
+
+  bool result = true;
+  for (int i = 0; i < count; ++i) {
+    result = copies[i].result && result;
+  }
+  return result;
+}
+
+/**
+ * Check both sides of the durable once and queue what is missing
+ */
+static void obPlanDurableLevelEntry(ObArena* arena, ObDurableLevel* level,
+                                    const ObDurableEntry* entry)
+{
+  obLogI("Preparing durable %s", entry->bindPath);
+
+  struct stat bindStat;
+  bool bindExists = stat(entry->bindPath, &bindStat) == 0;
+  bool persistentExists = obExists(entry->persistentPath);
+
+  if (!bindExists) {
+    if (entry->forceFileType) {
+      level->dirs[level->dirCount++] = obArenaDirname(arena, entry->bindPath);
+      level->files[level->fileCount++] = entry->bindPath;
+      if (!persistentExists) {
+        level->dirs[level->dirCount++] = obArenaDirname(arena, entry->persistentPath);
+        level->files[level->fileCount++] = entry->persistentPath;
+      }
+    }
+    else {
+      level->dirs[level->dirCount++] = entry->bindPath;
+      level->dirs[level->dirCount++] = entry->persistentPath;
+    }
+  }
+  else if (!persistentExists) {
+    bool isDir = S_ISDIR(bindStat.st_mode);
+    if (isDir) {
+      obLogI("Persistent directory not found, creating: %s", entry->persistentPath);
+      level->dirs[level->dirCount++] = entry->persistentPath;
+    }
+    else {
+      obLogI("This durable is not a directory");
+      level->dirs[level->dirCount++] = obArenaDirname(arena, entry->persistentPath);
+      if (!entry->copyOrigin) {
+        level->files[level->fileCount++] = entry->persistentPath;
+      }
+    }
+
+    if (entry->copyOrigin) {
+      ObDurableCopy* copy = &level->copies[level->copyCount++];
+      copy->entry = entry;
+      copy->isDir = isDir;
+    }
+  }
+}
+
+static bool obExecDurableLevel(ObArena* arena, ObDurablePlan* plan, int depth)
+{
+  ObDurableLevel level;
+  memset(&level, 0, sizeof(level));
+  level.dirs = obArenaAlloc(arena, 2 * plan->count * sizeof(const char*));
+  level.files = obArenaAlloc(arena, 2 * plan->count * sizeof(const char*));
+  level.copies = obArenaAlloc(arena, plan->count * sizeof(ObDurableCopy));
+
+  for (int i = 0; i < plan->count; ++i) {
+    if (plan->entries[i].depth == depth) {
+      obPlanDurableLevelEntry(arena, &level, &plan->entries[i]);
+    }
+  }
+
+  qsort(level.dirs, level.dirCount, sizeof(const char*), obCompareDirs);
+  bool result = obMkpaths(level.dirs, level.dirCount, OB_MKPATH_MODE);
+
+  for (int i = 0; i < level.fileCount; ++i) {
+    result = obCreateBlankFile(level.files[i]) && result;
+  }
+
+  result = obCopyDurableOrigins(level.copies, level.copyCount) && result;
+
+  for (int i = 0; i < plan->count; ++i) {
+    ObDurableEntry* entry = &plan->entries[i];
+    if (entry->depth == depth) {
+      obLogI("Binding durable: %s to %s", entry->persistentPath, entry->bindPath);
+      entry->bound = obRbind(entry->persistentPath, entry->bindPath);
+      result = entry->bound && result;
+    }
+  }
+
+  return result;
+}
+
+// --------- public API ---------- //
+
+ObDurablePlan* obPlanDurables(ObArena* arena, const ObDurable* durables,
+                              const char* root, const char* durablesPath)
+{
+  ObDurablePlan* plan = obArenaAlloc(arena, sizeof(ObDurablePlan));
+  for (const ObDurable* durable = durables; durable != NULL; durable = durable->next) {
+    plan->count += 1;
+  }
+  plan->entries = obArenaAlloc(arena, plan->count * sizeof(ObDurableEntry));
+
+  int i = 0;
+  for (const ObDurable* durable = durables; durable != NULL; durable = durable->next, ++i) {
+    char* path = obArenaStrdup(arena, durable->path);
+    size_t length = strlen(path);
+    while (length > 1 && path[length - 1] == '/') {
+      path[--length] = '\0';
+    }
+    plan->entries[i].path = path;
+    plan->entries[i].copyOrigin = durable->copyOrigin;
+    plan->entries[i].forceFileType = durable->forceFileType;
+  }
+
+  qsort(plan->entries, plan->count, sizeof(ObDurableEntry), obCompareDurableEntries);
+
+  int count = 0;
+  for (i = 0; i < plan->count; ++i) {
+    ObDurableEntry* entry = &plan->entries[i];
+    if (count > 0 && strcmp(plan->entries[count - 1].path, entry->path) == 0) {
+      obLogW("Duplicated durable %s, merging its options", entry->path);
+      plan->entries[count - 1].copyOrigin |= entry->copyOrigin;
+      plan->entries[count - 1].forceFileType |= entry->forceFileType;
+      continue;
+    }
+    plan->entries[count++] = *entry;
+  }
+  plan->count = count;
+
+  // the sorted entries keep each durable right behind its ancestors
+  int* ancestors = obArenaAlloc(arena, (count + 1) * sizeof(int));
+  int ancestorCount = 0;
+  for (i = 0; i < count; ++i) {
+    ObDurableEntry* entry = &plan->entries[i];
+    while (ancestorCount > 0
+           && !obIsParentPath(plan->entries[ancestors[ancestorCount - 1]].path, entry->path)) {
+      --ancestorCount;
+    }
+    entry->parent = ancestorCount > 0 ? ancestors[ancestorCount - 1] : -1;
+    entry->depth = ancestorCount;
+    ancestors[ancestorCount++] = i;
+
+    if (entry->depth > plan->maxDepth) {
+      plan->maxDepth = entry->depth;
+    }
+    entry->bindPath = obArenaPrintf(arena, "%s%s", root, entry->path);
+    entry->persistentPath = obArenaPrintf(arena, "%s%s", durablesPath, entry->path);
+  }
+
+  return plan;
+}
+
+bool obExecDurablePlan(ObArena* arena, ObDurablePlan* plan)
+{
+  bool result = true;
+  for (int depth = 0; plan->count > 0 && depth <= plan->maxDepth; ++depth) {
+    uint64_t traceStart = obGetMonotonicNs();
+    result = obExecDurableLevel(arena, plan, depth) && result;
+    obTraceSpan("obExecDurableLevel", NULL, traceStart);
+  }
+  return result;
+}
+
+bool obUndoDurablePlan(ObDurablePlan* plan)
+{
+  bool result = true;
+  for (int i = plan->count - 1; i >= 0; --i) {
+    ObDurableEntry* entry = &plan->entries[i];
+    if (entry->bound) {
+      result = obUnmount(entry->bindPath) && result;
+      entry->bound = false;
+    }
+  }
+  return result;
+}
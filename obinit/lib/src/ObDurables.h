@@ -0,0 +1,57 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBDURABLES_H
+#define OBDURABLES_H
+
+#include "ob/ObConfig.h"
+#include "ObArena.h"
+
+#include <stdbool.h>
+
+typedef struct ObDurableEntry
+{
+  const char* path; // without the trailing slashes
+  const char* bindPath;
+  const char* persistentPath;
+  bool copyOrigin;
+  bool forceFileType;
+  int parent; // index of the closest durable containing this one or -1
+  int depth;  // number of durables containing this one
+  bool bound;
+} ObDurableEntry;
+
+typedef struct ObDurablePlan
+{
+  ObDurableEntry* entries; // sorted with obComparePaths, parents first
+  int count;
+  int maxDepth;
+} ObDurablePlan;
+
+/**
+ * @brief Sort and deduplicate the durables (the flags of duplicates are
+ * merged) and find the nested ones. Nothing is touched on disk.
+ * The plan is allocated in the arena.
+ * @param root path the durables are bound under
+ * @param durablesPath persistent durables directory
+ */
+ObDurablePlan* obPlanDurables(ObArena* arena, const ObDurable* durables,
+                              const char* root, const char* durablesPath);
+
+/**
+ * @brief Set up the durables level by level, so that the nested durables
+ * see the directories bound before them. Each level is checked once,
+ * its missing directories are created in a batch, the origins are copied
+ * in parallel and then the durables are bound in order. A failing durable
+ * does not stop the others.
+ * @return false if any durable failed
+ */
+bool obExecDurablePlan(ObArena* arena, ObDurablePlan* plan);
+
+/**
+ * @brief Unmount the bound durables in the reverse order
+ */
+bool obUndoDurablePlan(ObDurablePlan* plan);
+
+#endif // OBDURABLES_H
@@ -0,0 +1,174 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObFlush.h"
+#include "ObOsUtils.h"
+#include "ObPaths.h"
+#include "ObTrash.h"
+#include "ob/ObSync.h"
+#include "ob/ObLogging.h"
+#include "ob/ObTrace.h"
+#include "ob/ObDefs.h"
+#include <sds.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+// one file at a time keeps the flash writes sequential
+#define FLUSH_THREADS 1
+
+static bool obSyncFilesystem(const char* path)
+{
+  int fd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  bool result = fd >= 0 && syncfs(fd) == 0;
+  if (!result) {
+    obLogE("Cannot flush the filesystem of %s: %s", path, strerror(errno));
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  return result;
+}
+
+static void obWriteFlusherPid(const char* prefix)
+{
+  sds pidPath = sdscat(sdsnew(prefix), OB_FLUSH_PID_PATH);
+  FILE* file = fopen(pidPath, "w");
+  if (file != NULL) {
+    fprintf(file, "%i\n", (int)getpid());
+    fclose(file);
+  }
+  sdsfree(pidPath);
+}
+
+/**
+ * Merge the upper layer at src onto the one at dst, entries missing
+ * in src are handled according to extraMode
+ */
+static bool obMergeUpper(const char* src, const char* dst, const char* stagingPath,
+                         ObSyncExtraMode extraMode, unsigned long long rateLimit)
+{
+  // the staged copies of an interrupted merge are not in place yet
+  if (obExists(stagingPath) && !obRemoveDirR(stagingPath)) {
+    return false;
+  }
+
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  options.threads = FLUSH_THREADS;
+  options.incremental = true;
+  options.mergeLayer = true;
+  options.extraMode = extraMode;
+  options.stagingDir = stagingPath;
+  options.rateLimit = rateLimit;
+
+  bool result = obSyncTree(src, dst, &options);
+  return obSyncFilesystem(dst) && result;
+}
+
+static void obRunUpperFlusher(const char* upperPath, const char* flushedPath,
+                              const char* stagingPath, int interval,
+                              unsigned long long rateLimit)
+{
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGUSR1);
+  sigprocmask(SIG_BLOCK, &signals, NULL);
+
+  bool last = false;
+  while (!last) {
+    struct timespec timeout = {interval, 0};
+    int received = interval > 0 ? sigtimedwait(&signals, NULL, &timeout)
+                                : sigwaitinfo(&signals, NULL);
+    if (received < 0 && errno != EAGAIN) {
+      continue;
+    }
+
+    last = received == SIGTERM || received == SIGINT;
+    obFlushUpper(upperPath, flushedPath, stagingPath, last ? 0 : rateLimit);
+    obFlushLog();
+  }
+}
+
+// --------- public API ---------- //
+
+bool obFlushUpper(const char* upperPath, const char* flushedPath,
+                  const char* stagingPath, unsigned long long rateLimit)
+{
+  uint64_t traceStart = obGetMonotonicNs();
+
+  obLogI("Flushing upper %s to %s", upperPath, flushedPath);
+  // the lowers do not change during a boot, so the upper is the whole diff
+  // and an entry created and then removed since the last flush leaves
+  // no whiteout behind
+  bool result = obMergeUpper(upperPath, flushedPath, stagingPath,
+                             OB_SYNC_DELETE_EXTRA, rateLimit);
+  if (!result) {
+    obLogE("Flushing upper %s failed", upperPath);
+  }
+
+  obTraceSpan("obFlushUpper", upperPath, traceStart);
+  return result;
+}
+
+bool obApplyFlushedUpper(const char* flushedPath, const char* persistentPath,
+                         const char* stagingPath, const char* trashDir)
+{
+  if (!obExists(flushedPath)) {
+    return true;
+  }
+
+  uint64_t traceStart = obGetMonotonicNs();
+  obLogI("Merging the flushed upper %s into %s", flushedPath, persistentPath);
+
+  // kept whole until merged, an interrupted merge is repeated on the next boot
+  bool result = obMergeUpper(flushedPath, persistentPath, stagingPath,
+                             OB_SYNC_KEEP_EXTRA, 0)
+      && obMoveToTrash(flushedPath, trashDir);
+  if (!result) {
+    obLogE("Merging the flushed upper %s failed", flushedPath);
+  }
+
+  obTraceSpan("obApplyFlushedUpper", flushedPath, traceStart);
+  return result;
+}
+
+bool obStartUpperFlusher(const ObContext* context)
+{
+  const ObConfig* config = &context->config;
+  obLogI("Starting the upper flusher (every %is)", config->flushInterval);
+
+  // the child must not write out the records buffered so far again
+  obFlushLog();
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    obLogE("Cannot start the upper flusher: %s", strerror(errno));
+    return false;
+  }
+
+  if (pid == 0) {
+    // detached grandchild reparented to init, outliving obinit
+    setsid();
+    if (fork() == 0) {
+      obInitLogger(false, true);
+      obWriteFlusherPid(config->prefix);
+      obRunUpperFlusher(obGetUpperPath(context), obGetFlushedUpperPath(context),
+                        obGetFlushStagingPath(context), config->flushInterval,
+                        config->flushRate);
+      obFlushLog();
+    }
+    _exit(0);
+  }
+
+  waitpid(pid, NULL, 0);
+  return true;
+}
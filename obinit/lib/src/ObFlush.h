@@ -0,0 +1,40 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBFLUSH_H
+#define OBFLUSH_H
+
+#include "ob/ObContext.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Merge the changed files, whiteouts and opaque directories of the
+ * tmpfs upper into the flushed upper, which is not mounted. Unchanged
+ * entries are not touched, the changed ones are built in stagingPath and
+ * moved into place after syncfs, so an interrupted flush leaves the
+ * previous version of each entry. Entries gone from the tmpfs upper are
+ * removed from the flushed upper last.
+ * @param rateLimit bytes per second, 0 for no limit
+ */
+bool obFlushUpper(const char* upperPath, const char* flushedPath,
+                  const char* stagingPath, unsigned long long rateLimit);
+
+/**
+ * @brief Merge the flushed upper of the previous boot into the persistent
+ * upper before it is mounted, then move it to trashDir. The persistent
+ * upper is never written while it is a lower layer of the overlay.
+ * @return true if there is nothing to merge or the merge succeeded
+ */
+bool obApplyFlushedUpper(const char* flushedPath, const char* persistentPath,
+                         const char* stagingPath, const char* trashDir);
+
+/**
+ * @brief Start a detached process flushing the upper of the write-back mode
+ * every flushInterval seconds, on SIGUSR1 and one last time (without the
+ * rate limit) on SIGTERM or SIGINT. Its pid is written to OB_FLUSH_PID_PATH.
+ */
+bool obStartUpperFlusher(const ObContext* context);
+
+#endif // OBFLUSH_H
@@ -7,9 +7,19 @@
 #include "ob/ObHash.h"
 #include "ObMount.h"
 #include "ObOsUtils.h"
+#include "ob/ObSync.h"
 #include "ObFstab.h"
 #include "ObPaths.h"
 #include "ObLayerCollector.h"
+#include "ObLayerFlatten.h"
+#include "ObDurables.h"
+#include "ObTrash.h"
+#include "ObFlush.h"
+#include "ObZram.h"
+#include "ObArena.h"
+#include "ob/ObLayerManifest.h"
+#include "ob/ObLayerImage.h"
+#include "ob/ObPrefetch.h"
 #include "sds.h"
 
 #include <stdlib.h>
@@ -18,51 +28,16 @@
 #include <errno.h>
 #include <sys/stat.h>
 
-typedef struct OverlayPaths
-{
-  sds workPath;
-  sds lowerPath;
-  sds upperPath;
-  sds repoPath;
-  sds layersPath;
-} OverlayPaths;
-
-static OverlayPaths newOverlayPaths(const ObContext* context)
-{
-  OverlayPaths paths;
-  paths.workPath = obGetOverlayWorkPath(context);
-
-  paths.repoPath = sdsempty();
-  paths.repoPath = sdscatfmt(paths.repoPath, ""
-                                "%s/%s", context->devMountPoint,
-                             context->config.repository);
-
-  paths.layersPath = obGetLayersPath(context);
-
-  paths.lowerPath = obGetLowerRootPath(context);
-  paths.upperPath = obGetUpperPath(context);
-  return paths;
-}
-
-static void freeOverlayPaths(OverlayPaths* paths)
-{
-  sdsfree(paths->workPath);
-  sdsfree(paths->repoPath);
-  sdsfree(paths->layersPath);
-  sdsfree(paths->lowerPath);
-  sdsfree(paths->upperPath);
-}
-
-
-static bool obPreparePersistentUpperDir(const ObContext* context, sds upperPath)
+static bool obPreparePersistentUpperDir(const ObContext* context, const char* upperPath)
 {
   obLogI("Preparing persistent upper layer dir: %s", upperPath);
   bool result = true;
   const ObConfig* config = &context->config;
 
   if (config->clearUpper) {
+    // the old upper is removed in the background, see obEmptyTrashInBackground
     obLogI("Clearing upper directory (%s)", upperPath);
-    if (!obRemoveDirR(upperPath)) {
+    if (!obMoveToTrash(upperPath, obGetTrashPath(context))) {
       obLogE("Clearing upper directory failed");
       result = false;
     }
@@ -81,57 +56,77 @@ static bool obPreparePersistentUpperDir(const ObContext* context, sds upperPath)
 }
 
 
-static bool obPrepareOverlay(const ObContext* context)
+static bool obPrepareOverlay(ObContext* context)
 {
   const ObConfig* config = &context->config;
-  if (!obMountTmpfs(context->overbootDir, config->tmpfsSize)) {
-    return false;
+  if (config->useZram) {
+    char device[OB_DEV_PATH_MAX];
+    if (!obMountZram(context->overbootDir, config->tmpfsSize,
+                     config->zramCompressor, device)) {
+      return false;
+    }
+    context->zramDevice = obArenaStrdup(context->arena, device);
   }
-
-  sds path = obGetOverlayWorkPath(context);
-  if (!obMkpath(path, OB_MKPATH_MODE)) {
-    sdsfree(path);
+  else if (!obMountTmpfs(context->overbootDir, config->tmpfsSize)) {
     return false;
   }
 
-  sdsfree(path);
-  path = obGetLowerRootPath(context);
-  if (!obMkpath(path, OB_MKPATH_MODE)) {
-    sdsfree(path);
-    return false;
+  return obMkpath(obGetOverlayWorkPath(context), OB_MKPATH_MODE)
+      && obMkpath(obGetLowerRootPath(context), OB_MKPATH_MODE)
+      && obMkpath(obGetUpperPath(context), OB_MKPATH_MODE);
+}
+
+static bool obVerifyLayers(const ObContext* context, const ObLayerItem* topLayer,
+                           const char* lowerPath)
+{
+  ObLayerVerifyLevel level = context->config.verifyLayers;
+  if (level == OB_LAYER_VERIFY_NONE) {
+    return true;
   }
 
-  sdsfree(path);
-  path = obGetUpperPath(context);
-  if (!obMkpath(path, OB_MKPATH_MODE)) {
-    sdsfree(path);
-    return false;
+  bool result = true;
+  for (const ObLayerItem* item = topLayer; item && result; item = item->prev) {
+    if (strcmp(item->layerPath, lowerPath) == 0) {
+      continue;
+    }
+
+    sds manifestPath = obGetLayerManifestPath(item->layerPath);
+    if (!obExists(manifestPath)) {
+      obLogW("Layer manifest not found (%s), skipping verification", manifestPath);
+    }
+    else if (!obVerifyLayerManifest(item->layerPath, manifestPath, level)) {
+      obLogE("Layer verification failed: %s", item->layerPath);
+      result = false;
+    }
+    sdsfree(manifestPath);
   }
 
-  sdsfree(path);
-  return true;
+  return result;
 }
 
-static bool obBindJobsDir(const ObContext* context, const char* bindedOverlay)
+static bool obMountLayerImages(const ObLayerItem* topLayer)
 {
-  sds jobsDir = obGetJobsPath(context);
-  if (!obMkpath(jobsDir, OB_MKPATH_MODE)) {
-    sdsfree(jobsDir);
-    return false;
-  }
-
-  sds bindedJobsDir = obGetBindedJobsPath(bindedOverlay);
   bool result = true;
+  for (const ObLayerItem* item = topLayer; item && result; item = item->prev) {
+    if (item->format == OB_LAYER_FORMAT_DIR) {
+      continue;
+    }
 
-  if (!obMkpath(jobsDir, OB_MKPATH_MODE)) {
-    result = false;
-  }
-  else {
-    result = obRbind(jobsDir, bindedJobsDir);
+    sds layerDir = sdsnew(item->layerPath);
+    sdsrange(layerDir, 0, -(int)strlen(OB_LAYER_ROOT_DIR) - 1);
+    result = obMountLayerImage(layerDir, item->format);
+    sdsfree(layerDir);
   }
+  return result;
+}
 
-  sdsfree(jobsDir);
-  sdsfree(bindedJobsDir);
+/**
+ * Bind the repository directory, takes bindedDir
+ */
+static bool obBindRepoDir(const char* dir, sds bindedDir)
+{
+  bool result = obMkpath(dir, OB_MKPATH_MODE) && obRbind(dir, bindedDir);
+  sdsfree(bindedDir);
   return result;
 }
 
@@ -179,29 +174,14 @@ bool obInitOverbootDir(ObContext* context)
     return false;
   }
 
-  bool result = true;
-  sds upperPath = obGetUpperPath(context);
-
-  if (!config->useTmpfs && !obPreparePersistentUpperDir(context, upperPath)) {
-    result = false;
-  }
-
-  sdsfree(upperPath);
-  return result;
+  return config->useTmpfs
+      || obPreparePersistentUpperDir(context, obGetUpperPath(context));
 }
 
 
 bool obInitLowerRoot(ObContext* context)
 {
-  bool result = true;
-  sds lowerPath = obGetLowerRootPath(context);
-
-  if (!obMove(context->root, lowerPath)) {
-    result = false;
-  }
-
-  sdsfree(lowerPath);
-  return result;
+  return obMove(context->root, obGetLowerRootPath(context));
 }
 
 
@@ -209,40 +189,56 @@ bool obInitOverlayfs(ObContext* context)
 {
   bool result = true;
   ObConfig* config = &context->config;
+  const char* layersPath = obGetLayersPath(context);
+  const char* lowerPath = obGetLowerRootPath(context);
 
-  OverlayPaths paths = newOverlayPaths(context);
-
-  uint8_t count = 0;
-  ObLayerItem* topLayer = obCollectLayers(paths.layersPath, config->headLayer,
-                                          paths.lowerPath, &count);
+  ObLayerIndex* index = obLoadLayerIndex(layersPath, obGetLayerIndexPath(context));
+  int count = 0;
+  ObLayerItem* topLayer = obCollectLayers(context->arena, index, config->headLayer,
+                                          lowerPath, &count);
+  obSaveLayerIndex(index);
+  obFreeLayerIndex(&index);
 
   if (!topLayer) {
-    freeOverlayPaths(&paths);
     return false;
   }
 
+  if (!obMountLayerImages(topLayer)
+      || !obVerifyLayers(context, topLayer, lowerPath)) {
+    obUnmountLayerImages(layersPath);
+    return false;
+  }
+
+  if (config->flattenLayers) {
+    topLayer = obUseFlatLayer(context->arena, topLayer, lowerPath, &count);
+  }
+
   if (count == 0) {
-    topLayer = calloc(1, sizeof(ObLayerItem));
-    strcpy(topLayer->layerPath, paths.lowerPath);
-    topLayer->prev = NULL;
+    topLayer = obAddLayerItem(context->arena, lowerPath, NULL);
     count = 1;
   }
 
-  if (config->useTmpfs && config->upperAsLower) {
-    ObLayerItem* extraLayer = calloc(1, sizeof(ObLayerItem));
-    sds persistentUpperPath = obGetPersistentUpperPath(context);
-    strcpy(extraLayer->layerPath, persistentUpperPath);
-    sdsfree(persistentUpperPath);
-    extraLayer->prev = topLayer;
-    topLayer = extraLayer;
+  // the write-back mode keeps the flushed changes in the persistent upper
+  if (config->useTmpfs && (config->upperAsLower || config->writeBack)) {
+    const char* persistentUpper = obGetPersistentUpperPath(context);
+    if (!obExists(persistentUpper)) {
+      obMkpath(persistentUpper, OB_MKPATH_MODE);
+    }
+    // the flusher never writes to a lower layer of the mounted overlay
+    if (config->writeBack
+        && !obApplyFlushedUpper(obGetFlushedUpperPath(context), persistentUpper,
+                                obGetFlushStagingPath(context), obGetTrashPath(context))) {
+      result = false;
+    }
+    topLayer = obAddLayerItem(context->arena, persistentUpper, topLayer);
     count += 1;
   }
 
-  char* layers[count];
+  const char** layers = obArenaAlloc(context->arena, count * sizeof(char*));
 
   obLogI("Collected layers:");
   ObLayerItem* layerItem = topLayer;
-  uint8_t i = 0;
+  int i = 0;
 
   while (layerItem) {
     layers[count - i - 1] = layerItem->layerPath;
@@ -251,21 +247,18 @@ bool obInitOverlayfs(ObContext* context)
     layerItem = layerItem->prev;
   }
 
-  if (!obMountOverlay(layers, count, paths.upperPath,
-                      paths.workPath, context->root)) {
+  context->layers = layers;
+  context->layerCount = count;
+
+  if (!obMountOverlay(layers, count, obGetUpperPath(context),
+                      obGetOverlayWorkPath(context), context->root)) {
     obLogE("Cannot mount overlay");
+    obUnmountLayerImages(layersPath);
     result = false;
   }
 
   if (context->deviceType == OB_DEV_BLK) {
-    obRemountRo(paths.lowerPath, NULL);
-  }
-
-  layerItem = topLayer;
-  while (layerItem) {
-    ObLayerItem* currentItem = layerItem;
-    layerItem = layerItem->prev;
-    free(currentItem);
+    obRemountRo(lowerPath, NULL);
   }
 
   if (context->deviceType == OB_DEV_DIR
@@ -276,8 +269,6 @@ bool obInitOverlayfs(ObContext* context)
   //TODO: block image by whiteout?
 
   chmod(context->root, OB_ROOT_MODE); //TODO: move to mount?
-
-  freeOverlayPaths(&paths);
   return result;
 }
 
@@ -287,19 +278,14 @@ bool obInitManagementBindings(ObContext* context)
   bool result = true;
   ObConfig* config = &context->config;
 
-  sds bindedOverlay = obGetBindedOverlayPath(context);
+  const char* bindedOverlay = obGetBindedOverlayPath(context);
 
   if (!obRbind(context->overbootDir, bindedOverlay)) {
-    sdsfree(bindedOverlay);
     return false;
   }
 
   if (config->bindLayers) {
-    sds repoPath = obGetRepoPath(context);
-
-    sds layersDir = sdsnew(repoPath);
-    layersDir = sdscat(layersDir, "/layers");
-
+    const char* layersDir = obGetLayersPath(context);
     sds bindedLayersDir = obGetBindedLayersPath(bindedOverlay);
 
     obMkpath(layersDir, OB_MKPATH_MODE);
@@ -308,25 +294,20 @@ bool obInitManagementBindings(ObContext* context)
       result = false;
     }
 
-    sdsfree(repoPath);
-    sdsfree(layersDir);
     sdsfree(bindedLayersDir);
   }
 
-  if (result && !config->useTmpfs) {
-    sds upper = obGetUpperPath(context);
-    sds bindedUpper = obGetBindedUpperPath(context);
-    if (!obRbind(upper, bindedUpper)) {
-      result = false;
-    }
-    sdsfree(upper);
-    sdsfree(bindedUpper);
+  if (result && !config->useTmpfs
+      && !obRbind(obGetUpperPath(context), obGetBindedUpperPath(context))) {
+    result = false;
   }
 
-  result = result && obBindJobsDir(context, bindedOverlay);
+  if (result && config->prefetch
+      && !obBindRepoDir(obGetPrefetchPath(context), obGetBindedPrefetchPath(bindedOverlay))) {
+    result = false;
+  }
 
-  sdsfree(bindedOverlay);
-  return result;
+  return result && obBindRepoDir(obGetJobsPath(context), obGetBindedJobsPath(bindedOverlay));
 }
 
 
@@ -343,69 +324,31 @@ bool obInitFstab(ObContext* context)
 
 bool obInitDurables(ObContext* context)
 {
-  bool result = true;
-  ObConfig* config = &context->config;
-  ObDurable* durable = config->durable;
-  sds repoPath = obGetRepoPath(context);
-
-  while (durable != NULL && result == true) {
-
-    sds persistentPath = sdsempty();
-    persistentPath = sdscatprintf(persistentPath, "%s/%s%s", repoPath, OB_DURABLES_DIR_NAME, durable->path);
-
-    sds bindPath = sdsnew(context->root);
-    bindPath = sdscat(bindPath, durable->path);
-    obLogI("Preparing durable %s", bindPath);
+  context->durablePlan = obPlanDurables(context->arena, context->config.durable,
+                                        context->root, obGetDurablesPath(context));
+  return obExecDurablePlan(context->arena, context->durablePlan);
+}
 
-    if (!obExists(bindPath)) {
-      if (durable->forceFileType) {
-        obCreateBlankFile(bindPath);
-        obCreateBlankFile(persistentPath);
-      }
-      else {
-        obMkpath(bindPath, OB_MKPATH_MODE);
-        obMkpath(persistentPath, OB_MKPATH_MODE);
-      }
-    }
-    else {
-      bool isDir = obIsDirectory(bindPath);
-      if (isDir && !obExists(persistentPath)) {
-        obLogI("Persistent directory not found, creating: %s", persistentPath);
-        obLogI("is dir: %i", obIsDirectory(persistentPath));
-        obMkpath(persistentPath, OB_MKPATH_MODE);
-        obLogI("is dir: %i", obIsDirectory(persistentPath));
-
-        if (durable->copyOrigin) {
-          obLogI("Copying origin from %s", bindPath);
-          obSync(bindPath, persistentPath);
-        }
-      }
-      else if (!isDir && !obExists(persistentPath)) {
-        obLogI("This durable is not a directory");
-        if (durable->copyOrigin) {
-          obLogI("Copying original file from %s to %s", bindPath, persistentPath);
-          if (!obCopyFile(bindPath, persistentPath)) {
-            obLogE("Copying originl file failed");
-          }
-        }
-        else {
-          obCreateBlankFile(persistentPath);
-        }
-      }
-    }
 
-    obLogI("Binding durable: %s to %s", persistentPath, bindPath);
-    if (!obRbind(persistentPath, bindPath)) {
-      result = false;
-    }
-    durable = durable->next;
+bool obInitPrefetch(ObContext* context)
+{
+  const char* listPath = obGetPrefetchListPath(context);
+  obRemoveStalePrefetchLists(obGetPrefetchPath(context), listPath);
+  if (!obExists(listPath)) {
+    obLogI("No prefetch list recorded for the head layer yet");
+    return true;
+  }
 
-    sdsfree(persistentPath);
-    sdsfree(bindPath);
+  // the upper and the layers from the top, the way overlayfs looks them up
+  const char** layers = obArenaAlloc(context->arena, (context->layerCount + 1) * sizeof(char*));
+  layers[0] = obGetUpperPath(context);
+  for (int i = 0; i < context->layerCount; ++i) {
+    layers[i + 1] = context->layers[context->layerCount - i - 1];
   }
 
-  sdsfree(repoPath);
-  return result;
+  // a failed prefetch only costs the boot time
+  obPrefetchFiles(listPath, layers, context->layerCount + 1);
+  return true;
 }
 
 
@@ -415,34 +358,43 @@ bool obInitLock(ObContext* context)
     return true;
   }
 
-  uint64_t currentConfigHash = obCalcualateFileHash(context->config.configPath);
+  ObHash currentConfigHash;
+  if (!obHashFile(context->config.configPath, OB_HASH_XXH3_128, &currentConfigHash)) {
+    return false;
+  }
 
-  sds lockPath = obGetLockFilePath(context);
+  char oldStr[OB_HASH_STR_MAX];
+  char currentStr[OB_HASH_STR_MAX];
+  const char* lockPath = obGetLockFilePath(context);
+  ObHash oldConfigHash;
   if (obExists(lockPath)) {
     obLogW("Lock file found in %s", lockPath);
-    uint64_t oldConfigHash = obReadHashValue(lockPath);
-    obLogI("Comparing old config (%" PRIx64 ") with current config (%" PRIx64 ")",
-           oldConfigHash, currentConfigHash);
-    if (oldConfigHash == currentConfigHash) {
-      obLogW("Locked config hasn't changed, aborting due to enabled safe mode");
-      sdsfree(lockPath);
-      return false;
+    if (obReadHash(lockPath, &oldConfigHash)) {
+      // older lock files keep their digest type
+      ObHash comparedHash = currentConfigHash;
+      if (oldConfigHash.type != comparedHash.type
+          && !obHashFile(context->config.configPath, oldConfigHash.type, &comparedHash)) {
+        return false;
+      }
+      obLogI("Comparing old config (%s) with current config (%s)",
+             obHashToStr(&oldConfigHash, oldStr), obHashToStr(&comparedHash, currentStr));
+      if (obHashEqual(&oldConfigHash, &comparedHash)) {
+        obLogW("Locked config hasn't changed, aborting due to enabled safe mode");
+        return false;
+      }
     }
   }
 
-  bool result = obWriteAsHexStr(currentConfigHash, lockPath);
-  sdsfree(lockPath);
-  return result;
+  return obWriteHash(&currentConfigHash, lockPath);
 }
 
 bool obUnsetLock(ObContext* context)
 {
-  sds lockPath = obGetLockFilePath(context);
+  const char* lockPath = obGetLockFilePath(context);
   bool result = true;
   if (obExists(lockPath) && !obRemovePath(lockPath)) {
     obLogE("Cannot remove lock file: %s", lockPath);
     result = false;
   }
-  sdsfree(lockPath);
   return result;
 }
@@ -6,74 +6,151 @@
 
 #include "ObTaskList.h"
 #include "ObDeinit.h"
+#include "ObCopy.h"
+#include "ObTrash.h"
+#include "ObFlush.h"
+#include "ObPaths.h"
+#include "ObOsUtils.h"
 #include "ob/ObInit.h"
 #include "ob/ObLogging.h"
 #include "ob/ObJobs.h"
+#include "ob/ObPrefetch.h"
+#include "ob/ObTrace.h"
 #include <stdlib.h>
+#include <string.h>
 
 static bool checkRollback(ObContext* context)
 {
   return !context->config.rollback;
 }
 
+/**
+ * Whether one of the paths is the other one or lies inside it
+ */
+static bool obPathsOverlap(const char* a, const char* b)
+{
+  size_t aLen = strlen(a);
+  size_t bLen = strlen(b);
+  size_t len = aLen < bLen ? aLen : bLen;
+  if (strncmp(a, b, len) != 0) {
+    return false;
+  }
+  const char* longer = aLen < bLen ? b : a;
+  return aLen == bLen || longer[len] == '/' || (len > 0 && longer[len - 1] == '/');
+}
+
+/**
+ * All the durables are set up by a single task after the overlay is mounted
+ * (see obExecDurablePlan), also after the fstab and the bindings path if any
+ * durable overlaps them
+ */
+static void addDurablesTask(ObTaskListPtr tasks, ObContext* context, ObTaskPtr overlayTask,
+                            ObTaskPtr bindingsTask, ObTaskPtr fstabTask)
+{
+  if (context->config.durable == NULL) {
+    return;
+  }
+
+  ObTaskPtr task = obCreateTask((ObTaskFunction)obInitDurables,
+                                (ObTaskFunction)obDeinitDurables,
+                                context);
+  task->name = "obInitDurables";
+  obAddTaskDependency(task, overlayTask);
+
+  for (ObDurable* durable = context->config.durable; durable; durable = durable->next) {
+    if (obPathsOverlap(durable->path, OB_USER_BINDINGS_DIR)) {
+      obAddTaskDependency(task, bindingsTask);
+      break;
+    }
+  }
+  for (ObDurable* durable = context->config.durable; durable; durable = durable->next) {
+    if (obPathsOverlap(durable->path, OB_FSTAB_PATH)) {
+      obAddTaskDependency(task, fstabTask);
+      break;
+    }
+  }
+  obAppendTask(tasks, task);
+}
+
 static ObTaskListPtr createObInitTaskList(ObContext* context)
 {
   ObTaskPtr task = NULL;
   ObTaskListPtr tasks = obCreateTaskList();
+  tasks->threads = OB_INIT_TASK_THREADS;
 
   task = obCreateTask((ObTaskFunction)obInitPersistentDevice,
                       (ObTaskFunction)obDeinitPersistentDevice,
                       context);
+  task->name = "obInitPersistentDevice";
   obAppendTask(tasks, task);
 
   task = obCreateTask((ObTaskFunction)obInitLock,
                       NULL,
                       context);
+  task->name = "obInitLock";
   obAppendTask(tasks, task);
 
   task = obCreateTask((ObTaskFunction)obExecPreInitJobs,
                       NULL,
                       context);
+  task->name = "obExecPreInitJobs";
   obAppendTask(tasks, task);
 
   task = obCreateTask((ObTaskFunction)obInitOverbootDir,
                       (ObTaskFunction)obDeinitOverbootDir,
                       context);
+  task->name = "obInitOverbootDir";
   obAppendTask(tasks, task);
 
   task = obCreateTask((ObTaskFunction)obInitLowerRoot,
                       (ObTaskFunction)obDeinitLowerRoot,
                       context);
+  task->name = "obInitLowerRoot";
   obAppendTask(tasks, task);
 
-  task = obCreateTask((ObTaskFunction)obInitOverlayfs,
-                      (ObTaskFunction)obDeinitOverlayfs,
-                      context);
-  obAppendTask(tasks, task);
-
-  task = obCreateTask((ObTaskFunction)obInitManagementBindings,
-                      (ObTaskFunction)obDeinitManagementBindings,
-                      context);
-  obAppendTask(tasks, task);
-
-  task = obCreateTask((ObTaskFunction)obInitFstab,
-                      (ObTaskFunction)obDeinitFstab,
-                      context);
-  obAppendTask(tasks, task);
-
-  task = obCreateTask((ObTaskFunction)obInitDurables,
-                      (ObTaskFunction)obDeinitDurables,
-                      context);
-  obAppendTask(tasks, task);
+  ObTaskPtr overlayTask = obCreateTask((ObTaskFunction)obInitOverlayfs,
+                                       (ObTaskFunction)obDeinitOverlayfs,
+                                       context);
+  overlayTask->name = "obInitOverlayfs";
+  obAppendTask(tasks, overlayTask);
+
+  // independent once the overlay is mounted
+  ObTaskPtr bindingsTask = obCreateTask((ObTaskFunction)obInitManagementBindings,
+                                        (ObTaskFunction)obDeinitManagementBindings,
+                                        context);
+  bindingsTask->name = "obInitManagementBindings";
+  obAddTaskDependency(bindingsTask, overlayTask);
+  obAppendTask(tasks, bindingsTask);
+
+  ObTaskPtr fstabTask = obCreateTask((ObTaskFunction)obInitFstab,
+                                     (ObTaskFunction)obDeinitFstab,
+                                     context);
+  fstabTask->name = "obInitFstab";
+  obAddTaskDependency(fstabTask, overlayTask);
+  obAppendTask(tasks, fstabTask);
+
+  addDurablesTask(tasks, context, overlayTask, bindingsTask, fstabTask);
+
+  if (context->config.prefetch) {
+    task = obCreateTask((ObTaskFunction)obInitPrefetch,
+                        NULL,
+                        context);
+    task->name = "obInitPrefetch";
+    obAddTaskDependency(task, overlayTask);
+    obAppendTask(tasks, task);
+  }
 
+  // waits for all the tasks above
   task = obCreateTask((ObTaskFunction)checkRollback,
                       NULL,
                       context);
+  task->name = "checkRollback";
   obAppendTask(tasks, task);
 
   task = obCreateTask((ObTaskFunction)obUnsetLock,
                       NULL,
                       context);
+  task->name = "obUnsetLock";
 
   obAppendTask(tasks, task);
 
@@ -84,15 +161,33 @@ static ObTaskListPtr createObInitTaskList(ObContext* context)
 
 bool obExecObInitTasks(ObContext* context)
 {
+  obResolveContextPaths(context);
+
+  uint64_t traceStart = obGetMonotonicNs();
   ObTaskListPtr tasks = createObInitTaskList(context);
   obLogI("Executing obinit tasks");
   bool result = obExecTaskList(tasks);
+  obTraceSpan("obExecObInitTasks", NULL, traceStart);
 
   if (result && obErrorOccurred()) {
     obLogE("An error occurred during initialization, please see full log for more details");
     result = false;
-    obCallUndoChain(tasks->last);
+    if (!obCallUndoChain(tasks->lastCompleted)) {
+      obLogE("Some of the initialization steps could not be undone");
+    }
+  }
+
+  if (result) {
+    obEmptyTrashInBackground(obGetTrashPath(context));
   }
+  if (result && context->config.writeBack) {
+    obStartUpperFlusher(context);
+  }
+  if (result && context->config.prefetch && !obExists(obGetPrefetchListPath(context))) {
+    obStartPrefetchRecorder(context);
+  }
+
+  obLogCopyStats();
 
   obFreeTaskList(&tasks);
   return result;
@@ -7,6 +7,13 @@
 #include "ObPaths.h"
 #include "ObOsUtils.h"
 #include "ObMount.h"
+#include "ObLayerIndex.h"
+#include "ObLayerSquash.h"
+#include "ObLayerCollector.h"
+#include "ObLayerFlatten.h"
+#include "ObYamlParser.h"
+#include "ob/ObLayerManifest.h"
+#include "ob/ObLayerImage.h"
 
 #include "ObYamlLayerReader.h"
 
@@ -16,6 +23,7 @@
 #include <unistd.h>
 
 #define JOB_COMMIT_NAME "commit"
+#define JOB_SQUASH_NAME "squash"
 #define JOB_UPDATE_CONFIG_NAME "update-config"
 #define JOB_INSTALL_CONFIG_PREFIX "install-config"
 
@@ -106,6 +114,54 @@ static bool obExecInstallConfigJob(ObContext* context, const char* jobsDir)
   return result;
 }
 
+/**
+ * Build the flat directory of the layerName chain unless it is up to date
+ */
+static bool obFlattenLayer(ObContext* context, const char* layerName)
+{
+  if (!context->config.flattenLayers) {
+    return true;
+  }
+
+  const char* lowerPath = obGetLowerRootPath(context);
+  ObLayerIndex* index = obLoadLayerIndex(obGetLayersPath(context),
+                                         obGetLayerIndexPath(context));
+  int count = 0;
+  ObLayerItem* topLayer = obCollectLayers(context->arena, index, layerName,
+                                          lowerPath, &count);
+  obSaveLayerIndex(index);
+  obFreeLayerIndex(&index);
+
+  bool result = true;
+  bool errorOccurred = obErrorOccurred();
+  if (topLayer != NULL && obIsLayerFlattenNeeded(topLayer, lowerPath)) {
+    obRemountRw(context->root, NULL);
+    result = obFlattenLayerChain(topLayer, lowerPath);
+  }
+
+  // the layers are mounted one by one without it, the boot goes on
+  if (!result && !errorOccurred) {
+    clearErrorOccurrence();
+  }
+  return result;
+}
+
+static bool obFlattenHeadLayer(ObContext* context)
+{
+  // only the head keeps its flat directory
+  const char* layersPath = obGetLayersPath(context);
+  const char* keepLayer = context->config.flattenLayers ? context->config.headLayer : NULL;
+  if (obHasStaleFlatLayers(layersPath, keepLayer)) {
+    obRemountRw(context->root, NULL);
+    obRemoveStaleFlatLayers(layersPath, keepLayer);
+  }
+
+  if (!obFlattenLayer(context, context->config.headLayer)) {
+    obLogW("Layer %s is used without a flat directory", context->config.headLayer);
+  }
+  return true;
+}
+
 //TODO: move?
 static bool commitUpperLayer(ObContext* context, const char* jobPath)
 {
@@ -118,9 +174,8 @@ static bool commitUpperLayer(ObContext* context, const char* jobPath)
   }
 
   bool result = true;
-  sds upperPath = obGetUpperPath(context);
-  sds newLayerPath = obGetLayersPath(context);
-  newLayerPath = sdscatfmt(newLayerPath, "/%s.obld", info.name);
+  const char* upperPath = obGetUpperPath(context);
+  sds newLayerPath = sdscatfmt(sdsempty(), "%s/%s.obld", obGetLayersPath(context), info.name);
 
   if (obExists(newLayerPath)) {
     obLogE("Layer named %s already exists in %s", info.name, newLayerPath);
@@ -136,18 +191,116 @@ static bool commitUpperLayer(ObContext* context, const char* jobPath)
     result = result && obCopyFile(jobPath, path);
     sdsfree(path);
 
+    if (result) {
+      sds rootPath = sdscat(sdsdup(newLayerPath), OB_LAYER_ROOT_DIR);
+      sds manifestPath = obGetLayerManifestPath(rootPath);
+      if (!obWriteLayerManifest(rootPath, manifestPath)) {
+        obLogW("Layer %s committed without a manifest, it cannot be verified", info.name);
+      }
+      if (!obPackLayerImage(newLayerPath, info.format)) {
+        obLogW("Layer %s committed as a directory", info.name);
+      }
+      sdsfree(rootPath);
+      sdsfree(manifestPath);
+    }
+
     if (result) {
       obMkpath(upperPath, OB_MKPATH_MODE);
+
+      obInvalidateLayerIndex(obGetLayerIndexPath(context));
+      if (!obFlattenLayer(context, info.name)) {
+        obLogW("Layer %s committed without a flat directory", info.name);
+      }
     }
   }
 
-  sdsfree(upperPath);
   sdsfree(newLayerPath);
   return result;
 }
 
 
 
+typedef struct ObSquashJob
+{
+  ObLayerInfo info;
+  char top[OB_NAME_MAX];
+  char bottom[OB_NAME_MAX];
+} ObSquashJob;
+
+static void onSquashJobValue(ObSquashJob* job, const char* itemPath, const char* value)
+{
+  if (strcmp(itemPath, ".name") == 0) {
+    strcpy(job->info.name, value);
+  }
+  else if (strcmp(itemPath, ".author") == 0) {
+    strcpy(job->info.author, value);
+  }
+  else if (strcmp(itemPath, ".create_ts") == 0) {
+    strcpy(job->info.createTs, value);
+  }
+  else if (strcmp(itemPath, ".description") == 0) {
+    strcpy(job->info.description, value);
+  }
+  else if (strcmp(itemPath, ".format") == 0) {
+    job->info.format = obParseLayerFormat(value);
+  }
+  else if (strcmp(itemPath, ".top") == 0) {
+    strcpy(job->top, value);
+  }
+  else if (strcmp(itemPath, ".bottom") == 0) {
+    strcpy(job->bottom, value);
+  }
+}
+
+static bool squashLayers(ObContext* context, const char* jobPath)
+{
+  ObSquashJob job;
+  memset(&job, 0, sizeof(ObSquashJob));
+  job.info.format = OB_LAYER_FORMAT_UNSET;
+  if (!obParseYamlFile(&job, jobPath, (ObYamlValueCallback)&onSquashJobValue, NULL)) {
+    obLogE("Cannot parse the squash job, aborting");
+    return false;
+  }
+
+  const char* top = strlen(job.top) > 0 ? job.top : context->config.headLayer;
+  return obSquashLayers(obGetLayersPath(context), obGetLayerIndexPath(context), top,
+                        job.bottom, &job.info, context->config.headLayer);
+}
+
+static bool obExecSquashJob(ObContext* context, const char* jobsDir)
+{
+  bool result = true;
+  sds jobPath = sdsnew(jobsDir);
+  jobPath = sdscatfmt(jobPath, "/%s", JOB_SQUASH_NAME);
+
+  if (obExists(jobPath)) {
+    obLogI("Squash job found in: %s", jobPath);
+    result = squashLayers(context, jobPath) && obRemovePath(jobPath);
+  }
+
+  sdsfree(jobPath);
+  return result;
+}
+
+static bool obLimitHeadDepth(ObContext* context)
+{
+  int maxDepth = context->config.maxLayerDepth;
+  if (maxDepth < 1) {
+    return true;
+  }
+
+  bool result = true;
+  const char* layersPath = obGetLayersPath(context);
+  const char* indexPath = obGetLayerIndexPath(context);
+  const char* head = context->config.headLayer;
+
+  if (obGetLayerDepth(layersPath, indexPath, head) > maxDepth) {
+    obRemountRw(context->root, NULL);
+    result = obLimitLayerDepth(layersPath, indexPath, head, maxDepth);
+  }
+  return result;
+}
+
 static bool obExecCommitJob(ObContext* context, const char* jobsDir)
 {
   bool result = true;
@@ -175,17 +328,15 @@ bool obExecPreInitJobs(ObContext* context)
 {
 
   obLogI("Looking for pre-init jobs to be executed");
-  sds jobsDir = obGetJobsPath(context);
+  const char* jobsDir = obGetJobsPath(context);
 
   if (!obExists(jobsDir)) {
-    bool result = obMkpath(jobsDir, OB_MKPATH_MODE);
-    sdsfree(jobsDir);
-    return result;
+    return obMkpath(jobsDir, OB_MKPATH_MODE) && obLimitHeadDepth(context)
+        && obFlattenHeadLayer(context);
   }
 
   if (obIsDirectoryEmpty(jobsDir)) {
-    sdsfree(jobsDir);
-    return true;
+    return obLimitHeadDepth(context) && obFlattenHeadLayer(context);
   }
   obRemountRw(context->root, NULL);
 
@@ -202,6 +353,9 @@ bool obExecPreInitJobs(ObContext* context)
     }
   }
 
-  sdsfree(jobsDir);
+  // after the config reload, so a switched head does not keep the old layers
+  result = result && obExecSquashJob(context, jobsDir)
+           && obLimitHeadDepth(context)
+           && obFlattenHeadLayer(context);
   return result;
 }
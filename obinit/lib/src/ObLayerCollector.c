@@ -4,7 +4,6 @@
 
 #include "ObLayerCollector.h"
 #include "ObLayerInfo.h"
-#include "ObYamlLayerReader.h"
 
 #include <string.h>
 #include <stdlib.h>
@@ -25,24 +24,32 @@ static bool isEndLayer(const char* layerName)
 // --------- public API ---------- //
 
 
-ObLayerItem* obCollectLayers(const char* layersDir, const char* layerName,
-                             const char* lowerPath, uint8_t* count)
+ObLayerItem* obCollectLayers(ObArena* arena, ObLayerIndex* index, const char* layerName,
+                             const char* lowerPath, int* count)
 {
   ObLayerItem* item = NULL;
 
   if (isRootLayer(layerName)) {
-    item = calloc(1, sizeof(ObLayerItem));
-    strcpy(item->layerPath, lowerPath);
+    item = obAddLayerItem(arena, lowerPath, NULL);
     *count += 1;
   }
   else if (!isEndLayer(layerName)) {
     ObLayerInfo info;
-    if (obLoadLayerInfo(layersDir, layerName, &info)) {
-      item = calloc(1, sizeof(ObLayerItem));
-      strcpy(item->layerPath, info.rootPath);
-      item->prev = obCollectLayers(layersDir, info.underlayer, lowerPath, count);
+    if (obFindIndexedLayer(index, layerName, &info)) {
+      ObLayerItem* prev = obCollectLayers(arena, index, info.underlayer, lowerPath, count);
+      item = obAddLayerItem(arena, info.rootPath, prev);
+      item->format = info.format;
       *count += 1;
     }
   }
   return item;
 }
+
+ObLayerItem* obAddLayerItem(ObArena* arena, const char* layerPath, ObLayerItem* prev)
+{
+  ObLayerItem* item = obArenaAlloc(arena, sizeof(ObLayerItem));
+  item->layerPath = obArenaIntern(arena, layerPath);
+  item->format = OB_LAYER_FORMAT_DIR;
+  item->prev = prev;
+  return item;
+}
@@ -6,17 +6,30 @@
 #define OBLAYERCOLLECTOR_H
 
 #include "ob/ObDefs.h"
+#include "ObLayerIndex.h"
+#include "ObArena.h"
+#include "ob/ObLayerImage.h"
 #include <inttypes.h>
 
 struct ObLayerItem;
 typedef struct ObLayerItem
 {
-  char layerPath[OB_PATH_MAX];
+  const char* layerPath;
+  ObLayerFormat format; // images are mounted on layerPath
   struct ObLayerItem* prev;
 } ObLayerItem;
 
-ObLayerItem* obCollectLayers(const char* layersDir, const char* layerName,
-                             const char* lowerPath, uint8_t* count);
+/**
+ * @brief Resolve the layer chain from layerName down to the root layer
+ * using the layer index. The items are allocated in the arena.
+ */
+ObLayerItem* obCollectLayers(ObArena* arena, ObLayerIndex* index, const char* layerName,
+                             const char* lowerPath, int* count);
+
+/**
+ * @brief Create a chain item in the arena on top of prev
+ */
+ObLayerItem* obAddLayerItem(ObArena* arena, const char* layerPath, ObLayerItem* prev);
 
 
 #endif // OBLAYERCOLLECTOR_H
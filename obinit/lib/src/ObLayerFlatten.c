@@ -0,0 +1,314 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObLayerFlatten.h"
+#include "ObOsUtils.h"
+#include "ObPaths.h"
+#include "ob/ObSync.h"
+#include "ob/ObLogging.h"
+#include "ob/ObTrace.h"
+#include "ob/ObDefs.h"
+#include <sds.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+#define FLATTEN_TMP_EXT ".tmp"
+#define FLATTEN_READ_CHUNK 4096
+
+typedef struct ObFlatChain
+{
+  const ObLayerItem** items; // top first, without the root filesystem
+  int count;
+  bool rootBelow;
+  sds index; // the layer root inodes and paths, top first
+  sds flatPath;
+  sds indexPath;
+} ObFlatChain;
+
+static void obFreeFlatChain(ObFlatChain* chain)
+{
+  free(chain->items);
+  sdsfree(chain->index);
+  sdsfree(chain->flatPath);
+  sdsfree(chain->indexPath);
+  memset(chain, 0, sizeof(ObFlatChain));
+}
+
+/**
+ * Describe the chain, hardlinks can only be made within a single filesystem
+ * and images are mounted read-only for the boot only
+ */
+static bool obPlanFlatChain(const ObLayerItem* topLayer, const char* lowerPath,
+                            ObFlatChain* chain)
+{
+  memset(chain, 0, sizeof(ObFlatChain));
+  chain->index = sdsempty();
+
+  int capacity = 0;
+  for (const ObLayerItem* item = topLayer; item != NULL; item = item->prev) {
+    capacity += 1;
+  }
+  chain->items = malloc(capacity * sizeof(ObLayerItem*));
+
+  bool result = true;
+  dev_t topDev = 0;
+  for (const ObLayerItem* item = topLayer; item != NULL && result; item = item->prev) {
+    struct stat st;
+    if (strcmp(item->layerPath, lowerPath) == 0) {
+      chain->rootBelow = true;
+    }
+    else if (item->format != OB_LAYER_FORMAT_DIR) {
+      obLogI("Layer %s is an image, the chain is not flattened", item->layerPath);
+      result = false;
+    }
+    else if (stat(item->layerPath, &st) != 0) {
+      obLogI("Cannot stat layer %s: %s", item->layerPath, strerror(errno));
+      result = false;
+    }
+    else if (chain->count > 0 && st.st_dev != topDev) {
+      obLogI("Layer %s is on another filesystem, the chain is not flattened",
+             item->layerPath);
+      result = false;
+    }
+    else {
+      topDev = chain->count == 0 ? st.st_dev : topDev;
+      chain->items[chain->count++] = item;
+      chain->index = sdscatprintf(chain->index, "%llu %s\n",
+                                  (unsigned long long)st.st_ino, item->layerPath);
+    }
+  }
+
+  // a single layer is mounted as it is
+  if (!result || chain->count < 2) {
+    obFreeFlatChain(chain);
+    return false;
+  }
+
+  chain->index = sdscat(chain->index, chain->rootBelow ? OB_UNDERLAYER_ROOT "\n"
+                                                       : OB_UNDERLAYER_NONE "\n");
+  chain->flatPath = obGetLayerFlatPath(topLayer->layerPath);
+  chain->indexPath = obGetLayerFlatIndexPath(topLayer->layerPath);
+  return true;
+}
+
+static bool obIsFlatChainValid(const ObFlatChain* chain)
+{
+  if (!obIsDirectory(chain->flatPath)) {
+    return false;
+  }
+
+  FILE* file = fopen(chain->indexPath, "r");
+  if (file == NULL) {
+    return false;
+  }
+
+  sds content = sdsempty();
+  char buffer[FLATTEN_READ_CHUNK];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    content = sdscatlen(content, buffer, size);
+  }
+  fclose(file);
+
+  bool result = sdscmp(content, chain->index) == 0;
+  sdsfree(content);
+  return result;
+}
+
+static bool obWriteFlatIndex(const ObFlatChain* chain)
+{
+  sds tmpPath = sdscat(sdsdup(chain->indexPath), FLATTEN_TMP_EXT);
+  size_t size = sdslen(chain->index);
+  int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool result = fd >= 0 && write(fd, chain->index, size) == (ssize_t)size && fsync(fd) == 0;
+  if (fd >= 0) {
+    result = close(fd) == 0 && result;
+  }
+  result = result && rename(tmpPath, chain->indexPath) == 0;
+
+  if (!result) {
+    obLogE("Cannot write %s: %s", chain->indexPath, strerror(errno));
+    unlink(tmpPath);
+  }
+  sdsfree(tmpPath);
+  return result;
+}
+
+static bool obMergeFlatChain(const ObFlatChain* chain, const char* flatPath)
+{
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  options.mergeLayer = true;
+  options.dropWhiteouts = !chain->rootBelow;
+  options.linkFiles = true;
+
+  bool result = true;
+  for (int i = chain->count - 1; i >= 0 && result; --i) {
+    result = obSyncTree(chain->items[i]->layerPath, flatPath, &options);
+  }
+  return result;
+}
+
+/**
+ * Layer references may skip the directory extension
+ */
+static bool obIsFlatLayerRef(const char* layerName, const char* dirName)
+{
+  size_t length = strlen(layerName);
+  return strncmp(layerName, dirName, length) == 0
+      && (dirName[length] == '\0'
+          || (dirName[length] == '.'
+              && strcmp(dirName + length + 1, OB_LAYER_DIR_EXT) == 0));
+}
+
+/**
+ * Find the flat directories of the layers other than keepLayer, removing
+ * them if requested
+ * @return true if any was found
+ */
+static bool obVisitStaleFlatLayers(const char* layersDir, const char* keepLayer,
+                                   bool remove)
+{
+  DIR* dir = opendir(layersDir);
+  if (dir == NULL) {
+    return false;
+  }
+
+  bool found = false;
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.'
+        || (keepLayer != NULL && obIsFlatLayerRef(keepLayer, entry->d_name))) {
+      continue;
+    }
+
+    sds rootPath = sdscatfmt(sdsempty(), "%s/%s%s", layersDir, entry->d_name,
+                             OB_LAYER_ROOT_DIR);
+    sds flatPath = obGetLayerFlatPath(rootPath);
+    sds indexPath = obGetLayerFlatIndexPath(rootPath);
+    if (obExists(flatPath) || obExists(indexPath)) {
+      found = true;
+      if (remove) {
+        obRemoveLayerFlat(rootPath);
+      }
+    }
+    sdsfree(indexPath);
+    sdsfree(flatPath);
+    sdsfree(rootPath);
+  }
+
+  closedir(dir);
+  return found;
+}
+
+// --------- public API ---------- //
+
+bool obIsLayerFlattenNeeded(const ObLayerItem* topLayer, const char* lowerPath)
+{
+  ObFlatChain chain;
+  if (!obPlanFlatChain(topLayer, lowerPath, &chain)) {
+    return false;
+  }
+
+  bool result = !obIsFlatChainValid(&chain);
+  obFreeFlatChain(&chain);
+  return result;
+}
+
+bool obFlattenLayerChain(const ObLayerItem* topLayer, const char* lowerPath)
+{
+  ObFlatChain chain;
+  if (!obPlanFlatChain(topLayer, lowerPath, &chain)) {
+    return true;
+  }
+
+  uint64_t traceStart = obGetMonotonicNs();
+  obLogI("Flattening %i layers into %s", chain.count, chain.flatPath);
+
+  // the index goes first, so an interrupted build is never taken as valid
+  sds tmpPath = sdscat(sdsdup(chain.flatPath), FLATTEN_TMP_EXT);
+  bool result = (!obExists(chain.indexPath) || obRemovePath(chain.indexPath))
+      && (!obExists(tmpPath) || obRemoveDirR(tmpPath))
+      && obMergeFlatChain(&chain, tmpPath)
+      && (!obExists(chain.flatPath) || obRemoveDirR(chain.flatPath))
+      && obRename(tmpPath, chain.flatPath)
+      && obWriteFlatIndex(&chain);
+
+  if (!result) {
+    obLogE("Cannot flatten the layer chain of %s", topLayer->layerPath);
+    if (obExists(tmpPath)) {
+      obRemoveDirR(tmpPath);
+    }
+  }
+
+  obTraceSpan("obFlattenLayerChain", topLayer->layerPath, traceStart);
+  sdsfree(tmpPath);
+  obFreeFlatChain(&chain);
+  return result;
+}
+
+ObLayerItem* obUseFlatLayer(ObArena* arena, ObLayerItem* topLayer,
+                            const char* lowerPath, int* count)
+{
+  ObFlatChain chain;
+  if (!obPlanFlatChain(topLayer, lowerPath, &chain)) {
+    return topLayer;
+  }
+
+  if (!obIsFlatChainValid(&chain)) {
+    obLogI("Flat directory %s is missing or stale, mounting all the layers",
+           chain.flatPath);
+    obFreeFlatChain(&chain);
+    return topLayer;
+  }
+
+  obLogI("Using the flat directory of %i layers: %s", chain.count, chain.flatPath);
+  ObLayerItem* root = chain.rootBelow ? obAddLayerItem(arena, lowerPath, NULL) : NULL;
+  ObLayerItem* flatLayer = obAddLayerItem(arena, chain.flatPath, root);
+  *count = chain.rootBelow ? 2 : 1;
+
+  obFreeFlatChain(&chain);
+  return flatLayer;
+}
+
+bool obRemoveLayerFlat(const char* layerRootPath)
+{
+  sds flatPath = obGetLayerFlatPath(layerRootPath);
+  sds indexPath = obGetLayerFlatIndexPath(layerRootPath);
+  sds tmpPath = sdscat(sdsdup(flatPath), FLATTEN_TMP_EXT);
+
+  bool result = true;
+  if (obExists(indexPath) || obExists(tmpPath) || obExists(flatPath)) {
+    obLogI("Removing the flat directory %s", flatPath);
+    // the index goes first, so a partially removed directory is never used
+    result = (!obExists(indexPath) || obRemovePath(indexPath))
+        && (!obExists(tmpPath) || obRemoveDirR(tmpPath))
+        && (!obExists(flatPath) || obRemoveDirR(flatPath));
+  }
+  if (!result) {
+    obLogW("Cannot remove the flat directory %s", flatPath);
+  }
+
+  sdsfree(tmpPath);
+  sdsfree(indexPath);
+  sdsfree(flatPath);
+  return result;
+}
+
+bool obHasStaleFlatLayers(const char* layersDir, const char* keepLayer)
+{
+  return obVisitStaleFlatLayers(layersDir, keepLayer, false);
+}
+
+void obRemoveStaleFlatLayers(const char* layersDir, const char* keepLayer)
+{
+  obVisitStaleFlatLayers(layersDir, keepLayer, true);
+}
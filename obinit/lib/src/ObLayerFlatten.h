@@ -0,0 +1,57 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBLAYERFLATTEN_H
+#define OBLAYERFLATTEN_H
+
+#include "ObLayerCollector.h"
+#include "ObArena.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Check whether the chain starting at topLayer can be flattened
+ * (at least two directory layers on a single filesystem) and its flat
+ * directory is missing or was built from a different chain
+ * @param lowerPath root filesystem at the bottom of the chain, kept apart
+ */
+bool obIsLayerFlattenNeeded(const ObLayerItem* topLayer, const char* lowerPath);
+
+/**
+ * @brief Merge the layers of the chain into the flat directory stored next
+ * to the top layer root. The regular files are hardlinked to the topmost
+ * layer holding them, so each path resolves to its layer without a copy.
+ * The whiteouts and opaque directories are kept only when the chain ends
+ * at the root filesystem (lowerPath), as they hide its entries.
+ * The flat index describing the chain is written last.
+ */
+bool obFlattenLayerChain(const ObLayerItem* topLayer, const char* lowerPath);
+
+/**
+ * @brief Replace the layers of the chain with their flat directory if it is
+ * up to date. The chain is returned as it is otherwise.
+ * @param count number of the chain items, updated
+ */
+ObLayerItem* obUseFlatLayer(ObArena* arena, ObLayerItem* topLayer,
+                            const char* lowerPath, int* count);
+
+/**
+ * @brief Remove the flat directory and index of the layer. Its hardlinks
+ * keep the files of the layers below allocated.
+ */
+bool obRemoveLayerFlat(const char* layerRootPath);
+
+/**
+ * @brief Check whether any layer in layersDir other than keepLayer (the
+ * head, NULL for none) has a flat directory
+ */
+bool obHasStaleFlatLayers(const char* layersDir, const char* keepLayer);
+
+/**
+ * @brief Remove the flat directories of all the layers in layersDir other
+ * than keepLayer, so that the blocks of the deleted layers are freed
+ */
+void obRemoveStaleFlatLayers(const char* layersDir, const char* keepLayer);
+
+#endif // OBLAYERFLATTEN_H
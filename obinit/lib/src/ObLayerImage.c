@@ -0,0 +1,219 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ob/ObLayerImage.h"
+#include "ob/ObLayerManifest.h"
+#include "ob/ObLogging.h"
+#include "ob/ObDefs.h"
+#include "ObMount.h"
+#include "ObOsUtils.h"
+#include <sds.h>
+
+#include <string.h>
+#include <stdlib.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define IMAGE_TMP_EXT ".tmp"
+
+static const char* obGetLayerImageFs(ObLayerFormat format)
+{
+  switch (format) {
+  case OB_LAYER_FORMAT_EROFS:
+    return "erofs";
+  case OB_LAYER_FORMAT_SQUASHFS:
+    return "squashfs";
+  default:
+    return "";
+  }
+}
+
+static sds obGetLayerImagePath(const char* layerDir, ObLayerFormat format)
+{
+  return sdscat(sdsnew(layerDir), obGetLayerImageName(format));
+}
+
+static bool obMakeImage(const char* rootPath, const char* imagePath, ObLayerFormat format)
+{
+  obLogI("Packing %s into %s", rootPath, imagePath);
+  if (format == OB_LAYER_FORMAT_EROFS) {
+    char* const argv[] = {OB_MKFS_EROFS_COMMAND, OB_MKFS_EROFS_COMPRESSION,
+                          (char*)imagePath, (char*)rootPath, NULL};
+    return obRunCommand(argv);
+  }
+
+  char* const argv[] = {OB_MKSQUASHFS_COMMAND, (char*)rootPath, (char*)imagePath,
+                        "-comp", OB_MKSQUASHFS_COMPRESSION, "-noappend",
+                        "-no-progress", NULL};
+  return obRunCommand(argv);
+}
+
+/**
+ * Image timestamps may be less precise than the ones of the source files
+ */
+static void obRewriteImageManifest(const char* layerDir, ObLayerFormat format)
+{
+  sds rootPath = sdscat(sdsnew(layerDir), OB_LAYER_ROOT_DIR);
+  sds manifestPath = sdscat(sdsnew(layerDir), OB_LAYER_MANIFEST_PATH);
+
+  bool result = obMountLayerImage(layerDir, format);
+  result = result && obWriteLayerManifest(rootPath, manifestPath);
+  obUnmountLayerImage(layerDir);
+
+  if (!result) {
+    obLogW("Layer image %s packed without a manifest, it cannot be verified", layerDir);
+    unlink(manifestPath);
+  }
+
+  sdsfree(rootPath);
+  sdsfree(manifestPath);
+}
+
+static bool obIsMountPoint(const char* path)
+{
+  sds parent = sdscat(sdsnew(path), "/..");
+  struct stat st;
+  struct stat parentSt;
+  bool result = stat(path, &st) == 0 && stat(parent, &parentSt) == 0
+      && st.st_dev != parentSt.st_dev;
+  sdsfree(parent);
+  return result;
+}
+
+// --------- public API ---------- //
+
+ObLayerFormat obParseLayerFormat(const char* value)
+{
+  if (strcmp(value, "erofs") == 0) {
+    return OB_LAYER_FORMAT_EROFS;
+  }
+  else if (strcmp(value, "squashfs") == 0) {
+    return OB_LAYER_FORMAT_SQUASHFS;
+  }
+  else if (strlen(value) > 0 && strcmp(value, "dir") != 0) {
+    obLogW("Unknown layer format: %s, using a directory", value);
+  }
+  return OB_LAYER_FORMAT_DIR;
+}
+
+ObLayerFormat obDetectLayerFormat(const char* layerDir)
+{
+  ObLayerFormat formats[] = {OB_LAYER_FORMAT_EROFS, OB_LAYER_FORMAT_SQUASHFS};
+  ObLayerFormat result = OB_LAYER_FORMAT_DIR;
+
+  for (size_t i = 0; i < sizeof(formats) / sizeof(formats[0]); ++i) {
+    sds imagePath = obGetLayerImagePath(layerDir, formats[i]);
+    bool found = obIsFile(imagePath);
+    sdsfree(imagePath);
+    if (found) {
+      result = formats[i];
+      break;
+    }
+  }
+  return result;
+}
+
+const char* obGetLayerImageName(ObLayerFormat format)
+{
+  switch (format) {
+  case OB_LAYER_FORMAT_EROFS:
+    return OB_LAYER_EROFS_IMAGE;
+  case OB_LAYER_FORMAT_SQUASHFS:
+    return OB_LAYER_SQUASHFS_IMAGE;
+  default:
+    return "";
+  }
+}
+
+bool obPackLayerImage(const char* layerDir, ObLayerFormat format)
+{
+  if (format == OB_LAYER_FORMAT_DIR) {
+    return true;
+  }
+  if (obDetectLayerFormat(layerDir) != OB_LAYER_FORMAT_DIR) {
+    obLogE("Layer %s is already packed", layerDir);
+    return false;
+  }
+
+  sds rootPath = sdscat(sdsnew(layerDir), OB_LAYER_ROOT_DIR);
+  sds imagePath = obGetLayerImagePath(layerDir, format);
+  sds tmpImagePath = sdscat(sdsdup(imagePath), IMAGE_TMP_EXT);
+  sds infoPath = sdscat(sdsdup(rootPath), OB_LAYER_INFO_PATH);
+  sds imageInfoPath = sdscat(sdsnew(layerDir), OB_LAYER_IMAGE_INFO_PATH);
+
+  unlink(tmpImagePath);
+  bool result = obMakeImage(rootPath, tmpImagePath, format)
+      && obCopyFile(infoPath, imageInfoPath)
+      && obRename(tmpImagePath, imagePath);
+
+  if (result) {
+    // the root directory becomes the image mount point
+    if (!obRemoveDirR(rootPath)) {
+      obLogW("Cannot remove packed layer files: %s", rootPath);
+    }
+    obRewriteImageManifest(layerDir, format);
+    sync();
+  }
+  else {
+    obLogE("Cannot pack layer %s into %s", layerDir, imagePath);
+    unlink(tmpImagePath);
+  }
+
+  sdsfree(rootPath);
+  sdsfree(imagePath);
+  sdsfree(tmpImagePath);
+  sdsfree(infoPath);
+  sdsfree(imageInfoPath);
+  return result;
+}
+
+bool obMountLayerImage(const char* layerDir, ObLayerFormat format)
+{
+  if (format == OB_LAYER_FORMAT_DIR) {
+    return true;
+  }
+
+  sds rootPath = sdscat(sdsnew(layerDir), OB_LAYER_ROOT_DIR);
+  sds imagePath = obGetLayerImagePath(layerDir, format);
+  bool result = obIsMountPoint(rootPath)
+      || obMountReadOnlyImage(imagePath, rootPath, obGetLayerImageFs(format));
+
+  sdsfree(rootPath);
+  sdsfree(imagePath);
+  return result;
+}
+
+bool obUnmountLayerImage(const char* layerDir)
+{
+  sds rootPath = sdscat(sdsnew(layerDir), OB_LAYER_ROOT_DIR);
+  bool result = true;
+  if (obIsMountPoint(rootPath)) {
+    result = obUnmount(rootPath);
+    rmdir(rootPath);
+  }
+  sdsfree(rootPath);
+  return result;
+}
+
+void obUnmountLayerImages(const char* layersDir)
+{
+  DIR* dir = opendir(layersDir);
+  if (dir == NULL) {
+    return;
+  }
+
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    sds layerDir = sdscatfmt(sdsempty(), "%s/%s", layersDir, entry->d_name);
+    if (obDetectLayerFormat(layerDir) != OB_LAYER_FORMAT_DIR) {
+      obUnmountLayerImage(layerDir);
+    }
+    sdsfree(layerDir);
+  }
+  closedir(dir);
+}
@@ -0,0 +1,394 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObLayerIndex.h"
+#include "ObYamlLayerReader.h"
+#include "ObOsUtils.h"
+#include "ObPaths.h"
+#include "ob/ObLogging.h"
+#include <sds.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <inttypes.h>
+#include <sys/stat.h>
+
+#define INDEX_MAGIC "OBLI"
+#define INDEX_VERSION 2
+#define INDEX_ENTRIES_INITIAL 16
+#define INDEX_STRING_COUNT 6
+
+typedef struct ObLayerIndexHeader
+{
+  char magic[4];
+  uint32_t version;
+  uint32_t count;
+  uint32_t reserved;
+  int64_t dirMtimeSec;
+  int64_t dirMtimeNsec;
+} ObLayerIndexHeader;
+
+// followed by the strings listed in lengths, without terminators
+typedef struct ObLayerIndexRecord
+{
+  int64_t yamlMtimeSec;
+  int64_t yamlMtimeNsec;
+  int64_t yamlSize;
+  uint16_t lengths[INDEX_STRING_COUNT];
+  uint32_t format;
+} ObLayerIndexRecord;
+
+typedef struct ObLayerIndexEntry
+{
+  char dirName[OB_NAME_MAX];
+  ObLayerInfo info;
+  struct timespec yamlMtime;
+  off_t yamlSize;
+} ObLayerIndexEntry;
+
+struct ObLayerIndex
+{
+  sds layersDir;
+  sds indexPath;
+  struct timespec dirMtime;
+
+  ObLayerIndexEntry* entries;
+  size_t count;
+  size_t capacity;
+  bool dirty;
+};
+
+static char* obGetIndexString(ObLayerIndexEntry* entry, int i, size_t* size)
+{
+  char* strings[INDEX_STRING_COUNT] = {
+    entry->dirName, entry->info.name, entry->info.author,
+    entry->info.createTs, entry->info.description, entry->info.underlayer
+  };
+  size_t sizes[INDEX_STRING_COUNT] = {
+    sizeof(entry->dirName), sizeof(entry->info.name), sizeof(entry->info.author),
+    sizeof(entry->info.createTs), sizeof(entry->info.description),
+    sizeof(entry->info.underlayer)
+  };
+  *size = sizes[i];
+  return strings[i];
+}
+
+static ObLayerIndexEntry* obAddLayerIndexEntry(ObLayerIndex* index)
+{
+  if (index->count == index->capacity) {
+    index->capacity = index->capacity ? index->capacity * 2 : INDEX_ENTRIES_INITIAL;
+    index->entries = realloc(index->entries, index->capacity * sizeof(ObLayerIndexEntry));
+  }
+  ObLayerIndexEntry* entry = &index->entries[index->count];
+  memset(entry, 0, sizeof(ObLayerIndexEntry));
+  index->count += 1;
+  return entry;
+}
+
+static sds obGetIndexedLayerPath(const ObLayerIndex* index, const char* dirName)
+{
+  sds path = sdsempty();
+  return sdscatfmt(path, "%s/%s", index->layersDir, dirName);
+}
+
+static sds obGetIndexedRootPath(const ObLayerIndex* index, const char* dirName)
+{
+  sds path = obGetIndexedLayerPath(index, dirName);
+  return sdscat(path, OB_LAYER_ROOT_DIR);
+}
+
+static bool obStatLayerYaml(const ObLayerIndex* index, const char* dirName, struct stat* st,
+                            ObLayerFormat* format)
+{
+  sds layerPath = obGetIndexedLayerPath(index, dirName);
+  sds path = obGetLayerInfoPath(layerPath, format);
+  bool result = stat(path, st) == 0 && S_ISREG(st->st_mode);
+  sdsfree(path);
+  sdsfree(layerPath);
+  return result;
+}
+
+static bool obLoadIndexEntry(ObLayerIndex* index, ObLayerIndexEntry* entry)
+{
+  struct stat st;
+  ObLayerFormat format;
+  if (!obStatLayerYaml(index, entry->dirName, &st, &format)) {
+    return false;
+  }
+
+  sds layerPath = obGetIndexedLayerPath(index, entry->dirName);
+  bool result = obLoadLayerDirInfo(layerPath, &entry->info) != NULL;
+  entry->yamlMtime = st.st_mtim;
+  entry->yamlSize = st.st_size;
+  sdsfree(layerPath);
+  return result;
+}
+
+static bool obRebuildLayerIndex(ObLayerIndex* index)
+{
+  obLogI("Rebuilding layer index: %s", index->indexPath);
+  index->count = 0;
+  index->dirty = true;
+
+  struct dirent** namelist;
+  int n = scandir(index->layersDir, &namelist, NULL, alphasort);
+  if (n == -1) {
+    obLogE("Cannot open directory: %s", index->layersDir);
+    return false;
+  }
+
+  for (int i = 0; i < n; ++i) {
+    const char* name = namelist[i]->d_name;
+    struct stat st;
+    ObLayerFormat format;
+    if (name[0] != '.' && strlen(name) < OB_NAME_MAX
+        && obStatLayerYaml(index, name, &st, &format)) {
+      ObLayerIndexEntry* entry = obAddLayerIndexEntry(index);
+      strcpy(entry->dirName, name);
+      if (!obLoadIndexEntry(index, entry)) {
+        index->count -= 1;
+      }
+    }
+    free(namelist[i]);
+  }
+  free(namelist);
+  return true;
+}
+
+static bool obParseLayerIndex(ObLayerIndex* index, const char* data, size_t size)
+{
+  ObLayerIndexHeader header;
+  if (size < sizeof(header)) {
+    return false;
+  }
+
+  memcpy(&header, data, sizeof(header));
+  if (memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0
+      || header.version != INDEX_VERSION) {
+    return false;
+  }
+
+  if (header.dirMtimeSec != index->dirMtime.tv_sec
+      || header.dirMtimeNsec != index->dirMtime.tv_nsec) {
+    obLogI("Layer index is stale");
+    return false;
+  }
+
+  size_t offset = sizeof(header);
+  for (uint32_t i = 0; i < header.count; ++i) {
+    ObLayerIndexRecord record;
+    if (size - offset < sizeof(record)) {
+      return false;
+    }
+    memcpy(&record, data + offset, sizeof(record));
+    offset += sizeof(record);
+
+    ObLayerIndexEntry* entry = obAddLayerIndexEntry(index);
+    entry->yamlMtime.tv_sec = record.yamlMtimeSec;
+    entry->yamlMtime.tv_nsec = record.yamlMtimeNsec;
+    entry->yamlSize = record.yamlSize;
+    entry->info.format = record.format;
+
+    for (int s = 0; s < INDEX_STRING_COUNT; ++s) {
+      size_t capacity;
+      char* string = obGetIndexString(entry, s, &capacity);
+      if (record.lengths[s] >= capacity || size - offset < record.lengths[s]) {
+        return false;
+      }
+      memcpy(string, data + offset, record.lengths[s]);
+      string[record.lengths[s]] = '\0';
+      offset += record.lengths[s];
+    }
+
+    sds rootPath = obGetIndexedRootPath(index, entry->dirName);
+    if (sdslen(rootPath) >= sizeof(entry->info.rootPath)) {
+      sdsfree(rootPath);
+      return false;
+    }
+    strcpy(entry->info.rootPath, rootPath);
+    sdsfree(rootPath);
+  }
+
+  return offset == size;
+}
+
+static bool obReadLayerIndex(ObLayerIndex* index)
+{
+  int fd = open(index->indexPath, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat st;
+  char* data = NULL;
+  bool result = fstat(fd, &st) == 0 && st.st_size > 0
+      && (data = malloc(st.st_size)) != NULL
+      && read(fd, data, st.st_size) == st.st_size;
+  close(fd);
+
+  result = result && obParseLayerIndex(index, data, st.st_size);
+  free(data);
+
+  if (!result) {
+    index->count = 0;
+  }
+  return result;
+}
+
+static ObLayerIndexEntry* obFindLayerIndexEntry(ObLayerIndex* index, const char* dirName)
+{
+  for (size_t i = 0; i < index->count; ++i) {
+    if (strcmp(index->entries[i].dirName, dirName) == 0) {
+      return &index->entries[i];
+    }
+  }
+  return NULL;
+}
+
+// --------- public API ---------- //
+
+ObLayerIndex* obLoadLayerIndex(const char* layersDir, const char* indexPath)
+{
+  ObLayerIndex* index = calloc(1, sizeof(ObLayerIndex));
+  index->layersDir = sdsnew(layersDir);
+  index->indexPath = sdsnew(indexPath);
+
+  struct stat st;
+  if (stat(layersDir, &st) != 0) {
+    obLogW("Layers directory not found: %s", layersDir);
+    return index;
+  }
+  index->dirMtime = st.st_mtim;
+
+  if (!obReadLayerIndex(index)) {
+    obRebuildLayerIndex(index);
+  }
+  return index;
+}
+
+ObLayerInfo* obFindIndexedLayer(ObLayerIndex* index, const char* layerName,
+                                ObLayerInfo* info)
+{
+  ObLayerIndexEntry* entry = obFindLayerIndexEntry(index, layerName);
+  if (entry == NULL) {
+    sds dirName = sdscatfmt(sdsempty(), "%s.%s", layerName, OB_LAYER_DIR_EXT);
+    entry = obFindLayerIndexEntry(index, dirName);
+    sdsfree(dirName);
+  }
+
+  if (entry == NULL) {
+    obLogE("Layer %s[.%s] not found", layerName, OB_LAYER_DIR_EXT);
+    return NULL;
+  }
+
+  struct stat st;
+  ObLayerFormat format;
+  if (!obStatLayerYaml(index, entry->dirName, &st, &format)) {
+    obLogE("Layer info file not found in %s/%s", index->layersDir, entry->dirName);
+    return NULL;
+  }
+
+  if (st.st_mtim.tv_sec != entry->yamlMtime.tv_sec
+      || st.st_mtim.tv_nsec != entry->yamlMtime.tv_nsec
+      || st.st_size != entry->yamlSize
+      || format != entry->info.format) {
+    obLogI("Layer info of %s changed, reloading", entry->dirName);
+    obLoadIndexEntry(index, entry);
+    index->dirty = true;
+  }
+
+  *info = entry->info;
+  return info;
+}
+
+bool obSaveLayerIndex(ObLayerIndex* index)
+{
+  if (!index->dirty || index->dirMtime.tv_sec == 0) {
+    return true;
+  }
+
+  ObLayerIndexHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+  header.version = INDEX_VERSION;
+  header.count = index->count;
+  header.dirMtimeSec = index->dirMtime.tv_sec;
+  header.dirMtimeNsec = index->dirMtime.tv_nsec;
+
+  sds data = sdsnewlen(&header, sizeof(header));
+  for (size_t i = 0; i < index->count; ++i) {
+    ObLayerIndexEntry* entry = &index->entries[i];
+    ObLayerIndexRecord record;
+    memset(&record, 0, sizeof(record));
+    record.yamlMtimeSec = entry->yamlMtime.tv_sec;
+    record.yamlMtimeNsec = entry->yamlMtime.tv_nsec;
+    record.yamlSize = entry->yamlSize;
+    record.format = entry->info.format;
+
+    size_t capacity;
+    for (int s = 0; s < INDEX_STRING_COUNT; ++s) {
+      record.lengths[s] = strlen(obGetIndexString(entry, s, &capacity));
+    }
+    data = sdscatlen(data, &record, sizeof(record));
+    for (int s = 0; s < INDEX_STRING_COUNT; ++s) {
+      data = sdscatlen(data, obGetIndexString(entry, s, &capacity), record.lengths[s]);
+    }
+  }
+
+  sds tmpPath = sdscat(sdsnew(index->indexPath), ".tmp");
+  bool result = false;
+  int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  if (fd >= 0) {
+    result = write(fd, data, sdslen(data)) == (ssize_t)sdslen(data);
+    result = close(fd) == 0 && result;
+    result = result && rename(tmpPath, index->indexPath) == 0;
+  }
+
+  if (result) {
+    index->dirty = false;
+  }
+  else {
+    obLogW("Cannot write layer index: %s (%s)", index->indexPath, strerror(errno));
+    unlink(tmpPath);
+  }
+
+  sdsfree(tmpPath);
+  sdsfree(data);
+  return result;
+}
+
+size_t obGetLayerIndexSize(const ObLayerIndex* index)
+{
+  return index->count;
+}
+
+const char* obGetIndexedLayerDir(const ObLayerIndex* index, size_t i)
+{
+  return i < index->count ? index->entries[i].dirName : NULL;
+}
+
+void obFreeLayerIndex(ObLayerIndex** index)
+{
+  if (*index == NULL) {
+    return;
+  }
+  sdsfree((*index)->layersDir);
+  sdsfree((*index)->indexPath);
+  free((*index)->entries);
+  free(*index);
+  *index = NULL;
+}
+
+bool obInvalidateLayerIndex(const char* indexPath)
+{
+  if (!obExists(indexPath)) {
+    return true;
+  }
+  return obRemovePath(indexPath);
+}
@@ -0,0 +1,51 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBLAYERINDEX_H
+#define OBLAYERINDEX_H
+
+#include "ObLayerInfo.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct ObLayerIndex ObLayerIndex;
+
+/**
+ * @brief Load the binary layer index, rebuilding it from the layer.yaml
+ * files when the layers directory has changed since it was written
+ * (or when it is missing or corrupted).
+ * @return index, never NULL; an index that cannot be written is only
+ * kept in memory
+ */
+ObLayerIndex* obLoadLayerIndex(const char* layersDir, const char* indexPath);
+
+/**
+ * @brief Find a layer by its directory name (with or without the layer
+ * extension), the same way obLoadLayerInfo does. An entry whose
+ * layer.yaml changed since indexing is reloaded.
+ */
+ObLayerInfo* obFindIndexedLayer(ObLayerIndex* index, const char* layerName,
+                                ObLayerInfo* info);
+
+/**
+ * @brief Write the index back if any entry was reloaded
+ */
+bool obSaveLayerIndex(ObLayerIndex* index);
+
+size_t obGetLayerIndexSize(const ObLayerIndex* index);
+
+/**
+ * @brief Directory name of the i-th indexed layer (in alphabetical order)
+ */
+const char* obGetIndexedLayerDir(const ObLayerIndex* index, size_t i);
+
+void obFreeLayerIndex(ObLayerIndex** index);
+
+/**
+ * @brief Remove the index file so the next load rebuilds it
+ */
+bool obInvalidateLayerIndex(const char* indexPath);
+
+#endif // OBLAYERINDEX_H
@@ -6,6 +6,7 @@
 #define OBLAYERINFO_H
 
 #include "ob/ObDefs.h"
+#include "ob/ObLayerImage.h"
 
 typedef struct ObLayerInfo
 {
@@ -16,6 +17,7 @@ typedef struct ObLayerInfo
   char underlayer[OB_NAME_MAX];
 
   char rootPath[OB_PATH_MAX];
+  ObLayerFormat format; // the requested one in job files
 } ObLayerInfo;
 
 #endif // OBLAYERINFO_H
@@ -0,0 +1,460 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ob/ObLayerManifest.h"
+#include "ObThreadPool.h"
+#include "ob/ObHash.h"
+#include "ob/ObDefs.h"
+#include "ob/ObLogging.h"
+#include <sds.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <time.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+
+#define MANIFEST_HEADER "obmanifest 1"
+#define MANIFEST_QUEUE_PER_THREAD 64
+#define MANIFEST_ENTRIES_INITIAL 256
+#define MANIFEST_HASH_TYPE OB_HASH_XXH3_128
+
+typedef struct ObManifestEntry
+{
+  sds relPath;
+  char type; // f(ile), d(irectory), l(ink) or s(pecial)
+  mode_t mode;
+  uid_t uid;
+  gid_t gid;
+  long long size;
+  struct timespec mtime;
+  ObHash hash;
+  bool hasHash;
+  bool checkHash;
+} ObManifestEntry;
+
+typedef struct ObManifest
+{
+  const char* root;
+  ObLayerVerifyLevel level;
+
+  ObManifestEntry* entries;
+  size_t count;
+  size_t capacity;
+
+  atomic_size_t failures;
+  atomic_size_t hashed;
+} ObManifest;
+
+typedef struct ObManifestWork
+{
+  ObManifest* manifest;
+  ObManifestEntry* entry;
+} ObManifestWork;
+
+static char obGetManifestType(mode_t mode)
+{
+  if (S_ISREG(mode)) {
+    return 'f';
+  }
+  else if (S_ISDIR(mode)) {
+    return 'd';
+  }
+  else if (S_ISLNK(mode)) {
+    return 'l';
+  }
+  return 's';
+}
+
+static ObManifestEntry* obAddManifestEntry(ObManifest* manifest)
+{
+  if (manifest->count == manifest->capacity) {
+    manifest->capacity = manifest->capacity ? manifest->capacity * 2 : MANIFEST_ENTRIES_INITIAL;
+    manifest->entries = realloc(manifest->entries, manifest->capacity * sizeof(ObManifestEntry));
+  }
+  ObManifestEntry* entry = &manifest->entries[manifest->count];
+  memset(entry, 0, sizeof(ObManifestEntry));
+  manifest->count += 1;
+  return entry;
+}
+
+static void obFreeManifest(ObManifest* manifest)
+{
+  for (size_t i = 0; i < manifest->count; ++i) {
+    sdsfree(manifest->entries[i].relPath);
+  }
+  free(manifest->entries);
+  manifest->entries = NULL;
+  manifest->count = manifest->capacity = 0;
+}
+
+static void obSetManifestStat(ObManifestEntry* entry, const struct stat64* st)
+{
+  entry->type = obGetManifestType(st->st_mode);
+  entry->mode = st->st_mode & 07777;
+  entry->uid = st->st_uid;
+  entry->gid = st->st_gid;
+  entry->size = entry->type == 'd' ? 0 : st->st_size;
+  entry->mtime = st->st_mtim;
+}
+
+static bool obHashManifestEntry(const ObManifest* manifest, const ObManifestEntry* entry,
+                                ObHash* hash)
+{
+  sds path = sdscat(sdsnew(manifest->root), entry->relPath);
+  bool result = true;
+
+  if (entry->type == 'l') {
+    char target[PATH_MAX];
+    ssize_t length = readlink(path, target, sizeof(target));
+    if (length < 0) {
+      result = false;
+    }
+    else {
+      obHashData(target, length, MANIFEST_HASH_TYPE, hash);
+    }
+  }
+  else {
+    result = obHashFile(path, MANIFEST_HASH_TYPE, hash);
+  }
+
+  sdsfree(path);
+  return result;
+}
+
+static bool obCollectManifestEntries(ObManifest* manifest, const char* relPath)
+{
+  sds dirPath = sdscat(sdsnew(manifest->root), relPath);
+  DIR* dir = opendir(dirPath);
+  if (dir == NULL) {
+    obLogE("Cannot open directory: %s (%s)", dirPath, strerror(errno));
+    sdsfree(dirPath);
+    return false;
+  }
+
+  bool result = true;
+  struct dirent* dirEntry;
+  while (result && (dirEntry = readdir(dir)) != NULL) {
+    if (strcmp(dirEntry->d_name, ".") == 0 || strcmp(dirEntry->d_name, "..") == 0) {
+      continue;
+    }
+
+    struct stat64 st;
+    if (fstatat64(dirfd(dir), dirEntry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+      obLogE("Cannot stat %s/%s (%s)", dirPath, dirEntry->d_name, strerror(errno));
+      result = false;
+      break;
+    }
+
+    ObManifestEntry* entry = obAddManifestEntry(manifest);
+    entry->relPath = sdscatfmt(sdsempty(), "%s/%s", relPath, dirEntry->d_name);
+    obSetManifestStat(entry, &st);
+    entry->checkHash = entry->type == 'f' || entry->type == 'l';
+
+    if (S_ISDIR(st.st_mode)) {
+      // entry may move when the array grows
+      sds childPath = sdsdup(entry->relPath);
+      result = obCollectManifestEntries(manifest, childPath);
+      sdsfree(childPath);
+    }
+  }
+
+  closedir(dir);
+  sdsfree(dirPath);
+  return result;
+}
+
+static void obHashEntryWork(ObManifest* manifest, ObManifestEntry* entry)
+{
+  entry->hasHash = obHashManifestEntry(manifest, entry, &entry->hash);
+  if (!entry->hasHash) {
+    atomic_fetch_add(&manifest->failures, 1);
+  }
+}
+
+static void obVerifyEntryWork(ObManifest* manifest, ObManifestEntry* entry)
+{
+  sds path = sdscat(sdsnew(manifest->root), entry->relPath);
+  struct stat64 st;
+  const char* problem = NULL;
+
+  if (lstat64(path, &st) != 0) {
+    problem = "missing";
+  }
+  else {
+    ObManifestEntry current;
+    obSetManifestStat(&current, &st);
+    if (current.type != entry->type) {
+      problem = "type changed";
+    }
+    else if (current.mode != entry->mode
+             || current.uid != entry->uid || current.gid != entry->gid) {
+      problem = "mode or owner changed";
+    }
+    else if (current.size != entry->size) {
+      problem = "size changed";
+    }
+    else if (entry->type != 'd'
+             && (current.mtime.tv_sec != entry->mtime.tv_sec
+                 || current.mtime.tv_nsec != entry->mtime.tv_nsec)) {
+      problem = "mtime changed";
+    }
+  }
+
+  if (problem == NULL && entry->checkHash) {
+    ObHash hash;
+    if (!obHashManifestEntry(manifest, entry, &hash)) {
+      problem = "unreadable";
+    }
+    else if (!obHashEqual(&hash, &entry->hash)) {
+      problem = "content changed";
+    }
+    atomic_fetch_add(&manifest->hashed, 1);
+  }
+
+  if (problem) {
+    obLogE("Layer entry %s: %s", path, problem);
+    atomic_fetch_add(&manifest->failures, 1);
+  }
+  sdsfree(path);
+}
+
+static void obManifestWork(void* arg)
+{
+  ObManifestWork* work = arg;
+  ObManifest* manifest = work->manifest;
+  if (manifest->level == OB_LAYER_VERIFY_NONE) {
+    obHashEntryWork(manifest, work->entry);
+  }
+  else {
+    obVerifyEntryWork(manifest, work->entry);
+  }
+  free(work);
+}
+
+/**
+ * Run obManifestWork for every entry that needs hashing (generation)
+ * or for every entry (verification) on all cores
+ */
+static bool obProcessManifest(ObManifest* manifest)
+{
+  int threads = obGetOnlineCpuCount();
+  ObThreadPool* pool = obCreateThreadPool(threads, (threads + 1) * MANIFEST_QUEUE_PER_THREAD);
+  if (pool == NULL) {
+    pool = obCreateThreadPool(0, 1);
+  }
+
+  bool result = true;
+  for (size_t i = 0; i < manifest->count && result; ++i) {
+    ObManifestEntry* entry = &manifest->entries[i];
+    if (manifest->level == OB_LAYER_VERIFY_NONE && !entry->checkHash) {
+      continue;
+    }
+
+    ObManifestWork* work = malloc(sizeof(ObManifestWork));
+    work->manifest = manifest;
+    work->entry = entry;
+    result = obSubmitWork(pool, obManifestWork, work);
+    if (!result) {
+      free(work);
+    }
+  }
+
+  obWaitThreadPool(pool);
+  obFreeThreadPool(&pool);
+  return result && atomic_load(&manifest->failures) == 0;
+}
+
+static int obCompareManifestEntries(const void* a, const void* b)
+{
+  return strcmp(((const ObManifestEntry*)a)->relPath, ((const ObManifestEntry*)b)->relPath);
+}
+
+static void obWriteManifestPath(FILE* file, const char* path)
+{
+  for (const char* c = path; *c; ++c) {
+    if (*c == '\\') {
+      fputs("\\\\", file);
+    }
+    else if (*c == '\n') {
+      fputs("\\n", file);
+    }
+    else {
+      fputc(*c, file);
+    }
+  }
+}
+
+static sds obReadManifestPath(const char* escaped)
+{
+  sds path = sdsempty();
+  for (const char* c = escaped; *c && *c != '\n'; ++c) {
+    if (*c == '\\' && c[1] == 'n') {
+      path = sdscatlen(path, "\n", 1);
+      ++c;
+    }
+    else if (*c == '\\' && c[1] == '\\') {
+      path = sdscatlen(path, "\\", 1);
+      ++c;
+    }
+    else {
+      path = sdscatlen(path, c, 1);
+    }
+  }
+  return path;
+}
+
+static bool obSaveManifest(const ObManifest* manifest, const char* manifestPath)
+{
+  sds tmpPath = sdscat(sdsnew(manifestPath), ".tmp");
+  FILE* file = fopen(tmpPath, "w");
+  if (file == NULL) {
+    obLogE("Cannot open file for writing: %s", tmpPath);
+    sdsfree(tmpPath);
+    return false;
+  }
+
+  char hashStr[OB_HASH_STR_MAX];
+  fprintf(file, "%s\n", MANIFEST_HEADER);
+  for (size_t i = 0; i < manifest->count; ++i) {
+    const ObManifestEntry* entry = &manifest->entries[i];
+    fprintf(file, "%c %o %u %u %lld %lld.%09ld %s ", entry->type, (unsigned)entry->mode,
+            (unsigned)entry->uid, (unsigned)entry->gid, entry->size,
+            (long long)entry->mtime.tv_sec, entry->mtime.tv_nsec,
+            entry->hasHash ? obHashToStr(&entry->hash, hashStr) : "-");
+    obWriteManifestPath(file, entry->relPath);
+    fputc('\n', file);
+  }
+
+  bool result = fflush(file) == 0 && fsync(fileno(file)) == 0;
+  result = fclose(file) == 0 && result;
+  result = result && rename(tmpPath, manifestPath) == 0;
+  if (!result) {
+    obLogE("Cannot write layer manifest: %s (%s)", manifestPath, strerror(errno));
+    unlink(tmpPath);
+  }
+
+  sdsfree(tmpPath);
+  return result;
+}
+
+static bool obLoadManifest(ObManifest* manifest, const char* manifestPath)
+{
+  FILE* file = fopen(manifestPath, "r");
+  if (file == NULL) {
+    obLogE("Cannot open file for reading: %s", manifestPath);
+    return false;
+  }
+
+  char* line = NULL;
+  size_t lineSize = 0;
+  bool result = getline(&line, &lineSize, file) > 0
+      && strncmp(line, MANIFEST_HEADER "\n", strlen(MANIFEST_HEADER) + 1) == 0;
+
+  while (result && getline(&line, &lineSize, file) > 0) {
+    char type;
+    unsigned mode, uid, gid;
+    long long size, mtimeSec;
+    long mtimeNsec;
+    char hashStr[OB_HASH_STR_MAX];
+    int pathOffset = 0;
+    int count = sscanf(line, "%c %o %u %u %lld %lld.%ld %47s %n", &type, &mode, &uid, &gid,
+                       &size, &mtimeSec, &mtimeNsec, hashStr, &pathOffset);
+    if (count != 8 || pathOffset == 0) {
+      result = false;
+      break;
+    }
+
+    ObManifestEntry* entry = obAddManifestEntry(manifest);
+    entry->type = type;
+    entry->mode = mode;
+    entry->uid = uid;
+    entry->gid = gid;
+    entry->size = size;
+    entry->mtime.tv_sec = mtimeSec;
+    entry->mtime.tv_nsec = mtimeNsec;
+    entry->relPath = obReadManifestPath(line + pathOffset);
+    entry->hasHash = strcmp(hashStr, "-") != 0;
+    if (entry->hasHash && !obHashFromStr(hashStr, &entry->hash)) {
+      result = false;
+    }
+  }
+
+  if (!result) {
+    obLogE("Malformed layer manifest: %s", manifestPath);
+  }
+  free(line);
+  fclose(file);
+  return result;
+}
+
+static void obSelectHashedEntries(ObManifest* manifest, ObLayerVerifyLevel level)
+{
+  unsigned seed = (unsigned)time(NULL) ^ (unsigned)getpid();
+  for (size_t i = 0; i < manifest->count; ++i) {
+    ObManifestEntry* entry = &manifest->entries[i];
+    entry->checkHash = false;
+    if (!entry->hasHash) {
+      continue;
+    }
+    if (level == OB_LAYER_VERIFY_FULL) {
+      entry->checkHash = true;
+    }
+    else if (level == OB_LAYER_VERIFY_SAMPLED) {
+      entry->checkHash = rand_r(&seed) % 100 < OB_LAYER_VERIFY_SAMPLE_PERCENT;
+    }
+  }
+}
+
+// --------- public API ---------- //
+
+bool obWriteLayerManifest(const char* layerRootPath, const char* manifestPath)
+{
+  ObManifest manifest;
+  memset(&manifest, 0, sizeof(manifest));
+  manifest.root = layerRootPath;
+  manifest.level = OB_LAYER_VERIFY_NONE;
+
+  obLogI("Writing layer manifest: %s", manifestPath);
+  bool result = obCollectManifestEntries(&manifest, "")
+      && obProcessManifest(&manifest);
+
+  if (result) {
+    qsort(manifest.entries, manifest.count, sizeof(ObManifestEntry), obCompareManifestEntries);
+    result = obSaveManifest(&manifest, manifestPath);
+  }
+
+  obFreeManifest(&manifest);
+  return result;
+}
+
+bool obVerifyLayerManifest(const char* layerRootPath, const char* manifestPath,
+                           ObLayerVerifyLevel level)
+{
+  if (level == OB_LAYER_VERIFY_NONE) {
+    return true;
+  }
+
+  ObManifest manifest;
+  memset(&manifest, 0, sizeof(manifest));
+  manifest.root = layerRootPath;
+  manifest.level = level;
+
+  bool result = obLoadManifest(&manifest, manifestPath);
+  if (result) {
+    obSelectHashedEntries(&manifest, level);
+    result = obProcessManifest(&manifest);
+    obLogI("Verified layer %s: %zu entries, %zu hashed, %zu failed", layerRootPath,
+           manifest.count, atomic_load(&manifest.hashed), atomic_load(&manifest.failures));
+  }
+
+  obFreeManifest(&manifest);
+  return result;
+}
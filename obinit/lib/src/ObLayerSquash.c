@@ -0,0 +1,514 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObLayerSquash.h"
+#include "ObLayerIndex.h"
+#include "ObOsUtils.h"
+#include "ObPaths.h"
+#include "ObLayerFlatten.h"
+#include "ob/ObSync.h"
+#include "ob/ObLayerManifest.h"
+#include "ob/ObLayerImage.h"
+#include "ob/ObLogging.h"
+#include <sds.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#define SQUASH_TMP_EXT "squash"
+#define SQUASH_REMOVED_EXT "removed"
+#define SQUASH_READ_CHUNK 4096
+
+typedef struct ObSquashLayer
+{
+  char dirName[OB_NAME_MAX];
+  ObLayerInfo info;
+  bool inRange;
+  bool removed;
+} ObSquashLayer;
+
+typedef struct ObSquashState
+{
+  const char* layersDir;
+  ObSquashLayer* layers;
+  size_t count;
+
+  ObSquashLayer** range; // top first
+  int rangeCount;
+} ObSquashState;
+
+static bool obIsChainEnd(const char* layerName)
+{
+  return strcmp(OB_UNDERLAYER_ROOT, layerName) == 0
+      || strcmp(OB_UNDERLAYER_NONE, layerName) == 0
+      || strcmp("", layerName) == 0;
+}
+
+/**
+ * Layer references may skip the directory extension
+ */
+static bool obIsLayerRef(const char* layerName, const char* dirName)
+{
+  size_t length = strlen(layerName);
+  return strncmp(layerName, dirName, length) == 0
+      && (dirName[length] == '\0'
+          || (dirName[length] == '.'
+              && strcmp(dirName + length + 1, OB_LAYER_DIR_EXT) == 0));
+}
+
+static void obLoadSquashLayers(ObSquashState* state, const char* layersDir,
+                               const char* indexPath)
+{
+  memset(state, 0, sizeof(ObSquashState));
+  state->layersDir = layersDir;
+
+  ObLayerIndex* index = obLoadLayerIndex(layersDir, indexPath);
+  size_t size = obGetLayerIndexSize(index);
+  state->layers = calloc(size + 1, sizeof(ObSquashLayer));
+  state->range = calloc(size + 1, sizeof(ObSquashLayer*));
+
+  for (size_t i = 0; i < size; ++i) {
+    ObSquashLayer* layer = &state->layers[state->count];
+    strcpy(layer->dirName, obGetIndexedLayerDir(index, i));
+    if (obFindIndexedLayer(index, layer->dirName, &layer->info)) {
+      state->count += 1;
+    }
+  }
+
+  obSaveLayerIndex(index);
+  obFreeLayerIndex(&index);
+}
+
+static void obFreeSquashLayers(ObSquashState* state)
+{
+  free(state->layers);
+  free(state->range);
+}
+
+static ObSquashLayer* obFindSquashLayer(ObSquashState* state, const char* layerName)
+{
+  for (size_t i = 0; i < state->count; ++i) {
+    if (strcmp(state->layers[i].dirName, layerName) == 0) {
+      return &state->layers[i];
+    }
+  }
+
+  ObSquashLayer* layer = NULL;
+  sds dirName = sdscatfmt(sdsempty(), "%s.%s", layerName, OB_LAYER_DIR_EXT);
+  for (size_t i = 0; i < state->count && layer == NULL; ++i) {
+    if (strcmp(state->layers[i].dirName, dirName) == 0) {
+      layer = &state->layers[i];
+    }
+  }
+  sdsfree(dirName);
+  return layer;
+}
+
+/**
+ * Collect the chain from top down to bottom (or to its end) into the range
+ */
+static bool obCollectSquashRange(ObSquashState* state, const char* top, const char* bottom)
+{
+  ObSquashLayer* layer = obFindSquashLayer(state, top);
+  if (layer == NULL) {
+    obLogE("Layer %s[.%s] not found", top, OB_LAYER_DIR_EXT);
+    return false;
+  }
+
+  ObSquashLayer* last = NULL;
+  if (bottom && strlen(bottom) > 0 && (last = obFindSquashLayer(state, bottom)) == NULL) {
+    obLogE("Layer %s[.%s] not found", bottom, OB_LAYER_DIR_EXT);
+    return false;
+  }
+
+  while (layer != NULL) {
+    if (layer->inRange) {
+      obLogE("Layer chain loops back to %s", layer->dirName);
+      return false;
+    }
+    layer->inRange = true;
+    state->range[state->rangeCount++] = layer;
+
+    if (layer == last || obIsChainEnd(layer->info.underlayer)) {
+      break;
+    }
+
+    ObSquashLayer* next = obFindSquashLayer(state, layer->info.underlayer);
+    if (next == NULL) {
+      obLogE("Underlayer %s of %s not found", layer->info.underlayer, layer->dirName);
+      return false;
+    }
+    layer = next;
+  }
+
+  if (last != NULL && state->range[state->rangeCount - 1] != last) {
+    obLogE("Layer %s is not below %s", bottom, top);
+    return false;
+  }
+  return true;
+}
+
+static bool obMergeSquashRange(ObSquashState* state, const char* rootPath)
+{
+  ObSquashLayer* base = state->range[state->rangeCount - 1];
+
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  options.mergeLayer = true;
+  // nothing below to hide, the root filesystem still is
+  options.dropWhiteouts = strcmp(base->info.underlayer, OB_UNDERLAYER_NONE) == 0;
+
+  bool result = true;
+  for (int i = state->rangeCount - 1; i >= 0 && result; --i) {
+    ObSquashLayer* layer = state->range[i];
+    sds layerDir = sdscatfmt(sdsempty(), "%s/%s", state->layersDir, layer->dirName);
+
+    obLogI("Squashing layer %s", layer->dirName);
+    result = obMountLayerImage(layerDir, layer->info.format)
+        && obSyncTree(layer->info.rootPath, rootPath, &options);
+
+    if (layer->info.format != OB_LAYER_FORMAT_DIR) {
+      obUnmountLayerImage(layerDir);
+    }
+    sdsfree(layerDir);
+  }
+  return result;
+}
+
+static sds obCatYamlValue(sds yaml, const char* key, const char* value)
+{
+  yaml = sdscatfmt(yaml, "%s: \"", key);
+  for (const char* c = value; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      yaml = sdscatlen(yaml, "\\", 1);
+    }
+    yaml = sdscatlen(yaml, c, 1);
+  }
+  return sdscat(yaml, "\"");
+}
+
+static bool obReplaceFile(const char* path, const char* data, size_t size)
+{
+  sds tmpPath = sdscat(sdsnew(path), ".tmp");
+  int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+  bool result = fd >= 0 && write(fd, data, size) == (ssize_t)size && fsync(fd) == 0;
+  if (fd >= 0) {
+    result = close(fd) == 0 && result;
+  }
+  result = result && rename(tmpPath, path) == 0;
+
+  if (!result) {
+    obLogE("Cannot write %s: %s", path, strerror(errno));
+    unlink(tmpPath);
+  }
+  sdsfree(tmpPath);
+  return result;
+}
+
+static sds obReadTextFile(const char* path)
+{
+  FILE* file = fopen(path, "r");
+  if (file == NULL) {
+    obLogE("Cannot open %s: %s", path, strerror(errno));
+    return NULL;
+  }
+
+  sds content = sdsempty();
+  char buffer[SQUASH_READ_CHUNK];
+  size_t size;
+  while ((size = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+    content = sdscatlen(content, buffer, size);
+  }
+  fclose(file);
+  return content;
+}
+
+static bool obWriteSquashedLayerInfo(const char* rootPath, const ObLayerInfo* info)
+{
+  sds yaml = obCatYamlValue(sdsempty(), "name", info->name);
+  yaml = obCatYamlValue(sdscat(yaml, "\n"), "description", info->description);
+  yaml = obCatYamlValue(sdscat(yaml, "\n"), "underlayer", info->underlayer);
+  yaml = obCatYamlValue(sdscat(yaml, "\n"), "author", info->author);
+  yaml = obCatYamlValue(sdscat(yaml, "\n"), "create_ts", info->createTs);
+  yaml = sdscat(yaml, "\n");
+
+  sds path = sdscat(sdsnew(rootPath), OB_LAYER_INFO_PATH);
+  sds dir = sdscat(sdsnew(rootPath), "/etc");
+  bool result = (obExists(dir) || obMkpath(dir, OB_MKPATH_MODE))
+      && obReplaceFile(path, yaml, sdslen(yaml));
+
+  sdsfree(dir);
+  sdsfree(path);
+  sdsfree(yaml);
+  return result;
+}
+
+/**
+ * Rewrite the underlayer entry keeping the rest of the file untouched
+ */
+static bool obSetUnderlayer(const char* rootPath, const char* underlayer)
+{
+  sds path = sdscat(sdsnew(rootPath), OB_LAYER_INFO_PATH);
+  sds content = obReadTextFile(path);
+  if (content == NULL) {
+    sdsfree(path);
+    return false;
+  }
+
+  int count = 0;
+  sds* lines = sdssplitlen(content, sdslen(content), "\n", 1, &count);
+  sds yaml = sdsempty();
+  bool found = false;
+
+  size_t keyLength = strlen("underlayer");
+  for (int i = 0; i < count; ++i) {
+    bool isUnderlayer = strncmp(lines[i], "underlayer", keyLength) == 0
+        && lines[i][keyLength + strspn(lines[i] + keyLength, " \t")] == ':';
+
+    yaml = i > 0 ? sdscat(yaml, "\n") : yaml;
+    if (isUnderlayer && !found) {
+      yaml = obCatYamlValue(yaml, "underlayer", underlayer);
+      found = true;
+    }
+    else {
+      yaml = sdscatsds(yaml, lines[i]);
+    }
+  }
+
+  if (!found) {
+    yaml = sdslen(yaml) > 0 && yaml[sdslen(yaml) - 1] != '\n' ? sdscat(yaml, "\n") : yaml;
+    yaml = sdscat(obCatYamlValue(yaml, "underlayer", underlayer), "\n");
+  }
+
+  bool result = obReplaceFile(path, yaml, sdslen(yaml));
+
+  sdsfreesplitres(lines, count);
+  sdsfree(yaml);
+  sdsfree(content);
+  sdsfree(path);
+  return result;
+}
+
+static bool obInstallSquashedLayer(const char* tmpDir, const char* layerDir, bool inPlace)
+{
+  if (!inPlace) {
+    return obRename(tmpDir, layerDir);
+  }
+
+  // swapped atomically so the chain never misses its top layer
+  if (renameat2(AT_FDCWD, tmpDir, AT_FDCWD, layerDir, RENAME_EXCHANGE) != 0) {
+    obLogE("Cannot replace %s: %s", layerDir, strerror(errno));
+    return false;
+  }
+  if (!obRemoveDirR(tmpDir)) {
+    obLogW("Cannot remove the replaced layer: %s", tmpDir);
+  }
+  return true;
+}
+
+static void obRepointSquashedLayer(ObSquashState* state, const char* topDir,
+                                   const char* layerName)
+{
+  for (size_t i = 0; i < state->count; ++i) {
+    ObSquashLayer* layer = &state->layers[i];
+    if (layer->inRange || !obIsLayerRef(layer->info.underlayer, topDir)) {
+      continue;
+    }
+
+    obLogI("Re-pointing layer %s to %s", layer->dirName, layerName);
+    // its flat directory links the files of the squashed layers
+    obRemoveLayerFlat(layer->info.rootPath);
+    if (obSetUnderlayer(layer->info.rootPath, layerName)) {
+      strcpy(layer->info.underlayer, layerName);
+    }
+    else {
+      obLogE("Layer %s still points to %s", layer->dirName, topDir);
+    }
+  }
+}
+
+static bool obIsLayerReferenced(const ObSquashState* state, const ObSquashLayer* layer,
+                                const char* keepLayer)
+{
+  if (keepLayer && obIsLayerRef(keepLayer, layer->dirName)) {
+    return true;
+  }
+
+  for (size_t i = 0; i < state->count; ++i) {
+    const ObSquashLayer* other = &state->layers[i];
+    if (other != layer && !other->removed
+        && obIsLayerRef(other->info.underlayer, layer->dirName)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void obRemoveSquashedLayers(ObSquashState* state, int first, const char* keepLayer)
+{
+  // top-down, so each removed layer releases the one below
+  for (int i = first; i < state->rangeCount; ++i) {
+    ObSquashLayer* layer = state->range[i];
+    if (obIsLayerReferenced(state, layer, keepLayer)) {
+      obLogI("Layer %s is still in use, keeping it", layer->dirName);
+      continue;
+    }
+
+    sds layerDir = sdscatfmt(sdsempty(), "%s/%s", state->layersDir, layer->dirName);
+    sds removedDir = sdscatfmt(sdsempty(), "%s/.%s.%s", state->layersDir,
+                               layer->dirName, SQUASH_REMOVED_EXT);
+
+    obLogI("Removing squashed layer %s", layer->dirName);
+    layer->removed = rename(layerDir, removedDir) == 0;
+    if (!layer->removed || !obRemoveDirR(removedDir)) {
+      obLogW("Cannot remove squashed layer %s", layerDir);
+    }
+
+    sdsfree(layerDir);
+    sdsfree(removedDir);
+  }
+}
+
+static bool obSquashRange(ObSquashState* state, const char* indexPath,
+                          const ObLayerInfo* info, const char* keepLayer)
+{
+  ObSquashLayer* topLayer = state->range[0];
+  ObSquashLayer* base = state->range[state->rangeCount - 1];
+  bool inPlace = info == NULL || strlen(info->name) == 0
+      || obIsLayerRef(info->name, topLayer->dirName);
+
+  ObLayerInfo newInfo = topLayer->info;
+  if (info != NULL) {
+    strcpy(newInfo.name, strlen(info->name) ? info->name : newInfo.name);
+    strcpy(newInfo.author, strlen(info->author) ? info->author : newInfo.author);
+    strcpy(newInfo.createTs, strlen(info->createTs) ? info->createTs : newInfo.createTs);
+    strcpy(newInfo.description, strlen(info->description) ? info->description
+                                                          : newInfo.description);
+  }
+  strcpy(newInfo.underlayer, base->info.underlayer);
+
+  sds layerDir = sdscatfmt(sdsempty(), "%s/", state->layersDir);
+  if (inPlace) {
+    layerDir = sdscat(layerDir, topLayer->dirName);
+  }
+  else {
+    layerDir = sdscatfmt(layerDir, "%s.%s", newInfo.name, OB_LAYER_DIR_EXT);
+  }
+
+  if (!inPlace && (obFindSquashLayer(state, newInfo.name) || obExists(layerDir))) {
+    obLogE("Layer named %s already exists in %s", newInfo.name, state->layersDir);
+    sdsfree(layerDir);
+    return false;
+  }
+
+  sds tmpDir = sdscatfmt(sdsempty(), "%s/.%s.%s", state->layersDir,
+                         strrchr(layerDir, '/') + 1, SQUASH_TMP_EXT);
+  sds tmpRoot = sdscat(sdsdup(tmpDir), OB_LAYER_ROOT_DIR);
+  sds manifestPath = obGetLayerManifestPath(tmpRoot);
+
+  obLogI("Squashing %i layers (%s - %s) into %s", state->rangeCount,
+         topLayer->dirName, base->dirName, layerDir);
+
+  bool result = (!obExists(tmpDir) || obRemoveDirR(tmpDir))
+      && obMergeSquashRange(state, tmpRoot)
+      && obWriteSquashedLayerInfo(tmpRoot, &newInfo);
+
+  if (result && !obWriteLayerManifest(tmpRoot, manifestPath)) {
+    obLogW("Layer %s squashed without a manifest, it cannot be verified", newInfo.name);
+  }
+
+  // an image keeps the format of the top layer unless requested otherwise
+  ObLayerFormat format = info && info->format != OB_LAYER_FORMAT_UNSET
+      ? info->format : topLayer->info.format;
+  if (result && !obPackLayerImage(tmpDir, format)) {
+    obLogW("Layer %s squashed into a directory", newInfo.name);
+  }
+
+  result = result && obInstallSquashedLayer(tmpDir, layerDir, inPlace);
+
+  if (result) {
+    if (inPlace) {
+      strcpy(topLayer->info.underlayer, newInfo.underlayer);
+    }
+    else {
+      obRepointSquashedLayer(state, topLayer->dirName, newInfo.name);
+    }
+    obRemoveSquashedLayers(state, inPlace ? 1 : 0, keepLayer);
+  }
+  else if (obExists(tmpDir)) {
+    obRemoveDirR(tmpDir);
+  }
+
+  obInvalidateLayerIndex(indexPath);
+  sync();
+
+  sdsfree(manifestPath);
+  sdsfree(tmpRoot);
+  sdsfree(tmpDir);
+  sdsfree(layerDir);
+  return result;
+}
+
+// --------- public API ---------- //
+
+bool obSquashLayers(const char* layersDir, const char* indexPath,
+                    const char* top, const char* bottom,
+                    const ObLayerInfo* info, const char* keepLayer)
+{
+  ObSquashState state;
+  obLoadSquashLayers(&state, layersDir, indexPath);
+
+  bool result = obCollectSquashRange(&state, top, bottom);
+  if (result && state.rangeCount < 2) {
+    obLogI("Nothing to squash below %s", top);
+  }
+  else if (result) {
+    result = obSquashRange(&state, indexPath, info, keepLayer);
+  }
+
+  obFreeSquashLayers(&state);
+  return result;
+}
+
+int obGetLayerDepth(const char* layersDir, const char* indexPath, const char* headLayer)
+{
+  if (obIsChainEnd(headLayer)) {
+    return 0;
+  }
+
+  ObSquashState state;
+  obLoadSquashLayers(&state, layersDir, indexPath);
+  int depth = obCollectSquashRange(&state, headLayer, NULL) ? state.rangeCount : -1;
+  obFreeSquashLayers(&state);
+  return depth;
+}
+
+bool obLimitLayerDepth(const char* layersDir, const char* indexPath,
+                       const char* headLayer, int maxDepth)
+{
+  if (maxDepth < 1 || obIsChainEnd(headLayer)) {
+    return true;
+  }
+
+  ObSquashState state;
+  obLoadSquashLayers(&state, layersDir, indexPath);
+  bool result = obCollectSquashRange(&state, headLayer, NULL);
+
+  char top[OB_NAME_MAX] = {0};
+  if (result && state.rangeCount > maxDepth) {
+    strcpy(top, state.range[maxDepth - 1]->dirName);
+    obLogI("Layer chain of %s is %i layers deep (max. %i)", headLayer,
+           state.rangeCount, maxDepth);
+  }
+  obFreeSquashLayers(&state);
+
+  if (result && strlen(top) > 0) {
+    result = obSquashLayers(layersDir, indexPath, top, NULL, NULL, headLayer);
+  }
+  return result;
+}
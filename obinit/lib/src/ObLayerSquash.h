@@ -0,0 +1,42 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBLAYERSQUASH_H
+#define OBLAYERSQUASH_H
+
+#include "ObLayerInfo.h"
+
+#include <stdbool.h>
+
+/**
+ * @brief Merge the chain of layers from top down to bottom into a single
+ * layer, applying their whiteouts and opaque directories. The new layer
+ * is named after info->name (NULL or empty to replace the top layer in
+ * place) and takes its author, description, timestamp and format from info
+ * when set (the top layer format is kept without info or when info->format
+ * is OB_LAYER_FORMAT_UNSET).
+ * The layers pointing to top are re-pointed to the new layer, then the
+ * squashed layers that are no longer referenced by any other layer or by
+ * keepLayer (usually the configured head) are removed.
+ * @param bottom the lowest layer to squash, NULL or empty for the last
+ * layer above "root" or "none"
+ */
+bool obSquashLayers(const char* layersDir, const char* indexPath,
+                    const char* top, const char* bottom,
+                    const ObLayerInfo* info, const char* keepLayer);
+
+/**
+ * @return number of layers in the chain starting at headLayer ("root" and
+ * "none" not included) or -1 if the chain is broken
+ */
+int obGetLayerDepth(const char* layersDir, const char* indexPath, const char* headLayer);
+
+/**
+ * @brief Squash the bottom of the headLayer chain in place so that it
+ * is at most maxDepth layers deep
+ */
+bool obLimitLayerDepth(const char* layersDir, const char* indexPath,
+                       const char* headLayer, int maxDepth);
+
+#endif // OBLAYERSQUASH_H
@@ -3,85 +3,161 @@
 // See accompanying file LICENSE.txt for the full license.
 
 #include "ob/ObLogging.h"
+#include "ob/ObDefs.h"
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <time.h>
 #include <fcntl.h>
 #include <string.h>
 #include <unistd.h>
 #include <stdarg.h>
+#include <pthread.h>
+
+#undef obLogI
+#undef obLogW
 
 #define OB_LOG_MAX 4096
+#define OB_LOG_TIME_MAX 64
 
 #define IGNORE_RETURN (void)!
 
 static struct {
   bool stdOut;
   bool kmsgOut;
-} obLoggerSettings = {true, false};
+  ObLogLevel level;
+} obLoggerSettings = {true, false, OB_LOG_LEVEL_INFO};
+
+/**
+ * Records are stored one after another (NUL-terminated) and written out
+ * when the next one might not fit, once a second, on errors, at exit and
+ * before the blocking waits (obFlushLog)
+ */
+static struct {
+  pthread_mutex_t mutex;
+  pthread_once_t once;
+  char buffer[OB_LOG_BUFFER_SIZE];
+  size_t size;
+  int kmsgFd;
+  time_t cachedTime;
+  time_t flushTime;
+  char cachedTimeStr[OB_LOG_TIME_MAX];
+} obLogger = {PTHREAD_MUTEX_INITIALIZER, PTHREAD_ONCE_INIT, "", 0, -1, 0, 0, ""};
 
 
 static bool _obErrorOccurred = false;
 
-static void obWriteStdLog(const char* log)
+static void obFlushLogAtExit()
 {
-  fprintf(stdout, "%s", log);
-  fflush(stdout);
+  obFlushLog();
 }
 
-static void obWriteStdLogE(const char* log)
+static void obSetupLogger()
 {
-  fprintf(stderr, "%s", log);
-  fflush(stderr);
+  atexit(obFlushLogAtExit);
 }
 
+static void obWriteStdLog(FILE* stream, const char* log)
+{
+  fputs(log, stream);
+}
 
 static void obWriteKmsgLog(const char* log)
 {
-  int fd = open("/dev/kmsg", O_RDWR);
-  if( fd<0 ) {
-    obWriteStdLogE("problem opening /dev/kmsg\n");
-    return;
+  if (obLogger.kmsgFd < 0) {
+    obLogger.kmsgFd = open("/dev/kmsg", O_WRONLY | O_CLOEXEC);
+    if (obLogger.kmsgFd < 0) {
+      fputs("problem opening /dev/kmsg\n", stderr);
+      obLoggerSettings.kmsgOut = false;
+      return;
+    }
   }
-  IGNORE_RETURN write(fd, log, strlen(log)+1);
-  close(fd);
+  IGNORE_RETURN write(obLogger.kmsgFd, log, strlen(log));
 }
 
-static void obWriteLog(const char* log)
+static void obFlushLocked()
 {
-  if (obLoggerSettings.stdOut) {
-    obWriteStdLog(log);
+  for (size_t pos = 0; pos < obLogger.size; pos += strlen(obLogger.buffer + pos) + 1) {
+    const char* log = obLogger.buffer + pos;
+    if (obLoggerSettings.stdOut) {
+      obWriteStdLog(stdout, log);
+    }
+    if (obLoggerSettings.kmsgOut) {
+      obWriteKmsgLog(log);
+    }
   }
-  if (obLoggerSettings.kmsgOut) {
-    obWriteKmsgLog(log);
+  if (obLoggerSettings.stdOut) {
+    fflush(stdout);
   }
+  obLogger.size = 0;
+  obLogger.flushTime = obLogger.cachedTime;
 }
 
-static void obWriteLogE(const char* log)
+/**
+ * localtime is only called when the second changes
+ */
+static const char* obGetTimeStr()
 {
-  if (obLoggerSettings.stdOut) {
-    obWriteStdLogE(log);
-  }
-  if (obLoggerSettings.kmsgOut) {
-    obWriteKmsgLog(log);
+  time_t t = time(NULL);
+  if (t != obLogger.cachedTime || obLogger.cachedTimeStr[0] == '\0') {
+    struct tm tm;
+    localtime_r(&t, &tm);
+    snprintf(obLogger.cachedTimeStr, OB_LOG_TIME_MAX, "%d-%02d-%02d %02d:%02d:%02d",
+             tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday,
+             tm.tm_hour, tm.tm_min, tm.tm_sec);
+    obLogger.cachedTime = t;
   }
+  return obLogger.cachedTimeStr;
 }
 
-
-static char* obDecorateLog(char* log, const char* msg, const char* severity, va_list args)
+/**
+ * Format the record directly into the buffer
+ */
+static char* obDecorateLog(const char* msg, const char* severity, va_list args)
 {
-  time_t t = time(NULL);
-  struct tm tm = *localtime(&t);
-
-  char formattedMsg[OB_LOG_MAX] = "";
+  if (OB_LOG_BUFFER_SIZE - obLogger.size < OB_LOG_MAX) {
+    obFlushLocked();
+  }
 
-  vsprintf(formattedMsg, msg, args);
+  char* log = obLogger.buffer + obLogger.size;
+  int prefixLen = snprintf(log, OB_LOG_MAX, "%s OBINIT %s: ", obGetTimeStr(), severity);
+  int msgLen = vsnprintf(log + prefixLen, OB_LOG_MAX - prefixLen - 1, msg, args);
+  msgLen = msgLen < 0 ? 0 : msgLen;
+  size_t len = prefixLen + (msgLen < OB_LOG_MAX - prefixLen - 1
+                            ? (size_t)msgLen : (size_t)(OB_LOG_MAX - prefixLen - 2));
+  log[len] = '\n';
+  log[len + 1] = '\0';
+  obLogger.size += len + 2;
+  return log;
+}
 
-  sprintf(log, "%d-%02d-%02d %02d:%02d:%02d OBINIT %s: %s\n",
-          tm.tm_year + 1900, tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec,
-          severity, formattedMsg);
+static void obLog(ObLogLevel level, const char* severity, const char* msg, va_list args)
+{
+  if (level > obLoggerSettings.level) {
+    return;
+  }
 
-  return log;
+  pthread_once(&obLogger.once, obSetupLogger);
+  pthread_mutex_lock(&obLogger.mutex);
+  char* log = obDecorateLog(msg, severity, args);
+
+  if (level == OB_LOG_LEVEL_ERROR) {
+    // errors go to stderr, after everything logged before them
+    obLogger.size -= strlen(log) + 1;
+    obFlushLocked();
+    if (obLoggerSettings.stdOut) {
+      obWriteStdLog(stderr, log);
+      fflush(stderr);
+    }
+    if (obLoggerSettings.kmsgOut) {
+      obWriteKmsgLog(log);
+    }
+  }
+  else if (obLogger.cachedTime != obLogger.flushTime) {
+    // at most a second of delay for long running commands
+    obFlushLocked();
+  }
+  pthread_mutex_unlock(&obLogger.mutex);
 }
 
 
@@ -90,38 +166,58 @@ static char* obDecorateLog(char* log, const char* msg, const char* severity, va_
 
 void obInitLogger(bool stdOut, bool kmsgOut)
 {
+  pthread_mutex_lock(&obLogger.mutex);
+  obFlushLocked();
   obLoggerSettings.stdOut = stdOut;
   obLoggerSettings.kmsgOut = kmsgOut;
+  pthread_mutex_unlock(&obLogger.mutex);
+}
+
+void obSetLogLevel(ObLogLevel level)
+{
+  obLoggerSettings.level = level;
+}
+
+ObLogLevel obParseLogLevel(const char* value)
+{
+  if (strcmp(value, "error") == 0) {
+    return OB_LOG_LEVEL_ERROR;
+  }
+  else if (strcmp(value, "warning") == 0) {
+    return OB_LOG_LEVEL_WARNING;
+  }
+  return OB_LOG_LEVEL_INFO;
+}
+
+void obFlushLog()
+{
+  pthread_mutex_lock(&obLogger.mutex);
+  obFlushLocked();
+  pthread_mutex_unlock(&obLogger.mutex);
 }
 
 void obLogI(const char* msg, ...)
 {
-  char log[OB_LOG_MAX] = "";
   va_list args;
   va_start(args, msg);
-  obDecorateLog(log, msg, "INFO", args);
+  obLog(OB_LOG_LEVEL_INFO, "INFO", msg, args);
   va_end(args);
-  obWriteLog(log);
 }
 
 void obLogW(const char* msg, ...)
 {
-  char log[OB_LOG_MAX] = "";
   va_list args;
   va_start(args, msg);
-  obDecorateLog(log, msg, "WARNING", args);
+  obLog(OB_LOG_LEVEL_WARNING, "WARNING", msg, args);
   va_end(args);
-  obWriteLog(log);
 }
 
 void obLogE(const char* msg, ...)
 {
-  char log[OB_LOG_MAX] = "";
   va_list args;
   va_start(args, msg);
-  obDecorateLog(log, msg, "ERROR", args);
+  obLog(OB_LOG_LEVEL_ERROR, "ERROR", msg, args);
   va_end(args);
-  obWriteLogE(log);
 
   if (!_obErrorOccurred) {
     _obErrorOccurred = true;
@@ -5,6 +5,8 @@
 #include "ObMount.h"
 #include "ObOsUtils.h"
 #include "ob/ObLogging.h"
+#include "ob/ObTrace.h"
+#include "sds.h"
 
 #include <stdlib.h>
 #include <stdio.h>
@@ -18,6 +20,127 @@
 #include <sys/mount.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
+
+// the new mount API constants, for C libraries that lack them
+#ifndef FSOPEN_CLOEXEC
+# define FSOPEN_CLOEXEC 0x00000001
+#endif
+#ifndef FSMOUNT_CLOEXEC
+# define FSMOUNT_CLOEXEC 0x00000001
+#endif
+#ifndef MOVE_MOUNT_F_EMPTY_PATH
+# define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+#endif
+#ifndef FSCONFIG_SET_STRING
+# define FSCONFIG_SET_STRING 1
+#endif
+#ifndef FSCONFIG_CMD_CREATE
+# define FSCONFIG_CMD_CREATE 6
+#endif
+
+#define OVERLAY_LEGACY_OPTIONS_MAX 4096
+
+typedef enum ObOverlayMountResult
+{
+  OVERLAY_MOUNTED = 0,
+  OVERLAY_UNSUPPORTED,
+  OVERLAY_FAILED
+} ObOverlayMountResult;
+
+static bool isNewMountApiUnsupported(int error)
+{
+  return error == ENOSYS || error == EPERM || error == EOPNOTSUPP;
+}
+
+/**
+ * Mount the overlay with fsopen/fsconfig/fsmount/move_mount, adding
+ * lower layers one by one (lowerdir+, Linux 6.8+), so neither the mount
+ * data page nor path escaping limit the stack
+ */
+static ObOverlayMountResult obMountOverlayFsApi(const char** layers, int layerCount,
+                                                const char* upper, const char* work,
+                                                const char* mountPoint)
+{
+#if defined(__NR_fsopen) && defined(__NR_fsconfig) && defined(__NR_fsmount) && defined(__NR_move_mount)
+  int fsFd = syscall(__NR_fsopen, "overlay", FSOPEN_CLOEXEC);
+  if (fsFd < 0) {
+    return isNewMountApiUnsupported(errno) ? OVERLAY_UNSUPPORTED : OVERLAY_FAILED;
+  }
+
+  ObOverlayMountResult result = OVERLAY_MOUNTED;
+  for (int i = layerCount - 1; i >= 0 && result == OVERLAY_MOUNTED; --i) {
+    if (syscall(__NR_fsconfig, fsFd, FSCONFIG_SET_STRING, "lowerdir+", layers[i], 0) != 0) {
+      // lowerdir+ is not known to older overlayfs versions
+      result = i == layerCount - 1 && errno == EINVAL ? OVERLAY_UNSUPPORTED : OVERLAY_FAILED;
+      if (result == OVERLAY_FAILED) {
+        obLogE("Cannot add overlay layer %s: %s", layers[i], strerror(errno));
+      }
+    }
+  }
+
+  if (result == OVERLAY_MOUNTED
+      && (syscall(__NR_fsconfig, fsFd, FSCONFIG_SET_STRING, "upperdir", upper, 0) != 0
+          || syscall(__NR_fsconfig, fsFd, FSCONFIG_SET_STRING, "workdir", work, 0) != 0
+          || syscall(__NR_fsconfig, fsFd, FSCONFIG_CMD_CREATE, NULL, NULL, 0) != 0)) {
+    obLogE("Cannot configure overlay in %s: %s", mountPoint, strerror(errno));
+    result = OVERLAY_FAILED;
+  }
+
+  int mountFd = -1;
+  if (result == OVERLAY_MOUNTED) {
+    mountFd = syscall(__NR_fsmount, fsFd, FSMOUNT_CLOEXEC, 0);
+    if (mountFd < 0
+        || syscall(__NR_move_mount, mountFd, "", AT_FDCWD, mountPoint,
+                   MOVE_MOUNT_F_EMPTY_PATH) != 0) {
+      obLogE("Cannot mount %s: %s", mountPoint, strerror(errno));
+      result = OVERLAY_FAILED;
+    }
+  }
+
+  if (mountFd >= 0) {
+    close(mountFd);
+  }
+  close(fsFd);
+  return result;
+#else
+  (void)layers;
+  (void)layerCount;
+  (void)upper;
+  (void)work;
+  (void)mountPoint;
+  return OVERLAY_UNSUPPORTED;
+#endif
+}
+
+static bool obMountOverlayLegacy(const char** layers, int layerCount, const char* upper,
+                                 const char* work, const char* mountPoint)
+{
+  sds options = sdsnew("lowerdir=");
+  for (int i = layerCount - 1; i >= 0; --i) {
+    options = sdscat(options, layers[i]);
+    if (i != 0) {
+      options = sdscatlen(options, ":", 1);
+    }
+  }
+  options = sdscatfmt(options, ",upperdir=%s,workdir=%s", upper, work);
+
+  bool result = true;
+  obLogI("Overlay options: %s", options);
+  if (sdslen(options) >= OVERLAY_LEGACY_OPTIONS_MAX) {
+    obLogE("Overlay options exceed the mount data limit (%zu bytes, %i layers)",
+           sdslen(options), layerCount);
+    result = false;
+  }
+  else if (mount("overlay", mountPoint, "overlay", 0, options) != 0) {
+    obLogE("Cannot mount %s: %s", mountPoint, strerror(errno));
+    result = false;
+  }
+
+  sdsfree(options);
+  return result;
+}
 
 // --------- public API ---------- //
 
@@ -37,24 +160,128 @@ bool obMountBlockDevice(const char* device, const char* mountPoint)
   return true;
 }
 
-bool obMountImageFile(const char* device, const char* mountPoint)
+static bool obGetFreeLoopDevice(char* loopDevice)
+{
+  int controlFd = open("/dev/loop-control", O_RDWR | O_CLOEXEC);
+  if (controlFd < 0) {
+      obLogE("Opening loop control device failed");
+      return false;
+  }
+
+  int loopId = ioctl(controlFd, LOOP_CTL_GET_FREE);
+  close(controlFd);
+  if (loopId < 0) {
+    obLogE("No free loop device: %s", strerror(errno));
+    return false;
+  }
+
+  sprintf(loopDevice, "/dev/loop%d", loopId);
+  return true;
+}
+
+/**
+ * The smallest loop block size that allows direct I/O is the logical
+ * block size of the device holding the image (0, i.e. 512, if unknown)
+ */
+static uint32_t obGetBackingBlockSize(int imageFd)
+{
+  struct stat st;
+  if (fstat(imageFd, &st) != 0 || major(st.st_dev) == 0) {
+    return 0;
+  }
+
+  // partitions share the queue of the parent device
+  const char* queuePaths[] = {"queue", "../queue"};
+  uint32_t blockSize = 0;
+  for (size_t i = 0; i < 2 && blockSize == 0; ++i) {
+    char path[OB_PATH_MAX];
+    sprintf(path, "/sys/dev/block/%u:%u/%s/logical_block_size",
+            major(st.st_dev), minor(st.st_dev), queuePaths[i]);
+    FILE* file = fopen(path, "r");
+    if (file != NULL) {
+      if (fscanf(file, "%u", &blockSize) != 1) {
+        blockSize = 0;
+      }
+      fclose(file);
+    }
+  }
+  return blockSize;
+}
+
+/**
+ * Bypassing the page cache of the image file avoids caching each block
+ * twice (for the image and for the loop device)
+ * @return 0 or the errno of the failed ioctl, logged by the caller
+ */
+static int obConfigureLoopDevice(int deviceFd, int imageFd, bool readOnly)
+{
+#ifdef LOOP_CONFIGURE
+  struct loop_config config;
+  memset(&config, 0, sizeof(struct loop_config));
+  config.fd = imageFd;
+  config.block_size = obGetBackingBlockSize(imageFd);
+  config.info.lo_flags = LO_FLAGS_AUTOCLEAR;
+  if (readOnly) {
+    config.info.lo_flags |= LO_FLAGS_READ_ONLY;
+  }
+  if (OB_LOOP_DIRECT_IO) {
+    config.info.lo_flags |= LO_FLAGS_DIRECT_IO;
+  }
+
+  if (ioctl(deviceFd, LOOP_CONFIGURE, &config) == 0) {
+    return 0;
+  }
+  else if (errno == EINVAL && (config.info.lo_flags & LO_FLAGS_DIRECT_IO)) {
+    obLogI("Direct I/O not supported for the loop device, using buffered I/O");
+    config.info.lo_flags &= ~LO_FLAGS_DIRECT_IO;
+    if (ioctl(deviceFd, LOOP_CONFIGURE, &config) == 0) {
+      return 0;
+    }
+  }
+
+  if (errno != EINVAL && errno != ENOTTY) {
+    return errno;
+  }
+  obLogI("LOOP_CONFIGURE not available, using LOOP_SET_FD");
+#endif
+
+  if (ioctl(deviceFd, LOOP_SET_FD, imageFd) < 0) {
+    return errno;
+  }
+
+  // released with the last mount, as with LOOP_CONFIGURE
+  struct loop_info64 info;
+  memset(&info, 0, sizeof(struct loop_info64));
+  info.lo_flags = LO_FLAGS_AUTOCLEAR;
+  if (ioctl(deviceFd, LOOP_SET_STATUS64, &info) < 0) {
+    obLogW("Cannot set autoclear on the loop device: %s", strerror(errno));
+  }
+
+  if (OB_LOOP_DIRECT_IO) {
+    ioctl(deviceFd, LOOP_SET_DIRECT_IO, 1);
+  }
+  return 0;
+}
+
+static bool obMountLoopImage(const char* device, const char* mountPoint,
+                             const char* fsType, unsigned long flags, const char* options)
 {
   char loopDevice[OB_DEV_PATH_MAX];
-  int loopDeviceFd = obMountLoopDevice(device, loopDevice);
+  int loopDeviceFd = obMountLoopDevice(device, loopDevice, flags & MS_RDONLY);
 
   if (loopDeviceFd < 0) {
     obLogE("Loop device mount failed");
     return false;
   }
 
-  if (!obMkpath(mountPoint, OB_DEV_MOUNT_MODE)) {
+  if (!obExists(mountPoint) && !obMkpath(mountPoint, OB_DEV_MOUNT_MODE)) {
+    obFreeLoopDevice(loopDeviceFd);
     return false;
   }
 
   obLogI("Mounting image file (%s) via loop device: %s", device, loopDevice);
   bool result = true;
-  if (mount(loopDevice, mountPoint, OB_DEVICE_FS,
-            OB_DEV_MOUNT_FLAGS, OB_DEV_MOUNT_OPTIONS) < 0) {
+  if (mount(loopDevice, mountPoint, fsType, flags, options) < 0) {
       obLogE("Mounting %s in %s failed with error: %s",
              loopDevice, mountPoint, strerror(errno));
       result = false;
@@ -64,6 +291,17 @@ bool obMountImageFile(const char* device, const char* mountPoint)
   return result;
 }
 
+bool obMountImageFile(const char* device, const char* mountPoint)
+{
+  return obMountLoopImage(device, mountPoint, OB_DEVICE_FS,
+                          OB_DEV_MOUNT_FLAGS, OB_DEV_MOUNT_OPTIONS);
+}
+
+bool obMountReadOnlyImage(const char* image, const char* mountPoint, const char* fsType)
+{
+  return obMountLoopImage(image, mountPoint, fsType, MS_RDONLY | MS_NODEV | MS_NOSUID, "");
+}
+
 //bool obMountDevice(const char* device, const char* mountPoint)
 //{
 //  obLogI("Mounting device %s in %s", device, mountPoint);
@@ -173,38 +411,38 @@ bool obMountTmpfs(const char* path, const char* sizeStr)
   return true;
 }
 
-int obMountLoopDevice(const char* imagePath, char* loopDevice)
+int obMountLoopDevice(const char* imagePath, char* loopDevice, bool readOnly)
 {
-  int controlFd = open("/dev/loop-control", O_RDWR);
-  if (controlFd < 0) {
-      obLogE("Opening loop control device failed");
-      return controlFd;
-  }
-
-  int loopId = ioctl(controlFd, LOOP_CTL_GET_FREE);
-  sprintf(loopDevice, "/dev/loop%d", loopId);
-  close(controlFd);
-
-  obLogI("Using loop device: %s", loopDevice);
-
-  int imageFd = open64(imagePath, O_RDWR);
+  int imageFd = open64(imagePath, (readOnly ? O_RDONLY : O_RDWR) | O_CLOEXEC);
   if (imageFd < 0) {
       obLogE("Opening image file (%s) failed: %s", imagePath, strerror(errno));
       return imageFd;
   }
 
-  int deviceFd = open(loopDevice, O_RDWR);
-  if (deviceFd < 0) {
-      obLogE("Opening loop device failed");
-      close(imageFd);
-      return deviceFd;
-  }
+  int deviceFd = -1;
+  for (int attempt = 0; attempt < OB_LOOP_BUSY_RETRIES && deviceFd < 0; ++attempt) {
+    if (!obGetFreeLoopDevice(loopDevice)) {
+      break;
+    }
 
-  if (ioctl(deviceFd, LOOP_SET_FD, imageFd) < 0) {
-      obLogE("ioctl LOOP_SET_FD failed");
-      close(imageFd);
+    obLogI("Using loop device: %s", loopDevice);
+    deviceFd = open(loopDevice, (readOnly ? O_RDONLY : O_RDWR) | O_CLOEXEC);
+    if (deviceFd < 0) {
+      obLogE("Opening loop device failed: %s", strerror(errno));
+      break;
+    }
+
+    int error = obConfigureLoopDevice(deviceFd, imageFd, readOnly);
+    if (error != 0) {
       close(deviceFd);
-      return -1;
+      deviceFd = -1;
+      // taken by another process in the meantime
+      if (error != EBUSY) {
+        obLogE("Cannot attach %s to %s: %s", imagePath, loopDevice, strerror(error));
+        break;
+      }
+      obLogI("Loop device %s is busy, trying another one", loopDevice);
+    }
   }
 
   close(imageFd);
@@ -217,23 +455,11 @@ void obFreeLoopDevice(int deviceFd)
   close(deviceFd);
 }
 
-bool obMountOverlay(char** layers, int layerCount, const char* upper,
+bool obMountOverlay(const char** layers, int layerCount, const char* upper,
                     const char* work, const char* mountPoint)
 {
-  obLogI("Mounting overlayfs in %s", mountPoint);
-
-  char lowerLayers[OB_PATH_MAX * layerCount];
-  lowerLayers[0] = '\0';
-
-  for (int i = layerCount -1; i >=0; --i) {
-    strcat(lowerLayers, layers[i]);
-    if (i != 0) {
-      strcat(lowerLayers, ":");
-    }
-  }
-
-  char options[OB_DEV_PATH_MAX * (layerCount+2)];
-  sprintf(options, "lowerdir=%s,upperdir=%s,workdir=%s", lowerLayers, upper, work);
+  uint64_t traceStart = obGetMonotonicNs();
+  obLogI("Mounting overlayfs in %s (%i lower layers)", mountPoint, layerCount);
 
   if (!obMkpath(mountPoint, OB_DEV_MOUNT_MODE)) {
     return false;
@@ -243,16 +469,19 @@ bool obMountOverlay(char** layers, int layerCount, const char* upper,
     return false;
   }
 
-  obLogI("Overlay options: %s", options);
-  int result = mount("overlay", mountPoint, "overlay", 0, options);
-  if (result != 0) {
-    obLogE("Cannot mount %s: %s", mountPoint, strerror(errno));
+  ObOverlayMountResult result = obMountOverlayFsApi(layers, layerCount, upper,
+                                                    work, mountPoint);
+  if (result == OVERLAY_UNSUPPORTED) {
+    obLogI("New mount API not available, using legacy overlay options");
+    result = obMountOverlayLegacy(layers, layerCount, upper, work, mountPoint)
+        ? OVERLAY_MOUNTED : OVERLAY_FAILED;
   }
-  else {
+
+  if (result == OVERLAY_MOUNTED) {
     obLogI("OVERLAY MOUNTED");
   }
-
-  return result == 0;
+  obTraceSpan("obMountOverlay", mountPoint, traceStart);
+  return result == OVERLAY_MOUNTED;
 }
 
 bool obBlockByTmpfs(const char* path)
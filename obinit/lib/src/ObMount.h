@@ -12,6 +12,11 @@ bool obMountBlockDevice(const char* device, const char* mountPoint);
 
 bool obMountImageFile(const char* device, const char* mountPoint);
 
+/**
+ * @brief Mount a read-only filesystem image (e.g. erofs) via a loop device
+ */
+bool obMountReadOnlyImage(const char* image, const char* mountPoint, const char* fsType);
+
 //bool obMountDevice(const char* device, const char* mountPoint);
 
 bool obUnmount(const char* path);
@@ -26,11 +31,16 @@ bool obMove(const char* srcPath, const char* dstPath);
 
 bool obMountTmpfs(const char* path, const char* sizeStr);
 
-int obMountLoopDevice(const char* imagePath, char* loopDevice);
+/**
+ * @brief Attach the image to a free loop device, with direct I/O and
+ * autoclear when LOOP_CONFIGURE is available
+ * @return loop device descriptor or a negative value on error
+ */
+int obMountLoopDevice(const char* imagePath, char* loopDevice, bool readOnly);
 
 void obFreeLoopDevice(int deviceFd);
 
-bool obMountOverlay(char** layers, int layerCount, const char* upper,
+bool obMountOverlay(const char** layers, int layerCount, const char* upper,
                     const char* work, const char* mountPoint);
 
 bool obBlockByTmpfs(const char* path);
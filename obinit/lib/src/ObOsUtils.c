@@ -3,6 +3,8 @@
 // See accompanying file LICENSE.txt for the full license.
 
 #include "ObOsUtils.h"
+#include "ObCopy.h"
+#include "ob/ObSync.h"
 #include "ob/ObLogging.h"
 #include "ob/ObDefs.h"
 #include <sds.h>
@@ -14,17 +16,19 @@
 #include <unistd.h>
 #include <errno.h>
 #include <string.h>
+#include <limits.h>
 #include <fcntl.h>
 #include <libgen.h>
 #include <dirent.h>
 #include <sys/types.h>
+#include <sys/xattr.h>
 
 #include <ftw.h>
+#include <spawn.h>
+#include <sys/wait.h>
 
 #define UNUSED(x) (void)(x)
 
-#define FILE_COPY_BUFFER_SIZE 1024
-#define NFTW_NOPENFD 10
 
 static int obMkdir(const char *path, mode_t mode)
 {
@@ -52,51 +56,6 @@ static int obRmPath(const char* path, const struct stat* sbuf, int type, struct
   return obRemovePath(path) ? 0 : -1;
 }
 
-static const char* syncSrcDir = NULL;
-static const char* syncDstDir = NULL;
-
-static int obSyncCb(const char* path, const struct stat* sbuf, int type, struct FTW* ftwb)
-{
-  UNUSED(sbuf);
-  UNUSED(type);
-  UNUSED(ftwb);
-
-  char toPath[OB_PATH_MAX];
-  strcpy(toPath, syncDstDir);
-  strcat(toPath, "/");
-  strcat(toPath, path + strlen(syncSrcDir));
-
-  if (type == FTW_D) {
-    struct stat st;
-    stat(path, &st);
-    if (!obMkpath(toPath, st.st_mode)) {
-      return 1;
-    }
-  }
-  else if (type == FTW_F) {
-    if (!obCopyFile(path, toPath)) {
-      return 1;
-    }
-  }
-  else if (type == FTW_SL) {
-    char linkTarget[OB_PATH_MAX] = {0};
-
-    if (readlink(path, linkTarget, OB_PATH_MAX) == -1) {
-      obLogE("readlink error on %s: ", path, errno);
-      return 1;
-    }
-    if (symlink(linkTarget, toPath) != 0) {
-      obLogE("Cannot create symlink %s -> %s", path, linkTarget);
-      return 1;
-    }
-  }
-  else {
-    obLogE("Type %i not supported (%s)", type, path);
-  }
-
-  return 0;
-}
-
 static bool obEnsureParentExists(const char* path)
 {
   char pathCpy[OB_PATH_MAX];
@@ -110,37 +69,23 @@ static bool obEnsureParentExists(const char* path)
   return true;
 }
 
-static bool obCopyFileAttributes(const char* src, const char* dst)
+static void obCopyFileAttributes(const struct stat64* st, int fd, const char* dst)
 {
-  struct stat64 st;
-  if (stat64(src, &st) == -1) {
-    obLogE("Cannot stat %s", src);
-    return false;
-  }
-
-  if (chmod(dst, st.st_mode) != 0) {
-    obLogW("chmod error on %s", dst);
-    return 1;
-  }
-
-  if (chown(dst, st.st_uid, st.st_gid) != 0) {
+  if (fchown(fd, st->st_uid, st->st_gid) != 0) {
     obLogW("chown error on %s", dst);
-    return 1;
   }
 
-  int fd = open(dst, O_WRONLY);
-  if (fd == -1) {
-    obLogE("Cannot open file (ts update) %s: %s", dst, strerror(errno));
-    return false;
+  if (fchmod(fd, st->st_mode) != 0) {
+    obLogW("chmod error on %s", dst);
   }
 
   struct timespec times[2] = {
-    st.st_atim,
-        st.st_mtim
+    st->st_atim,
+    st->st_mtim
   };
-  utimensat(fd, dst, times, 0);
-  close(fd);
-  return true;
+  if (futimens(fd, times) != 0) {
+    obLogW("Cannot update timestamps of %s: %s", dst, strerror(errno));
+  }
 }
 
 // --------- public API ---------- //
@@ -172,6 +117,78 @@ bool obMkpath(const char* path, mode_t mode)
   return true;
 }
 
+int obComparePaths(const char* a, const char* b)
+{
+  while (*a != '\0' && *a == *b) {
+    ++a;
+    ++b;
+  }
+  // the separator goes before any other character
+  unsigned char ca = *a == '/' ? 1 : (unsigned char)*a;
+  unsigned char cb = *b == '/' ? 1 : (unsigned char)*b;
+  return (int)ca - (int)cb;
+}
+
+bool obMkpaths(const char* const* paths, int count, mode_t mode)
+{
+  bool result = true;
+  const char* prev = NULL;
+  for (int i = 0; i < count; ++i) {
+    const char* path = paths[i];
+
+    // the longest common directory with the previous path already exists
+    size_t existing = 0;
+    if (prev != NULL) {
+      size_t common = 0;
+      while (path[common] != '\0' && path[common] == prev[common]) {
+        ++common;
+      }
+      if ((path[common] == '\0' || path[common] == '/')
+          && (prev[common] == '\0' || prev[common] == '/')) {
+        existing = common;
+      }
+      else {
+        while (common > 0 && path[common - 1] != '/') {
+          --common;
+        }
+        existing = common;
+      }
+    }
+
+    char dirPath[OB_PATH_MAX];
+    size_t length = strlen(path);
+    if (length >= sizeof(dirPath)) {
+      obLogE("Cannot create path %s (%s)", path, strerror(ENAMETOOLONG));
+      result = false;
+      prev = NULL;
+      continue;
+    }
+    memcpy(dirPath, path, length + 1);
+
+    int status = 0;
+    for (size_t c = existing + 1; status == 0 && c <= length; ++c) {
+      if (dirPath[c] == '/' || dirPath[c] == '\0') {
+        if (dirPath[c - 1] == '/') {
+          continue;
+        }
+        char separator = dirPath[c];
+        dirPath[c] = '\0';
+        status = obMkdir(dirPath, mode);
+        dirPath[c] = separator;
+      }
+    }
+
+    if (status != 0) {
+      obLogE("Cannot create path %s (%s)", path, strerror(errno));
+      result = false;
+      prev = NULL;
+      continue;
+    }
+    prev = path;
+  }
+  return result;
+}
+
 bool obExists(const char* path)
 {
   return access(path, F_OK) != -1;
@@ -254,56 +271,85 @@ bool obCreateBlankFile(const char* path)
 
 bool obCopyFile(const char* src, const char* dst)
 {
-  char buffer[FILE_COPY_BUFFER_SIZE];
-
-  FILE *fIn = fopen(src, "r");
-  if (fIn == NULL) {
+  int srcFd = open(src, O_RDONLY | O_CLOEXEC);
+  if (srcFd < 0) {
     obLogE("Cannot open source file %s: %s", src, strerror(errno));
     return false;
   }
 
+  struct stat64 st;
+  if (fstat64(srcFd, &st) != 0) {
+    obLogE("Cannot stat %s: %s", src, strerror(errno));
+    close(srcFd);
+    return false;
+  }
+
   char dname[OB_PATH_MAX];
   strcpy(dname, dst);
   dirname(dname);
   if (!obExists(dname)) {
-    struct stat st;
-    stat(src, &st);
     obMkpath(dname, st.st_mode);
   }
 
-  FILE *fOut = fopen(dst, "w");
-  if (fOut == NULL) {
+  int dstFd = open(dst, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, S_IRUSR | S_IWUSR);
+  if (dstFd < 0) {
     obLogE("Cannot open destination file %s: %s", dst, strerror(errno));
-    fclose(fIn);
+    close(srcFd);
     return false;
   }
 
-  while (!feof(fIn)) {
-    size_t byteCount = fread(buffer, 1, sizeof(buffer), fIn);
-    if (byteCount && fwrite(buffer, 1, byteCount, fOut) != byteCount) {
-      obLogE("Error while writing to %s: %s", dst, strerror(errno));;
-      fclose(fIn);
-      fclose(fOut);
-      return false;
-    }
+  ObCopyStrategy strategy;
+  bool result = obCopyFd(srcFd, dstFd, st.st_size, &strategy);
+  if (!result) {
+    obLogE("Error while writing to %s: %s", dst, strerror(errno));
+  }
+  else {
+    obCopyFileAttributes(&st, dstFd, dst);
+    obCopyXattrs(src, dst);
   }
 
-  fclose(fIn);
-  fclose(fOut);
+  close(srcFd);
+  close(dstFd);
+  return result;
+}
 
-  obCopyFileAttributes(src, dst);
-  return true;
+bool obCopyXattrs(const char* src, const char* dst)
+{
+  ssize_t listSize = llistxattr(src, NULL, 0);
+  if (listSize <= 0) {
+    return listSize == 0 || errno == ENOTSUP;
+  }
+
+  char* names = malloc(listSize);
+  listSize = llistxattr(src, names, listSize);
+  bool result = listSize >= 0;
+
+  for (ssize_t pos = 0; pos < listSize; pos += strlen(names + pos) + 1) {
+    const char* name = names + pos;
+    ssize_t valueSize = lgetxattr(src, name, NULL, 0);
+    if (valueSize < 0) {
+      continue;
+    }
+
+    char* value = malloc(valueSize > 0 ? valueSize : 1);
+    valueSize = lgetxattr(src, name, value, valueSize);
+    if (valueSize >= 0 && lsetxattr(dst, name, value, valueSize, 0) != 0
+        && errno != ENOTSUP && errno != EPERM) {
+      obLogW("Cannot set %s attribute on %s: %s", name, dst, strerror(errno));
+      result = false;
+    }
+    free(value);
+  }
+
+  free(names);
+  return result;
 }
 
 bool obSync(const char* src, const char* dst)
 {
-  obLogI("Syncing %s -> %s", src, dst);
-  syncSrcDir = src;
-  syncDstDir = dst;
-  bool result = nftw(src, obSyncCb, NFTW_NOPENFD, FTW_PHYS) >= 0;
-  syncSrcDir = NULL;
-  syncDstDir = NULL;
-  return result;
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  return obSyncTree(src, dst, &options);
 }
 
 bool obRename(const char* src, const char* dst)
@@ -318,8 +364,8 @@ bool obRename(const char* src, const char* dst)
   bool result = true;
   if (!obExists(parent)) {
     result = obMkpath(parent, OB_MKPATH_MODE);
-    sdsfree(dstCpy);
   }
+  sdsfree(dstCpy);
 
   if (result && rename(src, dst) != 0) {
     obLogE("Cannot rename %s -> %s: %s", src, dst, strerror(errno));
@@ -328,3 +374,80 @@ bool obRename(const char* src, const char* dst)
 
   return result;
 }
+
+bool obRunCommand(char* const argv[])
+{
+  extern char** environ;
+  pid_t pid;
+  // the records logged so far go before the output of the command
+  obFlushLog();
+  int error = posix_spawnp(&pid, argv[0], NULL, NULL, argv, environ);
+  if (error != 0) {
+    obLogE("Cannot run %s: %s", argv[0], strerror(error));
+    return false;
+  }
+
+  int status = 0;
+  while (waitpid(pid, &status, 0) < 0) {
+    if (errno != EINTR) {
+      obLogE("Cannot wait for %s: %s", argv[0], strerror(errno));
+      return false;
+    }
+  }
+
+  if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+    obLogE("%s failed with status %i", argv[0], WIFEXITED(status) ? WEXITSTATUS(status) : -1);
+    return false;
+  }
+  return true;
+}
+
+bool obParseSize(const char* str, unsigned long long* size)
+{
+  char* suffix = NULL;
+  errno = 0;
+  unsigned long long value = strtoull(str, &suffix, 10);
+  if (errno != 0 || suffix == str) {
+    return false;
+  }
+
+  int shift = 0;
+  switch (*suffix) {
+  case '\0':
+    break;
+  case 'k':
+  case 'K':
+    shift = 10;
+    break;
+  case 'm':
+  case 'M':
+    shift = 20;
+    break;
+  case 'g':
+  case 'G':
+    shift = 30;
+    break;
+  case 't':
+  case 'T':
+    shift = 40;
+    break;
+  case '%': {
+    unsigned long long ram = (unsigned long long)sysconf(_SC_PHYS_PAGES)
+        * (unsigned long long)sysconf(_SC_PAGESIZE);
+    // above 100 for the compressed devices
+    if (suffix[1] != '\0' || (value > 0 && ram / 100 > ULLONG_MAX / value)) {
+      return false;
+    }
+    *size = ram / 100 * value;
+    return true;
+  }
+  default:
+    return false;
+  }
+
+  if ((suffix[0] != '\0' && suffix[1] != '\0') || value > ULLONG_MAX >> shift) {
+    return false;
+  }
+  *size = value << shift;
+  return true;
+}
@@ -9,6 +9,18 @@
 #include <sys/types.h>
 
 bool obMkpath(const char *path, mode_t mode);
+
+/**
+ * @brief Compare paths component by component, so that a directory is
+ * directly followed by its contents ("/a", "/a/b", "/a-b")
+ */
+int obComparePaths(const char* a, const char* b);
+
+/**
+ * @brief obMkpath for many paths sorted with obComparePaths. The directories
+ * shared with the previous path are not checked again.
+ */
+bool obMkpaths(const char* const* paths, int count, mode_t mode);
 bool obExists(const char* path);
 bool obIsFile(const char* path);
 bool obIsBlockDevice(const char* path);
@@ -18,7 +30,21 @@ bool obRemoveDirR(const char* path);
 bool obRemovePath(const char* path);
 bool obCreateBlankFile(const char* path);
 bool obCopyFile(const char* src, const char* dst);
+bool obCopyXattrs(const char* src, const char* dst);
 bool obSync(const char* src, const char* dst);
 bool obRename(const char* src, const char* dst);
 
+/**
+ * @brief Run an external program (looked up in PATH) and wait for it
+ * @return true if it exited with status 0
+ */
+bool obRunCommand(char* const argv[]);
+
+/**
+ * @brief Parse a size the way tmpfs does: bytes with an optional k, m, g
+ * or t (binary) suffix, or % of the physical RAM (may exceed 100)
+ * @return false if the size is malformed or does not fit
+ */
+bool obParseSize(const char* str, unsigned long long* size);
+
 #endif // OBOSUTILS_H
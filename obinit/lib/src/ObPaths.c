@@ -4,73 +4,117 @@
 
 #include "ObPaths.h"
 
-sds obGetRepoPath(const ObContext* context)
+#include <string.h>
+
+/**
+ * The layer directory (.obld) of the layer root path
+ */
+static sds obGetLayerDirPath(const char* layerRootPath)
 {
-  sds repoPath = sdsempty();
-  return sdscatprintf(repoPath, "%s/%s", context->devMountPoint, context->config.repository);
+  sds path = sdsnew(layerRootPath);
+  size_t rootLength = strlen(OB_LAYER_ROOT_DIR);
+  if (sdslen(path) >= rootLength
+      && strcmp(path + sdslen(path) - rootLength, OB_LAYER_ROOT_DIR) == 0) {
+    sdsrange(path, 0, sdslen(path) - rootLength - 1);
+  }
+  return path;
 }
 
-sds obGetLowerRootPath(const ObContext* context)
+const char* obGetRepoPath(const ObContext* context)
 {
-  sds lowerPath = sdsnew(context->overbootDir);
-  return sdscat(lowerPath, "/lower-root");
+  return context->paths.repo;
 }
 
-sds obGetPersistentUpperPath(const ObContext* context)
+const char* obGetLowerRootPath(const ObContext* context)
 {
-  sds path = obGetRepoPath(context);
-  return sdscat(path, "/upper");
+  return context->paths.lowerRoot;
 }
 
-sds obGetUpperPath(const ObContext* context)
+const char* obGetPersistentUpperPath(const ObContext* context)
 {
-  sds upperPath = NULL;
-  if (context->config.useTmpfs) {
-    upperPath = sdsnew(context->overbootDir);
-    upperPath = sdscat(upperPath, "/upper");
-  }
-  else {
-    upperPath = obGetPersistentUpperPath(context);
-  }
-  return upperPath;
+  return context->paths.persistentUpper;
 }
 
-sds obGetBindedUpperPath(const ObContext* context)
+const char* obGetUpperPath(const ObContext* context)
 {
-  sds bindedOverlay = obGetBindedOverlayPath(context);
-  sds bindedUpper = sdsnew(bindedOverlay);
-  bindedUpper = sdscat(bindedUpper, "/upper");
-  sdsfree(bindedOverlay);
-  return bindedUpper;
+  return context->paths.upper;
 }
 
-sds obGetOverlayWorkPath(const ObContext* context)
+const char* obGetBindedUpperPath(const ObContext* context)
 {
-  sds workPath = NULL;
-  if (context->config.useTmpfs) {
-    workPath = sdsnew(context->overbootDir);
-  }
-  else {
-    sds repoPath = obGetRepoPath(context);
-    workPath = sdsnew(repoPath);
-    sdsfree(repoPath);
+  return context->paths.bindedUpper;
+}
+
+const char* obGetOverlayWorkPath(const ObContext* context)
+{
+  return context->paths.overlayWork;
+}
+
+
+const char* obGetBindedOverlayPath(const ObContext* context)
+{
+  return context->paths.bindedOverlay;
+}
+
+sds obGetLayerManifestPath(const char* layerRootPath)
+{
+  return sdscat(obGetLayerDirPath(layerRootPath), OB_LAYER_MANIFEST_PATH);
+}
+
+sds obGetLayerFlatPath(const char* layerRootPath)
+{
+  return sdscat(obGetLayerDirPath(layerRootPath), OB_LAYER_FLAT_DIR);
+}
+
+sds obGetLayerFlatIndexPath(const char* layerRootPath)
+{
+  return sdscat(obGetLayerDirPath(layerRootPath), OB_LAYER_FLAT_INDEX_PATH);
+}
+
+sds obGetLayerInfoPath(const char* layerDir, ObLayerFormat* format)
+{
+  *format = obDetectLayerFormat(layerDir);
+  sds path = sdsnew(layerDir);
+  if (*format == OB_LAYER_FORMAT_DIR) {
+    path = sdscat(path, OB_LAYER_ROOT_DIR);
+    return sdscat(path, OB_LAYER_INFO_PATH);
   }
-  return sdscat(workPath, "/work");
+  return sdscat(path, OB_LAYER_IMAGE_INFO_PATH);
 }
 
+const char* obGetJobsPath(const ObContext* context)
+{
+  return context->paths.jobs;
+}
 
-sds obGetBindedOverlayPath(const ObContext* context)
+const char* obGetDurablesPath(const ObContext* context)
 {
-  sds bindedOverlay = sdsempty();
-  return sdscatprintf(bindedOverlay, "%s/%s",
-                      context->root, OB_USER_BINDINGS_DIR);
+  return context->paths.durables;
 }
 
-sds obGetJobsPath(const ObContext* context)
+const char* obGetTrashPath(const ObContext* context)
 {
-  sds path = obGetRepoPath(context);
-  path = sdscatfmt(path, "/%s", OB_JOBS_DIR_NAME);
-  return path;
+  return context->paths.trash;
+}
+
+const char* obGetFlushStagingPath(const ObContext* context)
+{
+  return context->paths.flushStaging;
+}
+
+const char* obGetFlushedUpperPath(const ObContext* context)
+{
+  return context->paths.flushedUpper;
+}
+
+const char* obGetPrefetchPath(const ObContext* context)
+{
+  return context->paths.prefetch;
+}
+
+const char* obGetPrefetchListPath(const ObContext* context)
+{
+  return context->paths.prefetchList;
 }
 
 sds obGetBindedJobsPath(const char* bindedOverlay)
@@ -79,22 +123,27 @@ sds obGetBindedJobsPath(const char* bindedOverlay)
   return sdscatfmt(bindedJobsDir, "/%s", OB_JOBS_DIR_NAME);
 }
 
+sds obGetBindedPrefetchPath(const char* bindedOverlay)
+{
+  sds bindedPrefetchDir = sdsnew(bindedOverlay);
+  return sdscatfmt(bindedPrefetchDir, "/%s", OB_PREFETCH_DIR_NAME);
+}
+
 sds obGetBindedLayersPath(const char* bindedOverlay)
 {
   sds bindedLayersDir = sdsnew(bindedOverlay);
   return sdscat(bindedLayersDir, "/layers");
 }
 
-sds obGetLayersPath(const ObContext* context)
+const char* obGetLayersPath(const ObContext* context)
 {
-  sds path = obGetRepoPath(context);
-  return sdscatfmt(path, "/%s", OB_LAYERS_DIR_NAME);
+  return context->paths.layers;
 }
 
 sds obGetRootFstabPath(const char* rootmnt)
 {
   sds fstabPath = sdsnew(rootmnt);
-  return sdscat(fstabPath, "/etc/fstab");
+  return sdscat(fstabPath, OB_FSTAB_PATH);
 }
 
 sds obGetRootFstabBackupPath(const char* fstabPath)
@@ -103,8 +152,12 @@ sds obGetRootFstabBackupPath(const char* fstabPath)
   return sdscat(backupPath, ".orig");
 }
 
-sds obGetLockFilePath(const ObContext* context)
+const char* obGetLockFilePath(const ObContext* context)
+{
+  return context->paths.lock;
+}
+
+const char* obGetLayerIndexPath(const ObContext* context)
 {
-  sds path = obGetRepoPath(context);
-  return sdscat(path, "/obinit.lock");
+  return context->paths.layerIndex;
 }
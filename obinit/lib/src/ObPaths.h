@@ -6,35 +6,76 @@
 #define OBPATHS_H
 
 #include "ob/ObContext.h"
+#include "ob/ObLayerImage.h"
 #include "sds.h"
 #include <stdlib.h>
 
-sds obGetRepoPath(const ObContext* context);
+// the context paths are computed by obResolveContextPaths
 
-sds obGetLowerRootPath(const ObContext* context);
+const char* obGetRepoPath(const ObContext* context);
 
-sds obGetPersistentUpperPath(const ObContext* context);
+const char* obGetLowerRootPath(const ObContext* context);
 
-sds obGetUpperPath(const ObContext* context);
+const char* obGetPersistentUpperPath(const ObContext* context);
 
-sds obGetBindedUpperPath(const ObContext* context);
+const char* obGetUpperPath(const ObContext* context);
 
-sds obGetOverlayWorkPath(const ObContext* context);
+const char* obGetBindedUpperPath(const ObContext* context);
 
-sds obGetBindedOverlayPath(const ObContext* context);
+const char* obGetOverlayWorkPath(const ObContext* context);
+
+const char* obGetBindedOverlayPath(const ObContext* context);
 
 sds obGetBindedLayersPath(const char* bindedOverlay);
 
-sds obGetLayersPath(const ObContext* context);
+const char* obGetLayersPath(const ObContext* context);
+
+/**
+ * @brief Path of the manifest stored next to the layer root directory
+ */
+sds obGetLayerManifestPath(const char* layerRootPath);
+
+/**
+ * @brief Path of the flattened layer chain stored next to the layer root
+ * directory
+ */
+sds obGetLayerFlatPath(const char* layerRootPath);
+
+/**
+ * @brief Path of the chain description the flat directory was built from
+ */
+sds obGetLayerFlatIndexPath(const char* layerRootPath);
+
+/**
+ * @brief Path of the info file of the layer stored in layerDir (inside
+ * the root directory or next to the layer image)
+ */
+sds obGetLayerInfoPath(const char* layerDir, ObLayerFormat* format);
+
+const char* obGetJobsPath(const ObContext* context);
+
+const char* obGetDurablesPath(const ObContext* context);
 
-sds obGetJobsPath(const ObContext* context);
+const char* obGetTrashPath(const ObContext* context);
+
+const char* obGetFlushStagingPath(const ObContext* context);
+
+const char* obGetFlushedUpperPath(const ObContext* context);
+
+const char* obGetPrefetchPath(const ObContext* context);
+
+const char* obGetPrefetchListPath(const ObContext* context);
 
 sds obGetBindedJobsPath(const char* bindedOverlay);
 
+sds obGetBindedPrefetchPath(const char* bindedOverlay);
+
 sds obGetRootFstabPath(const char* rootmnt);
 
 sds obGetRootFstabBackupPath(const char* fstabPath);
 
-sds obGetLockFilePath(const ObContext* context);
+const char* obGetLockFilePath(const ObContext* context);
+
+const char* obGetLayerIndexPath(const ObContext* context);
 
 #endif // OBPATHS_H
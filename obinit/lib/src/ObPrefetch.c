@@ -0,0 +1,465 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ob/ObPrefetch.h"
+#include "ObOsUtils.h"
+#include "ObPaths.h"
+#include "ObThreadPool.h"
+#include "ob/ObHash.h"
+#include "ob/ObLogging.h"
+#include "ob/ObTrace.h"
+#include "ob/ObDefs.h"
+#include <sds.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+#include <sys/fanotify.h>
+
+#define PREFETCH_EVENT_BUFFER_SIZE 8192
+#define PREFETCH_DELETED_SUFFIX " (deleted)"
+#define PREFETCH_TMP_EXT ".tmp"
+#define PREFETCH_OPAQUE_XATTR "trusted.overlay.opaque"
+
+typedef struct ObPrefetchRecorder
+{
+  int fanotifyFd;
+  int procFd; // /proc may be moved into the new root
+  int rootFd; // the watched mount, its path changes when the root is switched
+  sds* paths;
+  int count;
+  uint64_t* seen; // open addressing set of the path hashes, 0 for a free slot
+  size_t seenSize;
+} ObPrefetchRecorder;
+
+typedef struct ObPrefetchQueue
+{
+  const char* const* layers;
+  int layerCount;
+  sds* paths;
+  int count;
+  atomic_int next;
+  atomic_int prefetched;
+} ObPrefetchQueue;
+
+static void obCloseRecorder(ObPrefetchRecorder* recorder)
+{
+  if (recorder->fanotifyFd >= 0) {
+    close(recorder->fanotifyFd);
+  }
+  if (recorder->procFd >= 0) {
+    close(recorder->procFd);
+  }
+  if (recorder->rootFd >= 0) {
+    close(recorder->rootFd);
+  }
+  for (int i = 0; i < recorder->count; ++i) {
+    sdsfree(recorder->paths[i]);
+  }
+  free(recorder->paths);
+  free(recorder->seen);
+  memset(recorder, 0, sizeof(ObPrefetchRecorder));
+  recorder->fanotifyFd = recorder->procFd = recorder->rootFd = -1;
+}
+
+static bool obOpenRecorder(ObPrefetchRecorder* recorder, const char* mountPath)
+{
+  memset(recorder, 0, sizeof(ObPrefetchRecorder));
+  recorder->fanotifyFd = fanotify_init(FAN_CLASS_NOTIF | FAN_CLOEXEC,
+                                       O_RDONLY | O_LARGEFILE | O_CLOEXEC);
+  recorder->procFd = open("/proc", O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  recorder->rootFd = open(mountPath, O_PATH | O_DIRECTORY | O_CLOEXEC);
+
+  if (recorder->fanotifyFd < 0 || recorder->procFd < 0 || recorder->rootFd < 0
+      || fanotify_mark(recorder->fanotifyFd, FAN_MARK_ADD | FAN_MARK_MOUNT,
+                       FAN_OPEN, AT_FDCWD, mountPath) != 0) {
+    obLogE("Cannot watch the files opened on %s: %s", mountPath, strerror(errno));
+    obCloseRecorder(recorder);
+    return false;
+  }
+
+  recorder->paths = calloc(OB_PREFETCH_MAX_FILES, sizeof(sds));
+  recorder->seenSize = 2 * OB_PREFETCH_MAX_FILES;
+  recorder->seen = calloc(recorder->seenSize, sizeof(uint64_t));
+  return true;
+}
+
+static bool obReadFdPath(int procFd, int fd, char* buffer, size_t size)
+{
+  char link[32];
+  sprintf(link, "self/fd/%i", fd);
+  ssize_t length = readlinkat(procFd, link, buffer, size - 1);
+  if (length < 0 || (size_t)length == size - 1) {
+    return false;
+  }
+  buffer[length] = '\0';
+  return true;
+}
+
+/**
+ * @return true if the path has not been seen before
+ */
+static bool obMarkSeen(ObPrefetchRecorder* recorder, const char* path)
+{
+  ObHash hash;
+  obHashData(path, strlen(path), OB_HASH_XXH3_64, &hash);
+  uint64_t key = hash.low | 1;
+
+  size_t slot = key % recorder->seenSize;
+  while (recorder->seen[slot] != 0) {
+    if (recorder->seen[slot] == key) {
+      return false;
+    }
+    slot = (slot + 1) % recorder->seenSize;
+  }
+  recorder->seen[slot] = key;
+  return true;
+}
+
+static void obRecordOpen(ObPrefetchRecorder* recorder, const char* path,
+                         const char* rootPath)
+{
+  size_t rootLength = strcmp(rootPath, "/") == 0 ? 0 : strlen(rootPath);
+  if (strncmp(path, rootPath, rootLength) != 0 || path[rootLength] != '/') {
+    return;
+  }
+
+  const char* relative = path + rootLength;
+  size_t length = strlen(relative);
+  size_t suffixLength = strlen(PREFETCH_DELETED_SUFFIX);
+  if (strchr(relative, '\n') != NULL
+      || (length > suffixLength
+          && strcmp(relative + length - suffixLength, PREFETCH_DELETED_SUFFIX) == 0)) {
+    return;
+  }
+
+  if (obMarkSeen(recorder, relative)) {
+    recorder->paths[recorder->count++] = sdsnewlen(relative, length);
+  }
+}
+
+static bool obRecordEvents(ObPrefetchRecorder* recorder, int seconds)
+{
+  char buffer[PREFETCH_EVENT_BUFFER_SIZE]
+      __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+  char rootPath[OB_PATH_MAX];
+  char path[OB_PATH_MAX];
+
+  pid_t self = getpid();
+  uint64_t deadline = obGetMonotonicNs() + (uint64_t)seconds * 1000000000ULL;
+  struct pollfd pollFd = {recorder->fanotifyFd, POLLIN, 0};
+
+  while (recorder->count < OB_PREFETCH_MAX_FILES) {
+    uint64_t now = obGetMonotonicNs();
+    if (now >= deadline) {
+      break;
+    }
+
+    int ready = poll(&pollFd, 1, (int)((deadline - now) / 1000000) + 1);
+    if (ready < 0 && errno != EINTR) {
+      obLogE("Cannot wait for the fanotify events: %s", strerror(errno));
+      return false;
+    }
+    if (ready <= 0) {
+      continue;
+    }
+
+    ssize_t length = read(recorder->fanotifyFd, buffer, sizeof(buffer));
+    if (length <= 0) {
+      continue;
+    }
+
+    // the path of the mount root changes when the root is switched
+    if (!obReadFdPath(recorder->procFd, recorder->rootFd, rootPath, sizeof(rootPath))) {
+      strcpy(rootPath, "/");
+    }
+
+    struct fanotify_event_metadata* event = (struct fanotify_event_metadata*)buffer;
+    for (; FAN_EVENT_OK(event, length); event = FAN_EVENT_NEXT(event, length)) {
+      if (event->vers != FANOTIFY_METADATA_VERSION) {
+        obLogE("Unsupported fanotify metadata version: %i", event->vers);
+        return false;
+      }
+      if (event->mask & FAN_Q_OVERFLOW) {
+        obLogW("Fanotify queue overflow, some files are not recorded");
+      }
+      if (event->fd < 0) {
+        continue;
+      }
+
+      if (event->pid != self && recorder->count < OB_PREFETCH_MAX_FILES
+          && obReadFdPath(recorder->procFd, event->fd, path, sizeof(path))) {
+        obRecordOpen(recorder, path, rootPath);
+      }
+      close(event->fd);
+    }
+  }
+
+  return true;
+}
+
+static bool obWritePrefetchList(const ObPrefetchRecorder* recorder, const char* listPath)
+{
+  sds tmpPath = sdscat(sdsnew(listPath), PREFETCH_TMP_EXT);
+  FILE* file = fopen(tmpPath, "w");
+  bool result = file != NULL;
+
+  for (int i = 0; result && i < recorder->count; ++i) {
+    result = fprintf(file, "%s\n", recorder->paths[i]) > 0;
+  }
+  if (file != NULL) {
+    result = fflush(file) == 0 && fsync(fileno(file)) == 0 && result;
+    result = fclose(file) == 0 && result;
+  }
+
+  // the list is only replaced when it is complete
+  result = result && rename(tmpPath, listPath) == 0;
+  if (!result) {
+    obLogE("Cannot write the prefetch list %s: %s", listPath, strerror(errno));
+    obRemovePath(tmpPath);
+  }
+  sdsfree(tmpPath);
+  return result;
+}
+
+static bool obRunRecorder(ObPrefetchRecorder* recorder, const char* listPath, int seconds)
+{
+  bool result = obRecordEvents(recorder, seconds)
+      && obWritePrefetchList(recorder, listPath);
+  if (result) {
+    obLogI("Recorded %i opened files to %s", recorder->count, listPath);
+  }
+  obCloseRecorder(recorder);
+  return result;
+}
+
+/**
+ * @return true if a parent directory of the missing file at layerPath is
+ * opaque or is not a directory, which hides the file of the layers below
+ */
+static bool obIsHiddenBelow(char* layerPath, size_t rootLength)
+{
+  for (char* slash = strchr(layerPath + rootLength + 1, '/'); slash != NULL;
+       slash = strchr(slash + 1, '/')) {
+    *slash = '\0';
+    struct stat st;
+    char value = 0;
+    bool exists = lstat(layerPath, &st) == 0;
+    bool hides = exists && (!S_ISDIR(st.st_mode)
+        || (lgetxattr(layerPath, PREFETCH_OPAQUE_XATTR, &value, 1) == 1 && value == 'y'));
+    *slash = '/';
+
+    if (!exists || hides) {
+      return hides;
+    }
+  }
+  return false;
+}
+
+static void obPrefetchFile(ObPrefetchQueue* queue, const char* path)
+{
+  char layerPath[OB_CCPATH_MAX];
+  for (int i = 0; i < queue->layerCount; ++i) {
+    snprintf(layerPath, sizeof(layerPath), "%s%s", queue->layers[i], path);
+
+    struct stat st;
+    if (lstat(layerPath, &st) != 0) {
+      if ((errno == ENOENT || errno == ENOTDIR)
+          && !obIsHiddenBelow(layerPath, strlen(queue->layers[i]))) {
+        continue;
+      }
+      return;
+    }
+
+    // a whiteout (or a directory) hides the file of the layers below
+    if (!S_ISREG(st.st_mode)) {
+      return;
+    }
+
+    int fd = open(layerPath, O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+      if (posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED) == 0) {
+        atomic_fetch_add(&queue->prefetched, 1);
+      }
+      close(fd);
+    }
+    return;
+  }
+}
+
+/**
+ * The workers take the files in the recorded order
+ */
+static void obRunPrefetchQueue(ObPrefetchQueue* queue)
+{
+  for (int i = atomic_fetch_add(&queue->next, 1); i < queue->count;
+       i = atomic_fetch_add(&queue->next, 1)) {
+    obPrefetchFile(queue, queue->paths[i]);
+  }
+}
+
+static int obReadPrefetchList(const char* listPath, sds* paths)
+{
+  FILE* file = fopen(listPath, "r");
+  if (file == NULL) {
+    return -1;
+  }
+
+  int count = 0;
+  char* line = NULL;
+  size_t size = 0;
+  ssize_t length = 0;
+  while (count < OB_PREFETCH_MAX_FILES && (length = getline(&line, &size, file)) > 0) {
+    if (line[length - 1] == '\n') {
+      line[--length] = '\0';
+    }
+    if (length > 0 && line[0] == '/') {
+      paths[count++] = sdsnewlen(line, length);
+    }
+  }
+
+  free(line);
+  fclose(file);
+  return count;
+}
+
+static int obStaleListFilter(const struct dirent* entry)
+{
+  size_t length = strlen(entry->d_name);
+  size_t extLength = strlen(OB_PREFETCH_LIST_EXT);
+  return length > extLength
+      && strcmp(entry->d_name + length - extLength, OB_PREFETCH_LIST_EXT) == 0;
+}
+
+// --------- public API ---------- //
+
+bool obRecordPrefetchList(const char* mountPath, const char* listPath, int seconds)
+{
+  ObPrefetchRecorder recorder;
+  if (!obOpenRecorder(&recorder, mountPath)) {
+    return false;
+  }
+
+  obLogI("Recording the files opened on %s for %is", mountPath, seconds);
+  return obRunRecorder(&recorder, listPath, seconds);
+}
+
+int obPrefetchFiles(const char* listPath, const char* const* layers, int layerCount)
+{
+  uint64_t traceStart = obGetMonotonicNs();
+  sds* paths = calloc(OB_PREFETCH_MAX_FILES, sizeof(sds));
+  int count = obReadPrefetchList(listPath, paths);
+  if (count < 0) {
+    obLogW("Cannot read the prefetch list %s: %s", listPath, strerror(errno));
+    free(paths);
+    return -1;
+  }
+
+  ObPrefetchQueue queue;
+  queue.layers = layers;
+  queue.layerCount = layerCount;
+  queue.paths = paths;
+  queue.count = count;
+  atomic_init(&queue.next, 0);
+  atomic_init(&queue.prefetched, 0);
+
+  int threads = count < OB_PREFETCH_THREADS ? count : OB_PREFETCH_THREADS;
+  ObThreadPool* pool = threads > 1 ? obCreateThreadPool(threads, threads) : NULL;
+  for (int t = 0; pool != NULL && t < threads; ++t) {
+    obSubmitWork(pool, (ObWorkFunction)obRunPrefetchQueue, &queue);
+  }
+  if (pool != NULL) {
+    obWaitThreadPool(pool);
+    obFreeThreadPool(&pool);
+  }
+  // whatever is left when no worker could be started
+  obRunPrefetchQueue(&queue);
+
+  int prefetched = atomic_load(&queue.prefetched);
+  obLogI("Read ahead %i of %i recorded files", prefetched, count);
+
+  for (int i = 0; i < count; ++i) {
+    sdsfree(paths[i]);
+  }
+  free(paths);
+  obTraceSpan("obPrefetchFiles", listPath, traceStart);
+  return prefetched;
+}
+
+bool obRemoveStalePrefetchLists(const char* prefetchDir, const char* listPath)
+{
+  if (!obIsDirectory(prefetchDir)) {
+    return true;
+  }
+
+  struct dirent** namelist;
+  int n = scandir(prefetchDir, &namelist, obStaleListFilter, alphasort);
+  if (n < 0) {
+    return false;
+  }
+
+  bool result = true;
+  for (int i = 0; i < n; ++i) {
+    sds path = sdscatfmt(sdsempty(), "%s/%s", prefetchDir, namelist[i]->d_name);
+    if (strcmp(path, listPath) != 0) {
+      obLogI("Removing the prefetch list of another head: %s", path);
+      result = obRemovePath(path) && result;
+    }
+    sdsfree(path);
+    free(namelist[i]);
+  }
+  free(namelist);
+  return result;
+}
+
+bool obStartPrefetchRecorder(const ObContext* context)
+{
+  const ObConfig* config = &context->config;
+  const char* listPath = obGetPrefetchListPath(context);
+  if (!obExists(obGetPrefetchPath(context))
+      && !obMkpath(obGetPrefetchPath(context), OB_MKPATH_MODE)) {
+    return false;
+  }
+
+  ObPrefetchRecorder recorder;
+  if (!obOpenRecorder(&recorder, context->root)) {
+    return false;
+  }
+
+  obLogI("Starting the prefetch recorder (%is)", config->prefetchRecordTime);
+
+  // the child must not write out the records buffered so far again
+  obFlushLog();
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    obLogW("Cannot start the prefetch recorder: %s", strerror(errno));
+    obCloseRecorder(&recorder);
+    return false;
+  }
+
+  if (pid == 0) {
+    // detached grandchild reparented to init, outliving obinit
+    setsid();
+    if (fork() == 0) {
+      obInitLogger(false, true);
+      obRunRecorder(&recorder, listPath, config->prefetchRecordTime);
+      obFlushLog();
+    }
+    _exit(0);
+  }
+
+  obCloseRecorder(&recorder);
+  waitpid(pid, NULL, 0);
+  return true;
+}
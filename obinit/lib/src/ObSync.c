@@ -0,0 +1,997 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ob/ObSync.h"
+#include "ObOsUtils.h"
+#include "ObThreadPool.h"
+#include "ob/ObHash.h"
+#include "ob/ObDefs.h"
+#include "ob/ObLogging.h"
+#include "ob/ObTrace.h"
+#include <sds.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <stdatomic.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+#include <time.h>
+
+#define SYNC_QUEUE_PER_THREAD 64
+#define SYNC_DIRS_INITIAL 64
+#define SYNC_INODES_INITIAL 64
+#define SYNC_OPAQUE_XATTR "trusted.overlay.opaque"
+#define SYNC_REPLACE_EXT ".obsync"
+
+typedef struct ObSyncDir
+{
+  sds relPath;
+  sds dstPath; // in the staging dir for a directory replacing the dst entry
+  struct stat64 st;
+  bool created;
+  bool staged; // (stagingDir) built aside with all its entries
+  bool replaces; // (stagingDir) swapped with the dst entry once complete
+  bool opaque; // (mergeLayer) hides the layers below dst
+  bool prune; // (mergeLayer) remove the dst entries missing in src
+} ObSyncDir;
+
+// first destination path of a multiply linked source inode
+typedef struct ObSyncInode
+{
+  dev_t dev;
+  ino_t ino;
+  sds dstPath;
+} ObSyncInode;
+
+typedef struct ObSyncLink
+{
+  sds target;
+  sds dstPath;
+} ObSyncLink;
+
+typedef struct ObSyncExtra
+{
+  sds dstPath;
+  bool prune;
+} ObSyncExtra;
+
+typedef struct ObSyncState
+{
+  const char* src;
+  const char* dst;
+  const ObSyncOptions* options;
+  ObThreadPool* pool;
+
+  ObSyncDir* dirs;
+  size_t dirCount;
+  size_t dirCapacity;
+
+  ObSyncInode* inodes;
+  size_t inodeCount;
+  size_t inodeCapacity;
+
+  ObSyncLink* links;
+  size_t linkCount;
+  size_t linkCapacity;
+
+  // staged entries (target) moved over dstPath, directories last
+  ObSyncLink* renames;
+  size_t renameCount;
+  size_t renameCapacity;
+
+  // extra dst entries handled after the staged ones are in place
+  ObSyncExtra* extras;
+  size_t extraPending;
+  size_t extraCapacity;
+
+  uint64_t startNs;
+  atomic_ullong copiedBytes;
+
+  atomic_bool failed;
+  atomic_size_t fileCount;
+  atomic_size_t skipCount;
+  size_t extraCount;
+} ObSyncState;
+
+typedef struct ObSyncWork
+{
+  ObSyncState* state;
+  sds srcPath;
+  sds dstPath;
+  sds stagePath; // NULL to copy straight to dstPath
+  struct stat64 st;
+} ObSyncWork;
+
+static int obCompareNames(const void* a, const void* b)
+{
+  return strcmp(*(const char**)a, *(const char**)b);
+}
+
+static bool obIsWhiteout(const struct stat64* st)
+{
+  return S_ISCHR(st->st_mode) && st->st_rdev == makedev(0, 0);
+}
+
+static sds obJoinSyncPath(const char* base, const char* relPath)
+{
+  sds path = sdsnew(base);
+  return sdscat(path, relPath);
+}
+
+static bool obIsOpaqueDir(const char* path)
+{
+  char value = 0;
+  return lgetxattr(path, SYNC_OPAQUE_XATTR, &value, 1) == 1 && value == 'y';
+}
+
+static ObSyncDir* obAddSyncDir(ObSyncState* state, sds relPath, sds dstPath,
+                               const struct stat64* st, bool created)
+{
+  if (state->dirCount == state->dirCapacity) {
+    state->dirCapacity = state->dirCapacity ? state->dirCapacity * 2 : SYNC_DIRS_INITIAL;
+    state->dirs = realloc(state->dirs, state->dirCapacity * sizeof(ObSyncDir));
+  }
+  state->dirs[state->dirCount].relPath = relPath;
+  state->dirs[state->dirCount].dstPath = dstPath;
+  state->dirs[state->dirCount].st = *st;
+  state->dirs[state->dirCount].created = created;
+  state->dirs[state->dirCount].staged = false;
+  state->dirs[state->dirCount].replaces = false;
+  state->dirs[state->dirCount].opaque = false;
+  state->dirs[state->dirCount].prune = false;
+  state->dirCount += 1;
+  return &state->dirs[state->dirCount - 1];
+}
+
+static size_t obHashInode(dev_t dev, ino_t ino, size_t capacity)
+{
+  uint64_t key = ((uint64_t)dev << 32) ^ (uint64_t)ino;
+  key *= 0x9E3779B97F4A7C15ULL;
+  return (size_t)(key >> 17) & (capacity - 1);
+}
+
+static void obGrowSyncInodes(ObSyncState* state)
+{
+  size_t oldCapacity = state->inodeCapacity;
+  ObSyncInode* oldInodes = state->inodes;
+
+  state->inodeCapacity = oldCapacity ? oldCapacity * 2 : SYNC_INODES_INITIAL;
+  state->inodes = calloc(state->inodeCapacity, sizeof(ObSyncInode));
+
+  for (size_t i = 0; i < oldCapacity; ++i) {
+    if (oldInodes[i].dstPath == NULL) {
+      continue;
+    }
+    size_t slot = obHashInode(oldInodes[i].dev, oldInodes[i].ino, state->inodeCapacity);
+    while (state->inodes[slot].dstPath != NULL) {
+      slot = (slot + 1) & (state->inodeCapacity - 1);
+    }
+    state->inodes[slot] = oldInodes[i];
+  }
+  free(oldInodes);
+}
+
+/**
+ * @return destination path of an already synced link to the same inode
+ * or NULL if this is the first one (then it is remembered)
+ */
+static const char* obFindSyncInode(ObSyncState* state, const struct stat64* st,
+                                   const char* dstPath)
+{
+  if (state->inodeCount * 2 >= state->inodeCapacity) {
+    obGrowSyncInodes(state);
+  }
+
+  size_t slot = obHashInode(st->st_dev, st->st_ino, state->inodeCapacity);
+  while (state->inodes[slot].dstPath != NULL) {
+    ObSyncInode* inode = &state->inodes[slot];
+    if (inode->dev == st->st_dev && inode->ino == st->st_ino) {
+      return inode->dstPath;
+    }
+    slot = (slot + 1) & (state->inodeCapacity - 1);
+  }
+
+  state->inodes[slot].dev = st->st_dev;
+  state->inodes[slot].ino = st->st_ino;
+  state->inodes[slot].dstPath = sdsnew(dstPath);
+  state->inodeCount += 1;
+  return NULL;
+}
+
+static void obAddSyncLink(ObSyncState* state, const char* target, sds dstPath)
+{
+  if (state->linkCount == state->linkCapacity) {
+    state->linkCapacity = state->linkCapacity ? state->linkCapacity * 2 : SYNC_INODES_INITIAL;
+    state->links = realloc(state->links, state->linkCapacity * sizeof(ObSyncLink));
+  }
+  state->links[state->linkCount].target = sdsnew(target);
+  state->links[state->linkCount].dstPath = dstPath;
+  state->linkCount += 1;
+}
+
+static sds obAddSyncRename(ObSyncState* state, const char* dstPath)
+{
+  if (state->renameCount == state->renameCapacity) {
+    state->renameCapacity = state->renameCapacity ? state->renameCapacity * 2
+                                                  : SYNC_INODES_INITIAL;
+    state->renames = realloc(state->renames, state->renameCapacity * sizeof(ObSyncLink));
+  }
+  ObSyncLink* pending = &state->renames[state->renameCount];
+  pending->target = sdscatprintf(sdsempty(), "%s/%zu", state->options->stagingDir,
+                                 state->renameCount);
+  pending->dstPath = sdsnew(dstPath);
+  state->renameCount += 1;
+  return sdsdup(pending->target);
+}
+
+/**
+ * Sleep until the bytes copied so far fit in the rate limit
+ */
+static void obThrottleSync(ObSyncState* state, uint64_t size)
+{
+  unsigned long long rateLimit = state->options->rateLimit;
+  if (rateLimit == 0) {
+    return;
+  }
+
+  uint64_t copied = atomic_fetch_add(&state->copiedBytes, size) + size;
+  uint64_t dueNs = state->startNs + (uint64_t)((double)copied * 1e9 / rateLimit);
+  uint64_t nowNs = obGetMonotonicNs();
+  if (dueNs > nowNs) {
+    struct timespec delay = {(dueNs - nowNs) / 1000000000ULL, (dueNs - nowNs) % 1000000000ULL};
+    nanosleep(&delay, NULL);
+  }
+}
+
+/**
+ * Copy owner, permissions, extended attributes (ACLs, security labels)
+ * and timestamps of a non-regular entry
+ */
+static void obApplySyncMetadata(const char* srcPath, const char* dstPath,
+                                const struct stat64* st)
+{
+  if (lchown(dstPath, st->st_uid, st->st_gid) != 0) {
+    obLogW("chown error on %s", dstPath);
+  }
+  if (!S_ISLNK(st->st_mode) && chmod(dstPath, st->st_mode & 07777) != 0) {
+    obLogW("chmod error on %s", dstPath);
+  }
+  obCopyXattrs(srcPath, dstPath);
+
+  struct timespec times[2] = {st->st_atim, st->st_mtim};
+  utimensat(AT_FDCWD, dstPath, times, AT_SYMLINK_NOFOLLOW);
+}
+
+/**
+ * Whether an incremental sync can leave the existing entry as it is
+ */
+static bool obIsSyncMetadataUnchanged(const char* dstPath, const struct stat64* st)
+{
+  struct stat64 dstSt;
+  return lstat64(dstPath, &dstSt) == 0
+      && dstSt.st_mode == st->st_mode
+      && dstSt.st_uid == st->st_uid && dstSt.st_gid == st->st_gid
+      && dstSt.st_mtim.tv_sec == st->st_mtim.tv_sec
+      && dstSt.st_mtim.tv_nsec == st->st_mtim.tv_nsec;
+}
+
+static bool obIsFileUnchanged(const ObSyncWork* work)
+{
+  struct stat64 dstSt;
+  if (lstat64(work->dstPath, &dstSt) != 0
+      || !S_ISREG(dstSt.st_mode)
+      || dstSt.st_size != work->st.st_size
+      || dstSt.st_mtim.tv_sec != work->st.st_mtim.tv_sec
+      || dstSt.st_mtim.tv_nsec != work->st.st_mtim.tv_nsec) {
+    return false;
+  }
+
+  if (work->state->options->compareHash) {
+    ObHash srcHash;
+    ObHash dstHash;
+    if (!obHashFile(work->srcPath, OB_HASH_XXH3_128, &srcHash)
+        || !obHashFile(work->dstPath, OB_HASH_XXH3_128, &dstHash)
+        || !obHashEqual(&srcHash, &dstHash)) {
+      return false;
+    }
+  }
+
+  // metadata-only changes do not need a copy
+  if (dstSt.st_uid != work->st.st_uid || dstSt.st_gid != work->st.st_gid) {
+    if (chown(work->dstPath, work->st.st_uid, work->st.st_gid) != 0) {
+      obLogW("chown error on %s", work->dstPath);
+    }
+  }
+  if ((dstSt.st_mode & 07777) != (work->st.st_mode & 07777)) {
+    if (chmod(work->dstPath, work->st.st_mode & 07777) != 0) {
+      obLogW("chmod error on %s", work->dstPath);
+    }
+  }
+  return true;
+}
+
+/**
+ * An existing regular dst may share its inode with other paths (e.g. the
+ * hardlinks of a merged layer), so it is replaced instead of overwritten
+ */
+static bool obCopySyncFile(const ObSyncWork* work)
+{
+  if (work->stagePath != NULL) {
+    return obCopyFile(work->srcPath, work->stagePath);
+  }
+
+  struct stat64 dstSt;
+  if (lstat64(work->dstPath, &dstSt) != 0 || !S_ISREG(dstSt.st_mode)) {
+    return obCopyFile(work->srcPath, work->dstPath);
+  }
+
+  sds tmpPath = sdscat(sdsdup(work->dstPath), SYNC_REPLACE_EXT);
+  bool result = obCopyFile(work->srcPath, tmpPath);
+  if (result && rename(tmpPath, work->dstPath) != 0) {
+    obLogE("Cannot replace %s: %s", work->dstPath, strerror(errno));
+    result = false;
+  }
+  if (!result) {
+    unlink(tmpPath);
+  }
+  sdsfree(tmpPath);
+  return result;
+}
+
+static void obSyncFileWork(void* arg)
+{
+  ObSyncWork* work = arg;
+  if (work->state->options->incremental && obIsFileUnchanged(work)) {
+    atomic_fetch_add(&work->state->skipCount, 1);
+  }
+  else if (!obCopySyncFile(work)) {
+    atomic_store(&work->state->failed, true);
+  }
+  else {
+    atomic_fetch_add(&work->state->fileCount, 1);
+    obThrottleSync(work->state, work->st.st_size);
+  }
+
+  sdsfree(work->srcPath);
+  sdsfree(work->dstPath);
+  sdsfree(work->stagePath);
+  free(work);
+}
+
+/**
+ * The linked inode is shared with src, its content and metadata are left as they are
+ */
+static bool obLinkSyncFile(const char* srcPath, const char* dstPath)
+{
+  if (link(srcPath, dstPath) != 0
+      && !(errno == EEXIST && unlink(dstPath) == 0 && link(srcPath, dstPath) == 0)) {
+    obLogE("Cannot link %s to %s: %s", dstPath, srcPath, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+/**
+ * A changed link is created at createPath, either dstPath or a staging path
+ */
+static bool obSyncSymlink(const char* srcPath, const char* dstPath, const char* createPath,
+                          const struct stat64* st)
+{
+  char* target = malloc(st->st_size + 1);
+  ssize_t length = readlink(srcPath, target, st->st_size + 1);
+  if (length < 0 || length > st->st_size) {
+    obLogE("readlink error on %s: %s", srcPath, strerror(errno));
+    free(target);
+    return false;
+  }
+  target[length] = '\0';
+
+  char* current = calloc(1, st->st_size + 2);
+  bool unchanged = readlink(dstPath, current, st->st_size + 1) == length
+      && strcmp(current, target) == 0;
+  free(current);
+
+  bool result = true;
+  if (unchanged) {
+    // nothing to do
+  }
+  else if (symlink(target, createPath) != 0
+      && !(errno == EEXIST && unlink(createPath) == 0 && symlink(target, createPath) == 0)) {
+    obLogE("Cannot create symlink %s -> %s: %s", dstPath, target, strerror(errno));
+    result = false;
+  }
+  else {
+    obApplySyncMetadata(srcPath, createPath, st);
+  }
+
+  free(target);
+  return result;
+}
+
+/**
+ * A changed node is created at createPath, either dstPath or a staging path
+ */
+static bool obSyncSpecial(const char* srcPath, const char* dstPath, const char* createPath,
+                          const struct stat64* st, bool incremental)
+{
+  struct stat64 dstSt;
+  bool exists = lstat64(dstPath, &dstSt) == 0;
+  bool matches = exists && (dstSt.st_mode & S_IFMT) == (st->st_mode & S_IFMT)
+      && dstSt.st_rdev == st->st_rdev;
+
+  if (matches) {
+    if (incremental && obIsSyncMetadataUnchanged(dstPath, st)) {
+      return true;
+    }
+    // only the metadata is updated
+    createPath = dstPath;
+  }
+  else {
+    if (exists && strcmp(createPath, dstPath) == 0 && !obRemovePath(dstPath)) {
+      return false;
+    }
+    if (mknod(createPath, st->st_mode, st->st_rdev) != 0) {
+      obLogE("Cannot create special file %s: %s", dstPath, strerror(errno));
+      return false;
+    }
+  }
+
+  obApplySyncMetadata(srcPath, createPath, st);
+  return true;
+}
+
+static bool obSyncMkdir(const char* dstPath, bool* created)
+{
+  // owner-writable until the metadata is fixed up
+  *created = mkdir(dstPath, S_IRWXU) == 0;
+  if (!*created && !(errno == EEXIST && obIsDirectory(dstPath))) {
+    obLogE("Cannot create directory %s: %s", dstPath, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+static bool obRemoveSyncTarget(const char* dstPath, const struct stat64* dstSt)
+{
+  if (S_ISDIR(dstSt->st_mode)) {
+    return obRemoveDirR(dstPath);
+  }
+  return obRemovePath(dstPath);
+}
+
+/**
+ * Remove the destination entry if its type does not match the source,
+ * or only mark it to be replaced by a staged entry
+ */
+static bool obPrepareSyncTarget(const char* dstPath, const struct stat64* st,
+                                bool* replace)
+{
+  struct stat64 dstSt;
+  if (lstat64(dstPath, &dstSt) != 0
+      || (dstSt.st_mode & S_IFMT) == (st->st_mode & S_IFMT)) {
+    return true;
+  }
+  if (replace != NULL) {
+    *replace = true;
+    return true;
+  }
+  return obRemoveSyncTarget(dstPath, &dstSt);
+}
+
+/**
+ * A whiteout in the merged layer removes the entry from the layers below
+ */
+static bool obMergeWhiteout(const char* srcPath, const char* dstPath, const char* createPath,
+                            const struct stat64* st, const ObSyncOptions* options)
+{
+  if (!options->dropWhiteouts) {
+    return obSyncSpecial(srcPath, dstPath, createPath, st, options->incremental);
+  }
+
+  struct stat64 dstSt;
+  if (lstat64(dstPath, &dstSt) != 0) {
+    return true;
+  }
+  return obRemoveSyncTarget(dstPath, &dstSt);
+}
+
+/**
+ * An opaque directory of the merged layer replaces the one below. The
+ * replaced entry is removed or, with replace set, left for a staged one.
+ */
+static bool obPrepareMergedDir(const char* srcPath, const char* dstPath,
+                               bool* opaque, bool* prune, bool* replace)
+{
+  struct stat64 dstSt;
+  if (lstat64(dstPath, &dstSt) != 0) {
+    // a new opaque directory must not show the lower layers half-filled either
+    if (replace != NULL && obIsOpaqueDir(srcPath)) {
+      *replace = true;
+    }
+    return true;
+  }
+
+  bool srcOpaque = obIsOpaqueDir(srcPath);
+  if (srcOpaque && S_ISDIR(dstSt.st_mode) && obIsOpaqueDir(dstPath)) {
+    // replaced by an earlier merge, only the entries gone since then are removed
+    *opaque = true;
+    *prune = true;
+    return true;
+  }
+
+  // a directory over a whiteout or a non-directory hides the lower layers too
+  *opaque = !S_ISDIR(dstSt.st_mode) || srcOpaque;
+  if (*opaque && replace != NULL) {
+    *replace = true;
+    return true;
+  }
+  return *opaque ? obRemoveSyncTarget(dstPath, &dstSt) : true;
+}
+
+/**
+ * With a staging directory nothing is removed from dst while scanning:
+ * the changed non-regular entries and the directories replacing dst
+ * entries are built in the staging directory and moved into place with
+ * the staged copies. The entries of a staged directory are created in it.
+ */
+static void obSyncEntry(ObSyncState* state, sds relPath, const char* dstDir, bool staged,
+                        const struct stat64* st, bool prune)
+{
+  sds srcPath = obJoinSyncPath(state->src, relPath);
+  sds dstPath = sdscat(sdsnew(dstDir), strrchr(relPath, '/'));
+  bool stage = state->options->stagingDir != NULL && !staged;
+  bool merge = state->options->mergeLayer;
+  bool opaque = false;
+  bool replace = false;
+  bool result = merge && S_ISDIR(st->st_mode)
+      ? obPrepareMergedDir(srcPath, dstPath, &opaque, &prune, stage ? &replace : NULL)
+      : obPrepareSyncTarget(dstPath, st, stage ? &replace : NULL);
+  const char* linkTarget = NULL;
+  sds createPath = NULL;
+  if (stage && !S_ISREG(st->st_mode) && (!S_ISDIR(st->st_mode) || replace)) {
+    createPath = obAddSyncRename(state, dstPath);
+  }
+
+  if (!result) {
+    // already logged
+  }
+  else if (merge && obIsWhiteout(st)) {
+    result = obMergeWhiteout(srcPath, dstPath, createPath ? createPath : dstPath, st,
+                             state->options);
+  }
+  else if (S_ISDIR(st->st_mode)) {
+    bool created = false;
+    result = obSyncMkdir(createPath ? createPath : dstPath, &created);
+    // marked before it is swapped in, so that it never shows the lower layers
+    if (result && createPath != NULL && opaque && !state->options->dropWhiteouts
+        && lsetxattr(createPath, SYNC_OPAQUE_XATTR, "y", 1, 0) != 0) {
+      obLogW("Cannot mark %s as opaque: %s", dstPath, strerror(errno));
+    }
+    if (result) {
+      ObSyncDir* dir = obAddSyncDir(state, relPath,
+                                    createPath ? sdsdup(createPath) : sdsdup(dstPath),
+                                    st, created);
+      dir->staged = staged || createPath != NULL;
+      dir->replaces = createPath != NULL;
+      dir->opaque = opaque;
+      dir->prune = prune;
+      relPath = NULL;
+    }
+  }
+  else if (S_ISREG(st->st_mode) && state->options->linkFiles) {
+    result = obLinkSyncFile(srcPath, dstPath);
+    if (result) {
+      atomic_fetch_add(&state->fileCount, 1);
+    }
+  }
+  else if (S_ISREG(st->st_mode) && st->st_nlink > 1
+           && (linkTarget = obFindSyncInode(state, st, dstPath)) != NULL) {
+    // linked after the first copy is done
+    obAddSyncLink(state, linkTarget, dstPath);
+    dstPath = NULL;
+  }
+  else if (S_ISREG(st->st_mode)) {
+    ObSyncWork* work = malloc(sizeof(ObSyncWork));
+    if (work == NULL) {
+      obLogE("Cannot allocate the copy of %s", srcPath);
+      result = false;
+    }
+    else {
+      work->state = state;
+      work->srcPath = srcPath;
+      work->dstPath = dstPath;
+      work->stagePath = stage ? obAddSyncRename(state, dstPath) : NULL;
+      work->st = *st;
+      srcPath = dstPath = NULL;
+      // copied in place when the queue cannot take it
+      if (!obSubmitWork(state->pool, obSyncFileWork, work)) {
+        obSyncFileWork(work);
+      }
+    }
+  }
+  else if (S_ISLNK(st->st_mode)) {
+    result = obSyncSymlink(srcPath, dstPath, createPath ? createPath : dstPath, st);
+  }
+  else {
+    result = obSyncSpecial(srcPath, dstPath, createPath ? createPath : dstPath, st,
+                           state->options->incremental);
+  }
+
+  if (!result) {
+    atomic_store(&state->failed, true);
+  }
+
+  sdsfree(createPath);
+  sdsfree(relPath);
+  sdsfree(srcPath);
+  sdsfree(dstPath);
+}
+
+static void obHandleSyncExtra(ObSyncState* state, const char* dstPath,
+                              const struct stat64* dstSt, bool prune)
+{
+  if (state->options->extraMode == OB_SYNC_WHITEOUT_EXTRA && !prune) {
+    if (obIsWhiteout(dstSt)) {
+      return;
+    }
+    if (!obRemoveSyncTarget(dstPath, dstSt)
+        || mknod(dstPath, S_IFCHR, makedev(0, 0)) != 0) {
+      obLogE("Cannot create whiteout %s: %s", dstPath, strerror(errno));
+      atomic_store(&state->failed, true);
+      return;
+    }
+  }
+  else if (!obRemoveSyncTarget(dstPath, dstSt)) {
+    atomic_store(&state->failed, true);
+    return;
+  }
+  state->extraCount += 1;
+}
+
+static void obAddSyncExtra(ObSyncState* state, sds dstPath, bool prune)
+{
+  if (state->extraPending == state->extraCapacity) {
+    state->extraCapacity = state->extraCapacity ? state->extraCapacity * 2
+                                                : SYNC_INODES_INITIAL;
+    state->extras = realloc(state->extras, state->extraCapacity * sizeof(ObSyncExtra));
+  }
+  state->extras[state->extraPending].dstPath = dstPath;
+  state->extras[state->extraPending].prune = prune;
+  state->extraPending += 1;
+}
+
+/**
+ * Handle the extra entries found in the staging mode once the staged ones
+ * are in place, before the directory metadata is set.
+ */
+static void obRemoveSyncExtras(ObSyncState* state)
+{
+  for (size_t i = 0; i < state->extraPending; ++i) {
+    ObSyncExtra* extra = &state->extras[i];
+    struct stat64 dstSt;
+    if (lstat64(extra->dstPath, &dstSt) == 0) {
+      obHandleSyncExtra(state, extra->dstPath, &dstSt, extra->prune);
+    }
+    sdsfree(extra->dstPath);
+  }
+  free(state->extras);
+}
+
+static void obSyncExtraEntries(ObSyncState* state, size_t index,
+                               char** names, size_t count)
+{
+  sds dstDir = sdsdup(state->dirs[index].dstPath);
+  DIR* dir = opendir(dstDir);
+  if (dir == NULL) {
+    obLogE("Cannot open directory %s: %s", dstDir, strerror(errno));
+    atomic_store(&state->failed, true);
+    sdsfree(dstDir);
+    return;
+  }
+
+  qsort(names, count, sizeof(char*), obCompareNames);
+
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    const char* name = entry->d_name;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0
+        || bsearch(&name, names, count, sizeof(char*), obCompareNames)) {
+      continue;
+    }
+
+    struct stat64 dstSt;
+    if (fstatat64(dirfd(dir), name, &dstSt, AT_SYMLINK_NOFOLLOW) != 0) {
+      continue;
+    }
+    sds dstPath = sdsdup(dstDir);
+    dstPath = sdscatfmt(dstPath, "/%s", name);
+    if (state->options->stagingDir != NULL) {
+      obAddSyncExtra(state, dstPath, state->dirs[index].prune);
+      continue;
+    }
+    obHandleSyncExtra(state, dstPath, &dstSt, state->dirs[index].prune);
+    sdsfree(dstPath);
+  }
+
+  closedir(dir);
+  sdsfree(dstDir);
+}
+
+static void obScanSyncDir(ObSyncState* state, size_t index)
+{
+  sds srcDir = obJoinSyncPath(state->src, state->dirs[index].relPath);
+  DIR* dir = opendir(srcDir);
+  if (dir == NULL) {
+    obLogE("Cannot open directory %s: %s", srcDir, strerror(errno));
+    atomic_store(&state->failed, true);
+    sdsfree(srcDir);
+    return;
+  }
+
+  // a freshly created directory cannot hold any extra entries
+  bool prune = state->dirs[index].prune;
+  bool staged = state->dirs[index].staged;
+  sds dstDir = sdsdup(state->dirs[index].dstPath);
+  bool checkExtra = (state->options->extraMode != OB_SYNC_KEEP_EXTRA || prune)
+      && !state->dirs[index].created;
+  char** names = NULL;
+  size_t nameCount = 0;
+  size_t nameCapacity = 0;
+
+  struct dirent* entry;
+  while ((entry = readdir(dir)) != NULL) {
+    if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+      continue;
+    }
+
+    if (checkExtra) {
+      if (nameCount == nameCapacity) {
+        nameCapacity = nameCapacity ? nameCapacity * 2 : SYNC_DIRS_INITIAL;
+        names = realloc(names, nameCapacity * sizeof(char*));
+      }
+      names[nameCount++] = strdup(entry->d_name);
+    }
+
+    struct stat64 st;
+    if (fstatat64(dirfd(dir), entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+      obLogE("Cannot stat %s/%s: %s", srcDir, entry->d_name, strerror(errno));
+      atomic_store(&state->failed, true);
+      continue;
+    }
+
+    // the dirs array may be reallocated by obSyncEntry
+    sds relPath = sdsdup(state->dirs[index].relPath);
+    relPath = sdscatfmt(relPath, "/%s", entry->d_name);
+    obSyncEntry(state, relPath, dstDir, staged, &st, prune);
+  }
+  closedir(dir);
+
+  if (checkExtra) {
+    obSyncExtraEntries(state, index, names, nameCount);
+  }
+
+  for (size_t i = 0; i < nameCount; ++i) {
+    free(names[i]);
+  }
+  free(names);
+  sdsfree(dstDir);
+  sdsfree(srcDir);
+}
+
+/**
+ * Move a staged entry over dstPath. Entries of another type, including any
+ * directory, are swapped with it first, the old one is removed afterwards.
+ */
+static bool obReplaceSyncEntry(const char* stagedPath, const char* dstPath)
+{
+  struct stat64 stagedSt;
+  struct stat64 dstSt;
+  if (lstat64(stagedPath, &stagedSt) != 0) {
+    obLogE("Cannot stat %s: %s", stagedPath, strerror(errno));
+    return false;
+  }
+
+  bool swap = lstat64(dstPath, &dstSt) == 0
+      && (S_ISDIR(stagedSt.st_mode) || S_ISDIR(dstSt.st_mode));
+  bool result = swap
+      ? renameat2(AT_FDCWD, stagedPath, AT_FDCWD, dstPath, RENAME_EXCHANGE) == 0
+      : rename(stagedPath, dstPath) == 0;
+
+  if (!result) {
+    obLogE("Cannot move %s to %s: %s", stagedPath, dstPath, strerror(errno));
+    obRemoveSyncTarget(stagedPath, &stagedSt);
+    return false;
+  }
+  return !swap || obRemoveSyncTarget(stagedPath, &dstSt);
+}
+
+/**
+ * Move the staged entries into place once they are on the disk. The staged
+ * directories are moved by obFixupSyncDirs when their metadata is set.
+ */
+static void obCommitSyncRenames(ObSyncState* state)
+{
+  if (state->renameCount == 0) {
+    return;
+  }
+
+  int stagingFd = open(state->options->stagingDir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (stagingFd < 0 || syncfs(stagingFd) != 0) {
+    obLogW("Cannot flush %s: %s", state->options->stagingDir, strerror(errno));
+  }
+  if (stagingFd >= 0) {
+    close(stagingFd);
+  }
+
+  for (size_t i = 0; i < state->renameCount; ++i) {
+    ObSyncLink* pending = &state->renames[i];
+    struct stat64 st;
+    // unchanged and failed entries are not staged
+    if (lstat64(pending->target, &st) == 0 && !S_ISDIR(st.st_mode)
+        && !obReplaceSyncEntry(pending->target, pending->dstPath)) {
+      atomic_store(&state->failed, true);
+    }
+    sdsfree(pending->target);
+    sdsfree(pending->dstPath);
+  }
+  free(state->renames);
+}
+
+static void obCreateSyncLinks(ObSyncState* state)
+{
+  for (size_t i = 0; i < state->linkCount; ++i) {
+    ObSyncLink* pending = &state->links[i];
+    struct stat64 targetSt;
+    struct stat64 dstSt;
+
+    bool linked = stat64(pending->target, &targetSt) == 0
+        && lstat64(pending->dstPath, &dstSt) == 0
+        && targetSt.st_dev == dstSt.st_dev && targetSt.st_ino == dstSt.st_ino;
+
+    if (!linked) {
+      // with a staging directory an existing entry is replaced, never removed first
+      bool replace = state->options->stagingDir != NULL
+          && lstat64(pending->dstPath, &dstSt) == 0;
+      sds linkPath = replace
+          ? sdscatprintf(sdsempty(), "%s/%zu.link", state->options->stagingDir, i)
+          : sdsdup(pending->dstPath);
+      if (!replace) {
+        unlink(pending->dstPath);
+      }
+
+      if (link(pending->target, linkPath) != 0) {
+        obLogE("Cannot link %s to %s: %s", pending->dstPath, pending->target, strerror(errno));
+        atomic_store(&state->failed, true);
+      }
+      else if (replace && !obReplaceSyncEntry(linkPath, pending->dstPath)) {
+        atomic_store(&state->failed, true);
+      }
+      sdsfree(linkPath);
+    }
+
+    sdsfree(pending->target);
+    sdsfree(pending->dstPath);
+  }
+  free(state->links);
+
+  for (size_t i = 0; i < state->inodeCapacity; ++i) {
+    sdsfree(state->inodes[i].dstPath);
+  }
+  free(state->inodes);
+}
+
+static void obFixupSyncDirs(ObSyncState* state)
+{
+  // children were discovered after their parents
+  for (size_t i = state->dirCount; i > 0; --i) {
+    ObSyncDir* dir = &state->dirs[i - 1];
+    sds srcPath = obJoinSyncPath(state->src, dir->relPath);
+    sds dstPath = dir->dstPath;
+
+    if (!state->options->incremental || dir->created
+        || !obIsSyncMetadataUnchanged(dstPath, &dir->st)) {
+      obApplySyncMetadata(srcPath, dstPath, &dir->st);
+    }
+
+    if (!state->options->mergeLayer) {
+      // plain copy
+    }
+    else if (state->options->dropWhiteouts) {
+      lremovexattr(dstPath, SYNC_OPAQUE_XATTR);
+    }
+    else if (dir->opaque && !obIsOpaqueDir(dstPath)
+             && lsetxattr(dstPath, SYNC_OPAQUE_XATTR, "y", 1, 0) != 0) {
+      obLogW("Cannot mark %s as opaque: %s", dstPath, strerror(errno));
+    }
+
+    // complete along with its entries, before the parent metadata is set
+    if (dir->replaces) {
+      sds targetPath = obJoinSyncPath(state->dst, dir->relPath);
+      if (!obReplaceSyncEntry(dstPath, targetPath)) {
+        atomic_store(&state->failed, true);
+      }
+      sdsfree(targetPath);
+    }
+
+    sdsfree(srcPath);
+    sdsfree(dstPath);
+    sdsfree(dir->relPath);
+  }
+}
+
+// --------- public API ---------- //
+
+void obInitSyncOptions(ObSyncOptions* options)
+{
+  options->threads = obGetOnlineCpuCount();
+  options->incremental = false;
+  options->compareHash = false;
+  options->extraMode = OB_SYNC_KEEP_EXTRA;
+  options->mergeLayer = false;
+  options->dropWhiteouts = false;
+  options->linkFiles = false;
+  options->stagingDir = NULL;
+  options->rateLimit = 0;
+}
+
+bool obSyncTree(const char* src, const char* dst, const ObSyncOptions* options)
+{
+  uint64_t traceStart = obGetMonotonicNs();
+  struct stat64 st;
+  if (stat64(src, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    obLogE("Cannot sync %s: not a directory", src);
+    return false;
+  }
+
+  if (!obExists(dst) && !obMkpath(dst, OB_MKPATH_MODE)) {
+    return false;
+  }
+
+  ObSyncState state;
+  memset(&state, 0, sizeof(ObSyncState));
+  state.src = src;
+  state.dst = dst;
+  state.options = options;
+  state.startNs = traceStart;
+
+  if (options->stagingDir != NULL && !obExists(options->stagingDir)
+      && !obMkpath(options->stagingDir, OB_MKPATH_MODE)) {
+    return false;
+  }
+
+  int threads = options->threads > 0 ? options->threads : 0;
+  state.pool = obCreateThreadPool(threads, (threads + 1) * SYNC_QUEUE_PER_THREAD);
+  if (state.pool == NULL) {
+    obLogW("Cannot start sync workers, copying in a single thread");
+    state.pool = obCreateThreadPool(0, 1);
+  }
+
+  obLogI("Syncing %s -> %s (%i workers)", src, dst, obGetThreadPoolSize(state.pool));
+
+  obAddSyncDir(&state, sdsempty(), sdsnew(dst), &st, false);
+  for (size_t i = 0; i < state.dirCount; ++i) {
+    obScanSyncDir(&state, i);
+  }
+
+  obWaitThreadPool(state.pool);
+  obFreeThreadPool(&state.pool);
+  obCommitSyncRenames(&state);
+  obCreateSyncLinks(&state);
+  obRemoveSyncExtras(&state);
+  obFixupSyncDirs(&state);
+
+  obLogI("Synced %zu directories, %zu files and %zu hardlinks from %s (%zu unchanged, %zu extra)",
+         state.dirCount, atomic_load(&state.fileCount), state.linkCount, src,
+         atomic_load(&state.skipCount), state.extraCount);
+
+  free(state.dirs);
+  obTraceSpan("obSyncTree", src, traceStart);
+  return !atomic_load(&state.failed);
+}
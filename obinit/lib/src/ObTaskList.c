@@ -3,9 +3,104 @@
 // See accompanying file LICENSE.txt for the full license.
 
 #include "ObTaskList.h"
+#include "ob/ObTrace.h"
 
 #include <stdlib.h>
 #include <assert.h>
+#include <pthread.h>
+
+typedef struct ObTaskExecutor
+{
+  ObTaskListPtr taskList;
+  pthread_mutex_t mutex;
+  pthread_cond_t changed;
+  int running;
+  bool failed;
+} ObTaskExecutor;
+
+static bool obIsTaskReady(ObTaskPtr task)
+{
+  if (task->state != OB_TASK_PENDING) {
+    return false;
+  }
+
+  if (task->dependencyCount == 0) {
+    for (ObTaskPtr previous = task->previous; previous; previous = previous->previous) {
+      if (previous->state != OB_TASK_DONE) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  for (int i = 0; i < task->dependencyCount; ++i) {
+    if (task->dependencies[i]->state != OB_TASK_DONE) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static ObTaskPtr obTakeReadyTask(ObTaskExecutor* executor)
+{
+  for (ObTaskPtr task = executor->taskList->first; task; task = task->next) {
+    if (obIsTaskReady(task)) {
+      task->state = OB_TASK_RUNNING;
+      return task;
+    }
+  }
+  return NULL;
+}
+
+static void* obTaskWorker(void* arg)
+{
+  ObTaskExecutor* executor = arg;
+  ObTaskListPtr taskList = executor->taskList;
+
+  pthread_mutex_lock(&executor->mutex);
+  while (!executor->failed) {
+    ObTaskPtr task = obTakeReadyTask(executor);
+    if (task == NULL) {
+      // nothing running means nothing can become ready anymore
+      if (executor->running == 0) {
+        break;
+      }
+      pthread_cond_wait(&executor->changed, &executor->mutex);
+      continue;
+    }
+
+    executor->running += 1;
+    pthread_mutex_unlock(&executor->mutex);
+
+    assert(task->exec != NULL);
+    task->threadId = obGetThreadId();
+    task->startNs = obGetMonotonicNs();
+    bool result = task->exec(task->context);
+    task->endNs = obGetMonotonicNs();
+    // recorded right away, so that the spans of the later work cannot crowd it out
+    if (task->name != NULL) {
+      obTraceSpanAt(task->name, NULL, task->startNs, task->endNs, task->threadId);
+    }
+
+    pthread_mutex_lock(&executor->mutex);
+    executor->running -= 1;
+    task->state = result ? OB_TASK_DONE : OB_TASK_FAILED;
+    task->completedBefore = taskList->lastCompleted;
+    taskList->lastCompleted = task;
+    executor->failed = executor->failed || !result;
+    pthread_cond_broadcast(&executor->changed);
+  }
+
+  // wait for the tasks still running before the rollback
+  while (executor->running > 0) {
+    pthread_cond_wait(&executor->changed, &executor->mutex);
+  }
+  pthread_cond_broadcast(&executor->changed);
+  pthread_mutex_unlock(&executor->mutex);
+  return NULL;
+}
+
+// --------- public API ---------- //
 
 ObTaskPtr obCreateTask(ObTaskFunction exec, ObTaskFunction undo, ObTaskContext context)
 {
@@ -15,11 +110,19 @@ ObTaskPtr obCreateTask(ObTaskFunction exec, ObTaskFunction undo, ObTaskContext c
   task->previous = NULL;
   task->next = NULL;
   task->context = context;
+  task->dependencies = NULL;
+  task->dependencyCount = 0;
+  task->state = OB_TASK_PENDING;
+  task->completedBefore = NULL;
+  task->name = NULL;
+  task->startNs = task->endNs = 0;
+  task->threadId = 0;
   return task;
 }
 
 void obFreeTask(ObTaskPtr* task)
 {
+  free((*task)->dependencies);
   free(*task);
   *task = NULL;
 }
@@ -28,6 +131,8 @@ ObTaskListPtr obCreateTaskList()
 {
   ObTaskList* list = malloc(sizeof(ObTaskList));
   list->first = list->last = NULL;
+  list->lastCompleted = NULL;
+  list->threads = 1;
   return list;
 }
 
@@ -65,29 +170,59 @@ void obAddTask(ObTaskListPtr taskList, ObTaskFunction exec, ObTaskFunction undo,
   obAppendTask(taskList, task);
 }
 
+void obAddTaskDependency(ObTaskPtr task, ObTaskPtr dependency)
+{
+  assert(task != NULL && dependency != NULL && task != dependency);
+
+  task->dependencies = realloc(task->dependencies,
+                               (task->dependencyCount + 1) * sizeof(ObTaskPtr));
+  task->dependencies[task->dependencyCount] = dependency;
+  task->dependencyCount += 1;
+}
+
 bool obCallUndoChain(ObTaskPtr task)
 {
+  bool result = true;
   while (task != NULL) {
-    if (task->undo != NULL) {
-      task->undo(task->context); //TODO: catch return value
+    if (task->undo != NULL && !task->undo(task->context)) {
+      result = false;
     }
-    task = task->previous;
+    task = task->completedBefore;
   }
-  return true;
+  return result;
 }
 
 bool obExecTaskList(ObTaskListPtr taskList)
 {
-  ObTaskPtr task = taskList->first;
-  while (task != NULL) {
-    assert(task->exec != NULL);
+  ObTaskExecutor executor;
+  executor.taskList = taskList;
+  executor.running = 0;
+  executor.failed = false;
+  pthread_mutex_init(&executor.mutex, NULL);
+  pthread_cond_init(&executor.changed, NULL);
 
-    bool result = task->exec(task->context);
-    if (!result) {
-      obCallUndoChain(task);
-      return false;
+  int threadCount = taskList->threads > 1 ? taskList->threads - 1 : 0;
+  pthread_t* threads = calloc(threadCount + 1, sizeof(pthread_t));
+  int started = 0;
+  for (; started < threadCount; ++started) {
+    if (pthread_create(&threads[started], NULL, obTaskWorker, &executor) != 0) {
+      break;
     }
-    task = task->next;
+  }
+
+  // the calling thread is a worker too
+  obTaskWorker(&executor);
+  for (int i = 0; i < started; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  free(threads);
+
+  pthread_cond_destroy(&executor.changed);
+  pthread_mutex_destroy(&executor.mutex);
+
+  if (executor.failed) {
+    obCallUndoChain(taskList->lastCompleted);
+    return false;
   }
   return true;
 }
@@ -6,23 +6,47 @@
 #define OBTASKLIST_H
 
 #include <stdbool.h>
+#include <stdint.h>
 
 typedef struct ObTask ObTask;
 typedef struct ObTask* ObTaskPtr;
 typedef void* ObTaskContext;
 typedef bool (*ObTaskFunction)(ObTaskContext);
 
+typedef enum ObTaskState
+{
+  OB_TASK_PENDING = 0,
+  OB_TASK_RUNNING,
+  OB_TASK_DONE,
+  OB_TASK_FAILED
+} ObTaskState;
+
 struct ObTask{
   ObTaskFunction exec;
   ObTaskFunction undo;
   ObTaskPtr next;
   ObTaskPtr previous;
   ObTaskContext context;
+
+  // without dependencies the task waits for all the tasks appended before it
+  ObTaskPtr* dependencies;
+  int dependencyCount;
+
+  ObTaskState state;
+  ObTaskPtr completedBefore; // the undo chain, in reverse completion order
+
+  // for tracing: optional name, CLOCK_MONOTONIC exec times and thread id
+  const char* name;
+  uint64_t startNs;
+  uint64_t endNs;
+  int threadId;
 };
 
 typedef struct {
   ObTaskPtr first;
   ObTaskPtr last;
+  ObTaskPtr lastCompleted;
+  int threads; // 1 (default) to execute the tasks one by one
 } ObTaskList;
 
 typedef ObTaskList* ObTaskListPtr;
@@ -42,8 +66,25 @@ void obAppendTask(ObTaskListPtr taskList, ObTaskPtr task);
 void obAddTask(ObTaskListPtr taskList, ObTaskFunction exec,
                ObTaskFunction undo, ObTaskContext context);
 
+/**
+ * @brief Make the task wait only for the given dependencies (and not for
+ * all the tasks appended before it). The dependency has to be appended
+ * to the list before the task.
+ */
+void obAddTaskDependency(ObTaskPtr task, ObTaskPtr dependency);
+
+/**
+ * @brief Call the undo functions of the task and of all the tasks
+ * completed before it, in reverse completion order
+ * @return false if any of the undo functions failed
+ */
 bool obCallUndoChain(ObTaskPtr task);
 
+/**
+ * @brief Execute the tasks as soon as their dependencies are done, on up
+ * to taskList->threads threads. After a failure no new task is started and
+ * all the completed (and failed) tasks are undone.
+ */
 bool obExecTaskList(ObTaskListPtr taskList);
 
 #endif // OBTASKLIST_H
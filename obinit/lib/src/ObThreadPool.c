@@ -0,0 +1,176 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObThreadPool.h"
+#include "ob/ObLogging.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+typedef struct ObWorkItem
+{
+  ObWorkFunction work;
+  void* arg;
+  struct ObWorkItem* next;
+} ObWorkItem;
+
+struct ObThreadPool
+{
+  pthread_mutex_t mutex;
+  pthread_cond_t workAvailable;
+  pthread_cond_t spaceAvailable;
+  pthread_cond_t idle;
+
+  ObWorkItem* head;
+  ObWorkItem* tail;
+  size_t queued;
+  size_t queueSize;
+  size_t pending; // queued + running
+  bool stop;
+
+  int threadCount;
+  pthread_t* threads;
+};
+
+static void* obWorkerLoop(void* arg)
+{
+  ObThreadPool* pool = arg;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (true) {
+    while (pool->head == NULL && !pool->stop) {
+      pthread_cond_wait(&pool->workAvailable, &pool->mutex);
+    }
+    if (pool->head == NULL) {
+      break;
+    }
+
+    ObWorkItem* item = pool->head;
+    pool->head = item->next;
+    if (pool->head == NULL) {
+      pool->tail = NULL;
+    }
+    pool->queued -= 1;
+    pthread_cond_signal(&pool->spaceAvailable);
+    pthread_mutex_unlock(&pool->mutex);
+
+    item->work(item->arg);
+    free(item);
+
+    pthread_mutex_lock(&pool->mutex);
+    pool->pending -= 1;
+    if (pool->pending == 0) {
+      pthread_cond_broadcast(&pool->idle);
+    }
+  }
+  pthread_mutex_unlock(&pool->mutex);
+  return NULL;
+}
+
+// --------- public API ---------- //
+
+ObThreadPool* obCreateThreadPool(int threads, size_t queueSize)
+{
+  ObThreadPool* pool = calloc(1, sizeof(ObThreadPool));
+  pthread_mutex_init(&pool->mutex, NULL);
+  pthread_cond_init(&pool->workAvailable, NULL);
+  pthread_cond_init(&pool->spaceAvailable, NULL);
+  pthread_cond_init(&pool->idle, NULL);
+  pool->queueSize = queueSize > 0 ? queueSize : 1;
+
+  if (threads > 0) {
+    pool->threads = calloc(threads, sizeof(pthread_t));
+  }
+
+  for (int i = 0; i < threads; ++i) {
+    if (pthread_create(&pool->threads[i], NULL, obWorkerLoop, pool) != 0) {
+      break;
+    }
+    pool->threadCount += 1;
+  }
+
+  if (threads > 0 && pool->threadCount == 0) {
+    obFreeThreadPool(&pool);
+  }
+  return pool;
+}
+
+void obFreeThreadPool(ObThreadPool** pool)
+{
+  ObThreadPool* p = *pool;
+  pthread_mutex_lock(&p->mutex);
+  p->stop = true;
+  pthread_cond_broadcast(&p->workAvailable);
+  pthread_mutex_unlock(&p->mutex);
+
+  for (int i = 0; i < p->threadCount; ++i) {
+    pthread_join(p->threads[i], NULL);
+  }
+
+  pthread_cond_destroy(&p->workAvailable);
+  pthread_cond_destroy(&p->spaceAvailable);
+  pthread_cond_destroy(&p->idle);
+  pthread_mutex_destroy(&p->mutex);
+  free(p->threads);
+  free(p);
+  *pool = NULL;
+}
+
+bool obSubmitWork(ObThreadPool* pool, ObWorkFunction work, void* arg)
+{
+  if (pool->threadCount == 0) {
+    work(arg);
+    return true;
+  }
+
+  ObWorkItem* item = malloc(sizeof(ObWorkItem));
+  if (item == NULL) {
+    return false;
+  }
+  item->work = work;
+  item->arg = arg;
+  item->next = NULL;
+
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->queued >= pool->queueSize) {
+    pthread_cond_wait(&pool->spaceAvailable, &pool->mutex);
+  }
+
+  if (pool->tail) {
+    pool->tail->next = item;
+  }
+  else {
+    pool->head = item;
+  }
+  pool->tail = item;
+  pool->queued += 1;
+  pool->pending += 1;
+
+  pthread_cond_signal(&pool->workAvailable);
+  pthread_mutex_unlock(&pool->mutex);
+  return true;
+}
+
+void obWaitThreadPool(ObThreadPool* pool)
+{
+  // the records buffered so far would wait for the next log call otherwise
+  obFlushLog();
+  pthread_mutex_lock(&pool->mutex);
+  while (pool->pending > 0) {
+    pthread_cond_wait(&pool->idle, &pool->mutex);
+  }
+  pthread_mutex_unlock(&pool->mutex);
+}
+
+int obGetThreadPoolSize(const ObThreadPool* pool)
+{
+  return pool->threadCount;
+}
+
+int obGetOnlineCpuCount()
+{
+  long count = sysconf(_SC_NPROCESSORS_ONLN);
+  return count > 0 ? (int)count : 1;
+}
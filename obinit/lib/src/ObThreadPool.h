@@ -0,0 +1,44 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBTHREADPOOL_H
+#define OBTHREADPOOL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef void (*ObWorkFunction)(void* arg);
+
+typedef struct ObThreadPool ObThreadPool;
+
+/**
+ * @brief Create a pool of worker threads with a bounded work queue
+ * @param threads number of workers, 0 makes obSubmitWork run the work
+ * in the calling thread
+ * @param queueSize maximum number of queued (not running) work items,
+ * obSubmitWork blocks when the queue is full
+ * @return new pool or NULL if no thread could be started
+ */
+ObThreadPool* obCreateThreadPool(int threads, size_t queueSize);
+
+/**
+ * @brief Stop and join the workers. Queued work is finished first.
+ */
+void obFreeThreadPool(ObThreadPool** pool);
+
+bool obSubmitWork(ObThreadPool* pool, ObWorkFunction work, void* arg);
+
+/**
+ * @brief Block until all submitted work has been finished
+ */
+void obWaitThreadPool(ObThreadPool* pool);
+
+int obGetThreadPoolSize(const ObThreadPool* pool);
+
+/**
+ * @brief Number of online CPUs, at least 1
+ */
+int obGetOnlineCpuCount();
+
+#endif // OBTHREADPOOL_H
@@ -0,0 +1,170 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ob/ObTrace.h"
+#include "ob/ObDefs.h"
+#include "ob/ObLogging.h"
+#include "ObOsUtils.h"
+#include <sds.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+#define TRACE_NAME_MAX 48
+#define TRACE_DETAIL_MAX 128
+#define TRACE_TMP_EXT ".tmp"
+
+typedef struct ObTraceEvent
+{
+  char name[TRACE_NAME_MAX];
+  char detail[TRACE_DETAIL_MAX];
+  uint64_t startNs;
+  uint64_t endNs;
+  int threadId;
+} ObTraceEvent;
+
+static struct {
+  pthread_mutex_t mutex;
+  ObTraceEvent* events;
+  size_t count;
+  size_t capacity;
+  size_t dropped;
+} obTrace = {PTHREAD_MUTEX_INITIALIZER, NULL, 0, 0, 0};
+
+static void obWriteJsonString(FILE* file, const char* str)
+{
+  fputc('"', file);
+  for (const unsigned char* c = (const unsigned char*)str; *c; ++c) {
+    if (*c == '"' || *c == '\\') {
+      fprintf(file, "\\%c", *c);
+    }
+    else if (*c < 0x20) {
+      fprintf(file, "\\u%04x", *c);
+    }
+    else {
+      fputc(*c, file);
+    }
+  }
+  fputc('"', file);
+}
+
+static void obWriteTraceEvent(FILE* file, const ObTraceEvent* event, int pid)
+{
+  // microseconds with nanosecond precision
+  fprintf(file, "{\"name\":");
+  obWriteJsonString(file, event->name);
+  fprintf(file, ",\"cat\":\"obinit\",\"ph\":\"X\",\"ts\":%llu.%03llu,\"dur\":%llu.%03llu,"
+          "\"pid\":%i,\"tid\":%i",
+          (unsigned long long)(event->startNs / 1000),
+          (unsigned long long)(event->startNs % 1000),
+          (unsigned long long)((event->endNs - event->startNs) / 1000),
+          (unsigned long long)((event->endNs - event->startNs) % 1000),
+          pid, event->threadId);
+  if (event->detail[0] != '\0') {
+    fprintf(file, ",\"args\":{\"detail\":");
+    obWriteJsonString(file, event->detail);
+    fputc('}', file);
+  }
+  fputc('}', file);
+}
+
+// --------- public API ---------- //
+
+uint64_t obGetMonotonicNs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ULL + (uint64_t)ts.tv_nsec;
+}
+
+int obGetThreadId()
+{
+  return (int)syscall(SYS_gettid);
+}
+
+void obTraceSpan(const char* name, const char* detail, uint64_t startNs)
+{
+  obTraceSpanAt(name, detail, startNs, obGetMonotonicNs(), obGetThreadId());
+}
+
+void obTraceSpanAt(const char* name, const char* detail,
+                   uint64_t startNs, uint64_t endNs, int threadId)
+{
+  pthread_mutex_lock(&obTrace.mutex);
+  if (obTrace.count == obTrace.capacity && obTrace.capacity < OB_TRACE_MAX_SPANS) {
+    size_t capacity = obTrace.capacity ? obTrace.capacity * 2 : 64;
+    capacity = capacity < OB_TRACE_MAX_SPANS ? capacity : OB_TRACE_MAX_SPANS;
+    ObTraceEvent* events = realloc(obTrace.events, capacity * sizeof(ObTraceEvent));
+    if (events != NULL) {
+      obTrace.events = events;
+      obTrace.capacity = capacity;
+    }
+  }
+
+  if (obTrace.count < obTrace.capacity) {
+    ObTraceEvent* event = &obTrace.events[obTrace.count++];
+    snprintf(event->name, TRACE_NAME_MAX, "%s", name);
+    snprintf(event->detail, TRACE_DETAIL_MAX, "%s", detail ? detail : "");
+    event->startNs = startNs;
+    event->endNs = endNs > startNs ? endNs : startNs;
+    event->threadId = threadId;
+  }
+  else {
+    obTrace.dropped += 1;
+  }
+  pthread_mutex_unlock(&obTrace.mutex);
+}
+
+bool obWriteTrace(const char* path)
+{
+  sds tmpPath = sdscat(sdsnew(path), TRACE_TMP_EXT);
+  FILE* file = fopen(tmpPath, "w");
+  if (file == NULL) {
+    obLogE("Cannot write boot trace to %s: %s", path, strerror(errno));
+    sdsfree(tmpPath);
+    return false;
+  }
+
+  int pid = (int)getpid();
+  pthread_mutex_lock(&obTrace.mutex);
+  fprintf(file, "{\"displayTimeUnit\":\"ms\",\"otherData\":{\"dropped\":%zu},"
+          "\"traceEvents\":[", obTrace.dropped);
+  for (size_t i = 0; i < obTrace.count; ++i) {
+    if (i > 0) {
+      fputc(',', file);
+    }
+    fputc('\n', file);
+    obWriteTraceEvent(file, &obTrace.events[i], pid);
+  }
+  fprintf(file, "\n]}\n");
+  size_t count = obTrace.count;
+  pthread_mutex_unlock(&obTrace.mutex);
+
+  bool result = fflush(file) == 0 && fsync(fileno(file)) == 0;
+  result = fclose(file) == 0 && result;
+  result = result && obRename(tmpPath, path);
+  if (result) {
+    obLogI("Boot trace with %zu spans written to %s", count, path);
+  }
+  else {
+    unlink(tmpPath);
+  }
+  sdsfree(tmpPath);
+  return result;
+}
+
+void obClearTrace()
+{
+  pthread_mutex_lock(&obTrace.mutex);
+  free(obTrace.events);
+  obTrace.events = NULL;
+  obTrace.count = obTrace.capacity = obTrace.dropped = 0;
+  pthread_mutex_unlock(&obTrace.mutex);
+}
@@ -0,0 +1,165 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObTrash.h"
+#include "ObOsUtils.h"
+#include "ob/ObLogging.h"
+#include "ob/ObDefs.h"
+#include <sds.h>
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_CLASS_SHIFT 13
+
+#define TRASH_NICE 19
+#define TRASH_MAX_ATTEMPTS 100
+
+/**
+ * Remove the contents of the directory, relative to its descriptor so that
+ * it keeps working when the path is no longer reachable. Takes dirFd.
+ */
+static bool obRemoveTreeAt(int dirFd)
+{
+  DIR* dir = fdopendir(dirFd);
+  if (dir == NULL) {
+    close(dirFd);
+    return false;
+  }
+
+  bool result = true;
+  struct dirent* entry = NULL;
+  while ((entry = readdir(dir)) != NULL) {
+    const char* name = entry->d_name;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+      continue;
+    }
+
+    bool isDir = entry->d_type == DT_DIR;
+    if (entry->d_type == DT_UNKNOWN) {
+      struct stat st;
+      isDir = fstatat(dirfd(dir), name, &st, AT_SYMLINK_NOFOLLOW) == 0
+          && S_ISDIR(st.st_mode);
+    }
+
+    if (isDir) {
+      int childFd = openat(dirfd(dir), name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+      result = childFd >= 0 && obRemoveTreeAt(childFd) && result;
+    }
+    if (unlinkat(dirfd(dir), name, isDir ? AT_REMOVEDIR : 0) != 0 && errno != ENOENT) {
+      result = false;
+    }
+  }
+
+  closedir(dir);
+  return result;
+}
+
+static bool obIsTrashEmpty(const char* trashDir)
+{
+  return !obIsDirectory(trashDir) || obIsDirectoryEmpty(trashDir);
+}
+
+// --------- public API ---------- //
+
+bool obMoveToTrash(const char* path, const char* trashDir)
+{
+  if (!obExists(path)) {
+    return true;
+  }
+  if (!obExists(trashDir) && !obMkpath(trashDir, OB_MKPATH_MODE)) {
+    return false;
+  }
+
+  const char* name = strrchr(path, '/');
+  name = name != NULL ? name + 1 : path;
+
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+
+  bool result = false;
+  sds generation = sdsempty();
+  for (int attempt = 0; attempt < TRASH_MAX_ATTEMPTS; ++attempt) {
+    sdsclear(generation);
+    generation = sdscatprintf(generation, "%s/%s-%lld-%i", trashDir, name,
+                              (long long)now.tv_sec, attempt);
+    if (rename(path, generation) == 0) {
+      obLogI("Moved %s to %s", path, generation);
+      result = true;
+      break;
+    }
+    if (errno != EEXIST && errno != ENOTEMPTY) {
+      break;
+    }
+  }
+
+  if (!result) {
+    obLogE("Cannot move %s to the trash: %s", path, strerror(errno));
+  }
+  sdsfree(generation);
+  return result;
+}
+
+bool obEmptyTrash(const char* trashDir)
+{
+  if (!obIsDirectory(trashDir)) {
+    return true;
+  }
+
+  int trashFd = open(trashDir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (trashFd < 0 || !obRemoveTreeAt(trashFd)) {
+    obLogE("Cannot empty the trash %s: %s", trashDir, strerror(errno));
+    return false;
+  }
+  return true;
+}
+
+bool obEmptyTrashInBackground(const char* trashDir)
+{
+  if (obIsTrashEmpty(trashDir)) {
+    return true;
+  }
+
+  int trashFd = open(trashDir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  if (trashFd < 0) {
+    obLogW("Cannot open the trash %s: %s", trashDir, strerror(errno));
+    return false;
+  }
+
+  obLogI("Emptying the trash in the background: %s", trashDir);
+  pid_t pid = fork();
+  if (pid < 0) {
+    obLogW("Cannot start emptying the trash: %s", strerror(errno));
+    close(trashFd);
+    return false;
+  }
+
+  if (pid == 0) {
+    // detached grandchild reparented to init, nothing is logged from here
+    // as the buffered log records are shared with the parent
+    setsid();
+    if (fork() == 0) {
+      setpriority(PRIO_PROCESS, 0, TRASH_NICE);
+      syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0,
+              IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+      _exit(obRemoveTreeAt(trashFd) ? 0 : 1);
+    }
+    _exit(0);
+  }
+
+  close(trashFd);
+  waitpid(pid, NULL, 0);
+  return true;
+}
@@ -0,0 +1,30 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBTRASH_H
+#define OBTRASH_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Rename path into a new generation directory of trashDir
+ * (on the same filesystem), which takes the same time for any size
+ * of the moved tree
+ */
+bool obMoveToTrash(const char* path, const char* trashDir);
+
+/**
+ * @brief Remove all the generations from trashDir, the trashDir itself
+ * is kept
+ */
+bool obEmptyTrash(const char* trashDir);
+
+/**
+ * @brief Empty the trash in a detached process with the lowest CPU and
+ * the idle I/O priority, so that it runs on after obinit exits
+ * @return true if the trash is empty or the process has been started
+ */
+bool obEmptyTrashInBackground(const char* trashDir);
+
+#endif // OBTRASH_H
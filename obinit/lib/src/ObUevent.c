@@ -0,0 +1,191 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObUevent.h"
+#include "ObBlkid.h"
+#include "ObOsUtils.h"
+#include "ob/ObDefs.h"
+#include "ob/ObLogging.h"
+#include "ob/ObTrace.h"
+
+#include <string.h>
+#include <stdio.h>
+#include <errno.h>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+
+#define UEVENT_KERNEL_GROUP 1
+#define UEVENT_UDEV_GROUP 2
+#define UEVENT_BUFFER_SIZE 8192
+#define UEVENT_RCVBUF_SIZE (1024 * 1024)
+#define UEVENT_DEV_PREFIX "/dev/"
+
+typedef struct ObUevent
+{
+  const char* action;
+  const char* subsystem;
+  const char* devname;
+} ObUevent;
+
+static long long obGetMonotonicMs()
+{
+  return (long long)(obGetMonotonicNs() / 1000000);
+}
+
+static int obOpenUeventSocket()
+{
+  int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC | SOCK_NONBLOCK,
+                  NETLINK_KOBJECT_UEVENT);
+  if (fd < 0) {
+    obLogW("Cannot open uevent socket: %s", strerror(errno));
+    return -1;
+  }
+
+  // the device node is created before the kernel event, the by-uuid
+  // symlinks only before the udev one
+  struct sockaddr_nl address;
+  memset(&address, 0, sizeof(struct sockaddr_nl));
+  address.nl_family = AF_NETLINK;
+  address.nl_groups = UEVENT_KERNEL_GROUP | UEVENT_UDEV_GROUP;
+  if (bind(fd, (struct sockaddr*)&address, sizeof(struct sockaddr_nl)) != 0) {
+    obLogW("Cannot bind uevent socket: %s", strerror(errno));
+    close(fd);
+    return -1;
+  }
+
+  int rcvbuf = UEVENT_RCVBUF_SIZE;
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUFFORCE, &rcvbuf, sizeof(rcvbuf));
+  return fd;
+}
+
+/**
+ * Kernel messages: "action@devpath\0KEY=value\0...", the udev ones start
+ * with "libudev\0" and are not parsed (any of them triggers a recheck)
+ */
+static void obParseUevent(const char* buffer, size_t size, ObUevent* event)
+{
+  memset(event, 0, sizeof(ObUevent));
+  if (size == 0 || strchr(buffer, '@') == NULL) {
+    return;
+  }
+
+  for (size_t i = 0; i < size; i += strlen(buffer + i) + 1) {
+    const char* item = buffer + i;
+    if (strncmp(item, "ACTION=", 7) == 0) {
+      event->action = item + 7;
+    }
+    else if (strncmp(item, "SUBSYSTEM=", 10) == 0) {
+      event->subsystem = item + 10;
+    }
+    else if (strncmp(item, "DEVNAME=", 8) == 0) {
+      event->devname = item + 8;
+    }
+  }
+}
+
+static bool obIsDeviceReady(const char* device, const ObUevent* event)
+{
+  if (!obIsUuid(device)) {
+    return obIsBlockDevice(device);
+  }
+
+  if (obIsUuidLinked(device)) {
+    return true;
+  }
+
+  if (event && event->devname && event->subsystem
+      && strcmp(event->subsystem, "block") == 0
+      && event->action && strcmp(event->action, "remove") != 0) {
+    char devicePath[OB_DEV_PATH_MAX];
+    snprintf(devicePath, OB_DEV_PATH_MAX, "%s%s", UEVENT_DEV_PREFIX, event->devname);
+    return obMatchDeviceUuid(device, devicePath);
+  }
+  return false;
+}
+
+/**
+ * Used when the uevent socket is not available
+ */
+static bool obPollForDevice(const char* device, long long deadline)
+{
+  while (!obIsDeviceReady(device, NULL)) {
+    if (obGetMonotonicMs() >= deadline) {
+      return false;
+    }
+    usleep(OB_DEVICE_POLL_INTERVAL_MS * 1000);
+  }
+  return true;
+}
+
+// --------- public API ---------- //
+
+bool obIsHotplugDevice(const char* device)
+{
+  return obIsUuid(device)
+      || strncmp(device, UEVENT_DEV_PREFIX, strlen(UEVENT_DEV_PREFIX)) == 0;
+}
+
+bool obWaitForDevice(const char* device, int timeoutMs)
+{
+  long long start = obGetMonotonicMs();
+  long long deadline = start + timeoutMs;
+
+  // subscribe first so that no event is missed between the check and poll
+  int fd = obOpenUeventSocket();
+  if (obIsDeviceReady(device, NULL)) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return true;
+  }
+
+  obLogI("Waiting up to %i ms for device %s", timeoutMs, device);
+  obFlushLog();
+  bool result = false;
+  if (fd < 0) {
+    result = obPollForDevice(device, deadline);
+  }
+  else {
+    char buffer[UEVENT_BUFFER_SIZE];
+    long long now = start;
+    while (!result && now < deadline) {
+      struct pollfd pfd = {.fd = fd, .events = POLLIN};
+      int ready = poll(&pfd, 1, (int)(deadline - now));
+      if (ready < 0 && errno != EINTR) {
+        obLogW("Polling uevent socket failed: %s", strerror(errno));
+        result = obPollForDevice(device, deadline);
+        break;
+      }
+
+      ssize_t size;
+      while (!result && (size = recv(fd, buffer, UEVENT_BUFFER_SIZE - 1, 0)) != 0) {
+        if (size < 0) {
+          // events lost on overflow, check the device directly
+          if (errno == ENOBUFS) {
+            result = obIsDeviceReady(device, NULL);
+            continue;
+          }
+          break;
+        }
+        buffer[size] = '\0';
+        ObUevent event;
+        obParseUevent(buffer, size, &event);
+        result = obIsDeviceReady(device, &event);
+      }
+      now = obGetMonotonicMs();
+    }
+    close(fd);
+  }
+
+  if (result) {
+    obLogI("Device %s available after %lli ms", device, obGetMonotonicMs() - start);
+  }
+  else {
+    obLogW("Device %s not available after %i ms", device, timeoutMs);
+  }
+  return result;
+}
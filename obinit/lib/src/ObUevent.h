@@ -0,0 +1,24 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBUEVENT_H
+#define OBUEVENT_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Check if the device needs to be waited for, i.e. it is a path
+ * in /dev or a "UUID=<uuid>" string
+ */
+bool obIsHotplugDevice(const char* device);
+
+/**
+ * @brief Wait until the block device (a /dev path or "UUID=<uuid>")
+ * shows up, listening to the kernel and udev uevents
+ * @param timeoutMs maximum waiting time in milliseconds
+ * @return true if the device is available
+ */
+bool obWaitForDevice(const char* device, int timeoutMs);
+
+#endif // OBUEVENT_H
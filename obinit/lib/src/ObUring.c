@@ -0,0 +1,505 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObUring.h"
+
+#ifdef OB_USE_IO_URING
+
+#include "ob/ObLogging.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdatomic.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+
+#define URING_DEPTH 16
+#define URING_BUFFER_SIZE (128 * 1024)
+
+typedef enum ObUringSlotState
+{
+  SLOT_IDLE = 0,
+  SLOT_READING,
+  SLOT_WRITING
+} ObUringSlotState;
+
+typedef struct ObUringSlot
+{
+  ObUringSlotState state;
+  off_t offset;   // file offset of the buffer start
+  size_t length;  // bytes still to be read at offset
+  size_t filled;  // bytes in the buffer
+  size_t written; // bytes of the buffer already written
+  int result;     // last completion result (reads in obUringReadFd)
+  bool completed;
+} ObUringSlot;
+
+struct ObUring
+{
+  int fd;
+  unsigned depth;
+  bool fixedBuffers;
+
+  unsigned* sqHead;
+  unsigned* sqTail;
+  unsigned* sqMask;
+  unsigned* sqArray;
+  struct io_uring_sqe* sqes;
+  unsigned pending;
+
+  unsigned* cqHead;
+  unsigned* cqTail;
+  unsigned* cqMask;
+  struct io_uring_cqe* cqes;
+
+  void* sqRing;
+  size_t sqRingSize;
+  void* cqRing;
+  size_t cqRingSize;
+  size_t sqesSize;
+
+  char* buffers;
+  ObUringSlot slots[URING_DEPTH];
+};
+
+static pthread_key_t uringKey;
+static pthread_once_t uringKeyOnce = PTHREAD_ONCE_INIT;
+static atomic_bool uringUnsupported = false;
+
+static void obFreeUring(void* arg)
+{
+  ObUring* ring = arg;
+  if (ring == NULL) {
+    return;
+  }
+  if (ring->sqes) {
+    munmap(ring->sqes, ring->sqesSize);
+  }
+  if (ring->cqRing && ring->cqRing != ring->sqRing) {
+    munmap(ring->cqRing, ring->cqRingSize);
+  }
+  if (ring->sqRing) {
+    munmap(ring->sqRing, ring->sqRingSize);
+  }
+  close(ring->fd);
+  free(ring->buffers);
+  free(ring);
+}
+
+static void obCreateUringKey()
+{
+  pthread_key_create(&uringKey, obFreeUring);
+}
+
+static int obUringEnter(ObUring* ring, unsigned toSubmit, unsigned minComplete)
+{
+  int result;
+  do {
+    result = syscall(__NR_io_uring_enter, ring->fd, toSubmit, minComplete,
+                     IORING_ENTER_GETEVENTS, NULL, 0);
+  } while (result < 0 && errno == EINTR);
+  return result;
+}
+
+static bool obRegisterUringBuffers(ObUring* ring)
+{
+  struct iovec iovecs[URING_DEPTH];
+  for (unsigned i = 0; i < ring->depth; ++i) {
+    iovecs[i].iov_base = ring->buffers + (size_t)i * URING_BUFFER_SIZE;
+    iovecs[i].iov_len = URING_BUFFER_SIZE;
+  }
+  return syscall(__NR_io_uring_register, ring->fd, IORING_REGISTER_BUFFERS,
+                 iovecs, ring->depth) == 0;
+}
+
+static ObUring* obCreateUring()
+{
+  struct io_uring_params params;
+  memset(&params, 0, sizeof(params));
+
+  int fd = syscall(__NR_io_uring_setup, URING_DEPTH, &params);
+  if (fd < 0) {
+    obLogI("io_uring not available (%s), using synchronous I/O", strerror(errno));
+    atomic_store(&uringUnsupported, true);
+    return NULL;
+  }
+
+  ObUring* ring = calloc(1, sizeof(ObUring));
+  ring->fd = fd;
+  ring->depth = params.sq_entries < URING_DEPTH ? params.sq_entries : URING_DEPTH;
+
+  ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+  ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+  bool singleMmap = params.features & IORING_FEAT_SINGLE_MMAP;
+  if (singleMmap && ring->cqRingSize > ring->sqRingSize) {
+    ring->sqRingSize = ring->cqRingSize;
+  }
+
+  ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE,
+                      MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+  if (ring->sqRing == MAP_FAILED) {
+    ring->sqRing = NULL;
+    obFreeUring(ring);
+    return NULL;
+  }
+
+  if (singleMmap) {
+    ring->cqRing = ring->sqRing;
+  }
+  else {
+    ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+    if (ring->cqRing == MAP_FAILED) {
+      ring->cqRing = NULL;
+      obFreeUring(ring);
+      return NULL;
+    }
+  }
+
+  ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+  ring->sqes = mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+  if (ring->sqes == MAP_FAILED) {
+    ring->sqes = NULL;
+    obFreeUring(ring);
+    return NULL;
+  }
+
+  char* sq = ring->sqRing;
+  char* cq = ring->cqRing;
+  ring->sqHead = (unsigned*)(sq + params.sq_off.head);
+  ring->sqTail = (unsigned*)(sq + params.sq_off.tail);
+  ring->sqMask = (unsigned*)(sq + params.sq_off.ring_mask);
+  ring->sqArray = (unsigned*)(sq + params.sq_off.array);
+  ring->cqHead = (unsigned*)(cq + params.cq_off.head);
+  ring->cqTail = (unsigned*)(cq + params.cq_off.tail);
+  ring->cqMask = (unsigned*)(cq + params.cq_off.ring_mask);
+  ring->cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+
+  if (posix_memalign((void**)&ring->buffers, 4096, (size_t)ring->depth * URING_BUFFER_SIZE) != 0) {
+    ring->buffers = NULL;
+    obFreeUring(ring);
+    return NULL;
+  }
+
+  // needs RLIMIT_MEMLOCK headroom on older kernels
+  ring->fixedBuffers = obRegisterUringBuffers(ring);
+  return ring;
+}
+
+static char* obGetSlotBuffer(ObUring* ring, unsigned slot)
+{
+  return ring->buffers + (size_t)slot * URING_BUFFER_SIZE;
+}
+
+static void obQueueUringIo(ObUring* ring, unsigned slot, int fd, bool write,
+                           char* buffer, size_t length, off_t offset)
+{
+  unsigned tail = *ring->sqTail;
+  unsigned index = tail & *ring->sqMask;
+  struct io_uring_sqe* sqe = &ring->sqes[index];
+  memset(sqe, 0, sizeof(struct io_uring_sqe));
+
+  if (ring->fixedBuffers) {
+    sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+    sqe->buf_index = slot;
+  }
+  else {
+    sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+  }
+  sqe->fd = fd;
+  sqe->addr = (unsigned long)buffer;
+  sqe->len = length;
+  sqe->off = offset;
+  sqe->user_data = slot;
+
+  ring->sqArray[index] = index;
+  atomic_store_explicit((_Atomic unsigned*)ring->sqTail, tail + 1, memory_order_release);
+  ring->pending += 1;
+}
+
+static void obQueueSlotRead(ObUring* ring, unsigned slot, int fd)
+{
+  ObUringSlot* s = &ring->slots[slot];
+  s->state = SLOT_READING;
+  size_t length = s->length > URING_BUFFER_SIZE ? URING_BUFFER_SIZE : s->length;
+  obQueueUringIo(ring, slot, fd, false, obGetSlotBuffer(ring, slot), length, s->offset);
+}
+
+static void obQueueSlotWrite(ObUring* ring, unsigned slot, int fd)
+{
+  ObUringSlot* s = &ring->slots[slot];
+  s->state = SLOT_WRITING;
+  obQueueUringIo(ring, slot, fd, true, obGetSlotBuffer(ring, slot) + s->written,
+                 s->filled - s->written, s->offset + s->written);
+}
+
+/**
+ * @brief Submit queued entries and wait for at least one completion
+ * @return false on io_uring_enter error
+ */
+static bool obSubmitUring(ObUring* ring)
+{
+  unsigned toSubmit = ring->pending;
+  ring->pending = 0;
+  return obUringEnter(ring, toSubmit, 1) >= 0;
+}
+
+static bool obPopUringCompletion(ObUring* ring, unsigned* slot, int* result)
+{
+  unsigned head = *ring->cqHead;
+  unsigned tail = atomic_load_explicit((_Atomic unsigned*)ring->cqTail, memory_order_acquire);
+  if (head == tail) {
+    return false;
+  }
+
+  struct io_uring_cqe* cqe = &ring->cqes[head & *ring->cqMask];
+  *slot = (unsigned)cqe->user_data;
+  *result = cqe->res;
+  atomic_store_explicit((_Atomic unsigned*)ring->cqHead, head + 1, memory_order_release);
+  return true;
+}
+
+// --------- public API ---------- //
+
+ObUring* obGetThreadUring()
+{
+  if (atomic_load(&uringUnsupported)) {
+    return NULL;
+  }
+
+  pthread_once(&uringKeyOnce, obCreateUringKey);
+  ObUring* ring = pthread_getspecific(uringKey);
+  if (ring == NULL) {
+    ring = obCreateUring();
+    pthread_setspecific(uringKey, ring);
+  }
+  return ring;
+}
+
+bool obUringCopyFd(ObUring* ring, int srcFd, int dstFd, off_t* offset, off_t size)
+{
+  off_t next = *offset;
+  off_t end = size; // lowered when the source turns out shorter
+  unsigned active = 0;
+  bool result = true;
+
+  memset(ring->slots, 0, sizeof(ring->slots));
+  while (result) {
+    for (unsigned i = 0; i < ring->depth && next < end; ++i) {
+      ObUringSlot* slot = &ring->slots[i];
+      if (slot->state != SLOT_IDLE) {
+        continue;
+      }
+      slot->offset = next;
+      slot->length = end - next > URING_BUFFER_SIZE ? URING_BUFFER_SIZE : end - next;
+      next += slot->length;
+      obQueueSlotRead(ring, i, srcFd);
+      active += 1;
+    }
+
+    if (active == 0) {
+      break;
+    }
+
+    if (!obSubmitUring(ring)) {
+      result = false;
+      break;
+    }
+
+    unsigned index;
+    int res;
+    while (result && obPopUringCompletion(ring, &index, &res)) {
+      ObUringSlot* slot = &ring->slots[index];
+      if (res < 0) {
+        errno = -res;
+        result = false;
+        slot->state = SLOT_IDLE;
+        active -= 1;
+      }
+      else if (slot->state == SLOT_READING && res == 0) {
+        if (slot->offset < end) {
+          end = slot->offset;
+        }
+        slot->state = SLOT_IDLE;
+        active -= 1;
+      }
+      else if (slot->state == SLOT_READING) {
+        slot->filled = res;
+        slot->written = 0;
+        obQueueSlotWrite(ring, index, dstFd);
+      }
+      else {
+        slot->written += res;
+        if (res == 0) {
+          errno = EIO;
+          result = false;
+          slot->state = SLOT_IDLE;
+          active -= 1;
+        }
+        else if (slot->written < slot->filled) {
+          obQueueSlotWrite(ring, index, dstFd);
+        }
+        else {
+          slot->offset += slot->filled;
+          slot->length -= slot->filled;
+          if (slot->length > 0 && slot->offset < end) {
+            obQueueSlotRead(ring, index, srcFd); // short read
+          }
+          else {
+            slot->state = SLOT_IDLE;
+            active -= 1;
+          }
+        }
+      }
+    }
+  }
+
+  // drain in-flight requests before the buffers are reused
+  while (!result && active > 0 && obUringEnter(ring, ring->pending, 1) >= 0) {
+    ring->pending = 0;
+    unsigned index;
+    int res;
+    while (active > 0 && obPopUringCompletion(ring, &index, &res)) {
+      active -= 1;
+    }
+  }
+
+  // on failure the offset is kept, so another strategy can redo the range
+  if (result) {
+    *offset = end < size ? end : size;
+  }
+  return result;
+}
+
+bool obUringReadFd(ObUring* ring, int fd, ObUringReadCallback callback, void* context)
+{
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return false;
+  }
+
+  off_t size = st.st_size;
+  off_t next = 0;
+  unsigned active = 0;
+  bool result = true;
+  memset(ring->slots, 0, sizeof(ring->slots));
+
+  // chunk k always lives in slot k % depth, so completions can be
+  // consumed in file order
+  for (unsigned i = 0; i < ring->depth && next < size; ++i) {
+    ObUringSlot* slot = &ring->slots[i];
+    slot->offset = next;
+    slot->length = size - next > URING_BUFFER_SIZE ? URING_BUFFER_SIZE : size - next;
+    next += slot->length;
+    obQueueSlotRead(ring, i, fd);
+    active += 1;
+  }
+
+  unsigned current = 0;
+  while (result && active > 0) {
+    ObUringSlot* slot = &ring->slots[current];
+    while (result && !slot->completed) {
+      unsigned index;
+      int res;
+      if (ring->pending > 0 || !obPopUringCompletion(ring, &index, &res)) {
+        result = obSubmitUring(ring);
+        continue;
+      }
+      ring->slots[index].completed = true;
+      ring->slots[index].result = res;
+    }
+    if (!result) {
+      break;
+    }
+
+    active -= 1;
+    slot->completed = false;
+    slot->state = SLOT_IDLE;
+    if (slot->result < 0) {
+      errno = -slot->result;
+      result = false;
+      break;
+    }
+
+    size_t length = slot->result;
+    char* buffer = obGetSlotBuffer(ring, current);
+    // finish short reads synchronously, they are rare on regular files
+    while (length < slot->length) {
+      ssize_t count = pread(fd, buffer + length, slot->length - length, slot->offset + length);
+      if (count <= 0) {
+        break;
+      }
+      length += count;
+    }
+
+    if (length > 0 && !callback(context, buffer, length)) {
+      result = false;
+      break;
+    }
+
+    if (next < size) {
+      slot->offset = next;
+      slot->length = size - next > URING_BUFFER_SIZE ? URING_BUFFER_SIZE : size - next;
+      next += slot->length;
+      obQueueSlotRead(ring, current, fd);
+      active += 1;
+    }
+    current = (current + 1) % ring->depth;
+  }
+
+  // completions popped ahead of their turn are no longer in flight
+  for (unsigned i = 0; !result && i < ring->depth; ++i) {
+    if (ring->slots[i].completed) {
+      ring->slots[i].completed = false;
+      active -= 1;
+    }
+  }
+
+  while (!result && active > 0 && obUringEnter(ring, ring->pending, 1) >= 0) {
+    ring->pending = 0;
+    unsigned index;
+    int res;
+    while (active > 0 && obPopUringCompletion(ring, &index, &res)) {
+      active -= 1;
+    }
+  }
+
+  return result;
+}
+
+#else
+
+ObUring* obGetThreadUring()
+{
+  return NULL;
+}
+
+bool obUringCopyFd(ObUring* ring, int srcFd, int dstFd, off_t* offset, off_t size)
+{
+  (void)ring;
+  (void)srcFd;
+  (void)dstFd;
+  (void)offset;
+  (void)size;
+  return false;
+}
+
+bool obUringReadFd(ObUring* ring, int fd, ObUringReadCallback callback, void* context)
+{
+  (void)ring;
+  (void)fd;
+  (void)callback;
+  (void)context;
+  return false;
+}
+
+#endif
@@ -0,0 +1,37 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBURING_H
+#define OBURING_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+typedef struct ObUring ObUring;
+
+typedef bool (*ObUringReadCallback)(void* context, const void* data, size_t size);
+
+/**
+ * @brief Get the io_uring instance of the calling thread, created on first
+ * use and released when the thread exits.
+ * @return NULL if this build or the running kernel does not support it
+ */
+ObUring* obGetThreadUring();
+
+/**
+ * @brief Copy [*offset, size) keeping up to queue depth reads and writes
+ * in flight. Registered buffers are used when the kernel allows it.
+ * @param offset updated with the number of bytes copied (less than size
+ * if the source shrank), left unchanged on failure
+ */
+bool obUringCopyFd(ObUring* ring, int srcFd, int dstFd, off_t* offset, off_t size);
+
+/**
+ * @brief Read the whole file with queued reads, passing consecutive chunks
+ * to the callback in file order.
+ */
+bool obUringReadFd(ObUring* ring, int fd, ObUringReadCallback callback, void* context);
+
+#endif // OBURING_H
@@ -5,66 +5,292 @@
 #include "ob/ObHash.h"
 #include "ob/ObLogging.h"
 #include "xxhash.h"
+#include "ObUring.h"
 
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
 
 #define HASH_SEED 0
-#define BUFFER_SIZE 1024
+#define BUFFER_SIZE (1024 * 1024)
+#define BUFFER_ALIGNMENT 4096
+#define MMAP_MIN_SIZE (64 * 1024)
+#define MMAP_MAX_SIZE ((off_t)1 << 30)
 
-XXH64_hash_t calculateXxHash64Stream(FILE* file)
+typedef struct ObHashState
 {
-    XXH64_state_t* const state = XXH64_createState();
-    if (state == NULL) {
-      return 0;
-    }
+  ObHashType type;
+  XXH64_state_t* xxh64;
+  XXH3_state_t* xxh3;
+} ObHashState;
 
-    char buffer[BUFFER_SIZE];
-    XXH64_hash_t const seed = HASH_SEED;
-    if (XXH64_reset(state, seed) == XXH_ERROR) {
-      XXH64_freeState(state);
-      return 0;
-    }
+static const char* hashTypeNames[] = {
+  "xxh64", "xxh3", "xxh128"
+};
+
+static bool initHashState(ObHashState* state, ObHashType type)
+{
+  memset(state, 0, sizeof(ObHashState));
+  state->type = type;
+
+  if (type == OB_HASH_XXH64) {
+    state->xxh64 = XXH64_createState();
+    return state->xxh64 && XXH64_reset(state->xxh64, HASH_SEED) != XXH_ERROR;
+  }
+
+  state->xxh3 = XXH3_createState();
+  if (state->xxh3 == NULL) {
+    return false;
+  }
+  if (type == OB_HASH_XXH3_64) {
+    return XXH3_64bits_reset(state->xxh3) != XXH_ERROR;
+  }
+  return XXH3_128bits_reset(state->xxh3) != XXH_ERROR;
+}
+
+static void freeHashState(ObHashState* state)
+{
+  XXH64_freeState(state->xxh64);
+  XXH3_freeState(state->xxh3);
+}
+
+static bool updateHashState(void* context, const void* data, size_t size)
+{
+  ObHashState* state = context;
+  switch (state->type) {
+    case OB_HASH_XXH64:
+      return XXH64_update(state->xxh64, data, size) != XXH_ERROR;
+    case OB_HASH_XXH3_64:
+      return XXH3_64bits_update(state->xxh3, data, size) != XXH_ERROR;
+    default:
+      return XXH3_128bits_update(state->xxh3, data, size) != XXH_ERROR;
+  }
+}
+
+static void digestHashState(ObHashState* state, ObHash* hash)
+{
+  hash->type = state->type;
+  hash->high = 0;
+  if (state->type == OB_HASH_XXH64) {
+    hash->low = XXH64_digest(state->xxh64);
+  }
+  else if (state->type == OB_HASH_XXH3_64) {
+    hash->low = XXH3_64bits_digest(state->xxh3);
+  }
+  else {
+    XXH128_hash_t digest = XXH3_128bits_digest(state->xxh3);
+    hash->low = digest.low64;
+    hash->high = digest.high64;
+  }
+}
+
+static void hashBuffer(const void* data, size_t size, ObHashType type, ObHash* hash)
+{
+  hash->type = type;
+  hash->high = 0;
+  if (type == OB_HASH_XXH64) {
+    hash->low = XXH64(data, size, HASH_SEED);
+  }
+  else if (type == OB_HASH_XXH3_64) {
+    hash->low = XXH3_64bits(data, size);
+  }
+  else {
+    XXH128_hash_t digest = XXH3_128bits(data, size);
+    hash->low = digest.low64;
+    hash->high = digest.high64;
+  }
+}
+
+/**
+ * A mapped file shrinking while it is hashed raises SIGBUS, which only
+ * cannot happen on a read-only filesystem (e.g. a layer image)
+ */
+static bool canHashMapped(int fd, const struct stat* st)
+{
+  struct statvfs fs;
+  return S_ISREG(st->st_mode) && st->st_size >= MMAP_MIN_SIZE
+      && st->st_size <= MMAP_MAX_SIZE
+      && fstatvfs(fd, &fs) == 0 && (fs.f_flag & ST_RDONLY);
+}
+
+/**
+ * One-shot hash of the mapped file, lets XXH3 pick its long-input path
+ */
+static bool hashMapped(int fd, off_t size, ObHashType type, ObHash* hash)
+{
+  void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+
+  madvise(data, size, MADV_SEQUENTIAL);
+  hashBuffer(data, size, type, hash);
+  munmap(data, size);
+  return true;
+}
 
-    while (!feof(file)) {
-        size_t length = fread(buffer, sizeof(char), BUFFER_SIZE, file);
-        if (XXH64_update(state, buffer, length) == XXH_ERROR) {
-          XXH64_freeState(state);
-          return 0;
-        }
+static bool hashStream(int fd, ObHashType type, ObHash* hash)
+{
+  ObHashState state;
+  char* buffer = NULL;
+  bool result = initHashState(&state, type)
+      && posix_memalign((void**)&buffer, BUFFER_ALIGNMENT, BUFFER_SIZE) == 0;
+
+  off_t offset = 0;
+  while (result) {
+    ssize_t length = pread(fd, buffer, BUFFER_SIZE, offset);
+    if (length < 0 && errno == EINTR) {
+      continue;
     }
+    if (length <= 0) {
+      result = length == 0;
+      break;
+    }
+    result = updateHashState(&state, buffer, length);
+    offset += length;
+  }
+
+  if (result) {
+    digestHashState(&state, hash);
+  }
+  free(buffer);
+  freeHashState(&state);
+  return result;
+}
 
-    XXH64_hash_t const hash = XXH64_digest(state);
-    XXH64_freeState(state);
-    return hash;
+static bool hashUring(ObUring* ring, int fd, ObHashType type, ObHash* hash)
+{
+  ObHashState state;
+  bool result = initHashState(&state, type)
+      && obUringReadFd(ring, fd, updateHashState, &state);
+  if (result) {
+    digestHashState(&state, hash);
+  }
+  freeHashState(&state);
+  return result;
 }
 
 // --------- public API ---------- //
 
-uint64_t obCalcualateFileHash(const char* path)
+bool obHashFd(int fd, ObHashType type, ObHash* hash)
 {
-  uint64_t result = 0;
-  FILE* file = fopen(path, "rb");
-  if (file) {
-    result = calculateXxHash64Stream(file);
-    fclose(file);
-    if (result == 0) {
-      obLogE("Cannot calculate hash value for file: %s", path);
-    }
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    return false;
   }
-  else {
+
+  ObUring* ring = obGetThreadUring();
+  if (ring && hashUring(ring, fd, type, hash)) {
+    return true;
+  }
+
+  if (canHashMapped(fd, &st) && hashMapped(fd, st.st_size, type, hash)) {
+    return true;
+  }
+
+  return hashStream(fd, type, hash);
+}
+
+void obHashData(const void* data, size_t size, ObHashType type, ObHash* hash)
+{
+  hashBuffer(data, size, type, hash);
+}
+
+bool obHashFile(const char* path, ObHashType type, ObHash* hash)
+{
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
     obLogE("Hash calculation error. Cannot open file: %s", path);
+    return false;
+  }
+
+  bool result = obHashFd(fd, type, hash);
+  close(fd);
+  if (!result) {
+    obLogE("Cannot calculate hash value for file: %s", path);
   }
   return result;
 }
 
-bool obWriteAsHexStr(uint64_t value, const char* outputPath)
+bool obHashEqual(const ObHash* first, const ObHash* second)
+{
+  return first->type == second->type
+      && first->low == second->low
+      && first->high == second->high;
+}
+
+const char* obHashToStr(const ObHash* hash, char* buffer)
+{
+  if (hash->type == OB_HASH_XXH64) {
+    snprintf(buffer, OB_HASH_STR_MAX, "%016" PRIx64, hash->low);
+  }
+  else if (hash->type == OB_HASH_XXH3_64) {
+    snprintf(buffer, OB_HASH_STR_MAX, "%s:%016" PRIx64,
+             hashTypeNames[hash->type], hash->low);
+  }
+  else {
+    // canonical order, as printed by xxh128sum
+    snprintf(buffer, OB_HASH_STR_MAX, "%s:%016" PRIx64 "%016" PRIx64,
+             hashTypeNames[hash->type], hash->high, hash->low);
+  }
+  return buffer;
+}
+
+bool obHashFromStr(const char* str, ObHash* hash)
 {
+  memset(hash, 0, sizeof(ObHash));
+  hash->type = OB_HASH_XXH64;
+
+  const char* hex = str;
+  const char* separator = strchr(str, ':');
+  if (separator) {
+    size_t length = separator - str;
+    bool found = false;
+    for (size_t i = 0; i < sizeof(hashTypeNames) / sizeof(hashTypeNames[0]); ++i) {
+      if (strlen(hashTypeNames[i]) == length && strncmp(str, hashTypeNames[i], length) == 0) {
+        hash->type = (ObHashType)i;
+        found = true;
+        break;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+    hex = separator + 1;
+  }
+
+  size_t digits = strspn(hex, "0123456789abcdefABCDEF");
+  if (digits == 0 || digits > 32 || (hash->type != OB_HASH_XXH3_128 && digits > 16)) {
+    return false;
+  }
+
+  char part[17];
+  if (digits > 16) {
+    size_t highDigits = digits - 16;
+    memcpy(part, hex, highDigits);
+    part[highDigits] = '\0';
+    hash->high = strtoull(part, NULL, 16);
+    hex += highDigits;
+    digits = 16;
+  }
+  memcpy(part, hex, digits);
+  part[digits] = '\0';
+  hash->low = strtoull(part, NULL, 16);
+  return true;
+}
+
+bool obWriteHash(const ObHash* hash, const char* outputPath)
+{
+  char buffer[OB_HASH_STR_MAX];
   FILE* file = fopen(outputPath, "w");
   if (file) {
-    // store it as 16-char hex
-    fprintf(file, "%" PRIx64 "\n", value);
+    fprintf(file, "%s\n", obHashToStr(hash, buffer));
     fclose(file);
   }
   else {
@@ -74,20 +300,18 @@ bool obWriteAsHexStr(uint64_t value, const char* outputPath)
   return true;
 }
 
-uint64_t obReadHashValue(const char* txtFilePath)
+bool obReadHash(const char* txtFilePath, ObHash* hash)
 {
-  uint64_t result = 0;
-  const size_t BUFSIZE = 17;
-  char buffer[BUFSIZE];
-  char* end = NULL;
+  bool result = false;
+  char buffer[OB_HASH_STR_MAX];
   FILE* file = fopen(txtFilePath, "r");
   if (file) {
-
-    if (fgets(buffer, BUFSIZE, file)) {
+    if (fgets(buffer, sizeof(buffer), file)) {
+      buffer[strcspn(buffer, "\r\n")] = '\0';
       obLogI("Read hash value: %s", buffer);
-      result = strtoull(buffer, &end, 16);
+      result = obHashFromStr(buffer, hash);
     }
-    else {
+    if (!result) {
       obLogE("Cannot read hash value from: %s", txtFilePath);
     }
     fclose(file);
@@ -99,3 +323,26 @@ uint64_t obReadHashValue(const char* txtFilePath)
   return result;
 }
 
+uint64_t obCalcualateFileHash(const char* path)
+{
+  ObHash hash;
+  if (!obHashFile(path, OB_HASH_XXH64, &hash)) {
+    return 0;
+  }
+  return hash.low;
+}
+
+bool obWriteAsHexStr(uint64_t value, const char* outputPath)
+{
+  ObHash hash = {OB_HASH_XXH64, value, 0};
+  return obWriteHash(&hash, outputPath);
+}
+
+uint64_t obReadHashValue(const char* txtFilePath)
+{
+  ObHash hash;
+  if (!obReadHash(txtFilePath, &hash) || hash.type != OB_HASH_XXH64) {
+    return 0;
+  }
+  return hash.low;
+}
@@ -7,6 +7,9 @@
 #include "ob/ObLogging.h"
 #include "ObOsUtils.h"
 #include "ObYamlParser.h"
+#include "ObConfigCache.h"
+#include "ob/ObHash.h"
+#include "ob/ObTrace.h"
 
 #include <sds.h>
 #include <stdio.h>
@@ -17,6 +20,23 @@
 
 #define MAX_CONFIG_EXT_LEN 8
 
+static ObLayerVerifyLevel obParseLayerVerifyLevel(const char* value)
+{
+  if (strcmp(value, "metadata") == 0) {
+    return OB_LAYER_VERIFY_METADATA;
+  }
+  else if (strcmp(value, "sampled") == 0) {
+    return OB_LAYER_VERIFY_SAMPLED;
+  }
+  else if (strcmp(value, "full") == 0) {
+    return OB_LAYER_VERIFY_FULL;
+  }
+  else if (strcmp(value, "none") != 0) {
+    obLogW("Unknown layer verification level: %s, verification disabled", value);
+  }
+  return OB_LAYER_VERIFY_NONE;
+}
+
 static void onScalarValue(ObConfig* config, const char* itemPath, const char* value)
 {
   if (strcmp(itemPath, ".enabled") == 0) {
@@ -26,27 +46,52 @@ static void onScalarValue(ObConfig* config, const char* itemPath, const char* va
     config->bindLayers = strcmp(value, "true") == 0 ? true : false;
   }
   else if (strcmp(itemPath, ".layers.device") == 0) {
-    strcpy(config->devicePath, value);
+    config->devicePath = obInternConfigString(config, value);
+  }
+  else if (strcmp(itemPath, ".layers.device_timeout") == 0) {
+    config->deviceTimeout = atoi(value);
   }
   else if (strcmp(itemPath, ".layers.repository") == 0) {
-    strcpy(config->repository, value);
+    config->repository = obInternConfigString(config, value);
   }
   else if (strcmp(itemPath, ".layers.head") == 0) {
-    strcpy(config->headLayer, value);
+    config->headLayer = obInternConfigString(config, value);
+  }
+  else if (strcmp(itemPath, ".layers.verify") == 0) {
+    config->verifyLayers = obParseLayerVerifyLevel(value);
+  }
+  else if (strcmp(itemPath, ".layers.max_depth") == 0) {
+    config->maxLayerDepth = atoi(value);
+  }
+  else if (strcmp(itemPath, ".layers.flatten") == 0) {
+    config->flattenLayers = strcmp(value, "true") == 0;
   }
   else if (strcmp(itemPath, ".upper.type") == 0) {
-    config->useTmpfs = strcmp(value, "tmpfs") == 0;
+    config->writeBack = strcmp(value, "writeback") == 0;
+    config->useZram = strcmp(value, "zram") == 0;
+    config->useTmpfs = strcmp(value, "tmpfs") == 0 || config->writeBack || config->useZram;
     config->clearUpper = strcmp(value, "volatile") == 0;
   }
+  else if (strcmp(itemPath, ".upper.flush_interval") == 0) {
+    config->flushInterval = atoi(value);
+  }
+  else if (strcmp(itemPath, ".upper.flush_rate") == 0) {
+    if (!obParseSize(value, &config->flushRate)) {
+      obLogW("Invalid flush rate: %s", value);
+    }
+  }
+  else if (strcmp(itemPath, ".upper.compressor") == 0) {
+    config->zramCompressor = obInternConfigString(config, value);
+  }
   else if (strcmp(itemPath, ".upper.size") == 0) {
-    strcpy(config->tmpfsSize, value);
+    config->tmpfsSize = obInternConfigString(config, value);
   }
   else if (strcmp(itemPath, ".upper.include_persistent_upper") == 0) {
     config->upperAsLower = strcmp(value, "true") == 0;
   }
   else if (strcmp(itemPath, ".durables..path") == 0
            && config->durable != NULL) {
-    strcpy(config->durable->path, value);
+    config->durable->path = obInternConfigString(config, value);
   }
   else if (strcmp(itemPath, ".durables..copy_origin") == 0
            && config->durable != NULL) {
@@ -56,8 +101,17 @@ static void onScalarValue(ObConfig* config, const char* itemPath, const char* va
            && config->durable != NULL) {
     config->durable->forceFileType = strcmp(value, "file") == 0;
   }
+  else if (strcmp(itemPath, ".prefetch.enabled") == 0) {
+    config->prefetch = strcmp(value, "true") == 0;
+  }
+  else if (strcmp(itemPath, ".prefetch.record_time") == 0) {
+    config->prefetchRecordTime = atoi(value);
+  }
   else if (strcmp(itemPath, ".config_dir") == 0) {
-    strcpy(config->configDir, value);
+    config->configDir = obInternConfigString(config, value);
+  }
+  else if (strcmp(itemPath, ".log_level") == 0) {
+    config->logLevel = obParseLogLevel(value);
   }
   else if (strcmp(itemPath, ".safe_mode") == 0) {
     config->safeMode = strcmp(value, "true") == 0;
@@ -91,20 +145,24 @@ static int configFilter(const struct dirent* entry)
 
 static bool obLoadPartialYamlConfig(ObConfig* config, const char* path)
 {
-  sds configDir = sdsnew(config->configDir);
-  memset(config->configDir, 0, sizeof(config->configDir));
+  const char* configDir = config->configDir;
+  config->configDir = "";
   bool result = obLoadYamlConfig(config, path);
-  strcpy(config->configDir, configDir);
-  sdsfree(configDir);
+  config->configDir = configDir;
   return result;
 }
 
-static bool loadYamlConfigDir(ObConfig* config, const char* configFilePath)
+static sds obGetConfigDirPath(const char* configFilePath, const char* configDir)
 {
   sds buffer = sdsnew(configFilePath);
-  char* configDirname = dirname(buffer);
-  sds configDirPath = sdsempty();
-  configDirPath = sdscatfmt(configDirPath, "%s/%s", configDirname, config->configDir);
+  sds configDirPath = sdscatfmt(sdsempty(), "%s/%s", dirname(buffer), configDir);
+  sdsfree(buffer);
+  return configDirPath;
+}
+
+static bool loadYamlConfigDir(ObConfig* config, const char* configFilePath)
+{
+  sds configDirPath = obGetConfigDirPath(configFilePath, config->configDir);
   bool result = true;
 
   if (!obExists(configDirPath)) {
@@ -129,11 +187,77 @@ static bool loadYamlConfigDir(ObConfig* config, const char* configFilePath)
     }
   }
 
-  sdsfree(buffer);
   sdsfree(configDirPath);
   return result;
 }
 
+static sds obAppendHash(sds inputs, const ObHash* hash)
+{
+  inputs = sdscatlen(inputs, &hash->low, sizeof(hash->low));
+  return sdscatlen(inputs, &hash->high, sizeof(hash->high));
+}
+
+/**
+ * The digests of the main file and the config dir files (with their names,
+ * in the loading order) hashed together
+ */
+static bool obHashConfigInputs(const char* path, const char* configDir, ObHash* hash)
+{
+  ObHash fileHash;
+  if (!obHashFile(path, OB_HASH_XXH3_128, &fileHash)) {
+    return false;
+  }
+
+  sds inputs = obAppendHash(sdsempty(), &fileHash);
+  sds configDirPath = obGetConfigDirPath(path, configDir);
+  bool result = true;
+
+  if (strlen(configDir) > 0 && obExists(configDirPath)) {
+    struct dirent **namelist;
+    int n = scandir(configDirPath, &namelist, configFilter, alphasort);
+    result = n != -1;
+    for (int i = 0; i < n; ++i) {
+      sds fullPath = sdscatfmt(sdsempty(), "%s/%s", configDirPath, namelist[i]->d_name);
+      result = obHashFile(fullPath, OB_HASH_XXH3_128, &fileHash) && result;
+      inputs = sdscatlen(inputs, namelist[i]->d_name, strlen(namelist[i]->d_name) + 1);
+      inputs = obAppendHash(inputs, &fileHash);
+      sdsfree(fullPath);
+      free(namelist[i]);
+    }
+    if (n != -1) {
+      free(namelist);
+    }
+  }
+
+  obHashData(inputs, sdslen(inputs), OB_HASH_XXH3_128, hash);
+  sdsfree(configDirPath);
+  sdsfree(inputs);
+  return result;
+}
+
+static bool obLoadConfigSnapshot(ObConfig* config, const char* path, const char* cachePath,
+                                 ObHash* inputHash)
+{
+  ObConfig snapshot;
+  snapshot.arena = config->arena;
+  ObHash snapshotHash;
+  if (!obReadConfigCache(cachePath, &snapshot, &snapshotHash)) {
+    return false;
+  }
+
+  bool result = obHashConfigInputs(path, snapshot.configDir, inputHash)
+      && obHashEqual(inputHash, &snapshotHash);
+
+  if (result) {
+    snapshot.prefix = config->prefix;
+    *config = snapshot;
+    config->configPath = path;
+  }
+  else {
+    obLogI("Config cache %s is stale", cachePath);
+  }
+  return result;
+}
 
 // --------- public API ---------- //
 
@@ -153,3 +277,20 @@ bool obLoadYamlConfig(ObConfig* config, const char* path)
   config->configPath = path;
   return result;
 }
+
+bool obLoadCachedYamlConfig(ObConfig* config, const char* path, const char* cachePath)
+{
+  uint64_t startNs = obGetMonotonicNs();
+  ObHash inputHash;
+  if (obLoadConfigSnapshot(config, path, cachePath, &inputHash)) {
+    obLogI("Configuration loaded from cache: %s", cachePath);
+    obTraceSpan("config-cache", cachePath, startNs);
+    return true;
+  }
+
+  bool result = obLoadYamlConfig(config, path);
+  if (result && obHashConfigInputs(path, config->configDir, &inputHash)) {
+    obWriteConfigCache(cachePath, config, &inputHash);
+  }
+  return result;
+}
@@ -5,6 +5,7 @@
 #include "ObYamlLayerReader.h"
 #include "ObOsUtils.h"
 #include "ObYamlParser.h"
+#include "ObPaths.h"
 #include "ob/ObLogging.h"
 
 #include <stdio.h>
@@ -27,6 +28,9 @@ static void onScalarValue(ObLayerInfo* info, const char* itemPath, const char* v
   else if (strcmp(itemPath, ".underlayer") == 0) {
     strcpy(info->underlayer, value);
   }
+  else if (strcmp(itemPath, ".format") == 0) {
+    info->format = obParseLayerFormat(value);
+  }
 }
 
 
@@ -45,14 +49,7 @@ ObLayerInfo* obLoadLayerInfo(const char* repoPath, const char* layerName, ObLaye
     }
   }
 
-  strcat(path, OB_LAYER_ROOT_DIR);
-  strcat(path, OB_LAYER_INFO_PATH);
-  if (!obExists(path)) {
-    obLogE("Layer info file not found: %s", path);
-    return NULL;
-  }
-
-  return obLoadLayerInfoYaml(path, info);
+  return obLoadLayerDirInfo(path, info);
 }
 
 ObLayerInfo* obLoadLayerInfoYaml(const char* yamlPath, ObLayerInfo* info)
@@ -66,4 +63,20 @@ ObLayerInfo* obLoadLayerInfoYaml(const char* yamlPath, ObLayerInfo* info)
   return info;
 }
 
+ObLayerInfo* obLoadLayerDirInfo(const char* layerDir, ObLayerInfo* info)
+{
+  ObLayerFormat format;
+  sds path = obGetLayerInfoPath(layerDir, &format);
+  if (!obExists(path)) {
+    obLogE("Layer info file not found: %s", path);
+    sdsfree(path);
+    return NULL;
+  }
+
+  obLoadLayerInfoYaml(path, info);
+  snprintf(info->rootPath, sizeof(info->rootPath), "%s%s", layerDir, OB_LAYER_ROOT_DIR);
+  info->format = format;
 
+  sdsfree(path);
+  return info;
+}
@@ -11,4 +11,10 @@ ObLayerInfo* obLoadLayerInfo(const char* repoPath, const char* layerName, ObLaye
 
 ObLayerInfo* obLoadLayerInfoYaml(const char* yamlPath, ObLayerInfo* info);
 
+/**
+ * @brief Load the info of the layer stored in layerDir, including its
+ * detected format
+ */
+ObLayerInfo* obLoadLayerDirInfo(const char* layerDir, ObLayerInfo* info);
+
 #endif // OBYAMLLAYERREADER_H
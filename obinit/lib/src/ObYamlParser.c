@@ -3,15 +3,31 @@
 // See accompanying file LICENSE.txt for the full license.
 
 #include "ObYamlParser.h"
+#include "ob/ObDefs.h"
 #include "ob/ObLogging.h"
+#include "ob/ObTrace.h"
 
 #include <yaml.h>
+#include <string.h>
+
+#define YAML_ITEM_PATH_MAX OB_PATH_MAX
 
 
 static char* pushKey(char* path, const yaml_char_t* key)
 {
-  strcat(path, ".");
-  strcat(path, (const char*)key);
+  // an overlong key is pushed empty so that popKey stays balanced
+  size_t length = strlen(path);
+  size_t keyLength = strlen((const char*)key);
+  path[length] = '.';
+  if (length + keyLength + 2 <= YAML_ITEM_PATH_MAX) {
+    memcpy(path + length + 1, key, keyLength + 1);
+  }
+  else if (length + 2 <= YAML_ITEM_PATH_MAX) {
+    path[length + 1] = '\0';
+  }
+  else {
+    path[length] = '\0';
+  }
   return path;
 }
 
@@ -30,6 +46,7 @@ static char* popKey(char* path)
 
 bool obParseYamlFile(void* context, const char* path, ObYamlValueCallback valueCallback, ObYamlEntryCallback entryCallback)
 {
+  uint64_t traceStart = obGetMonotonicNs();
   FILE *configFile = fopen(path, "r");
   yaml_parser_t parser;
 
@@ -47,7 +64,7 @@ bool obParseYamlFile(void* context, const char* path, ObYamlValueCallback valueC
   yaml_parser_set_input_file(&parser, configFile);
 
   yaml_token_t token;
-  char itemPath[128] = "";
+  char itemPath[YAML_ITEM_PATH_MAX] = "";
   bool isKey = false;
   do {
     yaml_parser_scan(&parser, &token);
@@ -91,5 +108,6 @@ bool obParseYamlFile(void* context, const char* path, ObYamlValueCallback valueC
   yaml_parser_delete(&parser);
   fclose(configFile);
 
+  obTraceSpan("obParseYamlFile", path, traceStart);
   return true;
 }
@@ -0,0 +1,137 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#include "ObZram.h"
+#include "ObMount.h"
+#include "ObOsUtils.h"
+#include "ObUevent.h"
+#include "ob/ObLogging.h"
+#include "ob/ObTrace.h"
+#include "ob/ObDefs.h"
+#include <sds.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mount.h>
+
+#define ZRAM_ATTR_MAX 32
+
+static bool obWriteZramAttr(const char* path, const char* value)
+{
+  int fd = open(path, O_WRONLY | O_CLOEXEC);
+  bool result = fd >= 0 && write(fd, value, strlen(value)) == (ssize_t)strlen(value);
+  if (!result) {
+    obLogE("Cannot write %s to %s: %s", value, path, strerror(errno));
+  }
+  if (fd >= 0) {
+    close(fd);
+  }
+  return result;
+}
+
+static bool obSetZramDeviceAttr(int id, const char* name, const char* value)
+{
+  sds path = sdscatprintf(sdsempty(), "/sys/block/zram%i/%s", id, name);
+  bool result = obWriteZramAttr(path, value);
+  sdsfree(path);
+  return result;
+}
+
+static int obAddZramDevice()
+{
+  if (!obExists(OB_ZRAM_CONTROL_DIR)) {
+    // no devices up front, all of them are added on demand
+    char* const argv[] = {"modprobe", "zram", "num_devices=0", NULL};
+    obRunCommand(argv);
+  }
+
+  int id = -1;
+  FILE* file = fopen(OB_ZRAM_CONTROL_DIR "/hot_add", "r");
+  if (file == NULL || fscanf(file, "%i", &id) != 1) {
+    obLogE("Cannot add a zram device: %s", strerror(errno));
+    id = -1;
+  }
+  if (file != NULL) {
+    fclose(file);
+  }
+  return id;
+}
+
+static bool obRemoveZramDevice(int id)
+{
+  char value[ZRAM_ATTR_MAX];
+  sprintf(value, "%i", id);
+  bool result = obSetZramDeviceAttr(id, "reset", "1");
+  return obWriteZramAttr(OB_ZRAM_CONTROL_DIR "/hot_remove", value) && result;
+}
+
+static bool obFormatZram(const char* device)
+{
+  // the device is all zeros, there is nothing to discard or journal
+  char* const argv[] = {
+    OB_MKFS_EXT4_COMMAND, "-q", "-F", "-O", "^has_journal", "-m", "0",
+    "-E", "nodiscard", (char*)device, NULL
+  };
+  return obRunCommand(argv);
+}
+
+// --------- public API ---------- //
+
+bool obMountZram(const char* path, const char* sizeStr, const char* compressor,
+                 char* device)
+{
+  uint64_t traceStart = obGetMonotonicNs();
+  obLogI("Mounting %s as zram (%s) of size %s", path, compressor, sizeStr);
+
+  unsigned long long diskSize = 0;
+  if (!obParseSize(sizeStr, &diskSize) || diskSize == 0) {
+    obLogE("Invalid zram size: %s", sizeStr);
+    return false;
+  }
+
+  int id = obAddZramDevice();
+  if (id < 0) {
+    return false;
+  }
+
+  // the compressor has to be set before the size initializes the device
+  char value[ZRAM_ATTR_MAX];
+  sprintf(value, "%llu", diskSize);
+  sprintf(device, "/dev/zram%i", id);
+  bool result = obSetZramDeviceAttr(id, "comp_algorithm", compressor)
+      && obSetZramDeviceAttr(id, "disksize", value)
+      && obWaitForDevice(device, OB_ZRAM_DEVICE_TIMEOUT_MS)
+      && obFormatZram(device)
+      && obMkpath(path, OB_DEV_MOUNT_MODE);
+
+  if (result && mount(device, path, OB_ZRAM_FS, MS_NOATIME, OB_ZRAM_MOUNT_OPTIONS) != 0) {
+    obLogE("Cannot mount %s in %s: %s", device, path, strerror(errno));
+    result = false;
+  }
+
+  if (!result) {
+    obLogE("Cannot set up zram device %s", device);
+    obRemoveZramDevice(id);
+    device[0] = '\0';
+  }
+
+  obTraceSpan("obMountZram", device, traceStart);
+  return result;
+}
+
+bool obUnmountZram(const char* path, const char* device)
+{
+  int id = -1;
+  if (sscanf(device, "/dev/zram%i", &id) != 1) {
+    obLogE("Not a zram device: %s", device);
+    return false;
+  }
+
+  bool result = obUnmount(path);
+  return result && obRemoveZramDevice(id);
+}
@@ -0,0 +1,24 @@
+// Copyright (c) 2021  Lukasz Chodyla
+// Distributed under the MIT License.
+// See accompanying file LICENSE.txt for the full license.
+
+#ifndef OBZRAM_H
+#define OBZRAM_H
+
+#include <stdbool.h>
+
+/**
+ * @brief Set up a new zram device of the given size (tmpfs-like size string,
+ * % of RAM included) with the compressor, format it and mount it at path
+ * @param device buffer for the device path (OB_DEV_PATH_MAX)
+ */
+bool obMountZram(const char* path, const char* sizeStr, const char* compressor,
+                 char* device);
+
+/**
+ * @brief Unmount path and release the zram device, so that its memory
+ * is freed
+ */
+bool obUnmountZram(const char* path, const char* device);
+
+#endif // OBZRAM_H
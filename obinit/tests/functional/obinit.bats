@@ -489,6 +489,20 @@ vgRun()
   [ ! -d "$TEST_OB_OVERLAY_DIR" ]
 }
 
+@test "obinit should not start when the safe mode is on and the lock file contains current config's XXH3-128 hash" {
+  test_composeConfig enabled layers-loop upper-tmpfs safe-mode
+  local hash=$(xxh128sum "$TEST_COMPOSED_CONFIG" | awk '{print $1}')
+  echo "xxHash: $hash"
+
+  mount $TEST_LOOP_DEVICE_LINK "$TEST_MNT_DIR"
+  echo "xxh128:$hash" > "$TEST_MNT_DIR/$TEST_OB_REPOSITORY_NAME/$TEST_OB_LOCK_NAME"
+  umount -fl "$TEST_MNT_DIR"
+  vgRun $OBINIT_BIN -r "$TEST_RAMFS_DIR" -c "$TEST_COMPOSED_CONFIG"
+   
+  [ $vgExitCode -ne 0 ]
+  [ ! -d "$TEST_OB_OVERLAY_DIR" ]
+}
+
 @test "obinit should not not delete the lock file when it contains current config's xxHash" {
   test_composeConfig enabled layers-loop upper-tmpfs safe-mode
   local hash=$(xxh64sum "$TEST_COMPOSED_CONFIG" | awk '{print $1}')
@@ -0,0 +1,67 @@
+#include "unity.h"
+#include "ObArena.h"
+#include "ob/ObDefs.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+#define TEST_BLOCK_SIZE 256
+
+ObArena* arena = NULL;
+
+void setUp(void)
+{
+  arena = obCreateArena(TEST_BLOCK_SIZE);
+}
+
+void tearDown(void)
+{
+  obFreeArena(&arena);
+}
+
+void test_obArenaAlloc_shouldReturnZeroedAlignedMemory()
+{
+  for (size_t size = 1; size < 64; ++size) {
+    unsigned char* ptr = obArenaAlloc(arena, size);
+    TEST_ASSERT_NOT_NULL(ptr);
+    TEST_ASSERT_EQUAL(0, (uintptr_t)ptr % _Alignof(max_align_t));
+    for (size_t i = 0; i < size; ++i) {
+      TEST_ASSERT_EQUAL(0, ptr[i]);
+    }
+    memset(ptr, 0xff, size);
+  }
+
+  // larger than a block
+  unsigned char* big = obArenaAlloc(arena, TEST_BLOCK_SIZE * 4);
+  TEST_ASSERT_NOT_NULL(big);
+  memset(big, 0xff, TEST_BLOCK_SIZE * 4);
+  TEST_ASSERT_NOT_NULL(obArenaAlloc(arena, 8));
+  TEST_ASSERT_TRUE(obGetArenaUsage(arena) >= TEST_BLOCK_SIZE * 4);
+}
+
+void test_obArenaIntern_shouldReturnSamePointerForEqualStrings()
+{
+  char buffer[32];
+  const char* first[100];
+  for (int i = 0; i < 100; ++i) {
+    sprintf(buffer, "/durable/%i", i);
+    first[i] = obArenaIntern(arena, buffer);
+    TEST_ASSERT_EQUAL_STRING(buffer, first[i]);
+  }
+
+  size_t usage = obGetArenaUsage(arena);
+  for (int i = 0; i < 100; ++i) {
+    sprintf(buffer, "/durable/%i", i);
+    TEST_ASSERT_EQUAL_PTR(first[i], obArenaIntern(arena, buffer));
+  }
+  TEST_ASSERT_EQUAL(usage, obGetArenaUsage(arena));
+  TEST_ASSERT_TRUE(obArenaIntern(arena, "/a") != obArenaIntern(arena, "/b"));
+}
+
+void test_obArenaPrintf_shouldFormatStrings()
+{
+  char* path = obArenaPrintf(arena, "%s/%s", "/obmnt", "overboot");
+  TEST_ASSERT_EQUAL_STRING("/obmnt/overboot", path);
+  TEST_ASSERT_EQUAL_STRING("", obArenaStrdup(arena, ""));
+}
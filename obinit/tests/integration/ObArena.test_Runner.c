@@ -0,0 +1,83 @@
+/* AUTOGENERATED FILE. DO NOT EDIT. */
+
+/*=======Automagically Detected Files To Include=====*/
+#include "unity.h"
+#include "ObArena.h"
+#include "ob/ObDefs.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+/*=======External Functions This Runner Calls=====*/
+extern void setUp(void);
+extern void tearDown(void);
+extern void test_obArenaAlloc_shouldReturnZeroedAlignedMemory();
+extern void test_obArenaIntern_shouldReturnSamePointerForEqualStrings();
+extern void test_obArenaPrintf_shouldFormatStrings();
+
+
+/*=======Mock Management=====*/
+static void CMock_Init(void)
+{
+}
+static void CMock_Verify(void)
+{
+}
+static void CMock_Destroy(void)
+{
+}
+
+/*=======Test Reset Options=====*/
+void resetTest(void);
+void resetTest(void)
+{
+  tearDown();
+  CMock_Verify();
+  CMock_Destroy();
+  CMock_Init();
+  setUp();
+}
+void verifyTest(void);
+void verifyTest(void)
+{
+  CMock_Verify();
+}
+
+/*=======Test Runner Used To Run Each Test=====*/
+static void run_test(UnityTestFunction func, const char* name, UNITY_LINE_TYPE line_num)
+{
+    Unity.CurrentTestName = name;
+    Unity.CurrentTestLineNumber = line_num;
+#ifdef UNITY_USE_COMMAND_LINE_ARGS
+    if (!UnityTestMatches())
+        return;
+#endif
+    Unity.NumberOfTests++;
+    UNITY_CLR_DETAILS();
+    UNITY_EXEC_TIME_START();
+    CMock_Init();
+    if (TEST_PROTECT())
+    {
+        setUp();
+        func();
+    }
+    if (TEST_PROTECT())
+    {
+        tearDown();
+        CMock_Verify();
+    }
+    CMock_Destroy();
+    UNITY_EXEC_TIME_STOP();
+    UnityConcludeTest();
+}
+
+/*=======MAIN=====*/
+int main(void)
+{
+  UnityBegin("./ObArena.test.c");
+  run_test(test_obArenaAlloc_shouldReturnZeroedAlignedMemory, "test_obArenaAlloc_shouldReturnZeroedAlignedMemory", 23);
+  run_test(test_obArenaIntern_shouldReturnSamePointerForEqualStrings, "test_obArenaIntern_shouldReturnSamePointerForEqualStrings", 43);
+  run_test(test_obArenaPrintf_shouldFormatStrings, "test_obArenaPrintf_shouldFormatStrings", 62);
+
+  return UnityEnd();
+}
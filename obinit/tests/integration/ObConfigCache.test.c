@@ -0,0 +1,116 @@
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObConfigCache.h"
+#include "ob/ObContext.h"
+#include "ob/ObYamlConfigReader.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_CONFIG_DIR_NAME "/obconfigcache-test"
+
+char configDirPath[OB_PATH_MAX] = {0};
+char configPath[OB_CPATH_MAX] = {0};
+char partialPath[OB_CPATH_MAX] = {0};
+char cachePath[OB_CCPATH_MAX] = {0};
+ObContext* context = NULL;
+
+void setUp(void)
+{
+  obGetSelfPath(configDirPath, OB_PATH_MAX);
+  strcat(configDirPath, TEST_CONFIG_DIR_NAME);
+  sprintf(configPath, "%s/overboot.yaml", configDirPath);
+  sprintf(partialPath, "%s/overboot.d/10-head.yaml", configDirPath);
+  sprintf(cachePath, "%s%s", configPath, OB_CONFIG_CACHE_EXT);
+
+  obMkpath(configDirPath, OB_MKPATH_MODE);
+  obCreateFile(configPath, "enabled: true\n"
+                           "config_dir: \"overboot.d\"\n"
+                           "layers:\n"
+                           "  head: \"base\"\n"
+                           "durables:\n"
+                           "  - path: \"/first\"\n"
+                           "  - path: \"/second\"\n"
+                           "    copy_origin: true\n");
+  context = obCreateObContext("");
+}
+
+void tearDown(void)
+{
+  obFreeObContext(&context);
+  obRemoveDirR(configDirPath);
+}
+
+void helper_createPartial(const char* head)
+{
+  char content[OB_PATH_MAX];
+  sprintf(content, "layers:\n  head: \"%s\"\n", head);
+  char dir[OB_CPATH_MAX];
+  sprintf(dir, "%s/overboot.d", configDirPath);
+  obMkpath(dir, OB_MKPATH_MODE);
+  obCreateFile(partialPath, content);
+}
+
+void helper_reloadConfig()
+{
+  obFreeObContext(&context);
+  context = obCreateObContext("");
+  TEST_ASSERT_TRUE(obLoadCachedYamlConfig(&context->config, configPath, cachePath));
+}
+
+void test_obLoadCachedYamlConfig_shouldWriteSnapshotWithDurables()
+{
+  helper_createPartial("partial");
+  TEST_ASSERT_TRUE(obLoadCachedYamlConfig(&context->config, configPath, cachePath));
+
+  ObConfig snapshot;
+  snapshot.arena = context->arena;
+  ObHash hash;
+  TEST_ASSERT_TRUE(obReadConfigCache(cachePath, &snapshot, &hash));
+  TEST_ASSERT_TRUE(snapshot.enabled);
+  TEST_ASSERT_EQUAL_STRING("partial", snapshot.headLayer);
+  TEST_ASSERT_EQUAL(2, obCountDurables(&snapshot));
+
+  ObDurable* parsed = context->config.durable;
+  for (ObDurable* durable = snapshot.durable; durable != NULL; durable = durable->next) {
+    TEST_ASSERT_EQUAL_STRING(parsed->path, durable->path);
+    TEST_ASSERT_EQUAL(parsed->copyOrigin, durable->copyOrigin);
+    parsed = parsed->next;
+  }
+}
+
+void test_obLoadCachedYamlConfig_shouldUseSnapshotOfUnchangedConfig()
+{
+  TEST_ASSERT_TRUE(obLoadCachedYamlConfig(&context->config, configPath, cachePath));
+
+  // a snapshot that cannot come from the YAML proves libyaml was skipped
+  ObConfig snapshot;
+  snapshot.arena = context->arena;
+  ObHash hash;
+  TEST_ASSERT_TRUE(obReadConfigCache(cachePath, &snapshot, &hash));
+  snapshot.headLayer = "from-cache";
+  TEST_ASSERT_TRUE(obWriteConfigCache(cachePath, &snapshot, &hash));
+
+  helper_reloadConfig();
+  TEST_ASSERT_EQUAL_STRING("from-cache", context->config.headLayer);
+  TEST_ASSERT_EQUAL_STRING(configPath, context->config.configPath);
+  TEST_ASSERT_EQUAL(2, obCountDurables(&context->config));
+}
+
+void test_obLoadCachedYamlConfig_shouldReparseChangedConfigDir()
+{
+  helper_createPartial("partial");
+  TEST_ASSERT_TRUE(obLoadCachedYamlConfig(&context->config, configPath, cachePath));
+  TEST_ASSERT_EQUAL_STRING("partial", context->config.headLayer);
+
+  helper_createPartial("changed");
+  helper_reloadConfig();
+  TEST_ASSERT_EQUAL_STRING("changed", context->config.headLayer);
+
+  obRemovePath(partialPath);
+  helper_reloadConfig();
+  TEST_ASSERT_EQUAL_STRING("base", context->config.headLayer);
+}
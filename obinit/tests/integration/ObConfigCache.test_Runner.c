@@ -0,0 +1,87 @@
+/* AUTOGENERATED FILE. DO NOT EDIT. */
+
+/*=======Automagically Detected Files To Include=====*/
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObConfigCache.h"
+#include "ob/ObContext.h"
+#include "ob/ObYamlConfigReader.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/*=======External Functions This Runner Calls=====*/
+extern void setUp(void);
+extern void tearDown(void);
+extern void test_obLoadCachedYamlConfig_shouldWriteSnapshotWithDurables();
+extern void test_obLoadCachedYamlConfig_shouldUseSnapshotOfUnchangedConfig();
+extern void test_obLoadCachedYamlConfig_shouldReparseChangedConfigDir();
+
+
+/*=======Mock Management=====*/
+static void CMock_Init(void)
+{
+}
+static void CMock_Verify(void)
+{
+}
+static void CMock_Destroy(void)
+{
+}
+
+/*=======Test Reset Options=====*/
+void resetTest(void);
+void resetTest(void)
+{
+  tearDown();
+  CMock_Verify();
+  CMock_Destroy();
+  CMock_Init();
+  setUp();
+}
+void verifyTest(void);
+void verifyTest(void)
+{
+  CMock_Verify();
+}
+
+/*=======Test Runner Used To Run Each Test=====*/
+static void run_test(UnityTestFunction func, const char* name, UNITY_LINE_TYPE line_num)
+{
+    Unity.CurrentTestName = name;
+    Unity.CurrentTestLineNumber = line_num;
+#ifdef UNITY_USE_COMMAND_LINE_ARGS
+    if (!UnityTestMatches())
+        return;
+#endif
+    Unity.NumberOfTests++;
+    UNITY_CLR_DETAILS();
+    UNITY_EXEC_TIME_START();
+    CMock_Init();
+    if (TEST_PROTECT())
+    {
+        setUp();
+        func();
+    }
+    if (TEST_PROTECT())
+    {
+        tearDown();
+        CMock_Verify();
+    }
+    CMock_Destroy();
+    UNITY_EXEC_TIME_STOP();
+    UnityConcludeTest();
+}
+
+/*=======MAIN=====*/
+int main(void)
+{
+  UnityBegin("./ObConfigCache.test.c");
+  run_test(test_obLoadCachedYamlConfig_shouldWriteSnapshotWithDurables, "test_obLoadCachedYamlConfig_shouldWriteSnapshotWithDurables", 64);
+  run_test(test_obLoadCachedYamlConfig_shouldUseSnapshotOfUnchangedConfig, "test_obLoadCachedYamlConfig_shouldUseSnapshotOfUnchangedConfig", 85);
+  run_test(test_obLoadCachedYamlConfig_shouldReparseChangedConfigDir, "test_obLoadCachedYamlConfig_shouldReparseChangedConfigDir", 103);
+
+  return UnityEnd();
+}
@@ -0,0 +1,129 @@
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObDurables.h"
+#include "ob/ObContext.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_DIR_NAME "/obdurables-test"
+
+char testDir[OB_PATH_MAX] = {0};
+char rootPath[OB_CPATH_MAX] = {0};
+char durablesPath[OB_CPATH_MAX] = {0};
+ObContext* context = NULL;
+
+void setUp(void)
+{
+  obGetSelfPath(testDir, OB_PATH_MAX);
+  strcat(testDir, TEST_DIR_NAME);
+  sprintf(rootPath, "%s/root", testDir);
+  sprintf(durablesPath, "%s/durables", testDir);
+  obMkpath(rootPath, OB_MKPATH_MODE);
+  context = obCreateObContext("");
+}
+
+void tearDown(void)
+{
+  obFreeObContext(&context);
+  obRemoveDirR(testDir);
+}
+
+void helper_addDurable(const char* path, bool copyOrigin)
+{
+  obAddDurable(&context->config, path);
+  context->config.durable->copyOrigin = copyOrigin;
+}
+
+void test_obPlanDurables_shouldSortMergeAndNestDurables()
+{
+  helper_addDurable("/var/lib/app", false);
+  helper_addDurable("/var-data", false);
+  helper_addDurable("/var/", false);
+  helper_addDurable("/home", false);
+  helper_addDurable("/var/lib/app/", true);
+  helper_addDurable("/var/lib/app/cache", false);
+
+  ObDurablePlan* plan = obPlanDurables(context->arena, context->config.durable,
+                                       rootPath, durablesPath);
+
+  TEST_ASSERT_EQUAL(5, plan->count);
+  TEST_ASSERT_EQUAL(2, plan->maxDepth);
+
+  const char* paths[] = {"/home", "/var", "/var/lib/app", "/var/lib/app/cache", "/var-data"};
+  int parents[] = {-1, -1, 1, 2, -1};
+  for (int i = 0; i < plan->count; ++i) {
+    TEST_ASSERT_EQUAL_STRING(paths[i], plan->entries[i].path);
+    TEST_ASSERT_EQUAL(parents[i], plan->entries[i].parent);
+    TEST_ASSERT_FALSE(plan->entries[i].bound);
+  }
+
+  TEST_ASSERT_TRUE(plan->entries[2].copyOrigin);
+  TEST_ASSERT_EQUAL(2, plan->entries[3].depth);
+
+  char expected[OB_CCPATH_MAX];
+  sprintf(expected, "%s/var/lib/app", durablesPath);
+  TEST_ASSERT_EQUAL_STRING(expected, plan->entries[2].persistentPath);
+  sprintf(expected, "%s/var/lib/app", rootPath);
+  TEST_ASSERT_EQUAL_STRING(expected, plan->entries[2].bindPath);
+}
+
+void test_obMkpaths_shouldCreateAllSortedPaths()
+{
+  char buffers[4][OB_CCPATH_MAX];
+  sprintf(buffers[0], "%s/a/b", testDir);
+  sprintf(buffers[1], "%s/a/b/c/d", testDir);
+  sprintf(buffers[2], "%s/a/bc", testDir);
+  sprintf(buffers[3], "%s/e", testDir);
+  const char* paths[] = {buffers[0], buffers[1], buffers[2], buffers[3]};
+
+  TEST_ASSERT_TRUE(obMkpaths(paths, 4, OB_MKPATH_MODE));
+  for (int i = 0; i < 4; ++i) {
+    TEST_ASSERT_TRUE(obIsDirectory(paths[i]));
+  }
+
+  char filePath[OB_CCPATH_MAX + 8];
+  sprintf(filePath, "%s/file", testDir);
+  obCreateFile(filePath, "");
+  sprintf(buffers[0], "%s/file/dir", testDir);
+  sprintf(buffers[1], "%s/g", testDir);
+  TEST_ASSERT_FALSE(obMkpaths(paths, 2, OB_MKPATH_MODE));
+  TEST_ASSERT_TRUE(obIsDirectory(paths[1]));
+}
+
+void test_obExecDurablePlan_shouldCopyOriginsAndBindNestedDurables()
+{
+  char path[OB_CCPATH_MAX + 32];
+  char content[OB_PATH_MAX];
+  sprintf(path, "%s/etc/app/app.conf", rootPath);
+  obMkpath(path, OB_MKPATH_MODE);
+  obRemovePath(path);
+  obCreateFile(path, "origin");
+
+  helper_addDurable("/etc/app", true);
+  helper_addDurable("/data", false);
+  helper_addDurable("/data/nested", false);
+
+  ObDurablePlan* plan = obPlanDurables(context->arena, context->config.durable,
+                                       rootPath, durablesPath);
+  TEST_ASSERT_TRUE(obExecDurablePlan(context->arena, plan));
+  for (int i = 0; i < plan->count; ++i) {
+    TEST_ASSERT_TRUE(plan->entries[i].bound);
+  }
+
+  sprintf(path, "%s/etc/app/app.conf", durablesPath);
+  TEST_ASSERT_EQUAL_STRING("origin", obReadFile(path, content));
+
+  // the nested durable is stored in its own persistent directory
+  sprintf(path, "%s/data/nested/file", rootPath);
+  obCreateFile(path, "nested");
+  sprintf(path, "%s/data/nested/file", durablesPath);
+  TEST_ASSERT_EQUAL_STRING("nested", obReadFile(path, content));
+
+  TEST_ASSERT_TRUE(obUndoDurablePlan(plan));
+  sprintf(path, "%s/data/nested/file", rootPath);
+  TEST_ASSERT_FALSE(obExists(path));
+}
@@ -0,0 +1,261 @@
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObFlush.h"
+#include "ob/ObTrace.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+
+#define TEST_DIR_NAME "/obflush-test"
+#define TEST_OPAQUE_XATTR "trusted.overlay.opaque"
+
+char testDir[OB_PATH_MAX] = {0};
+char upperPath[OB_CPATH_MAX] = {0};
+char persistentPath[OB_CPATH_MAX] = {0};
+char stagingPath[OB_CPATH_MAX] = {0};
+char flushedPath[OB_CPATH_MAX] = {0};
+char trashPath[OB_CPATH_MAX] = {0};
+
+void setUp(void)
+{
+  obGetSelfPath(testDir, OB_PATH_MAX);
+  strcat(testDir, TEST_DIR_NAME);
+  sprintf(upperPath, "%s/tmpfs-upper", testDir);
+  sprintf(persistentPath, "%s/upper", testDir);
+  sprintf(stagingPath, "%s/flush", testDir);
+  sprintf(flushedPath, "%s/flushed", testDir);
+  sprintf(trashPath, "%s/trash", testDir);
+  obMkpath(upperPath, OB_MKPATH_MODE);
+  obMkpath(persistentPath, OB_MKPATH_MODE);
+}
+
+void tearDown(void)
+{
+  obRemoveDirR(testDir);
+}
+
+void helper_create(const char* base, const char* relPath, const char* content)
+{
+  char path[OB_CCPATH_MAX + 64];
+  sprintf(path, "%s/%s", base, relPath);
+  char* slash = strrchr(path, '/');
+  *slash = '\0';
+  obMkpath(path, OB_MKPATH_MODE);
+  *slash = '/';
+  if (content != NULL) {
+    obCreateFile(path, content);
+  }
+  else {
+    TEST_ASSERT_EQUAL(0, mknod(path, S_IFCHR, makedev(0, 0)));
+  }
+}
+
+void helper_setOpaque(const char* base, const char* relPath)
+{
+  char path[OB_CCPATH_MAX + 64];
+  sprintf(path, "%s/%s", base, relPath);
+  obMkpath(path, OB_MKPATH_MODE);
+  TEST_ASSERT_EQUAL(0, lsetxattr(path, TEST_OPAQUE_XATTR, "y", 1, 0));
+}
+
+const char* helper_read(const char* base, const char* relPath)
+{
+  static char content[OB_PATH_MAX];
+  char path[OB_CCPATH_MAX + 64];
+  sprintf(path, "%s/%s", base, relPath);
+  return obReadFile(path, content);
+}
+
+bool helper_exists(const char* base, const char* relPath)
+{
+  char path[OB_CCPATH_MAX + 64];
+  sprintf(path, "%s/%s", base, relPath);
+  return obExists(path);
+}
+
+ino_t helper_inode(const char* base, const char* relPath)
+{
+  char path[OB_CCPATH_MAX + 64];
+  sprintf(path, "%s/%s", base, relPath);
+  struct stat st;
+  TEST_ASSERT_EQUAL(0, lstat(path, &st));
+  return st.st_ino;
+}
+
+void test_obFlushUpper_shouldMergeFilesWhiteoutsAndOpaqueDirs()
+{
+  helper_create(persistentPath, "etc/removed.conf", "old");
+  helper_create(persistentPath, "var/cache/stale", "stale");
+  helper_create(persistentPath, "etc/app.conf", "old");
+
+  helper_create(upperPath, "etc/app.conf", "new");
+  helper_create(upperPath, "etc/removed.conf", NULL);
+  helper_create(upperPath, "var/cache/fresh", "fresh");
+  helper_setOpaque(upperPath, "var/cache");
+
+  TEST_ASSERT_TRUE(obFlushUpper(upperPath, persistentPath, stagingPath, 0));
+
+  TEST_ASSERT_EQUAL_STRING("new", helper_read(persistentPath, "etc/app.conf"));
+  TEST_ASSERT_EQUAL_STRING("fresh", helper_read(persistentPath, "var/cache/fresh"));
+  TEST_ASSERT_FALSE(helper_exists(persistentPath, "var/cache/stale"));
+
+  char path[OB_CCPATH_MAX + 64];
+  struct stat st;
+  sprintf(path, "%s/etc/removed.conf", persistentPath);
+  TEST_ASSERT_EQUAL(0, lstat(path, &st));
+  TEST_ASSERT_TRUE(S_ISCHR(st.st_mode) && st.st_rdev == makedev(0, 0));
+
+  char value = 0;
+  sprintf(path, "%s/var/cache", persistentPath);
+  TEST_ASSERT_EQUAL(1, lgetxattr(path, TEST_OPAQUE_XATTR, &value, 1));
+  TEST_ASSERT_TRUE(obIsDirectoryEmpty(stagingPath));
+}
+
+void test_obFlushUpper_shouldOnlyCopyChangedEntries()
+{
+  helper_create(upperPath, "etc/app.conf", "first");
+  helper_create(upperPath, "etc/other.conf", "other");
+  helper_create(upperPath, "var/cache/kept", "kept");
+  helper_create(upperPath, "var/cache/dropped", "dropped");
+  helper_setOpaque(upperPath, "var/cache");
+  TEST_ASSERT_TRUE(obFlushUpper(upperPath, persistentPath, stagingPath, 0));
+
+  ino_t otherInode = helper_inode(persistentPath, "etc/other.conf");
+  ino_t keptInode = helper_inode(persistentPath, "var/cache/kept");
+
+  // a leftover of an interrupted flush
+  helper_create(stagingPath, "0", "partial");
+
+  char path[OB_CCPATH_MAX + 64];
+  sprintf(path, "%s/var/cache/dropped", upperPath);
+  TEST_ASSERT_EQUAL(0, unlink(path));
+  helper_create(upperPath, "etc/app.conf", "second");
+  TEST_ASSERT_TRUE(obFlushUpper(upperPath, persistentPath, stagingPath, 0));
+
+  TEST_ASSERT_EQUAL_STRING("second", helper_read(persistentPath, "etc/app.conf"));
+  TEST_ASSERT_EQUAL(otherInode, helper_inode(persistentPath, "etc/other.conf"));
+  TEST_ASSERT_EQUAL(keptInode, helper_inode(persistentPath, "var/cache/kept"));
+  TEST_ASSERT_FALSE(helper_exists(persistentPath, "var/cache/dropped"));
+  TEST_ASSERT_TRUE(obIsDirectoryEmpty(stagingPath));
+}
+
+void test_obFlushUpper_shouldRemoveEntriesDeletedFromUpper()
+{
+  helper_create(upperPath, "etc/temp.conf", "temp");
+  helper_create(upperPath, "etc/app.conf", "app");
+  helper_create(upperPath, "etc/removed.conf", NULL);
+  helper_create(upperPath, "var/job/data/part", "part");
+  TEST_ASSERT_TRUE(obFlushUpper(upperPath, persistentPath, stagingPath, 0));
+  TEST_ASSERT_TRUE(helper_exists(persistentPath, "etc/temp.conf"));
+
+  // upper-only entries leave no whiteout when deleted
+  char path[OB_CCPATH_MAX + 64];
+  char renamed[OB_CCPATH_MAX + 64];
+  sprintf(path, "%s/etc/temp.conf", upperPath);
+  TEST_ASSERT_EQUAL(0, unlink(path));
+  sprintf(path, "%s/var/job", upperPath);
+  TEST_ASSERT_TRUE(obRemoveDirR(path));
+  sprintf(path, "%s/etc/app.conf", upperPath);
+  sprintf(renamed, "%s/etc/app.conf.bak", upperPath);
+  TEST_ASSERT_EQUAL(0, rename(path, renamed));
+  TEST_ASSERT_TRUE(obFlushUpper(upperPath, persistentPath, stagingPath, 0));
+
+  TEST_ASSERT_FALSE(helper_exists(persistentPath, "etc/temp.conf"));
+  TEST_ASSERT_FALSE(helper_exists(persistentPath, "var/job"));
+  TEST_ASSERT_FALSE(helper_exists(persistentPath, "etc/app.conf"));
+  TEST_ASSERT_EQUAL_STRING("app", helper_read(persistentPath, "etc/app.conf.bak"));
+
+  struct stat st;
+  sprintf(path, "%s/etc/removed.conf", persistentPath);
+  TEST_ASSERT_EQUAL(0, lstat(path, &st));
+  TEST_ASSERT_TRUE(S_ISCHR(st.st_mode) && st.st_rdev == makedev(0, 0));
+  TEST_ASSERT_TRUE(obIsDirectoryEmpty(stagingPath));
+}
+
+void test_obFlushUpper_shouldSwapInReplacedEntries()
+{
+  helper_create(persistentPath, "etc", "file");
+  helper_create(persistentPath, "lib/old.so", "old");
+  helper_create(persistentPath, "opt/app/old", "old");
+  ino_t appInode = helper_inode(persistentPath, "opt/app");
+
+  helper_create(upperPath, "etc/app.conf", "new");
+  helper_create(upperPath, "usr/lib/new.so", "new");
+  helper_create(upperPath, "opt/app/new", "new");
+  helper_setOpaque(upperPath, "opt/app");
+  char path[OB_CCPATH_MAX + 64];
+  sprintf(path, "%s/lib", upperPath);
+  TEST_ASSERT_EQUAL(0, symlink("usr/lib", path));
+
+  TEST_ASSERT_TRUE(obFlushUpper(upperPath, persistentPath, stagingPath, 0));
+
+  TEST_ASSERT_EQUAL_STRING("new", helper_read(persistentPath, "etc/app.conf"));
+  TEST_ASSERT_EQUAL_STRING("new", helper_read(persistentPath, "lib/new.so"));
+  TEST_ASSERT_FALSE(helper_exists(persistentPath, "usr/lib/old.so"));
+  struct stat st;
+  sprintf(path, "%s/lib", persistentPath);
+  TEST_ASSERT_EQUAL(0, lstat(path, &st));
+  TEST_ASSERT_TRUE(S_ISLNK(st.st_mode));
+
+  // built aside, opaque before it is moved in
+  TEST_ASSERT_NOT_EQUAL(appInode, helper_inode(persistentPath, "opt/app"));
+  TEST_ASSERT_FALSE(helper_exists(persistentPath, "opt/app/old"));
+  TEST_ASSERT_EQUAL_STRING("new", helper_read(persistentPath, "opt/app/new"));
+  char value = 0;
+  sprintf(path, "%s/opt/app", persistentPath);
+  TEST_ASSERT_EQUAL(1, lgetxattr(path, TEST_OPAQUE_XATTR, &value, 1));
+  TEST_ASSERT_TRUE(obIsDirectoryEmpty(stagingPath));
+}
+
+void test_obFlushUpper_shouldLimitCopyRate()
+{
+  char content[16 * 1024 + 1];
+  memset(content, 'x', sizeof(content) - 1);
+  content[sizeof(content) - 1] = '\0';
+  helper_create(upperPath, "a", content);
+  helper_create(upperPath, "b", content);
+
+  uint64_t startNs = obGetMonotonicNs();
+  TEST_ASSERT_TRUE(obFlushUpper(upperPath, persistentPath, stagingPath, 64 * 1024));
+  uint64_t elapsedMs = (obGetMonotonicNs() - startNs) / 1000000;
+
+  // 32 KiB at 64 KiB/s
+  TEST_ASSERT_TRUE(elapsedMs >= 450);
+  char path[OB_CCPATH_MAX + 64];
+  struct stat st;
+  sprintf(path, "%s/b", persistentPath);
+  TEST_ASSERT_EQUAL(0, stat(path, &st));
+  TEST_ASSERT_EQUAL(sizeof(content) - 1, st.st_size);
+}
+
+void test_obApplyFlushedUpper_shouldMergeIntoPersistentUpperOnce()
+{
+  TEST_ASSERT_TRUE(obApplyFlushedUpper(flushedPath, persistentPath, stagingPath, trashPath));
+
+  helper_create(persistentPath, "etc/app.conf", "old");
+  helper_create(persistentPath, "etc/removed.conf", "old");
+  helper_create(upperPath, "etc/app.conf", "new");
+  helper_create(upperPath, "etc/removed.conf", NULL);
+  TEST_ASSERT_TRUE(obFlushUpper(upperPath, flushedPath, stagingPath, 0));
+
+  // the mounted persistent upper is left alone until the next boot
+  TEST_ASSERT_EQUAL_STRING("old", helper_read(persistentPath, "etc/app.conf"));
+  TEST_ASSERT_EQUAL_STRING("new", helper_read(flushedPath, "etc/app.conf"));
+
+  TEST_ASSERT_TRUE(obApplyFlushedUpper(flushedPath, persistentPath, stagingPath, trashPath));
+  TEST_ASSERT_EQUAL_STRING("new", helper_read(persistentPath, "etc/app.conf"));
+  char path[OB_CCPATH_MAX + 64];
+  struct stat st;
+  sprintf(path, "%s/etc/removed.conf", persistentPath);
+  TEST_ASSERT_EQUAL(0, lstat(path, &st));
+  TEST_ASSERT_TRUE(S_ISCHR(st.st_mode));
+  TEST_ASSERT_FALSE(obExists(flushedPath));
+  TEST_ASSERT_FALSE(obIsDirectoryEmpty(trashPath));
+}
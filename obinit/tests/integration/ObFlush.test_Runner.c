@@ -0,0 +1,96 @@
+/* AUTOGENERATED FILE. DO NOT EDIT. */
+
+/*=======Automagically Detected Files To Include=====*/
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObFlush.h"
+#include "ob/ObTrace.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <sys/xattr.h>
+
+/*=======External Functions This Runner Calls=====*/
+extern void setUp(void);
+extern void tearDown(void);
+extern void test_obFlushUpper_shouldMergeFilesWhiteoutsAndOpaqueDirs();
+extern void test_obFlushUpper_shouldOnlyCopyChangedEntries();
+extern void test_obFlushUpper_shouldRemoveEntriesDeletedFromUpper();
+extern void test_obFlushUpper_shouldSwapInReplacedEntries();
+extern void test_obFlushUpper_shouldLimitCopyRate();
+extern void test_obApplyFlushedUpper_shouldMergeIntoPersistentUpperOnce();
+
+
+/*=======Mock Management=====*/
+static void CMock_Init(void)
+{
+}
+static void CMock_Verify(void)
+{
+}
+static void CMock_Destroy(void)
+{
+}
+
+/*=======Test Reset Options=====*/
+void resetTest(void);
+void resetTest(void)
+{
+  tearDown();
+  CMock_Verify();
+  CMock_Destroy();
+  CMock_Init();
+  setUp();
+}
+void verifyTest(void);
+void verifyTest(void)
+{
+  CMock_Verify();
+}
+
+/*=======Test Runner Used To Run Each Test=====*/
+static void run_test(UnityTestFunction func, const char* name, UNITY_LINE_TYPE line_num)
+{
+    Unity.CurrentTestName = name;
+    Unity.CurrentTestLineNumber = line_num;
+#ifdef UNITY_USE_COMMAND_LINE_ARGS
+    if (!UnityTestMatches())
+        return;
+#endif
+    Unity.NumberOfTests++;
+    UNITY_CLR_DETAILS();
+    UNITY_EXEC_TIME_START();
+    CMock_Init();
+    if (TEST_PROTECT())
+    {
+        setUp();
+        func();
+    }
+    if (TEST_PROTECT())
+    {
+        tearDown();
+        CMock_Verify();
+    }
+    CMock_Destroy();
+    UNITY_EXEC_TIME_STOP();
+    UnityConcludeTest();
+}
+
+/*=======MAIN=====*/
+int main(void)
+{
+  UnityBegin("./ObFlush.test.c");
+  run_test(test_obFlushUpper_shouldMergeFilesWhiteoutsAndOpaqueDirs, "test_obFlushUpper_shouldMergeFilesWhiteoutsAndOpaqueDirs", 92);
+  run_test(test_obFlushUpper_shouldOnlyCopyChangedEntries, "test_obFlushUpper_shouldOnlyCopyChangedEntries", 121);
+  run_test(test_obFlushUpper_shouldRemoveEntriesDeletedFromUpper, "test_obFlushUpper_shouldRemoveEntriesDeletedFromUpper", 149);
+  run_test(test_obFlushUpper_shouldSwapInReplacedEntries, "test_obFlushUpper_shouldSwapInReplacedEntries", 182);
+  run_test(test_obFlushUpper_shouldLimitCopyRate, "test_obFlushUpper_shouldLimitCopyRate", 217);
+  run_test(test_obApplyFlushedUpper_shouldMergeIntoPersistentUpperOnce, "test_obApplyFlushedUpper_shouldMergeIntoPersistentUpperOnce", 238);
+
+  return UnityEnd();
+}
@@ -0,0 +1,231 @@
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ob/ObHash.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+#include "ObUring.h"
+
+#define XXH_INLINE_ALL
+#include "xxhash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+#define TEST_EMPTY_NAME "empty"
+#define TEST_SMALL_NAME "small"
+#define TEST_LARGE_NAME "large"
+#define TEST_LOCK_NAME "lock"
+#define TEST_LARGE_SIZE (3 * 1024 * 1024 + 7)
+
+char testDir[OB_PATH_MAX] = {0};
+
+typedef struct ReadCount
+{
+  size_t size;
+  int chunks;
+  int failAt;
+} ReadCount;
+
+bool helper_countChunk(void* context, const void* data, size_t size)
+{
+  (void)data;
+  ReadCount* count = context;
+  count->size += size;
+  count->chunks += 1;
+  return count->chunks != count->failAt;
+}
+
+void helper_getTestPath(char* path, const char* name)
+{
+  sprintf(path, "%s/%s", testDir, name);
+}
+
+void helper_createFile(const char* name, const char* data, size_t size)
+{
+  char path[OB_CCPATH_MAX];
+  helper_getTestPath(path, name);
+  FILE* file = fopen(path, "wb");
+  TEST_ASSERT_NOT_NULL(file);
+  TEST_ASSERT_EQUAL(size, fwrite(data, 1, size, file));
+  fclose(file);
+}
+
+void setUp(void)
+{
+  obGetSelfPath(testDir, OB_PATH_MAX);
+  strcat(testDir, "/obhash-test");
+  obMkpath(testDir, OB_MKPATH_MODE);
+}
+
+void tearDown(void)
+{
+  obRemoveDirR(testDir);
+}
+
+void test_obHashFile_shouldMatchReferenceVectorsOfEmptyFile()
+{
+  char path[OB_CCPATH_MAX];
+  helper_createFile(TEST_EMPTY_NAME, "", 0);
+  helper_getTestPath(path, TEST_EMPTY_NAME);
+
+  ObHash hash;
+  TEST_ASSERT_TRUE(obHashFile(path, OB_HASH_XXH64, &hash));
+  TEST_ASSERT_EQUAL_HEX64(0xef46db3751d8e999ULL, hash.low);
+
+  TEST_ASSERT_TRUE(obHashFile(path, OB_HASH_XXH3_64, &hash));
+  TEST_ASSERT_EQUAL_HEX64(0x2d06800538d394c2ULL, hash.low);
+
+  TEST_ASSERT_TRUE(obHashFile(path, OB_HASH_XXH3_128, &hash));
+  TEST_ASSERT_EQUAL_HEX64(0x99aa06d3014798d8ULL, hash.high);
+  TEST_ASSERT_EQUAL_HEX64(0x6001c324468d497fULL, hash.low);
+}
+
+void test_obHashFile_shouldMatchInMemoryDigestForMappedAndStreamedFiles()
+{
+  char* data = malloc(TEST_LARGE_SIZE);
+  for (size_t i = 0; i < TEST_LARGE_SIZE; ++i) {
+    data[i] = (char)(i * 31 + i / 4096);
+  }
+  helper_createFile(TEST_LARGE_NAME, data, TEST_LARGE_SIZE);
+  helper_createFile(TEST_SMALL_NAME, data, 1000);
+
+  char path[OB_CCPATH_MAX];
+  ObHash hash;
+  helper_getTestPath(path, TEST_LARGE_NAME);
+  TEST_ASSERT_TRUE(obHashFile(path, OB_HASH_XXH3_128, &hash));
+  XXH128_hash_t expected = XXH3_128bits(data, TEST_LARGE_SIZE);
+  TEST_ASSERT_EQUAL_HEX64(expected.high64, hash.high);
+  TEST_ASSERT_EQUAL_HEX64(expected.low64, hash.low);
+
+  TEST_ASSERT_TRUE(obHashFile(path, OB_HASH_XXH64, &hash));
+  TEST_ASSERT_EQUAL_HEX64(XXH64(data, TEST_LARGE_SIZE, 0), hash.low);
+  TEST_ASSERT_EQUAL_HEX64(hash.low, obCalcualateFileHash(path));
+
+  helper_getTestPath(path, TEST_SMALL_NAME);
+  TEST_ASSERT_TRUE(obHashFile(path, OB_HASH_XXH3_64, &hash));
+  TEST_ASSERT_EQUAL_HEX64(XXH3_64bits(data, 1000), hash.low);
+
+  free(data);
+}
+
+void test_obHashFromStr_shouldParseTypedAndLegacyStrings()
+{
+  char buffer[OB_HASH_STR_MAX];
+  ObHash parsed;
+  ObHash hash128 = {OB_HASH_XXH3_128, 0x0123456789abcdefULL, 0x00000000000000ffULL};
+  ObHash hash64 = {OB_HASH_XXH3_64, 0x00ab, 0};
+
+  TEST_ASSERT_EQUAL_STRING("xxh128:00000000000000ff0123456789abcdef",
+                           obHashToStr(&hash128, buffer));
+  TEST_ASSERT_TRUE(obHashFromStr(buffer, &parsed));
+  TEST_ASSERT_TRUE(obHashEqual(&hash128, &parsed));
+
+  TEST_ASSERT_EQUAL_STRING("xxh3:00000000000000ab", obHashToStr(&hash64, buffer));
+  TEST_ASSERT_TRUE(obHashFromStr(buffer, &parsed));
+  TEST_ASSERT_TRUE(obHashEqual(&hash64, &parsed));
+
+  // lock files written before the type prefix
+  TEST_ASSERT_TRUE(obHashFromStr("8c1e5a0f3a2b\n", &parsed));
+  TEST_ASSERT_EQUAL(OB_HASH_XXH64, parsed.type);
+  TEST_ASSERT_EQUAL_HEX64(0x8c1e5a0f3a2bULL, parsed.low);
+
+  TEST_ASSERT_FALSE(obHashFromStr("md5:0123", &parsed));
+  TEST_ASSERT_FALSE(obHashFromStr("wrongxxhash", &parsed));
+}
+
+void test_obWriteHash_shouldRoundTripThroughFile()
+{
+  char path[OB_CCPATH_MAX];
+  helper_getTestPath(path, TEST_LOCK_NAME);
+
+  ObHash hash = {OB_HASH_XXH3_128, 0xfedcba9876543210ULL, 0x1122334455667788ULL};
+  ObHash parsed;
+  TEST_ASSERT_TRUE(obWriteHash(&hash, path));
+  TEST_ASSERT_TRUE(obReadHash(path, &parsed));
+  TEST_ASSERT_TRUE(obHashEqual(&hash, &parsed));
+
+  TEST_ASSERT_TRUE(obWriteAsHexStr(0x42, path));
+  TEST_ASSERT_EQUAL_HEX64(0x42, obReadHashValue(path));
+}
+
+void test_obUringReadFd_shouldDrainTheRingAfterReadAndCallbackErrors()
+{
+  ObUring* ring = obGetThreadUring();
+  if (ring == NULL) {
+    TEST_IGNORE_MESSAGE("io_uring is not available");
+  }
+
+  char path[OB_CCPATH_MAX];
+  char* data = calloc(1, TEST_LARGE_SIZE);
+  helper_createFile(TEST_LARGE_NAME, data, TEST_LARGE_SIZE);
+  free(data);
+  helper_getTestPath(path, TEST_LARGE_NAME);
+
+  // every queued read fails
+  ReadCount count = {0, 0, 0};
+  int fd = open(path, O_WRONLY);
+  TEST_ASSERT_TRUE(fd >= 0);
+  TEST_ASSERT_FALSE(obUringReadFd(ring, fd, helper_countChunk, &count));
+  close(fd);
+
+  fd = open(path, O_RDONLY);
+  TEST_ASSERT_TRUE(fd >= 0);
+  count.failAt = 2;
+  TEST_ASSERT_FALSE(obUringReadFd(ring, fd, helper_countChunk, &count));
+
+  // nothing left in flight from the failed reads
+  memset(&count, 0, sizeof(count));
+  TEST_ASSERT_TRUE(obUringReadFd(ring, fd, helper_countChunk, &count));
+  TEST_ASSERT_EQUAL(TEST_LARGE_SIZE, count.size);
+  close(fd);
+}
+
+void test_obUringCopyFd_shouldDrainTheRingAfterWriteErrors()
+{
+  ObUring* ring = obGetThreadUring();
+  if (ring == NULL) {
+    TEST_IGNORE_MESSAGE("io_uring is not available");
+  }
+
+  char srcPath[OB_CCPATH_MAX];
+  char dstPath[OB_CCPATH_MAX];
+  char* data = malloc(TEST_LARGE_SIZE);
+  for (size_t i = 0; i < TEST_LARGE_SIZE; ++i) {
+    data[i] = (char)(i * 7);
+  }
+  helper_createFile(TEST_LARGE_NAME, data, TEST_LARGE_SIZE);
+  helper_createFile(TEST_SMALL_NAME, "", 0);
+  helper_getTestPath(srcPath, TEST_LARGE_NAME);
+  helper_getTestPath(dstPath, TEST_SMALL_NAME);
+
+  int srcFd = open(srcPath, O_RDONLY);
+  TEST_ASSERT_TRUE(srcFd >= 0);
+
+  // every queued write fails
+  int dstFd = open(dstPath, O_RDONLY);
+  TEST_ASSERT_TRUE(dstFd >= 0);
+  off_t offset = 0;
+  TEST_ASSERT_FALSE(obUringCopyFd(ring, srcFd, dstFd, &offset, TEST_LARGE_SIZE));
+  TEST_ASSERT_EQUAL(0, offset);
+  close(dstFd);
+
+  // nothing left in flight from the failed writes
+  dstFd = open(dstPath, O_WRONLY);
+  TEST_ASSERT_TRUE(dstFd >= 0);
+  TEST_ASSERT_TRUE(obUringCopyFd(ring, srcFd, dstFd, &offset, TEST_LARGE_SIZE));
+  TEST_ASSERT_EQUAL(TEST_LARGE_SIZE, offset);
+  close(dstFd);
+  close(srcFd);
+
+  char* copied = malloc(TEST_LARGE_SIZE + 1);
+  FILE* file = fopen(dstPath, "rb");
+  TEST_ASSERT_NOT_NULL(file);
+  TEST_ASSERT_EQUAL(TEST_LARGE_SIZE, fread(copied, 1, TEST_LARGE_SIZE + 1, file));
+  fclose(file);
+  TEST_ASSERT_EQUAL_MEMORY(data, copied, TEST_LARGE_SIZE);
+  free(copied);
+  free(data);
+}
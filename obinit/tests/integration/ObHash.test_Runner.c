@@ -0,0 +1,95 @@
+/* AUTOGENERATED FILE. DO NOT EDIT. */
+
+/*=======Automagically Detected Files To Include=====*/
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ob/ObHash.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+#include "ObUring.h"
+#include "xxhash.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+
+/*=======External Functions This Runner Calls=====*/
+extern void setUp(void);
+extern void tearDown(void);
+extern void test_obHashFile_shouldMatchReferenceVectorsOfEmptyFile();
+extern void test_obHashFile_shouldMatchInMemoryDigestForMappedAndStreamedFiles();
+extern void test_obHashFromStr_shouldParseTypedAndLegacyStrings();
+extern void test_obWriteHash_shouldRoundTripThroughFile();
+extern void test_obUringReadFd_shouldDrainTheRingAfterReadAndCallbackErrors();
+extern void test_obUringCopyFd_shouldDrainTheRingAfterWriteErrors();
+
+
+/*=======Mock Management=====*/
+static void CMock_Init(void)
+{
+}
+static void CMock_Verify(void)
+{
+}
+static void CMock_Destroy(void)
+{
+}
+
+/*=======Test Reset Options=====*/
+void resetTest(void);
+void resetTest(void)
+{
+  tearDown();
+  CMock_Verify();
+  CMock_Destroy();
+  CMock_Init();
+  setUp();
+}
+void verifyTest(void);
+void verifyTest(void)
+{
+  CMock_Verify();
+}
+
+/*=======Test Runner Used To Run Each Test=====*/
+static void run_test(UnityTestFunction func, const char* name, UNITY_LINE_TYPE line_num)
+{
+    Unity.CurrentTestName = name;
+    Unity.CurrentTestLineNumber = line_num;
+#ifdef UNITY_USE_COMMAND_LINE_ARGS
+    if (!UnityTestMatches())
+        return;
+#endif
+    Unity.NumberOfTests++;
+    UNITY_CLR_DETAILS();
+    UNITY_EXEC_TIME_START();
+    CMock_Init();
+    if (TEST_PROTECT())
+    {
+        setUp();
+        func();
+    }
+    if (TEST_PROTECT())
+    {
+        tearDown();
+        CMock_Verify();
+    }
+    CMock_Destroy();
+    UNITY_EXEC_TIME_STOP();
+    UnityConcludeTest();
+}
+
+/*=======MAIN=====*/
+int main(void)
+{
+  UnityBegin("./ObHash.test.c");
+  run_test(test_obHashFile_shouldMatchReferenceVectorsOfEmptyFile, "test_obHashFile_shouldMatchReferenceVectorsOfEmptyFile", 68);
+  run_test(test_obHashFile_shouldMatchInMemoryDigestForMappedAndStreamedFiles, "test_obHashFile_shouldMatchInMemoryDigestForMappedAndStreamedFiles", 86);
+  run_test(test_obHashFromStr_shouldParseTypedAndLegacyStrings, "test_obHashFromStr_shouldParseTypedAndLegacyStrings", 114);
+  run_test(test_obWriteHash_shouldRoundTripThroughFile, "test_obWriteHash_shouldRoundTripThroughFile", 139);
+  run_test(test_obUringReadFd_shouldDrainTheRingAfterReadAndCallbackErrors, "test_obUringReadFd_shouldDrainTheRingAfterReadAndCallbackErrors", 154);
+  run_test(test_obUringCopyFd_shouldDrainTheRingAfterWriteErrors, "test_obUringCopyFd_shouldDrainTheRingAfterWriteErrors", 186);
+
+  return UnityEnd();
+}
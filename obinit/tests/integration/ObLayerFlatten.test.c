@@ -0,0 +1,229 @@
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObLayerFlatten.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/xattr.h>
+#include <sys/sysmacros.h>
+
+#define TEST_REPO_NAME "/oblayerflatten-test"
+#define TEST_CONTENT "flatten test content"
+#define TEST_LARGE_SIZE (8 * 1024 * 1024)
+
+char repoPath[OB_PATH_MAX] = {0};
+char layersPath[OB_CPATH_MAX] = {0};
+char lowerPath[OB_CPATH_MAX] = {0};
+ObArena* arena = NULL;
+
+void helper_getLayerPath(char* path, const char* layer, const char* relPath)
+{
+  sprintf(path, "%s/%s.%s%s%s", layersPath, layer, OB_LAYER_DIR_EXT,
+          OB_LAYER_ROOT_DIR, relPath);
+}
+
+void helper_getFlatPath(char* path, const char* layer, const char* relPath)
+{
+  sprintf(path, "%s/%s.%s%s%s", layersPath, layer, OB_LAYER_DIR_EXT,
+          OB_LAYER_FLAT_DIR, relPath);
+}
+
+void helper_createLayerFile(const char* layer, const char* relPath)
+{
+  char path[OB_CCPATH_MAX];
+  helper_getLayerPath(path, layer, relPath);
+  obCreateFile(path, TEST_CONTENT);
+}
+
+void helper_createLayerDir(const char* layer, const char* relPath)
+{
+  char path[OB_CCPATH_MAX];
+  helper_getLayerPath(path, layer, relPath);
+  obMkpath(path, OB_MKPATH_MODE);
+}
+
+ObLayerItem* helper_addLayer(const char* layer, ObLayerItem* prev)
+{
+  char path[OB_CCPATH_MAX];
+  helper_getLayerPath(path, layer, "");
+  return obAddLayerItem(arena, path, prev);
+}
+
+ObLayerItem* helper_collectChain(bool rootBelow)
+{
+  ObLayerItem* root = rootBelow ? obAddLayerItem(arena, lowerPath, NULL) : NULL;
+  return helper_addLayer("top", helper_addLayer("mid", helper_addLayer("base", root)));
+}
+
+bool helper_isFlatLink(const char* layer, const char* relPath)
+{
+  char layerFile[OB_CCPATH_MAX];
+  char flatFile[OB_CCPATH_MAX];
+  helper_getLayerPath(layerFile, layer, relPath);
+  helper_getFlatPath(flatFile, "top", relPath);
+
+  struct stat layerSt;
+  struct stat flatSt;
+  return stat(layerFile, &layerSt) == 0 && stat(flatFile, &flatSt) == 0
+      && layerSt.st_ino == flatSt.st_ino;
+}
+
+bool helper_flatExists(const char* relPath)
+{
+  char path[OB_CCPATH_MAX];
+  helper_getFlatPath(path, "top", relPath);
+  return obExists(path);
+}
+
+void setUp(void)
+{
+  obGetSelfPath(repoPath, OB_PATH_MAX);
+  strcat(repoPath, TEST_REPO_NAME);
+  sprintf(layersPath, "%s/%s", repoPath, OB_LAYERS_DIR_NAME);
+  sprintf(lowerPath, "%s/lower", repoPath);
+  obMkpath(lowerPath, OB_MKPATH_MODE);
+  arena = obCreateArena(OB_ARENA_BLOCK_SIZE);
+
+  // base: /a, /b, /dir/x; mid: removes /a, replaces /dir; top: adds /c, changes /b
+  helper_createLayerDir("base", "");
+  helper_createLayerFile("base", "/a");
+  helper_createLayerFile("base", "/b");
+  helper_createLayerDir("base", "/dir");
+  helper_createLayerFile("base", "/dir/x");
+
+  char path[OB_CCPATH_MAX];
+  helper_createLayerDir("mid", "");
+  helper_getLayerPath(path, "mid", "/a");
+  mknod(path, S_IFCHR, makedev(0, 0));
+  helper_createLayerDir("mid", "/dir");
+  helper_getLayerPath(path, "mid", "/dir");
+  lsetxattr(path, "trusted.overlay.opaque", "y", 1, 0);
+  helper_createLayerFile("mid", "/dir/y");
+
+  helper_createLayerDir("top", "");
+  helper_createLayerFile("top", "/b");
+  helper_createLayerFile("top", "/c");
+}
+
+void tearDown(void)
+{
+  obFreeArena(&arena);
+  obRemoveDirR(repoPath);
+}
+
+void test_obFlattenLayerChain_shouldLinkTopmostFilesAndDropWhiteouts()
+{
+  ObLayerItem* topLayer = helper_collectChain(false);
+  TEST_ASSERT_TRUE(obIsLayerFlattenNeeded(topLayer, lowerPath));
+  TEST_ASSERT_TRUE(obFlattenLayerChain(topLayer, lowerPath));
+
+  TEST_ASSERT_FALSE(helper_flatExists("/a"));
+  TEST_ASSERT_TRUE(helper_isFlatLink("top", "/b"));
+  TEST_ASSERT_TRUE(helper_isFlatLink("top", "/c"));
+  TEST_ASSERT_FALSE(helper_flatExists("/dir/x"));
+  TEST_ASSERT_TRUE(helper_isFlatLink("mid", "/dir/y"));
+
+  // nothing below the chain to hide
+  char path[OB_CCPATH_MAX];
+  char value = 0;
+  helper_getFlatPath(path, "top", "/dir");
+  TEST_ASSERT_TRUE(lgetxattr(path, "trusted.overlay.opaque", &value, 1) < 0);
+
+  TEST_ASSERT_FALSE(obIsLayerFlattenNeeded(topLayer, lowerPath));
+}
+
+void test_obUseFlatLayer_shouldKeepRootFilesystemBelowFlatLayer()
+{
+  ObLayerItem* topLayer = helper_collectChain(true);
+  TEST_ASSERT_TRUE(obFlattenLayerChain(topLayer, lowerPath));
+
+  char path[OB_CCPATH_MAX];
+  struct stat st;
+  helper_getFlatPath(path, "top", "/a");
+  TEST_ASSERT_TRUE(lstat(path, &st) == 0 && S_ISCHR(st.st_mode));
+
+  char value = 0;
+  helper_getFlatPath(path, "top", "/dir");
+  TEST_ASSERT_EQUAL(1, lgetxattr(path, "trusted.overlay.opaque", &value, 1));
+
+  int count = 4;
+  ObLayerItem* flatLayer = obUseFlatLayer(arena, topLayer, lowerPath, &count);
+  TEST_ASSERT_EQUAL(2, count);
+  helper_getFlatPath(path, "top", "");
+  TEST_ASSERT_EQUAL_STRING(path, flatLayer->layerPath);
+  TEST_ASSERT_EQUAL_STRING(lowerPath, flatLayer->prev->layerPath);
+  TEST_ASSERT_NULL(flatLayer->prev->prev);
+}
+
+void test_obUseFlatLayer_shouldMountStaleChainAsItIs()
+{
+  ObLayerItem* topLayer = helper_collectChain(false);
+  TEST_ASSERT_TRUE(obFlattenLayerChain(topLayer, lowerPath));
+
+  // the mid layer replaced with another directory
+  char path[OB_CCPATH_MAX];
+  char movedPath[OB_CCPATH_MAX];
+  helper_getLayerPath(path, "mid", "");
+  sprintf(movedPath, "%s/moved", repoPath);
+  TEST_ASSERT_TRUE(obRename(path, movedPath));
+  obMkpath(path, OB_MKPATH_MODE);
+  TEST_ASSERT_TRUE(obIsLayerFlattenNeeded(topLayer, lowerPath));
+
+  int count = 3;
+  TEST_ASSERT_EQUAL_PTR(topLayer, obUseFlatLayer(arena, topLayer, lowerPath, &count));
+  TEST_ASSERT_EQUAL(3, count);
+
+  // images are mounted for the boot only
+  TEST_ASSERT_TRUE(obFlattenLayerChain(topLayer, lowerPath));
+  topLayer->prev->format = OB_LAYER_FORMAT_EROFS;
+  TEST_ASSERT_FALSE(obIsLayerFlattenNeeded(topLayer, lowerPath));
+  TEST_ASSERT_EQUAL_PTR(topLayer, obUseFlatLayer(arena, topLayer, lowerPath, &count));
+}
+
+unsigned long long helper_getFreeBytes()
+{
+  struct statvfs st;
+  TEST_ASSERT_EQUAL(0, statvfs(layersPath, &st));
+  return (unsigned long long)st.f_bavail * st.f_frsize;
+}
+
+void test_obRemoveStaleFlatLayers_shouldFreeFilesOfRemovedLayers()
+{
+  char path[OB_CCPATH_MAX];
+  helper_getLayerPath(path, "mid", "/large");
+  FILE* file = fopen(path, "wb");
+  TEST_ASSERT_NOT_NULL(file);
+  char chunk[4096];
+  memset(chunk, 'x', sizeof(chunk));
+  for (size_t size = 0; size < TEST_LARGE_SIZE; size += sizeof(chunk)) {
+    TEST_ASSERT_EQUAL(1, fwrite(chunk, sizeof(chunk), 1, file));
+  }
+  TEST_ASSERT_EQUAL(0, fsync(fileno(file)));
+  fclose(file);
+
+  ObLayerItem* topLayer = helper_collectChain(false);
+  TEST_ASSERT_TRUE(obFlattenLayerChain(topLayer, lowerPath));
+  TEST_ASSERT_TRUE(helper_isFlatLink("mid", "/large"));
+  TEST_ASSERT_FALSE(obHasStaleFlatLayers(layersPath, "top"));
+
+  // the head moved, the old flat directory holds the only other link
+  TEST_ASSERT_TRUE(obHasStaleFlatLayers(layersPath, "mid"));
+  obRemoveStaleFlatLayers(layersPath, "mid");
+  TEST_ASSERT_FALSE(helper_flatExists(""));
+  TEST_ASSERT_FALSE(obHasStaleFlatLayers(layersPath, "mid"));
+
+  struct stat st;
+  TEST_ASSERT_EQUAL(0, stat(path, &st));
+  TEST_ASSERT_EQUAL(1, st.st_nlink);
+
+  unsigned long long freeBytes = helper_getFreeBytes();
+  TEST_ASSERT_EQUAL(0, unlink(path));
+  sync();
+  TEST_ASSERT_TRUE(helper_getFreeBytes() >= freeBytes + TEST_LARGE_SIZE / 2);
+}
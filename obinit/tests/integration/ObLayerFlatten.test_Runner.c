@@ -0,0 +1,92 @@
+/* AUTOGENERATED FILE. DO NOT EDIT. */
+
+/*=======Automagically Detected Files To Include=====*/
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObLayerFlatten.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <sys/xattr.h>
+#include <sys/sysmacros.h>
+
+/*=======External Functions This Runner Calls=====*/
+extern void setUp(void);
+extern void tearDown(void);
+extern void test_obFlattenLayerChain_shouldLinkTopmostFilesAndDropWhiteouts();
+extern void test_obUseFlatLayer_shouldKeepRootFilesystemBelowFlatLayer();
+extern void test_obUseFlatLayer_shouldMountStaleChainAsItIs();
+extern void test_obRemoveStaleFlatLayers_shouldFreeFilesOfRemovedLayers();
+
+
+/*=======Mock Management=====*/
+static void CMock_Init(void)
+{
+}
+static void CMock_Verify(void)
+{
+}
+static void CMock_Destroy(void)
+{
+}
+
+/*=======Test Reset Options=====*/
+void resetTest(void);
+void resetTest(void)
+{
+  tearDown();
+  CMock_Verify();
+  CMock_Destroy();
+  CMock_Init();
+  setUp();
+}
+void verifyTest(void);
+void verifyTest(void)
+{
+  CMock_Verify();
+}
+
+/*=======Test Runner Used To Run Each Test=====*/
+static void run_test(UnityTestFunction func, const char* name, UNITY_LINE_TYPE line_num)
+{
+    Unity.CurrentTestName = name;
+    Unity.CurrentTestLineNumber = line_num;
+#ifdef UNITY_USE_COMMAND_LINE_ARGS
+    if (!UnityTestMatches())
+        return;
+#endif
+    Unity.NumberOfTests++;
+    UNITY_CLR_DETAILS();
+    UNITY_EXEC_TIME_START();
+    CMock_Init();
+    if (TEST_PROTECT())
+    {
+        setUp();
+        func();
+    }
+    if (TEST_PROTECT())
+    {
+        tearDown();
+        CMock_Verify();
+    }
+    CMock_Destroy();
+    UNITY_EXEC_TIME_STOP();
+    UnityConcludeTest();
+}
+
+/*=======MAIN=====*/
+int main(void)
+{
+  UnityBegin("./ObLayerFlatten.test.c");
+  run_test(test_obFlattenLayerChain_shouldLinkTopmostFilesAndDropWhiteouts, "test_obFlattenLayerChain_shouldLinkTopmostFilesAndDropWhiteouts", 120);
+  run_test(test_obUseFlatLayer_shouldKeepRootFilesystemBelowFlatLayer, "test_obUseFlatLayer_shouldKeepRootFilesystemBelowFlatLayer", 141);
+  run_test(test_obUseFlatLayer_shouldMountStaleChainAsItIs, "test_obUseFlatLayer_shouldMountStaleChainAsItIs", 164);
+  run_test(test_obRemoveStaleFlatLayers_shouldFreeFilesOfRemovedLayers, "test_obRemoveStaleFlatLayers_shouldFreeFilesOfRemovedLayers", 196);
+
+  return UnityEnd();
+}
@@ -0,0 +1,160 @@
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObLayerIndex.h"
+#include "ObLayerCollector.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_REPO_NAME "/oblayerindex-test"
+#define TEST_LOWER_PATH "/lower-root"
+
+char repoPath[OB_PATH_MAX] = {0};
+char layersPath[OB_CPATH_MAX] = {0};
+char indexPath[OB_CPATH_MAX] = {0};
+ObArena* arena = NULL;
+
+void helper_createLayer(const char* name, const char* underlayer)
+{
+  char path[OB_CCPATH_MAX];
+  sprintf(path, "%s/%s.%s%s/etc", layersPath, name, OB_LAYER_DIR_EXT, OB_LAYER_ROOT_DIR);
+  obMkpath(path, OB_MKPATH_MODE);
+
+  char content[OB_PATH_MAX];
+  sprintf(content, "name: \"%s\"\nunderlayer: \"%s\"\n", name, underlayer);
+  strcat(path, "/layer.yaml");
+  obCreateFile(path, content);
+}
+
+int helper_countLayers(ObLayerItem* item)
+{
+  int count = 0;
+  for (; item; item = item->prev) {
+    count += 1;
+  }
+  return count;
+}
+
+void setUp(void)
+{
+  arena = obCreateArena(OB_ARENA_BLOCK_SIZE);
+  obGetSelfPath(repoPath, OB_PATH_MAX);
+  strcat(repoPath, TEST_REPO_NAME);
+  sprintf(layersPath, "%s/%s", repoPath, OB_LAYERS_DIR_NAME);
+  sprintf(indexPath, "%s/%s", repoPath, OB_LAYER_INDEX_NAME);
+
+  helper_createLayer("base", "root");
+  helper_createLayer("mid", "base");
+  helper_createLayer("top", "mid");
+}
+
+void tearDown(void)
+{
+  obFreeArena(&arena);
+  obRemoveDirR(repoPath);
+}
+
+void test_obLoadLayerIndex_shouldResolveChainAndPersistIndex()
+{
+  ObLayerIndex* index = obLoadLayerIndex(layersPath, indexPath);
+  int count = 0;
+  ObLayerItem* top = obCollectLayers(arena, index, "top", TEST_LOWER_PATH, &count);
+  TEST_ASSERT_TRUE(obSaveLayerIndex(index));
+  obFreeLayerIndex(&index);
+
+  TEST_ASSERT_NOT_NULL(top);
+  TEST_ASSERT_EQUAL(4, count);
+  TEST_ASSERT_EQUAL(4, helper_countLayers(top));
+  TEST_ASSERT_EQUAL_STRING(TEST_LOWER_PATH, top->prev->prev->prev->layerPath);
+  TEST_ASSERT_TRUE(strstr(top->layerPath, "/top.obld/root") != NULL);
+  TEST_ASSERT_TRUE(obExists(indexPath));
+
+  // resolved from the index file this time
+  index = obLoadLayerIndex(layersPath, indexPath);
+  ObLayerInfo info;
+  TEST_ASSERT_NOT_NULL(obFindIndexedLayer(index, "mid", &info));
+  TEST_ASSERT_EQUAL_STRING("base", info.underlayer);
+  TEST_ASSERT_NOT_NULL(obFindIndexedLayer(index, "mid.obld", &info));
+  TEST_ASSERT_NULL(obFindIndexedLayer(index, "missing", &info));
+  obFreeLayerIndex(&index);
+}
+
+void test_obLoadLayerIndex_shouldReloadChangedLayersAndRebuildStaleIndex()
+{
+  ObLayerIndex* index = obLoadLayerIndex(layersPath, indexPath);
+  obSaveLayerIndex(index);
+  obFreeLayerIndex(&index);
+
+  // layer.yaml rewritten in place, the layers directory is not touched
+  helper_createLayer("mid", "root");
+
+  index = obLoadLayerIndex(layersPath, indexPath);
+  int count = 0;
+  ObLayerItem* top = obCollectLayers(arena, index, "top", TEST_LOWER_PATH, &count);
+  obSaveLayerIndex(index);
+  obFreeLayerIndex(&index);
+  TEST_ASSERT_NOT_NULL(top);
+  TEST_ASSERT_EQUAL(3, count);
+
+  // new layer directory
+  helper_createLayer("next", "top");
+
+  index = obLoadLayerIndex(layersPath, indexPath);
+  count = 0;
+  top = obCollectLayers(arena, index, "next", TEST_LOWER_PATH, &count);
+  obFreeLayerIndex(&index);
+  TEST_ASSERT_NOT_NULL(top);
+  TEST_ASSERT_EQUAL(4, count);
+}
+
+void test_obLoadLayerIndex_shouldIgnoreCorruptedIndex()
+{
+  obMkpath(repoPath, OB_MKPATH_MODE);
+  obCreateFile(indexPath, "OBLI garbage");
+
+  ObLayerIndex* index = obLoadLayerIndex(layersPath, indexPath);
+  ObLayerInfo info;
+  TEST_ASSERT_NOT_NULL(obFindIndexedLayer(index, "top", &info));
+  TEST_ASSERT_EQUAL_STRING("mid", info.underlayer);
+  obFreeLayerIndex(&index);
+
+  TEST_ASSERT_TRUE(obInvalidateLayerIndex(indexPath));
+  TEST_ASSERT_FALSE(obExists(indexPath));
+}
+
+void test_obLoadLayerIndex_shouldDetectImageLayers()
+{
+  ObLayerIndex* index = obLoadLayerIndex(layersPath, indexPath);
+  obSaveLayerIndex(index);
+  obFreeLayerIndex(&index);
+
+  // packed layer: the info lies next to the image, root is the mount point
+  char layerDir[OB_CCPATH_MAX];
+  char path[OB_CCPATH_MAX + OB_PATH_MAX];
+  sprintf(layerDir, "%s/mid.%s", layersPath, OB_LAYER_DIR_EXT);
+  sprintf(path, "%s%s", layerDir, OB_LAYER_ROOT_DIR);
+  obRemoveDirR(path);
+  sprintf(path, "%s%s", layerDir, OB_LAYER_EROFS_IMAGE);
+  obCreateFile(path, "image");
+  sprintf(path, "%s%s", layerDir, OB_LAYER_IMAGE_INFO_PATH);
+  obCreateFile(path, "name: \"mid\"\nunderlayer: \"base\"\n");
+
+  TEST_ASSERT_EQUAL(OB_LAYER_FORMAT_EROFS, obDetectLayerFormat(layerDir));
+
+  index = obLoadLayerIndex(layersPath, indexPath);
+  ObLayerInfo info;
+  TEST_ASSERT_NOT_NULL(obFindIndexedLayer(index, "mid", &info));
+  TEST_ASSERT_EQUAL(OB_LAYER_FORMAT_EROFS, info.format);
+  TEST_ASSERT_EQUAL_STRING("base", info.underlayer);
+
+  int count = 0;
+  ObLayerItem* top = obCollectLayers(arena, index, "top", TEST_LOWER_PATH, &count);
+  obFreeLayerIndex(&index);
+  TEST_ASSERT_EQUAL(4, count);
+  TEST_ASSERT_EQUAL(OB_LAYER_FORMAT_EROFS, top->prev->format);
+  TEST_ASSERT_EQUAL(OB_LAYER_FORMAT_DIR, top->format);
+}
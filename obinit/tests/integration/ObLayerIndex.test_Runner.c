@@ -0,0 +1,89 @@
+/* AUTOGENERATED FILE. DO NOT EDIT. */
+
+/*=======Automagically Detected Files To Include=====*/
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObLayerIndex.h"
+#include "ObLayerCollector.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/*=======External Functions This Runner Calls=====*/
+extern void setUp(void);
+extern void tearDown(void);
+extern void test_obLoadLayerIndex_shouldResolveChainAndPersistIndex();
+extern void test_obLoadLayerIndex_shouldReloadChangedLayersAndRebuildStaleIndex();
+extern void test_obLoadLayerIndex_shouldIgnoreCorruptedIndex();
+extern void test_obLoadLayerIndex_shouldDetectImageLayers();
+
+
+/*=======Mock Management=====*/
+static void CMock_Init(void)
+{
+}
+static void CMock_Verify(void)
+{
+}
+static void CMock_Destroy(void)
+{
+}
+
+/*=======Test Reset Options=====*/
+void resetTest(void);
+void resetTest(void)
+{
+  tearDown();
+  CMock_Verify();
+  CMock_Destroy();
+  CMock_Init();
+  setUp();
+}
+void verifyTest(void);
+void verifyTest(void)
+{
+  CMock_Verify();
+}
+
+/*=======Test Runner Used To Run Each Test=====*/
+static void run_test(UnityTestFunction func, const char* name, UNITY_LINE_TYPE line_num)
+{
+    Unity.CurrentTestName = name;
+    Unity.CurrentTestLineNumber = line_num;
+#ifdef UNITY_USE_COMMAND_LINE_ARGS
+    if (!UnityTestMatches())
+        return;
+#endif
+    Unity.NumberOfTests++;
+    UNITY_CLR_DETAILS();
+    UNITY_EXEC_TIME_START();
+    CMock_Init();
+    if (TEST_PROTECT())
+    {
+        setUp();
+        func();
+    }
+    if (TEST_PROTECT())
+    {
+        tearDown();
+        CMock_Verify();
+    }
+    CMock_Destroy();
+    UNITY_EXEC_TIME_STOP();
+    UnityConcludeTest();
+}
+
+/*=======MAIN=====*/
+int main(void)
+{
+  UnityBegin("./ObLayerIndex.test.c");
+  run_test(test_obLoadLayerIndex_shouldResolveChainAndPersistIndex, "test_obLoadLayerIndex_shouldResolveChainAndPersistIndex", 58);
+  run_test(test_obLoadLayerIndex_shouldReloadChangedLayersAndRebuildStaleIndex, "test_obLoadLayerIndex_shouldReloadChangedLayersAndRebuildStaleIndex", 84);
+  run_test(test_obLoadLayerIndex_shouldIgnoreCorruptedIndex, "test_obLoadLayerIndex_shouldIgnoreCorruptedIndex", 112);
+  run_test(test_obLoadLayerIndex_shouldDetectImageLayers, "test_obLoadLayerIndex_shouldDetectImageLayers", 127);
+
+  return UnityEnd();
+}
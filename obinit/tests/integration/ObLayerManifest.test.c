@@ -0,0 +1,101 @@
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ob/ObLayerManifest.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#define TEST_LAYER_NAME "/obmanifest-test.obld"
+#define TEST_FILE_1 "/etc/layer.yaml"
+#define TEST_FILE_2 "/usr/bin/tool"
+#define TEST_LINK_1 "/usr/bin/tool-link"
+#define TEST_CONTENT "manifest test content"
+
+char layerPath[OB_PATH_MAX] = {0};
+char rootPath[OB_CPATH_MAX] = {0};
+char manifestPath[OB_CPATH_MAX] = {0};
+
+void helper_getRootPath(char* path, const char* relPath)
+{
+  sprintf(path, "%s%s", rootPath, relPath);
+}
+
+void helper_tamperFile(const char* relPath, const char* content)
+{
+  char path[OB_CCPATH_MAX];
+  helper_getRootPath(path, relPath);
+
+  struct stat st;
+  stat(path, &st);
+  obCreateFile(path, content);
+
+  struct timespec times[2] = {st.st_atim, st.st_mtim};
+  utimensat(AT_FDCWD, path, times, 0);
+}
+
+void setUp(void)
+{
+  obGetSelfPath(layerPath, OB_PATH_MAX);
+  strcat(layerPath, TEST_LAYER_NAME);
+  sprintf(rootPath, "%s%s", layerPath, OB_LAYER_ROOT_DIR);
+  sprintf(manifestPath, "%s%s", layerPath, OB_LAYER_MANIFEST_PATH);
+
+  char path[OB_CCPATH_MAX];
+  helper_getRootPath(path, "/etc");
+  obMkpath(path, OB_MKPATH_MODE);
+  helper_getRootPath(path, "/usr/bin");
+  obMkpath(path, OB_MKPATH_MODE);
+
+  helper_getRootPath(path, TEST_FILE_1);
+  obCreateFile(path, TEST_CONTENT);
+  helper_getRootPath(path, TEST_FILE_2);
+  obCreateFile(path, TEST_CONTENT TEST_CONTENT);
+
+  char linkPath[OB_CCPATH_MAX];
+  helper_getRootPath(linkPath, TEST_LINK_1);
+  symlink("tool", linkPath);
+
+  TEST_ASSERT_TRUE(obWriteLayerManifest(rootPath, manifestPath));
+}
+
+void tearDown(void)
+{
+  obRemoveDirR(layerPath);
+}
+
+void test_obVerifyLayerManifest_shouldAcceptUnchangedLayerAtAllLevels()
+{
+  TEST_ASSERT_TRUE(obExists(manifestPath));
+  TEST_ASSERT_TRUE(obVerifyLayerManifest(rootPath, manifestPath, OB_LAYER_VERIFY_METADATA));
+  TEST_ASSERT_TRUE(obVerifyLayerManifest(rootPath, manifestPath, OB_LAYER_VERIFY_SAMPLED));
+  TEST_ASSERT_TRUE(obVerifyLayerManifest(rootPath, manifestPath, OB_LAYER_VERIFY_FULL));
+}
+
+void test_obVerifyLayerManifest_shouldDetectContentChangeOnlyWithFullLevel()
+{
+  // same size and mtime, as left by a flipped bit
+  helper_tamperFile(TEST_FILE_1, "manifest TEST content");
+
+  TEST_ASSERT_TRUE(obVerifyLayerManifest(rootPath, manifestPath, OB_LAYER_VERIFY_METADATA));
+  TEST_ASSERT_FALSE(obVerifyLayerManifest(rootPath, manifestPath, OB_LAYER_VERIFY_FULL));
+}
+
+void test_obVerifyLayerManifest_shouldDetectMetadataChanges()
+{
+  helper_tamperFile(TEST_FILE_2, TEST_CONTENT);
+  TEST_ASSERT_FALSE(obVerifyLayerManifest(rootPath, manifestPath, OB_LAYER_VERIFY_METADATA));
+
+  TEST_ASSERT_TRUE(obWriteLayerManifest(rootPath, manifestPath));
+  TEST_ASSERT_TRUE(obVerifyLayerManifest(rootPath, manifestPath, OB_LAYER_VERIFY_METADATA));
+
+  char path[OB_CCPATH_MAX];
+  helper_getRootPath(path, TEST_LINK_1);
+  unlink(path);
+  TEST_ASSERT_FALSE(obVerifyLayerManifest(rootPath, manifestPath, OB_LAYER_VERIFY_METADATA));
+}
@@ -0,0 +1,88 @@
+/* AUTOGENERATED FILE. DO NOT EDIT. */
+
+/*=======Automagically Detected Files To Include=====*/
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ob/ObLayerManifest.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+
+/*=======External Functions This Runner Calls=====*/
+extern void setUp(void);
+extern void tearDown(void);
+extern void test_obVerifyLayerManifest_shouldAcceptUnchangedLayerAtAllLevels();
+extern void test_obVerifyLayerManifest_shouldDetectContentChangeOnlyWithFullLevel();
+extern void test_obVerifyLayerManifest_shouldDetectMetadataChanges();
+
+
+/*=======Mock Management=====*/
+static void CMock_Init(void)
+{
+}
+static void CMock_Verify(void)
+{
+}
+static void CMock_Destroy(void)
+{
+}
+
+/*=======Test Reset Options=====*/
+void resetTest(void);
+void resetTest(void)
+{
+  tearDown();
+  CMock_Verify();
+  CMock_Destroy();
+  CMock_Init();
+  setUp();
+}
+void verifyTest(void);
+void verifyTest(void)
+{
+  CMock_Verify();
+}
+
+/*=======Test Runner Used To Run Each Test=====*/
+static void run_test(UnityTestFunction func, const char* name, UNITY_LINE_TYPE line_num)
+{
+    Unity.CurrentTestName = name;
+    Unity.CurrentTestLineNumber = line_num;
+#ifdef UNITY_USE_COMMAND_LINE_ARGS
+    if (!UnityTestMatches())
+        return;
+#endif
+    Unity.NumberOfTests++;
+    UNITY_CLR_DETAILS();
+    UNITY_EXEC_TIME_START();
+    CMock_Init();
+    if (TEST_PROTECT())
+    {
+        setUp();
+        func();
+    }
+    if (TEST_PROTECT())
+    {
+        tearDown();
+        CMock_Verify();
+    }
+    CMock_Destroy();
+    UNITY_EXEC_TIME_STOP();
+    UnityConcludeTest();
+}
+
+/*=======MAIN=====*/
+int main(void)
+{
+  UnityBegin("./ObLayerManifest.test.c");
+  run_test(test_obVerifyLayerManifest_shouldAcceptUnchangedLayerAtAllLevels, "test_obVerifyLayerManifest_shouldAcceptUnchangedLayerAtAllLevels", 72);
+  run_test(test_obVerifyLayerManifest_shouldDetectContentChangeOnlyWithFullLevel, "test_obVerifyLayerManifest_shouldDetectContentChangeOnlyWithFullLevel", 80);
+  run_test(test_obVerifyLayerManifest_shouldDetectMetadataChanges, "test_obVerifyLayerManifest_shouldDetectMetadataChanges", 89);
+
+  return UnityEnd();
+}
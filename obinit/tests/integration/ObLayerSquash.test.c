@@ -0,0 +1,203 @@
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObLayerSquash.h"
+#include "ObYamlLayerReader.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <sys/sysmacros.h>
+
+#define TEST_REPO_NAME "/oblayersquash-test"
+#define TEST_CONTENT "squash test content"
+
+char repoPath[OB_PATH_MAX] = {0};
+char layersPath[OB_CPATH_MAX] = {0};
+char indexPath[OB_CPATH_MAX] = {0};
+
+void helper_getLayerPath(char* path, const char* layer, const char* relPath)
+{
+  sprintf(path, "%s/%s.%s%s%s", layersPath, layer, OB_LAYER_DIR_EXT,
+          OB_LAYER_ROOT_DIR, relPath);
+}
+
+void helper_createLayer(const char* name, const char* underlayer)
+{
+  char path[OB_CCPATH_MAX];
+  helper_getLayerPath(path, name, "/etc");
+  obMkpath(path, OB_MKPATH_MODE);
+
+  char content[OB_PATH_MAX];
+  sprintf(content, "name: \"%s\"\nunderlayer: \"%s\"\nauthor: \"tester\"\n", name, underlayer);
+  strcat(path, "/layer.yaml");
+  obCreateFile(path, content);
+}
+
+void helper_createLayerFile(const char* layer, const char* relPath)
+{
+  char path[OB_CCPATH_MAX];
+  helper_getLayerPath(path, layer, relPath);
+  obCreateFile(path, TEST_CONTENT);
+}
+
+void helper_createLayerDir(const char* layer, const char* relPath)
+{
+  char path[OB_CCPATH_MAX];
+  helper_getLayerPath(path, layer, relPath);
+  obMkpath(path, OB_MKPATH_MODE);
+}
+
+bool helper_layerExists(const char* layer, const char* relPath)
+{
+  char path[OB_CCPATH_MAX];
+  helper_getLayerPath(path, layer, relPath);
+  return obExists(path);
+}
+
+bool helper_isWhiteout(const char* layer, const char* relPath)
+{
+  char path[OB_CCPATH_MAX];
+  helper_getLayerPath(path, layer, relPath);
+  struct stat st;
+  return lstat(path, &st) == 0 && S_ISCHR(st.st_mode) && st.st_rdev == makedev(0, 0);
+}
+
+ObLayerInfo* helper_loadInfo(const char* layer, ObLayerInfo* info)
+{
+  return obLoadLayerInfo(layersPath, layer, info);
+}
+
+void setUp(void)
+{
+  obGetSelfPath(repoPath, OB_PATH_MAX);
+  strcat(repoPath, TEST_REPO_NAME);
+  sprintf(layersPath, "%s/%s", repoPath, OB_LAYERS_DIR_NAME);
+  sprintf(indexPath, "%s/%s", repoPath, OB_LAYER_INDEX_NAME);
+
+  // base: /a, /b, /dir/x; mid: removes /a, replaces /dir; top: adds /c
+  helper_createLayer("base", OB_UNDERLAYER_NONE);
+  helper_createLayerFile("base", "/a");
+  helper_createLayerFile("base", "/b");
+  helper_createLayerDir("base", "/dir");
+  helper_createLayerFile("base", "/dir/x");
+
+  helper_createLayer("mid", "base");
+  char path[OB_CCPATH_MAX];
+  helper_getLayerPath(path, "mid", "/a");
+  mknod(path, S_IFCHR, makedev(0, 0));
+  helper_createLayerDir("mid", "/dir");
+  helper_getLayerPath(path, "mid", "/dir");
+  lsetxattr(path, "trusted.overlay.opaque", "y", 1, 0);
+  helper_createLayerFile("mid", "/dir/y");
+
+  helper_createLayer("top", "mid");
+  helper_createLayerFile("top", "/c");
+
+  helper_createLayer("next", "top");
+}
+
+void tearDown(void)
+{
+  obRemoveDirR(repoPath);
+}
+
+void test_obSquashLayers_shouldMergeRangeAndRepointLayersAbove()
+{
+  ObLayerInfo info;
+  memset(&info, 0, sizeof(ObLayerInfo));
+  strcpy(info.name, "merged");
+
+  // a flat directory of the next layer linking a squashed file
+  char path[OB_CCPATH_MAX];
+  char flatPath[OB_CCPATH_MAX];
+  sprintf(flatPath, "%s/next.%s%s", layersPath, OB_LAYER_DIR_EXT, OB_LAYER_FLAT_DIR);
+  obMkpath(flatPath, OB_MKPATH_MODE);
+  strcat(flatPath, "/c");
+  helper_getLayerPath(path, "top", "/c");
+  TEST_ASSERT_EQUAL(0, link(path, flatPath));
+
+  TEST_ASSERT_TRUE(obSquashLayers(layersPath, indexPath, "top", "base", &info, "next"));
+  TEST_ASSERT_FALSE(obExists(flatPath));
+
+  TEST_ASSERT_TRUE(helper_layerExists("merged", "/b"));
+  TEST_ASSERT_TRUE(helper_layerExists("merged", "/c"));
+  TEST_ASSERT_TRUE(helper_layerExists("merged", "/dir/y"));
+  TEST_ASSERT_FALSE(helper_layerExists("merged", "/dir/x"));
+  // nothing below the base layer, the whiteout is not needed
+  TEST_ASSERT_FALSE(helper_layerExists("merged", "/a"));
+
+  TEST_ASSERT_NOT_NULL(helper_loadInfo("merged", &info));
+  TEST_ASSERT_EQUAL_STRING("merged", info.name);
+  TEST_ASSERT_EQUAL_STRING(OB_UNDERLAYER_NONE, info.underlayer);
+  TEST_ASSERT_EQUAL_STRING("tester", info.author);
+
+  TEST_ASSERT_NOT_NULL(helper_loadInfo("next", &info));
+  TEST_ASSERT_EQUAL_STRING("merged", info.underlayer);
+
+  TEST_ASSERT_FALSE(helper_layerExists("top", ""));
+  TEST_ASSERT_FALSE(helper_layerExists("mid", ""));
+  TEST_ASSERT_FALSE(helper_layerExists("base", ""));
+}
+
+void test_obLimitLayerDepth_shouldSquashBottomLayersInPlace()
+{
+  // the whiteouts must still hide the root filesystem
+  helper_createLayer("base", OB_UNDERLAYER_ROOT);
+
+  TEST_ASSERT_EQUAL(4, obGetLayerDepth(layersPath, indexPath, "next"));
+  TEST_ASSERT_TRUE(obLimitLayerDepth(layersPath, indexPath, "next", 2));
+  TEST_ASSERT_EQUAL(2, obGetLayerDepth(layersPath, indexPath, "next"));
+
+  TEST_ASSERT_TRUE(helper_isWhiteout("top", "/a"));
+  TEST_ASSERT_TRUE(helper_layerExists("top", "/c"));
+  TEST_ASSERT_TRUE(helper_layerExists("top", "/dir/y"));
+  TEST_ASSERT_FALSE(helper_layerExists("top", "/dir/x"));
+
+  ObLayerInfo info;
+  TEST_ASSERT_NOT_NULL(helper_loadInfo("top", &info));
+  TEST_ASSERT_EQUAL_STRING(OB_UNDERLAYER_ROOT, info.underlayer);
+  TEST_ASSERT_NOT_NULL(helper_loadInfo("next", &info));
+  TEST_ASSERT_EQUAL_STRING("top", info.underlayer);
+  TEST_ASSERT_FALSE(helper_layerExists("mid", ""));
+}
+
+void test_obSquashLayers_shouldKeepLayersStillInUse()
+{
+  helper_createLayer("fork", "mid");
+
+  ObLayerInfo info;
+  memset(&info, 0, sizeof(ObLayerInfo));
+  strcpy(info.name, "merged");
+
+  TEST_ASSERT_TRUE(obSquashLayers(layersPath, indexPath, "top", NULL, &info, "top"));
+
+  TEST_ASSERT_TRUE(helper_layerExists("merged", "/c"));
+  TEST_ASSERT_TRUE(helper_layerExists("top", ""));
+  TEST_ASSERT_TRUE(helper_layerExists("mid", ""));
+  TEST_ASSERT_TRUE(helper_layerExists("base", ""));
+  TEST_ASSERT_FALSE(obSquashLayers(layersPath, indexPath, "top", NULL, &info, NULL));
+}
+
+void test_obSquashLayers_shouldKeepTheImageFormatOfTopLayer()
+{
+  char layerDir[OB_CCPATH_MAX];
+  sprintf(layerDir, "%s/top.%s", layersPath, OB_LAYER_DIR_EXT);
+  if (!obPackLayerImage(layerDir, OB_LAYER_FORMAT_EROFS)) {
+    TEST_IGNORE_MESSAGE("mkfs.erofs not available");
+  }
+
+  // a job without the format key
+  ObLayerInfo info;
+  memset(&info, 0, sizeof(ObLayerInfo));
+  strcpy(info.name, "merged");
+  info.format = OB_LAYER_FORMAT_UNSET;
+  TEST_ASSERT_TRUE(obSquashLayers(layersPath, indexPath, "top", "mid", &info, "next"));
+
+  sprintf(layerDir, "%s/merged.%s", layersPath, OB_LAYER_DIR_EXT);
+  TEST_ASSERT_EQUAL(OB_LAYER_FORMAT_EROFS, obDetectLayerFormat(layerDir));
+}
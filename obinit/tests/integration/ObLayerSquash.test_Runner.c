@@ -0,0 +1,92 @@
+/* AUTOGENERATED FILE. DO NOT EDIT. */
+
+/*=======Automagically Detected Files To Include=====*/
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObLayerSquash.h"
+#include "ObYamlLayerReader.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/xattr.h>
+#include <sys/sysmacros.h>
+
+/*=======External Functions This Runner Calls=====*/
+extern void setUp(void);
+extern void tearDown(void);
+extern void test_obSquashLayers_shouldMergeRangeAndRepointLayersAbove();
+extern void test_obLimitLayerDepth_shouldSquashBottomLayersInPlace();
+extern void test_obSquashLayers_shouldKeepLayersStillInUse();
+extern void test_obSquashLayers_shouldKeepTheImageFormatOfTopLayer();
+
+
+/*=======Mock Management=====*/
+static void CMock_Init(void)
+{
+}
+static void CMock_Verify(void)
+{
+}
+static void CMock_Destroy(void)
+{
+}
+
+/*=======Test Reset Options=====*/
+void resetTest(void);
+void resetTest(void)
+{
+  tearDown();
+  CMock_Verify();
+  CMock_Destroy();
+  CMock_Init();
+  setUp();
+}
+void verifyTest(void);
+void verifyTest(void)
+{
+  CMock_Verify();
+}
+
+/*=======Test Runner Used To Run Each Test=====*/
+static void run_test(UnityTestFunction func, const char* name, UNITY_LINE_TYPE line_num)
+{
+    Unity.CurrentTestName = name;
+    Unity.CurrentTestLineNumber = line_num;
+#ifdef UNITY_USE_COMMAND_LINE_ARGS
+    if (!UnityTestMatches())
+        return;
+#endif
+    Unity.NumberOfTests++;
+    UNITY_CLR_DETAILS();
+    UNITY_EXEC_TIME_START();
+    CMock_Init();
+    if (TEST_PROTECT())
+    {
+        setUp();
+        func();
+    }
+    if (TEST_PROTECT())
+    {
+        tearDown();
+        CMock_Verify();
+    }
+    CMock_Destroy();
+    UNITY_EXEC_TIME_STOP();
+    UnityConcludeTest();
+}
+
+/*=======MAIN=====*/
+int main(void)
+{
+  UnityBegin("./ObLayerSquash.test.c");
+  run_test(test_obSquashLayers_shouldMergeRangeAndRepointLayersAbove, "test_obSquashLayers_shouldMergeRangeAndRepointLayersAbove", 109);
+  run_test(test_obLimitLayerDepth_shouldSquashBottomLayersInPlace, "test_obLimitLayerDepth_shouldSquashBottomLayersInPlace", 147);
+  run_test(test_obSquashLayers_shouldKeepLayersStillInUse, "test_obSquashLayers_shouldKeepLayersStillInUse", 169);
+  run_test(test_obSquashLayers_shouldKeepTheImageFormatOfTopLayer, "test_obSquashLayers_shouldKeepTheImageFormatOfTopLayer", 186);
+
+  return UnityEnd();
+}
@@ -37,7 +37,7 @@ ObContext helper_getObContext()
   ObContext context;
   obInitializeObContext(&context, prefix);
 
-  strcpy(context.config.devicePath, TEST_DEVICE_IMAGE_PATH);
+  context.config.devicePath = TEST_DEVICE_IMAGE_PATH;
   obFindDevice(&context);
 
   return context;
@@ -74,9 +74,9 @@ char* helper_readTestFile(const char* prefix, char* content)
 //{
 //  ObContext context = helper_getObContext();
 //  char loopDevice[OB_PATH_MAX];
-//  int loopDev = obMountLoopDevice(context.config.devicePath, loopDevice);
+//  int loopDev = obMountLoopDevice(context.config.devicePath, loopDevice, false);
 
-//  strcpy(context.config.devicePath, loopDevice);
+//  context.config.devicePath = loopDevice;
 //  obMountImageFile(context.config.devicePath, context.devMountPoint);
 
 //  obFreeLoopDevice(loopDev);
@@ -91,7 +91,7 @@ char* helper_readTestFile(const char* prefix, char* content)
 //void test_obMountDevice_shouldFailWhenWrongPath()
 //{
 //  ObContext context = helper_getObContext();
-//  strcpy(context.config.devicePath, TEST_WRONG_DEVICE_PATH);
+//  context.config.devicePath = TEST_WRONG_DEVICE_PATH;
 //  bool result = obMountImageFile(context.config.devicePath, context.devMountPoint);
 //  TEST_ASSERT_FALSE(result);
 //}
@@ -0,0 +1,157 @@
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObMount.h"
+#include "ob/ObPrefetch.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+#include <sys/sysmacros.h>
+
+#define TEST_DIR_NAME "/obprefetch-test"
+#define TEST_OPEN_DELAY_US 200000
+#define TEST_RECORD_TIME 1
+
+char testDir[OB_PATH_MAX] = {0};
+char listPath[OB_CPATH_MAX] = {0};
+
+void setUp(void)
+{
+  obGetSelfPath(testDir, OB_PATH_MAX);
+  strcat(testDir, TEST_DIR_NAME);
+  sprintf(listPath, "%s/prefetch/root.list", testDir);
+  obMkpath(testDir, OB_MKPATH_MODE);
+}
+
+void tearDown(void)
+{
+  obRemoveDirR(testDir);
+}
+
+void helper_createLayerFile(const char* layer, const char* path, const char* content)
+{
+  char fullPath[OB_CCPATH_MAX];
+  sprintf(fullPath, "%s/%s%s", testDir, layer, path);
+  obMkpath(fullPath, OB_MKPATH_MODE);
+  obRemovePath(fullPath);
+  obCreateFile(fullPath, content);
+}
+
+void helper_openFilesLater(const char* dir)
+{
+  obFlushLog();
+  if (fork() == 0) {
+    usleep(TEST_OPEN_DELAY_US);
+    const char* names[] = {"a", "b", "a", "c"};
+    char path[OB_CCPATH_MAX];
+    for (int i = 0; i < 4; ++i) {
+      sprintf(path, "%s/%s", dir, names[i]);
+      close(open(path, O_RDONLY));
+    }
+    _exit(0);
+  }
+}
+
+void test_obPrefetchFiles_shouldReadAheadTopmostFilesOnly()
+{
+  helper_createLayerFile("bottom", "/usr/a", "a");
+  helper_createLayerFile("bottom", "/usr/b", "b");
+  helper_createLayerFile("top", "/usr/b", "b2");
+  helper_createLayerFile("bottom", "/usr/c", "c");
+
+  // a whiteout of /usr/c in the top layer
+  char whiteout[OB_CCPATH_MAX];
+  sprintf(whiteout, "%s/top/usr/c", testDir);
+  TEST_ASSERT_EQUAL(0, mknod(whiteout, S_IFCHR | 0600, makedev(0, 0)));
+
+  obMkpath(listPath, OB_MKPATH_MODE);
+  obRemovePath(listPath);
+  obCreateFile(listPath, "/usr/a\n/usr/b\n/usr/c\n/usr/missing\n");
+
+  char top[OB_CPATH_MAX];
+  char bottom[OB_CPATH_MAX];
+  sprintf(top, "%s/top", testDir);
+  sprintf(bottom, "%s/bottom", testDir);
+  const char* layers[] = {top, bottom};
+
+  TEST_ASSERT_EQUAL(2, obPrefetchFiles(listPath, layers, 2));
+  TEST_ASSERT_EQUAL(-1, obPrefetchFiles("/ob-missing.list", layers, 2));
+}
+
+void test_obPrefetchFiles_shouldSkipFilesHiddenByOpaqueDirs()
+{
+  helper_createLayerFile("bottom", "/opt/app/lib.so", "lib");
+  helper_createLayerFile("bottom", "/opt/app/sub/x", "x");
+  helper_createLayerFile("bottom", "/var/log/old", "old");
+  helper_createLayerFile("top", "/opt/app/new", "new");
+  helper_createLayerFile("top", "/var", "var");
+
+  char path[OB_CCPATH_MAX];
+  sprintf(path, "%s/top/opt/app", testDir);
+  TEST_ASSERT_EQUAL(0, lsetxattr(path, "trusted.overlay.opaque", "y", 1, 0));
+
+  obMkpath(listPath, OB_MKPATH_MODE);
+  obRemovePath(listPath);
+  obCreateFile(listPath, "/opt/app/lib.so\n/opt/app/sub/x\n/opt/app/new\n/var/log/old\n");
+
+  char top[OB_CPATH_MAX];
+  char bottom[OB_CPATH_MAX];
+  sprintf(top, "%s/top", testDir);
+  sprintf(bottom, "%s/bottom", testDir);
+  const char* layers[] = {top, bottom};
+
+  TEST_ASSERT_EQUAL(1, obPrefetchFiles(listPath, layers, 2));
+}
+
+void test_obRecordPrefetchList_shouldRecordFirstOpensInOrder()
+{
+  char mountPath[OB_CPATH_MAX];
+  sprintf(mountPath, "%s/root", testDir);
+  TEST_ASSERT_TRUE(obMountTmpfs(mountPath, "1m"));
+
+  char path[OB_CCPATH_MAX];
+  const char* names[] = {"a", "b", "c"};
+  for (int i = 0; i < 3; ++i) {
+    sprintf(path, "%s/%s", mountPath, names[i]);
+    obCreateFile(path, names[i]);
+  }
+
+  obMkpath(listPath, OB_MKPATH_MODE);
+  obRemovePath(listPath);
+  helper_openFilesLater(mountPath);
+  bool result = obRecordPrefetchList(mountPath, listPath, TEST_RECORD_TIME);
+  wait(NULL);
+  obUnmount(mountPath);
+
+  char content[OB_PATH_MAX] = {0};
+  FILE* file = fopen(listPath, "r");
+  TEST_ASSERT_NOT_NULL(file);
+  fread(content, 1, sizeof(content) - 1, file);
+  fclose(file);
+
+  TEST_ASSERT_TRUE(result);
+  TEST_ASSERT_EQUAL_STRING("/a\n/b\n/c\n", content);
+}
+
+void test_obRemoveStalePrefetchLists_shouldKeepHeadListOnly()
+{
+  char otherPath[OB_CPATH_MAX];
+  sprintf(otherPath, "%s/prefetch/old-head.list", testDir);
+  obMkpath(listPath, OB_MKPATH_MODE);
+  obRemovePath(listPath);
+  obCreateFile(listPath, "/a\n");
+  obCreateFile(otherPath, "/b\n");
+
+  char prefetchDir[OB_CPATH_MAX];
+  sprintf(prefetchDir, "%s/prefetch", testDir);
+  TEST_ASSERT_TRUE(obRemoveStalePrefetchLists(prefetchDir, listPath));
+  TEST_ASSERT_TRUE(obExists(listPath));
+  TEST_ASSERT_FALSE(obExists(otherPath));
+}
@@ -0,0 +1,94 @@
+/* AUTOGENERATED FILE. DO NOT EDIT. */
+
+/*=======Automagically Detected Files To Include=====*/
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObMount.h"
+#include "ob/ObPrefetch.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <sys/xattr.h>
+#include <sys/sysmacros.h>
+
+/*=======External Functions This Runner Calls=====*/
+extern void setUp(void);
+extern void tearDown(void);
+extern void test_obPrefetchFiles_shouldReadAheadTopmostFilesOnly();
+extern void test_obPrefetchFiles_shouldSkipFilesHiddenByOpaqueDirs();
+extern void test_obRecordPrefetchList_shouldRecordFirstOpensInOrder();
+extern void test_obRemoveStalePrefetchLists_shouldKeepHeadListOnly();
+
+
+/*=======Mock Management=====*/
+static void CMock_Init(void)
+{
+}
+static void CMock_Verify(void)
+{
+}
+static void CMock_Destroy(void)
+{
+}
+
+/*=======Test Reset Options=====*/
+void resetTest(void);
+void resetTest(void)
+{
+  tearDown();
+  CMock_Verify();
+  CMock_Destroy();
+  CMock_Init();
+  setUp();
+}
+void verifyTest(void);
+void verifyTest(void)
+{
+  CMock_Verify();
+}
+
+/*=======Test Runner Used To Run Each Test=====*/
+static void run_test(UnityTestFunction func, const char* name, UNITY_LINE_TYPE line_num)
+{
+    Unity.CurrentTestName = name;
+    Unity.CurrentTestLineNumber = line_num;
+#ifdef UNITY_USE_COMMAND_LINE_ARGS
+    if (!UnityTestMatches())
+        return;
+#endif
+    Unity.NumberOfTests++;
+    UNITY_CLR_DETAILS();
+    UNITY_EXEC_TIME_START();
+    CMock_Init();
+    if (TEST_PROTECT())
+    {
+        setUp();
+        func();
+    }
+    if (TEST_PROTECT())
+    {
+        tearDown();
+        CMock_Verify();
+    }
+    CMock_Destroy();
+    UNITY_EXEC_TIME_STOP();
+    UnityConcludeTest();
+}
+
+/*=======MAIN=====*/
+int main(void)
+{
+  UnityBegin("./ObPrefetch.test.c");
+  run_test(test_obPrefetchFiles_shouldReadAheadTopmostFilesOnly, "test_obPrefetchFiles_shouldReadAheadTopmostFilesOnly", 62);
+  run_test(test_obPrefetchFiles_shouldSkipFilesHiddenByOpaqueDirs, "test_obPrefetchFiles_shouldSkipFilesHiddenByOpaqueDirs", 88);
+  run_test(test_obRecordPrefetchList_shouldRecordFirstOpensInOrder, "test_obRecordPrefetchList_shouldRecordFirstOpensInOrder", 113);
+  run_test(test_obRemoveStalePrefetchLists_shouldKeepHeadListOnly, "test_obRemoveStalePrefetchLists_shouldKeepHeadListOnly", 143);
+
+  return UnityEnd();
+}
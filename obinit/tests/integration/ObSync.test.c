@@ -1,6 +1,8 @@
 
 #include "unity.h"
 #include "ObOsUtils.h"
+#include "ObCopy.h"
+#include "ob/ObSync.h"
 #include "ob/ObDefs.h"
 #include "ObTestHelpers.h"
 
@@ -117,3 +119,244 @@ void test_obSync_shouldCopySymbolicLinks()
   TEST_ASSERT_TRUE(obExists(testPath));
   TEST_ASSERT_TRUE(S_ISLNK(buf.st_mode));
 }
+
+void test_obCopyFile_shouldCopyContentAndCountStrategy()
+{
+  obResetCopyStats();
+
+  char srcFile[OB_CPATH_MAX];
+  char dstFile[OB_CPATH_MAX];
+  sprintf(srcFile, "%s/%s", srcPath, TEST_FILE_1);
+  sprintf(dstFile, "%s/%s", dstPath, TEST_FILE_1);
+  TEST_ASSERT_TRUE(obCopyFile(srcFile, dstFile));
+
+  char content[OB_NAME_MAX];
+  obReadFile(dstFile, content);
+  TEST_ASSERT_EQUAL_STRING("sync", content);
+
+  ObCopyStats stats;
+  obGetCopyStats(&stats);
+  uint64_t files = 0;
+  uint64_t bytes = 0;
+  for (int i = 0; i < OB_COPY_STRATEGY_COUNT; ++i) {
+    files += stats.files[i];
+    bytes += stats.bytes[i];
+  }
+  TEST_ASSERT_EQUAL_UINT64(1, files);
+  TEST_ASSERT_EQUAL_UINT64(strlen(TEST_CONTENT), bytes);
+}
+
+void test_obSyncTree_shouldCopyAllFilesWithWorkers()
+{
+  char path[OB_CCPATH_MAX];
+  for (int i = 0; i < 100; ++i) {
+    sprintf(path, "%s/%s/file_%i", srcPath, TEST_SUBDIR_2, i);
+    obCreateFile(path, TEST_CONTENT);
+  }
+
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  options.threads = 4;
+  TEST_ASSERT_TRUE(obSyncTree(srcPath, dstPath, &options));
+
+  for (int i = 0; i < 100; ++i) {
+    sprintf(path, "%s/%s/file_%i", dstPath, TEST_SUBDIR_2, i);
+    TEST_ASSERT_TRUE(obIsFile(path));
+  }
+}
+
+void test_obSyncTree_shouldRestoreDirectoryMetadata()
+{
+  char path[OB_CCPATH_MAX];
+  sprintf(path, "%s/%s", srcPath, TEST_SUBDIR_1);
+  chmod(path, 0550);
+
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  TEST_ASSERT_TRUE(obSyncTree(srcPath, dstPath, &options));
+
+  struct stat srcStat;
+  struct stat dstStat;
+  stat(path, &srcStat);
+  sprintf(path, "%s/%s", dstPath, TEST_SUBDIR_1);
+  stat(path, &dstStat);
+  TEST_ASSERT_EQUAL_UINT32(0550, dstStat.st_mode & 07777);
+  TEST_ASSERT_EQUAL_INT64(srcStat.st_mtim.tv_sec, dstStat.st_mtim.tv_sec);
+
+  sprintf(path, "%s/%s", dstPath, TEST_FILE_1);
+  TEST_ASSERT_TRUE(obIsFile(path));
+}
+
+static void helper_tamperDstFile(const char* srcFile, const char* dstFile)
+{
+  struct stat st;
+  stat(srcFile, &st);
+  obCreateFile(dstFile, "SYNC TEST CONTENT");
+  struct timespec times[2] = {st.st_atim, st.st_mtim};
+  utimensat(AT_FDCWD, dstFile, times, 0);
+}
+
+void test_obSyncTree_shouldSkipUnchangedFilesInIncrementalMode()
+{
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  obSyncTree(srcPath, dstPath, &options);
+
+  char srcFile[OB_CPATH_MAX];
+  char dstFile[OB_CPATH_MAX];
+  sprintf(srcFile, "%s/%s", srcPath, TEST_FILE_1);
+  sprintf(dstFile, "%s/%s", dstPath, TEST_FILE_1);
+  helper_tamperDstFile(srcFile, dstFile);
+
+  options.incremental = true;
+  TEST_ASSERT_TRUE(obSyncTree(srcPath, dstPath, &options));
+
+  char content[OB_NAME_MAX];
+  TEST_ASSERT_EQUAL_STRING("SYNC", obReadFile(dstFile, content));
+}
+
+void test_obSyncTree_shouldCompareHashesWhenRequested()
+{
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  obSyncTree(srcPath, dstPath, &options);
+
+  char srcFile[OB_CPATH_MAX];
+  char dstFile[OB_CPATH_MAX];
+  sprintf(srcFile, "%s/%s", srcPath, TEST_FILE_1);
+  sprintf(dstFile, "%s/%s", dstPath, TEST_FILE_1);
+  helper_tamperDstFile(srcFile, dstFile);
+
+  options.incremental = true;
+  options.compareHash = true;
+  TEST_ASSERT_TRUE(obSyncTree(srcPath, dstPath, &options));
+
+  char content[OB_NAME_MAX];
+  TEST_ASSERT_EQUAL_STRING("sync", obReadFile(dstFile, content));
+}
+
+void test_obSyncTree_shouldDeleteOrWhiteoutExtraEntries()
+{
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  obSyncTree(srcPath, dstPath, &options);
+
+  char path[OB_CPATH_MAX];
+  sprintf(path, "%s/%s", srcPath, TEST_FILE_1);
+  remove(path);
+  sprintf(path, "%s/%s", srcPath, TEST_SUBDIR_3);
+  remove(path);
+
+  options.incremental = true;
+  options.extraMode = OB_SYNC_WHITEOUT_EXTRA;
+  TEST_ASSERT_TRUE(obSyncTree(srcPath, dstPath, &options));
+
+  struct stat st;
+  sprintf(path, "%s/%s", dstPath, TEST_FILE_1);
+  TEST_ASSERT_EQUAL_INT(0, lstat(path, &st));
+  TEST_ASSERT_TRUE(S_ISCHR(st.st_mode));
+  sprintf(path, "%s/%s", dstPath, TEST_SUBDIR_3);
+  TEST_ASSERT_EQUAL_INT(0, lstat(path, &st));
+  TEST_ASSERT_TRUE(S_ISCHR(st.st_mode));
+
+  options.extraMode = OB_SYNC_DELETE_EXTRA;
+  TEST_ASSERT_TRUE(obSyncTree(srcPath, dstPath, &options));
+  sprintf(path, "%s/%s", dstPath, TEST_FILE_1);
+  TEST_ASSERT_FALSE(obExists(path));
+  sprintf(path, "%s/%s", dstPath, TEST_LINK_1);
+  TEST_ASSERT_EQUAL_INT(0, lstat(path, &st));
+}
+
+void test_obSyncTree_shouldKeepHardlinks()
+{
+  char path[OB_CCPATH_MAX];
+  char linkPath[OB_CCPATH_MAX];
+  sprintf(path, "%s/%s", srcPath, TEST_FILE_1);
+  sprintf(linkPath, "%s/%s/hardlink", srcPath, TEST_DIR_2);
+  link(path, linkPath);
+
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  TEST_ASSERT_TRUE(obSyncTree(srcPath, dstPath, &options));
+
+  struct stat fileStat;
+  struct stat linkStat;
+  sprintf(path, "%s/%s", dstPath, TEST_FILE_1);
+  sprintf(linkPath, "%s/%s/hardlink", dstPath, TEST_DIR_2);
+  TEST_ASSERT_EQUAL_INT(0, stat(path, &fileStat));
+  TEST_ASSERT_EQUAL_INT(0, stat(linkPath, &linkStat));
+  TEST_ASSERT_EQUAL_UINT64(fileStat.st_ino, linkStat.st_ino);
+}
+
+void test_obSyncTree_shouldReplaceLinkedFilesWhenMerging()
+{
+  char path[OB_CCPATH_MAX + 32];
+  char linkPath[OB_CCPATH_MAX];
+  sprintf(path, "%s/%s", srcPath, TEST_FILE_1);
+  sprintf(linkPath, "%s/%s/hardlink", srcPath, TEST_DIR_2);
+  link(path, linkPath);
+
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  options.mergeLayer = true;
+  TEST_ASSERT_TRUE(obSyncTree(srcPath, dstPath, &options));
+
+  // the upper layer changes one of the linked paths only
+  char upperPath[OB_CCPATH_MAX];
+  sprintf(upperPath, "%s/upper", treePath);
+  sprintf(path, "%s/%s", upperPath, TEST_FILE_1);
+  obMkpath(path, OB_MKPATH_MODE);
+  obRemovePath(path);
+  obCreateFile(path, "upper");
+  TEST_ASSERT_TRUE(obSyncTree(upperPath, dstPath, &options));
+
+  char content[OB_PATH_MAX];
+  sprintf(path, "%s/%s", dstPath, TEST_FILE_1);
+  TEST_ASSERT_EQUAL_STRING("upper", obReadFile(path, content));
+  sprintf(linkPath, "%s/%s/hardlink", dstPath, TEST_DIR_2);
+  TEST_ASSERT_EQUAL_STRING("sync", obReadFile(linkPath, content));
+}
+
+void test_obSyncTree_shouldRecreateSpecialFiles()
+{
+  char path[OB_CCPATH_MAX];
+  sprintf(path, "%s/%s/fifo", srcPath, TEST_DIR_2);
+  mkfifo(path, 0640);
+
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  TEST_ASSERT_TRUE(obSyncTree(srcPath, dstPath, &options));
+
+  struct stat st;
+  sprintf(path, "%s/%s/fifo", dstPath, TEST_DIR_2);
+  TEST_ASSERT_EQUAL_INT(0, lstat(path, &st));
+  TEST_ASSERT_TRUE(S_ISFIFO(st.st_mode));
+  TEST_ASSERT_EQUAL_UINT32(0640, st.st_mode & 07777);
+}
+
+void test_obSyncTree_shouldKeepHolesInSparseFiles()
+{
+  const off_t size = 64 * 1024 * 1024;
+  char path[OB_CCPATH_MAX];
+  sprintf(path, "%s/%s/sparse.img", srcPath, TEST_DIR_2);
+  int fd = open(path, O_WRONLY | O_CREAT, 0644);
+  pwrite(fd, TEST_CONTENT, strlen(TEST_CONTENT), size / 2);
+  ftruncate(fd, size);
+  close(fd);
+
+  ObSyncOptions options;
+  obInitSyncOptions(&options);
+  TEST_ASSERT_TRUE(obSyncTree(srcPath, dstPath, &options));
+
+  struct stat st;
+  sprintf(path, "%s/%s/sparse.img", dstPath, TEST_DIR_2);
+  TEST_ASSERT_EQUAL_INT(0, stat(path, &st));
+  TEST_ASSERT_EQUAL_INT64(size, st.st_size);
+  TEST_ASSERT_TRUE(st.st_blocks * 512 < size / 2);
+
+  char content[sizeof(TEST_CONTENT)] = {0};
+  fd = open(path, O_RDONLY);
+  pread(fd, content, strlen(TEST_CONTENT), size / 2);
+  close(fd);
+  TEST_ASSERT_EQUAL_STRING(TEST_CONTENT, content);
+}
@@ -3,6 +3,8 @@
 /*=======Automagically Detected Files To Include=====*/
 #include "unity.h"
 #include "ObOsUtils.h"
+#include "ObCopy.h"
+#include "ob/ObSync.h"
 #include "ob/ObDefs.h"
 #include "ObTestHelpers.h"
 #include <stdlib.h>
@@ -19,6 +21,16 @@ extern void tearDown(void);
 extern void test_obSync_shouldRecreateDirectoriesRecursively();
 extern void test_obSync_shouldCopyFiles();
 extern void test_obSync_shouldCopySymbolicLinks();
+extern void test_obCopyFile_shouldCopyContentAndCountStrategy();
+extern void test_obSyncTree_shouldCopyAllFilesWithWorkers();
+extern void test_obSyncTree_shouldRestoreDirectoryMetadata();
+extern void test_obSyncTree_shouldSkipUnchangedFilesInIncrementalMode();
+extern void test_obSyncTree_shouldCompareHashesWhenRequested();
+extern void test_obSyncTree_shouldDeleteOrWhiteoutExtraEntries();
+extern void test_obSyncTree_shouldKeepHardlinks();
+extern void test_obSyncTree_shouldReplaceLinkedFilesWhenMerging();
+extern void test_obSyncTree_shouldRecreateSpecialFiles();
+extern void test_obSyncTree_shouldKeepHolesInSparseFiles();
 
 
 /*=======Mock Management=====*/
@@ -80,9 +92,19 @@ static void run_test(UnityTestFunction func, const char* name, UNITY_LINE_TYPE l
 int main(void)
 {
   UnityBegin("./ObSync.test.c");
-  run_test(test_obSync_shouldRecreateDirectoriesRecursively, "test_obSync_shouldRecreateDirectoriesRecursively", 83);
-  run_test(test_obSync_shouldCopyFiles, "test_obSync_shouldCopyFiles", 99);
-  run_test(test_obSync_shouldCopySymbolicLinks, "test_obSync_shouldCopySymbolicLinks", 108);
+  run_test(test_obSync_shouldRecreateDirectoriesRecursively, "test_obSync_shouldRecreateDirectoriesRecursively", 86);
+  run_test(test_obSync_shouldCopyFiles, "test_obSync_shouldCopyFiles", 102);
+  run_test(test_obSync_shouldCopySymbolicLinks, "test_obSync_shouldCopySymbolicLinks", 111);
+  run_test(test_obCopyFile_shouldCopyContentAndCountStrategy, "test_obCopyFile_shouldCopyContentAndCountStrategy", 123);
+  run_test(test_obSyncTree_shouldCopyAllFilesWithWorkers, "test_obSyncTree_shouldCopyAllFilesWithWorkers", 149);
+  run_test(test_obSyncTree_shouldRestoreDirectoryMetadata, "test_obSyncTree_shouldRestoreDirectoryMetadata", 168);
+  run_test(test_obSyncTree_shouldSkipUnchangedFilesInIncrementalMode, "test_obSyncTree_shouldSkipUnchangedFilesInIncrementalMode", 199);
+  run_test(test_obSyncTree_shouldCompareHashesWhenRequested, "test_obSyncTree_shouldCompareHashesWhenRequested", 218);
+  run_test(test_obSyncTree_shouldDeleteOrWhiteoutExtraEntries, "test_obSyncTree_shouldDeleteOrWhiteoutExtraEntries", 238);
+  run_test(test_obSyncTree_shouldKeepHardlinks, "test_obSyncTree_shouldKeepHardlinks", 270);
+  run_test(test_obSyncTree_shouldReplaceLinkedFilesWhenMerging, "test_obSyncTree_shouldReplaceLinkedFilesWhenMerging", 291);
+  run_test(test_obSyncTree_shouldRecreateSpecialFiles, "test_obSyncTree_shouldRecreateSpecialFiles", 320);
+  run_test(test_obSyncTree_shouldKeepHolesInSparseFiles, "test_obSyncTree_shouldKeepHolesInSparseFiles", 337);
 
   return UnityEnd();
 }
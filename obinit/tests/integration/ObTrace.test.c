@@ -0,0 +1,66 @@
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ob/ObTrace.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define TEST_TRACE_NAME "/obtrace-test.json"
+#define TEST_TRACE_MAX 65536
+
+char tracePath[OB_PATH_MAX] = {0};
+char content[TEST_TRACE_MAX] = {0};
+
+void setUp(void)
+{
+  obGetSelfPath(tracePath, OB_PATH_MAX);
+  strcat(tracePath, TEST_TRACE_NAME);
+  obClearTrace();
+}
+
+void tearDown(void)
+{
+  obRemovePath(tracePath);
+  obClearTrace();
+}
+
+char* helper_readTrace()
+{
+  memset(content, 0, TEST_TRACE_MAX);
+  FILE* file = fopen(tracePath, "r");
+  if (file != NULL) {
+    size_t size = fread(content, 1, TEST_TRACE_MAX - 1, file);
+    content[size] = '\0';
+    fclose(file);
+  }
+  return content;
+}
+
+void test_obWriteTrace_shouldWriteChromeTraceEvents()
+{
+  obTraceSpanAt("obMountOverlay", "/root", 1234567, 2234568, 42);
+  obTraceSpan("obSyncTree", "a \"quoted\"\\path", obGetMonotonicNs());
+
+  TEST_ASSERT_TRUE(obWriteTrace(tracePath));
+  helper_readTrace();
+
+  TEST_ASSERT_NOT_NULL(strstr(content, "\"traceEvents\":["));
+  TEST_ASSERT_NOT_NULL(strstr(content, "\"name\":\"obMountOverlay\""));
+  TEST_ASSERT_NOT_NULL(strstr(content, "\"ph\":\"X\",\"ts\":1234.567,\"dur\":1000.001"));
+  TEST_ASSERT_NOT_NULL(strstr(content, "\"tid\":42,\"args\":{\"detail\":\"/root\"}"));
+  TEST_ASSERT_NOT_NULL(strstr(content, "\"detail\":\"a \\\"quoted\\\"\\\\path\""));
+}
+
+void test_obTraceSpan_shouldDropSpansAboveLimit()
+{
+  for (int i = 0; i < OB_TRACE_MAX_SPANS + 3; ++i) {
+    obTraceSpanAt("span", NULL, 0, 1, 1);
+  }
+
+  TEST_ASSERT_TRUE(obWriteTrace(tracePath));
+  helper_readTrace();
+  TEST_ASSERT_NOT_NULL(strstr(content, "\"dropped\":3"));
+}
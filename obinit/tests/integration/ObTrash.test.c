@@ -0,0 +1,83 @@
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObTrash.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_DIR_NAME "/obtrash-test"
+#define TEST_WAIT_STEP_US 10000
+#define TEST_WAIT_STEPS 500
+
+char testDir[OB_PATH_MAX] = {0};
+char upperPath[OB_CPATH_MAX] = {0};
+char trashPath[OB_CPATH_MAX] = {0};
+
+void setUp(void)
+{
+  obGetSelfPath(testDir, OB_PATH_MAX);
+  strcat(testDir, TEST_DIR_NAME);
+  sprintf(upperPath, "%s/upper", testDir);
+  sprintf(trashPath, "%s/trash", testDir);
+  obMkpath(upperPath, OB_MKPATH_MODE);
+}
+
+void tearDown(void)
+{
+  obRemoveDirR(testDir);
+}
+
+void helper_fillUpper()
+{
+  char path[OB_CCPATH_MAX + 32];
+  for (int i = 0; i < 10; ++i) {
+    sprintf(path, "%s/dir-%i/sub", upperPath, i);
+    obMkpath(path, OB_MKPATH_MODE);
+    sprintf(path, "%s/dir-%i/sub/file", upperPath, i);
+    obCreateFile(path, "content");
+    sprintf(path, "%s/dir-%i/link", upperPath, i);
+    TEST_ASSERT_EQUAL(0, symlink("sub", path));
+  }
+}
+
+void test_obMoveToTrash_shouldMoveEachGenerationAside()
+{
+  helper_fillUpper();
+  TEST_ASSERT_TRUE(obMoveToTrash(upperPath, trashPath));
+  TEST_ASSERT_FALSE(obExists(upperPath));
+
+  obMkpath(upperPath, OB_MKPATH_MODE);
+  helper_fillUpper();
+  TEST_ASSERT_TRUE(obMoveToTrash(upperPath, trashPath));
+  TEST_ASSERT_FALSE(obExists(upperPath));
+
+  char path[OB_CCPATH_MAX + 32];
+  sprintf(path, "%s/upper-missing", testDir);
+  TEST_ASSERT_TRUE(obMoveToTrash(path, trashPath));
+
+  TEST_ASSERT_TRUE(obEmptyTrash(trashPath));
+  TEST_ASSERT_TRUE(obIsDirectory(trashPath));
+  TEST_ASSERT_TRUE(obIsDirectoryEmpty(trashPath));
+}
+
+void test_obEmptyTrash_shouldAcceptMissingTrash()
+{
+  TEST_ASSERT_TRUE(obEmptyTrash(trashPath));
+  TEST_ASSERT_TRUE(obEmptyTrashInBackground(trashPath));
+}
+
+void test_obEmptyTrashInBackground_shouldEmptyTrashAfterReturning()
+{
+  helper_fillUpper();
+  TEST_ASSERT_TRUE(obMoveToTrash(upperPath, trashPath));
+  TEST_ASSERT_TRUE(obEmptyTrashInBackground(trashPath));
+
+  int steps = 0;
+  while (!obIsDirectoryEmpty(trashPath) && steps++ < TEST_WAIT_STEPS) {
+    usleep(TEST_WAIT_STEP_US);
+  }
+  TEST_ASSERT_TRUE(obIsDirectoryEmpty(trashPath));
+}
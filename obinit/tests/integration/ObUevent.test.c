@@ -0,0 +1,75 @@
+#include "unity.h"
+#include "ObUevent.h"
+#include "ObOsUtils.h"
+#include "ObTestHelpers.h"
+
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/loop.h>
+
+#define TEST_LOOP_ID 217
+#define TEST_LOOP_PATH "/dev/loop217"
+#define TEST_MISSING_PATH "/dev/ob-missing-device"
+#define TEST_TIMEOUT_MS 200
+#define TEST_ADD_DELAY_US 100000
+#define TEST_ADD_TIMEOUT_MS 5000
+
+static void helper_controlLoop(unsigned long request)
+{
+  int fd = open("/dev/loop-control", O_RDWR);
+  if (fd >= 0) {
+    ioctl(fd, request, TEST_LOOP_ID);
+    close(fd);
+  }
+}
+
+static void* helper_addLoopLater(void* arg)
+{
+  (void)arg;
+  usleep(TEST_ADD_DELAY_US);
+  helper_controlLoop(LOOP_CTL_ADD);
+  return NULL;
+}
+
+void setUp(void)
+{
+  helper_controlLoop(LOOP_CTL_REMOVE);
+}
+
+void tearDown(void)
+{
+  helper_controlLoop(LOOP_CTL_REMOVE);
+}
+
+void test_obIsHotplugDevice_shouldAcceptDevPathsAndUuids()
+{
+  TEST_ASSERT_TRUE(obIsHotplugDevice("/dev/sda1"));
+  TEST_ASSERT_TRUE(obIsHotplugDevice("UUID=04349192-f5bc-48b8-b63b-dd1b8bef0df5"));
+  TEST_ASSERT_FALSE(obIsHotplugDevice("/var/obdev"));
+}
+
+void test_obWaitForDevice_shouldTimeOutForMissingDevice()
+{
+  TEST_ASSERT_FALSE(obWaitForDevice(TEST_MISSING_PATH, TEST_TIMEOUT_MS));
+  TEST_ASSERT_FALSE(obWaitForDevice("UUID=ob-missing-uuid", TEST_TIMEOUT_MS));
+}
+
+void test_obWaitForDevice_shouldReturnWhenDeviceIsAdded()
+{
+  if (!obExists("/dev/loop-control")) {
+    TEST_IGNORE_MESSAGE("loop-control not available");
+  }
+
+  TEST_ASSERT_FALSE(obExists(TEST_LOOP_PATH));
+  pthread_t thread;
+  pthread_create(&thread, NULL, helper_addLoopLater, NULL);
+  bool result = obWaitForDevice(TEST_LOOP_PATH, TEST_ADD_TIMEOUT_MS);
+  pthread_join(thread, NULL);
+  TEST_ASSERT_TRUE(result);
+
+  // already present
+  TEST_ASSERT_TRUE(obWaitForDevice(TEST_LOOP_PATH, 0));
+}
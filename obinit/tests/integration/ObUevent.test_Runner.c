@@ -0,0 +1,87 @@
+/* AUTOGENERATED FILE. DO NOT EDIT. */
+
+/*=======Automagically Detected Files To Include=====*/
+#include "unity.h"
+#include "ObUevent.h"
+#include "ObOsUtils.h"
+#include "ObTestHelpers.h"
+#include <stdio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <linux/loop.h>
+
+/*=======External Functions This Runner Calls=====*/
+extern void setUp(void);
+extern void tearDown(void);
+extern void test_obIsHotplugDevice_shouldAcceptDevPathsAndUuids();
+extern void test_obWaitForDevice_shouldTimeOutForMissingDevice();
+extern void test_obWaitForDevice_shouldReturnWhenDeviceIsAdded();
+
+
+/*=======Mock Management=====*/
+static void CMock_Init(void)
+{
+}
+static void CMock_Verify(void)
+{
+}
+static void CMock_Destroy(void)
+{
+}
+
+/*=======Test Reset Options=====*/
+void resetTest(void);
+void resetTest(void)
+{
+  tearDown();
+  CMock_Verify();
+  CMock_Destroy();
+  CMock_Init();
+  setUp();
+}
+void verifyTest(void);
+void verifyTest(void)
+{
+  CMock_Verify();
+}
+
+/*=======Test Runner Used To Run Each Test=====*/
+static void run_test(UnityTestFunction func, const char* name, UNITY_LINE_TYPE line_num)
+{
+    Unity.CurrentTestName = name;
+    Unity.CurrentTestLineNumber = line_num;
+#ifdef UNITY_USE_COMMAND_LINE_ARGS
+    if (!UnityTestMatches())
+        return;
+#endif
+    Unity.NumberOfTests++;
+    UNITY_CLR_DETAILS();
+    UNITY_EXEC_TIME_START();
+    CMock_Init();
+    if (TEST_PROTECT())
+    {
+        setUp();
+        func();
+    }
+    if (TEST_PROTECT())
+    {
+        tearDown();
+        CMock_Verify();
+    }
+    CMock_Destroy();
+    UNITY_EXEC_TIME_STOP();
+    UnityConcludeTest();
+}
+
+/*=======MAIN=====*/
+int main(void)
+{
+  UnityBegin("./ObUevent.test.c");
+  run_test(test_obIsHotplugDevice_shouldAcceptDevPathsAndUuids, "test_obIsHotplugDevice_shouldAcceptDevPathsAndUuids", 47);
+  run_test(test_obWaitForDevice_shouldTimeOutForMissingDevice, "test_obWaitForDevice_shouldTimeOutForMissingDevice", 54);
+  run_test(test_obWaitForDevice_shouldReturnWhenDeviceIsAdded, "test_obWaitForDevice_shouldReturnWhenDeviceIsAdded", 60);
+
+  return UnityEnd();
+}
@@ -0,0 +1,87 @@
+#include "unity.h"
+#include "ObOsUtils.h"
+#include "ObZram.h"
+#include "ob/ObDefs.h"
+#include "ObTestHelpers.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#define TEST_DIR_NAME "/obzram-test"
+
+char testDir[OB_PATH_MAX] = {0};
+char mountPath[OB_CPATH_MAX] = {0};
+
+void setUp(void)
+{
+  obGetSelfPath(testDir, OB_PATH_MAX);
+  strcat(testDir, TEST_DIR_NAME);
+  sprintf(mountPath, "%s/overlay", testDir);
+}
+
+void tearDown(void)
+{
+  obRemoveDirR(testDir);
+}
+
+void test_obParseSize_shouldParseSuffixesAndPercentage()
+{
+  unsigned long long size = 0;
+  TEST_ASSERT_TRUE(obParseSize("512", &size));
+  TEST_ASSERT_EQUAL_UINT64(512, size);
+  TEST_ASSERT_TRUE(obParseSize("4k", &size));
+  TEST_ASSERT_EQUAL_UINT64(4096, size);
+  TEST_ASSERT_TRUE(obParseSize("3M", &size));
+  TEST_ASSERT_EQUAL_UINT64(3ULL << 20, size);
+  TEST_ASSERT_TRUE(obParseSize("2g", &size));
+  TEST_ASSERT_EQUAL_UINT64(2ULL << 30, size);
+
+  unsigned long long ram = (unsigned long long)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE);
+  TEST_ASSERT_TRUE(obParseSize("50%", &size));
+  TEST_ASSERT_EQUAL_UINT64(ram / 100 * 50, size);
+  TEST_ASSERT_TRUE(obParseSize("150%", &size));
+  TEST_ASSERT_EQUAL_UINT64(ram / 100 * 150, size);
+
+  TEST_ASSERT_FALSE(obParseSize("", &size));
+  TEST_ASSERT_FALSE(obParseSize("m", &size));
+  TEST_ASSERT_FALSE(obParseSize("10x", &size));
+  TEST_ASSERT_FALSE(obParseSize("10mb", &size));
+  TEST_ASSERT_FALSE(obParseSize("18446744073709551616", &size));
+  TEST_ASSERT_FALSE(obParseSize("16777216t", &size));
+  TEST_ASSERT_FALSE(obParseSize("18446744073709551615%", &size));
+}
+
+void test_obMountZram_shouldMountWritableDeviceAndReleaseIt()
+{
+  if (!obExists(OB_ZRAM_CONTROL_DIR)) {
+    TEST_IGNORE_MESSAGE("zram not available");
+  }
+
+  char device[OB_DEV_PATH_MAX];
+  TEST_ASSERT_TRUE(obMountZram(mountPath, "16m", "lz4", device));
+  TEST_ASSERT_TRUE(obIsBlockDevice(device));
+
+  char path[OB_CCPATH_MAX];
+  char content[OB_PATH_MAX];
+  sprintf(path, "%s/upper/file", mountPath);
+  obMkpath(path, OB_MKPATH_MODE);
+  obRemovePath(path);
+  obCreateFile(path, "compressed");
+  TEST_ASSERT_EQUAL_STRING("compressed", obReadFile(path, content));
+
+  TEST_ASSERT_TRUE(obUnmountZram(mountPath, device));
+  TEST_ASSERT_FALSE(obExists(path));
+  TEST_ASSERT_FALSE(obExists(device));
+}
+
+void test_obMountZram_shouldRejectUnknownCompressor()
+{
+  if (!obExists(OB_ZRAM_CONTROL_DIR)) {
+    TEST_IGNORE_MESSAGE("zram not available");
+  }
+
+  char device[OB_DEV_PATH_MAX];
+  TEST_ASSERT_FALSE(obMountZram(mountPath, "16m", "no-such-compressor", device));
+  TEST_ASSERT_EQUAL_STRING("", device);
+}
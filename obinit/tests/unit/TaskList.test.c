@@ -5,6 +5,10 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
 typedef struct {
   int index;
@@ -176,3 +180,178 @@ void test_execTaskList_shouldExecAllUndoFunctionsFromFiledToFirst()
 
   obFreeTaskList(&taskList);
 }
+
+bool failUndoTask(ObTaskContext rawContext)
+{
+  undoTask(rawContext);
+  return false;
+}
+
+typedef struct {
+  pthread_mutex_t mutex;
+  pthread_cond_t changed;
+  int started;
+  int completed;
+  char order[8];
+} ParallelTestContext;
+
+ParallelTestContext parallelContext;
+
+void initParallelTestContext()
+{
+  pthread_mutex_init(&parallelContext.mutex, NULL);
+  pthread_cond_init(&parallelContext.changed, NULL);
+  parallelContext.started = 0;
+  parallelContext.completed = 0;
+  memset(parallelContext.order, 0, sizeof(parallelContext.order));
+}
+
+void recordCompletion(char tag)
+{
+  pthread_mutex_lock(&parallelContext.mutex);
+  parallelContext.order[parallelContext.completed] = tag;
+  parallelContext.completed += 1;
+  pthread_cond_broadcast(&parallelContext.changed);
+  pthread_mutex_unlock(&parallelContext.mutex);
+}
+
+// succeeds only if the other waiting task runs at the same time
+bool waitingTask(ObTaskContext rawContext)
+{
+  char tag = *(char*)rawContext;
+  pthread_mutex_lock(&parallelContext.mutex);
+  parallelContext.started += 1;
+  pthread_cond_broadcast(&parallelContext.changed);
+
+  struct timespec deadline;
+  clock_gettime(CLOCK_REALTIME, &deadline);
+  deadline.tv_sec += 5;
+  int rc = 0;
+  while (parallelContext.started < 2 && rc == 0) {
+    rc = pthread_cond_timedwait(&parallelContext.changed, &parallelContext.mutex, &deadline);
+  }
+  bool result = parallelContext.started >= 2;
+  pthread_mutex_unlock(&parallelContext.mutex);
+
+  recordCompletion(tag);
+  return result;
+}
+
+ObTaskPtr awaitedTask = NULL;
+
+// completes after awaitedTask
+bool lateTask(ObTaskContext rawContext)
+{
+  while (__atomic_load_n(&awaitedTask->state, __ATOMIC_SEQ_CST) != OB_TASK_DONE) {
+    usleep(1000);
+  }
+  recordCompletion(*(char*)rawContext);
+  return true;
+}
+
+bool recordTask(ObTaskContext rawContext)
+{
+  recordCompletion(*(char*)rawContext);
+  return true;
+}
+
+bool recordUndoTask(ObTaskContext rawContext)
+{
+  recordCompletion(*(char*)rawContext);
+  return true;
+}
+
+void test_callUndoChain_shouldReturnFalseIfAnyUndoFails()
+{
+  ObTaskListPtr taskList = obCreateTaskList();
+  TaskListTestContext context = createTaskListTestContext();
+
+  obAddTask(taskList, &successTaskA, &undoTask, &context);
+  obAddTask(taskList, &successTaskB, &failUndoTask, &context);
+  obAddTask(taskList, &successTaskC, &undoTask, &context);
+
+  TEST_ASSERT_TRUE(obExecTaskList(taskList));
+  TEST_ASSERT_FALSE(obCallUndoChain(taskList->lastCompleted));
+
+  // the chain is not interrupted by the failed undo
+  TEST_ASSERT_EQUAL(0, context.index);
+  TEST_ASSERT_EQUAL('X', context.data[0]);
+
+  obFreeTaskList(&taskList);
+}
+
+void test_execTaskList_shouldRunIndependentTasksInParallel()
+{
+  initParallelTestContext();
+  ObTaskListPtr taskList = obCreateTaskList();
+  taskList->threads = 2;
+  char tags[] = "ABCD";
+
+  ObTaskPtr first = obCreateTask(&recordTask, NULL, &tags[0]);
+  ObTaskPtr left = obCreateTask(&waitingTask, NULL, &tags[1]);
+  ObTaskPtr right = obCreateTask(&waitingTask, NULL, &tags[2]);
+  ObTaskPtr last = obCreateTask(&recordTask, NULL, &tags[3]);
+  obAddTaskDependency(left, first);
+  obAddTaskDependency(right, first);
+
+  obAppendTask(taskList, first);
+  obAppendTask(taskList, left);
+  obAppendTask(taskList, right);
+  obAppendTask(taskList, last);
+
+  TEST_ASSERT_TRUE(obExecTaskList(taskList));
+  TEST_ASSERT_EQUAL(4, parallelContext.completed);
+  TEST_ASSERT_EQUAL('A', parallelContext.order[0]);
+  // without dependencies the task waits for all the tasks before it
+  TEST_ASSERT_EQUAL('D', parallelContext.order[3]);
+
+  obFreeTaskList(&taskList);
+}
+
+void test_execTaskList_shouldUndoInReverseCompletionOrder()
+{
+  initParallelTestContext();
+  ObTaskListPtr taskList = obCreateTaskList();
+  taskList->threads = 2;
+  TaskListTestContext context = createTaskListTestContext();
+  char tags[] = "PAB";
+
+  // A is appended before B but waits for B to complete
+  ObTaskPtr first = obCreateTask(&recordTask, &recordUndoTask, &tags[0]);
+  ObTaskPtr taskA = obCreateTask(&lateTask, &recordUndoTask, &tags[1]);
+  ObTaskPtr taskB = obCreateTask(&recordTask, &recordUndoTask, &tags[2]);
+  ObTaskPtr fail = obCreateTask(&failTask, NULL, &context);
+  obAddTaskDependency(taskA, first);
+  obAddTaskDependency(taskB, first);
+  awaitedTask = taskB;
+  obAppendTask(taskList, first);
+  obAppendTask(taskList, taskA);
+  obAppendTask(taskList, taskB);
+  obAppendTask(taskList, fail);
+
+  TEST_ASSERT_FALSE(obExecTaskList(taskList));
+  TEST_ASSERT_EQUAL(6, parallelContext.completed);
+  TEST_ASSERT_EQUAL_STRING_LEN("PBAABP", parallelContext.order, 6);
+
+  obFreeTaskList(&taskList);
+}
+
+void test_execTaskList_shouldNotStartTasksAfterFailure()
+{
+  ObTaskListPtr taskList = obCreateTaskList();
+  taskList->threads = 4;
+  TaskListTestContext context = createTaskListTestContext();
+
+  ObTaskPtr fail = obCreateTask(&failTask, NULL, &context);
+  ObTaskPtr dependent = obCreateTask(&successTaskA, NULL, &context);
+  obAddTaskDependency(dependent, fail);
+  obAppendTask(taskList, fail);
+  obAppendTask(taskList, dependent);
+
+  TEST_ASSERT_FALSE(obExecTaskList(taskList));
+  TEST_ASSERT_EQUAL(1, context.index);
+  TEST_ASSERT_EQUAL('F', context.data[0]);
+  TEST_ASSERT_EQUAL(OB_TASK_PENDING, dependent->state);
+
+  obFreeTaskList(&taskList);
+}
@@ -2,9 +2,14 @@
 
 /*=======Automagically Detected Files To Include=====*/
 #include "unity.h"
+#include "ObTaskList.h"
 #include <stdlib.h>
 #include <stdbool.h>
 #include <assert.h>
+#include <time.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
 
 /*=======External Functions This Runner Calls=====*/
 extern void setUp(void);
@@ -20,6 +25,10 @@ extern void test_execTaskList_shouldExecuteAllTasksInOrder();
 extern void test_execTaskList_shouldReturnTrueIfAllTasksSucceed();
 extern void test_execTaskList_shouldReturnFalseIfAnyTasksFails();
 extern void test_execTaskList_shouldExecAllUndoFunctionsFromFiledToFirst();
+extern void test_callUndoChain_shouldReturnFalseIfAnyUndoFails();
+extern void test_execTaskList_shouldRunIndependentTasksInParallel();
+extern void test_execTaskList_shouldUndoInReverseCompletionOrder();
+extern void test_execTaskList_shouldNotStartTasksAfterFailure();
 
 
 /*=======Mock Management=====*/
@@ -86,18 +95,22 @@ static void run_test(UnityTestFunction func, const char* name, UNITY_LINE_TYPE l
 /*=======MAIN=====*/
 int main(void)
 {
-  UnityBegin("../../../tests/unit/TaskList.test.c");
-  run_test(test_createTaskList_shouldCreateNewTaskList, "test_createTaskList_shouldCreateNewTaskList", 140);
-  run_test(test_freeTaskList_shouldFreeAndNullTaskList, "test_freeTaskList_shouldFreeAndNullTaskList", 148);
-  run_test(test_createTaskList_shouldCreateNullListEnds, "test_createTaskList_shouldCreateNullListEnds", 155);
-  run_test(test_createTask_shouldCreateNewTaks, "test_createTask_shouldCreateNewTaks", 164);
-  run_test(test_freeTask_shouldFreeAndNullTask, "test_freeTask_shouldFreeAndNullTask", 172);
-  run_test(test_appendTask_shouldMakeTheTaskFirstAndLastOnEmptyList, "test_appendTask_shouldMakeTheTaskFirstAndLastOnEmptyList", 179);
-  run_test(test_appendTask_shouldUpdateLastTaskWhenListNotEmpty, "test_appendTask_shouldUpdateLastTaskWhenListNotEmpty", 192);
-  run_test(test_execTaskList_shouldExecuteAllTasksInOrder, "test_execTaskList_shouldExecuteAllTasksInOrder", 207);
-  run_test(test_execTaskList_shouldReturnTrueIfAllTasksSucceed, "test_execTaskList_shouldReturnTrueIfAllTasksSucceed", 225);
-  run_test(test_execTaskList_shouldReturnFalseIfAnyTasksFails, "test_execTaskList_shouldReturnFalseIfAnyTasksFails", 238);
-  run_test(test_execTaskList_shouldExecAllUndoFunctionsFromFiledToFirst, "test_execTaskList_shouldExecAllUndoFunctionsFromFiledToFirst", 254);
+  UnityBegin("./TaskList.test.c");
+  run_test(test_createTaskList_shouldCreateNewTaskList, "test_createTaskList_shouldCreateNewTaskList", 52);
+  run_test(test_freeTaskList_shouldFreeAndNullTaskList, "test_freeTaskList_shouldFreeAndNullTaskList", 60);
+  run_test(test_createTaskList_shouldCreateNullListEnds, "test_createTaskList_shouldCreateNullListEnds", 67);
+  run_test(test_createTask_shouldCreateNewTaks, "test_createTask_shouldCreateNewTaks", 76);
+  run_test(test_freeTask_shouldFreeAndNullTask, "test_freeTask_shouldFreeAndNullTask", 84);
+  run_test(test_appendTask_shouldMakeTheTaskFirstAndLastOnEmptyList, "test_appendTask_shouldMakeTheTaskFirstAndLastOnEmptyList", 91);
+  run_test(test_appendTask_shouldUpdateLastTaskWhenListNotEmpty, "test_appendTask_shouldUpdateLastTaskWhenListNotEmpty", 104);
+  run_test(test_execTaskList_shouldExecuteAllTasksInOrder, "test_execTaskList_shouldExecuteAllTasksInOrder", 119);
+  run_test(test_execTaskList_shouldReturnTrueIfAllTasksSucceed, "test_execTaskList_shouldReturnTrueIfAllTasksSucceed", 137);
+  run_test(test_execTaskList_shouldReturnFalseIfAnyTasksFails, "test_execTaskList_shouldReturnFalseIfAnyTasksFails", 150);
+  run_test(test_execTaskList_shouldExecAllUndoFunctionsFromFiledToFirst, "test_execTaskList_shouldExecAllUndoFunctionsFromFiledToFirst", 166);
+  run_test(test_callUndoChain_shouldReturnFalseIfAnyUndoFails, "test_callUndoChain_shouldReturnFalseIfAnyUndoFails", 264);
+  run_test(test_execTaskList_shouldRunIndependentTasksInParallel, "test_execTaskList_shouldRunIndependentTasksInParallel", 283);
+  run_test(test_execTaskList_shouldUndoInReverseCompletionOrder, "test_execTaskList_shouldUndoInReverseCompletionOrder", 311);
+  run_test(test_execTaskList_shouldNotStartTasksAfterFailure, "test_execTaskList_shouldNotStartTasksAfterFailure", 339);
 
   return UnityEnd();
 }